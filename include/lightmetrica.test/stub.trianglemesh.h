@@ -185,14 +185,13 @@ class StubTriangleMesh_Random : public StubTriangleMesh
 {
 public:
 
-	StubTriangleMesh_Random()
+	StubTriangleMesh_Random(int faceCount = 1000)
 	{
 		// Fix seed
 		std::mt19937 gen(42);
 		std::uniform_real_distribution<double> dist;
 
-		const int FaceCount = 1000;
-		for (int i = 0; i < FaceCount; i++)
+		for (int i = 0; i < faceCount; i++)
 		{
 			auto p1 = Math::Vec3(Math::Float(dist(gen)), Math::Float(dist(gen)), Math::Float(dist(gen)));
 			auto p2 = Math::Vec3(Math::Float(dist(gen)), Math::Float(dist(gen)), Math::Float(dist(gen)));
@@ -0,0 +1,201 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_ACCEL_CACHE_H
+#define LIB_LIGHTMETRICA_ACCEL_CACHE_H
+
+#include "common.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+LM_NAMESPACE_BEGIN
+
+class Primitives;
+
+/*!
+	Acceleration structure cache.
+	Reads and writes the flattened data of an acceleration structure (nodes, triangles, etc.)
+	from/to a versioned binary cache file keyed by the content hash of the scene.
+	The file is a sequence of sections, which must be read in the same order as they are written.
+	Elements of the sections are written as raw bytes, so they must not contain pointers or own resources.
+	The sections are read by the copy assignment from the mapped memory
+	because some elements (e.g., AABB) are not trivially copyable in terms of the language.
+*/
+class LM_PUBLIC_API AccelerationCache
+{
+public:
+
+	AccelerationCache();
+	~AccelerationCache();
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(AccelerationCache);
+
+public:
+
+	/*!
+		Compute content hash of the primitives.
+		The hash is computed from the transforms and the mesh data (positions and faces) of the primitives.
+		\param primitives Primitives.
+		\return Hash value.
+	*/
+	static unsigned long long ComputeHash(const Primitives& primitives);
+
+	/*!
+		Get path to the cache file.
+		\param dir Cache directory.
+		\param key Key specifying the type of the acceleration structure and its parameters.
+		\param hash Content hash of the scene.
+		\return Path to the cache file.
+	*/
+	static std::string CachePath(const std::string& dir, const std::string& key, unsigned long long hash);
+
+	/*!
+		Check if a triangle reference read from the cache points to a triangle in the primitives.
+		The indices in the cache file cannot be trusted even if the header is valid,
+		because the file might be truncated or corrupted.
+		\param primitives Primitives.
+		\param primitiveIndex Index of the primitive.
+		\param faceIndex Index of the face in the mesh of the primitive.
+		\retval true The reference is valid.
+		\retval false The reference is out of range.
+	*/
+	static bool ValidTriangle(const Primitives& primitives, int primitiveIndex, int faceIndex);
+
+public:
+
+	/*!
+		Open a cache file for reading.
+		The file is memory-mapped and the header is validated.
+		\param path Path to the cache file.
+		\param key Key of the acceleration structure.
+		\param hash Content hash of the scene.
+		\retval true Succeeded to open.
+		\retval false Failed to open, or the cache is invalid.
+	*/
+	bool OpenForRead(const std::string& path, const std::string& key, unsigned long long hash);
+
+	/*!
+		Open a cache file for writing.
+		The file is written to a temporary file and replaced on #Close.
+		\param path Path to the cache file.
+		\param key Key of the acceleration structure.
+		\param hash Content hash of the scene.
+		\retval true Succeeded to open.
+		\retval false Failed to open.
+	*/
+	bool OpenForWrite(const std::string& path, const std::string& key, unsigned long long hash);
+
+	/*!
+		Close the cache file.
+		\retval true Succeeded to close (and to write the file if opened for writing).
+		\retval false Failed to close.
+	*/
+	bool Close();
+
+	/*!
+		Read a section into a vector.
+		\param values Values to be read.
+		\retval true Succeeded to read.
+		\retval false Failed to read.
+	*/
+	template <typename T, typename Alloc>
+	bool Read(std::vector<T, Alloc>& values)
+	{
+		const void* data;
+		size_t size;
+		if (!ReadSection(data, size) || size % sizeof(T) != 0 || !Aligned<T>(data))
+		{
+			return false;
+		}
+
+		const auto* begin = static_cast<const T*>(data);
+		values.assign(begin, begin + size / sizeof(T));
+		return true;
+	}
+
+	/*!
+		Read a section into a value.
+		\param value Value to be read.
+		\retval true Succeeded to read.
+		\retval false Failed to read.
+	*/
+	template <typename T>
+	bool ReadValue(T& value)
+	{
+		const void* data;
+		size_t size;
+		if (!ReadSection(data, size) || size != sizeof(T) || !Aligned<T>(data))
+		{
+			return false;
+		}
+
+		value = *static_cast<const T*>(data);
+		return true;
+	}
+
+	/*!
+		Write a vector as a section.
+		\param values Values to be written.
+		\retval true Succeeded to write.
+		\retval false Failed to write.
+	*/
+	template <typename T, typename Alloc>
+	bool Write(const std::vector<T, Alloc>& values)
+	{
+		return WriteSection(values.empty() ? nullptr : &values[0], values.size() * sizeof(T));
+	}
+
+	/*!
+		Write a value as a section.
+		\param value Value to be written.
+		\retval true Succeeded to write.
+		\retval false Failed to write.
+	*/
+	template <typename T>
+	bool WriteValue(const T& value)
+	{
+		return WriteSection(&value, sizeof(T));
+	}
+
+private:
+
+	template <typename T>
+	static bool Aligned(const void* data)
+	{
+		return reinterpret_cast<uintptr_t>(data) % std::alignment_of<T>::value == 0;
+	}
+
+	bool ReadSection(const void*& data, size_t& size);
+	bool WriteSection(const void* data, size_t size);
+
+private:
+
+	class Impl;
+	Impl* p;
+
+};
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_ACCEL_CACHE_H
@@ -56,6 +56,8 @@ public:
 	/*!
 		Load assets from XML element.
 		Parse the element #node and register assets.
+		The assets which do not depend on each other are loaded in parallel
+		with the number of threads specified by the optional \a num_threads element.
 		\param node A XML element which consists of the \a assets element.
 		\retval true Succeeded to load assets.
 		\retval false Failed to load assets.
@@ -0,0 +1,64 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_BINARY_MESH_H
+#define LIB_LIGHTMETRICA_BINARY_MESH_H
+
+#include "common.h"
+#include <string>
+
+LM_NAMESPACE_BEGIN
+
+class TriangleMesh;
+
+/*!
+	Binary mesh utility.
+	Helper class for the binary triangle mesh format loaded by the 'binary' triangle mesh.
+	The file consists of a header followed by the arrays of
+	positions, normals, texture coordinates and faces.
+	Each array is aligned to 64 bytes so that the arrays in the memory-mapped file
+	can be used directly without copies.
+*/
+class LM_PUBLIC_API BinaryMeshUtils
+{
+private:
+
+	BinaryMeshUtils() {}
+	LM_DISABLE_COPY_AND_MOVE(BinaryMeshUtils);
+
+public:
+
+	/*!
+		Save triangle mesh.
+		Writes the triangle mesh in the binary format.
+		The floating-point values are stored in single precision
+		for single precision build, otherwise double precision.
+		\param mesh Triangle mesh.
+		\param path Path to the output file.
+		\retval true Succeeded to save the mesh.
+		\retval false Failed to save the mesh.
+	*/
+	static bool Save(const TriangleMesh& mesh, const std::string& path);
+
+};
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_BINARY_MESH_H
@@ -0,0 +1,223 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_BINNED_SAH_H
+#define LIB_LIGHTMETRICA_BINNED_SAH_H
+
+#include "aabb.h"
+#include "align.h"
+#include "parallel.h"
+#include <vector>
+#include <algorithm>
+
+LM_NAMESPACE_BEGIN
+
+/*!
+	Build data for binned SAH.
+	Per-triangle data shared among the BVH construction processes, e.g., QBVH or OBVH.
+*/
+struct BinnedSAHBuildData
+{
+
+	//! Bounds of the triangles
+	std::vector<AABB, aligned_allocator<AABB, std::alignment_of<AABB>::value>> triBounds;
+
+	//! Centroids of the bounds of the triangles
+	std::vector<Math::Vec3, aligned_allocator<Math::Vec3, std::alignment_of<Math::Vec3>::value>> triBoundCentroids;
+
+};
+
+/*!
+	Binned SAH.
+	Determines the split of the triangles by SAH (surface area heuristics),
+	where the cost is computed with split bins for efficiency.
+	Reference:
+		Wald, I., On fast Construction of SAH-based Bounding Volume Hierarchies,
+		IEEE Symposium on Interactive Ray Tracing, 2007.
+*/
+class BinnedSAH
+{
+public:
+
+	BinnedSAH() = delete;
+
+public:
+
+	//! Number of bins
+	static const int NumBins = 12;
+
+	//! Minimum number of triangles processed in a thread in the parallel binning
+	static const unsigned int ParallelMinChunkSize = 1 << 15;
+
+private:
+
+	// Bounds and # of triangles for each bin
+	struct Bins
+	{
+		AABB bound[NumBins];
+		int count[NumBins];
+		Bins() { std::fill(count, count + NumBins, 0); }
+	};
+
+public:
+
+	/*!
+		Determine the split axis and the position.
+		\param data Build data.
+		\param triIndices List of triangle indices.
+		\param begin Begin of the range of #triIndices.
+		\param end End of the range of #triIndices.
+		\param axis Split axis.
+		\param splitPosition Split position.
+		\param depth Depth of the recursion of the caller, which limits the number of threads used in the binning (see Parallel).
+		\retval true Succeeded to split.
+		\retval false Failed to split because the primitive bound is degenerated.
+	*/
+	static bool SplitAxisAndPosition(const BinnedSAHBuildData& data, const std::vector<unsigned int>& triIndices, unsigned int begin, unsigned int end, int& axis, Math::Float& splitPosition, int depth = 0)
+	{
+		// Choose the axis to split
+		// Large ranges (e.g., near the root) are processed in parallel.
+		// Note that the union of the bounds is independent of the order,
+		// so the result is same as the serial one.
+		AABB centroidBound;
+		Parallel::Reduce(begin, end, ParallelMinChunkSize, centroidBound,
+			[&](size_t chunkBegin, size_t chunkEnd, AABB& result)
+			{
+				for (size_t i = chunkBegin; i < chunkEnd; i++)
+				{
+					result = result.Union(data.triBoundCentroids[triIndices[i]]);
+				}
+			},
+			[](AABB& result, const AABB& chunkResult)
+			{
+				result = result.Union(chunkResult);
+			}, depth);
+		axis = centroidBound.LongestAxis();
+
+		// Check if the bound is degenerated
+		if (centroidBound.min[axis] == centroidBound.max[axis])
+		{
+			// Degenerated
+			return false;
+		}
+
+		// Number of bins
+		const int numBins = NumBins;
+
+		// Some precomputed values
+		const Math::Float k0 = centroidBound.min[axis];
+		const Math::Float k1 = static_cast<Math::Float>(numBins) / (centroidBound.max[axis] - k0);
+
+		// Compute bounds and count # of triangles for each bin
+		Bins bins;
+		Parallel::Reduce(begin, end, ParallelMinChunkSize, bins,
+			[&](size_t chunkBegin, size_t chunkEnd, Bins& result)
+			{
+				for (size_t i = chunkBegin; i < chunkEnd; i++)
+				{
+					const unsigned int index = triIndices[i];
+					const int binId = std::max(0, std::min(numBins - 1, static_cast<int>(k1 * (data.triBoundCentroids[index][axis] - k0))));
+					result.count[binId]++;
+					result.bound[binId] = result.bound[binId].Union(data.triBounds[index]);
+				}
+			},
+			[](Bins& result, const Bins& chunkResult)
+			{
+				for (int i = 0; i < NumBins; i++)
+				{
+					result.count[i] += chunkResult.count[i];
+					result.bound[i] = result.bound[i].Union(chunkResult.bound[i]);
+				}
+			}, depth);
+		const auto* binTriBound = bins.bound;
+		const auto* binTris = bins.count;
+
+		// Compute costs for each candidate for partition
+		Math::Float costs[numBins - 1];
+		for (int i = 0; i < numBins - 1; i++)
+		{
+			AABB b1, b2;
+			int count1 = 0, count2 = 0;
+
+			// [0, i]
+			for (int j = 0; j <= i; j++)
+			{
+				b1 = b1.Union(binTriBound[j]);
+				count1 += binTris[j];
+			}
+
+			// (i, numBins - 1]
+			for (int j = i + 1; j < numBins; j++)
+			{
+				b2 = b2.Union(binTriBound[j]);
+				count2 += binTris[j];
+			}
+
+			// Compute cost
+			costs[i] = static_cast<Math::Float>(count1) * b1.SurfaceArea() + static_cast<Math::Float>(count2) * b2.SurfaceArea();
+		}
+
+		// Find minimum partition
+		int minCostIdx = 0;
+		double minCost = costs[0];
+		for (int i = 1; i < numBins - 1; i++)
+		{
+			if (minCost > costs[i])
+			{
+				minCost = costs[i];
+				minCostIdx = i;
+			}
+		}
+
+		splitPosition = centroidBound.min[axis] + static_cast<Math::Float>(minCostIdx + 1) * (centroidBound.max[axis] - centroidBound.min[axis]) / numBins;
+		return true;
+	}
+
+	/*!
+		Rearrange primitives by partition according to the split axis and position.
+		\param data Build data.
+		\param triIndices List of triangle indices to be rearranged.
+		\param begin Begin of the range of #triIndices.
+		\param end End of the range of #triIndices.
+		\param axis Split axis.
+		\param splitPosition Split position.
+		\param splitTriIndex Boundary index of the partition.
+	*/
+	static void PartitionPrimitives(const BinnedSAHBuildData& data, std::vector<unsigned int>& triIndices, unsigned int begin, unsigned int end, int axis, Math::Float splitPosition, unsigned int& splitTriIndex)
+	{
+		splitTriIndex = begin;
+		for (unsigned int i = begin; i < end; i++)
+		{
+			const unsigned int triIndex = triIndices[i];
+			if (data.triBoundCentroids[triIndex][axis] <= splitPosition)
+			{
+				// Swap indices
+				triIndices[i] = triIndices[splitTriIndex];
+				triIndices[splitTriIndex] = triIndex;
+				splitTriIndex++;
+			}
+		}
+	}
+
+};
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_BINNED_SAH_H
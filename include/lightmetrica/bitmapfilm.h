@@ -36,6 +36,17 @@ enum class BitmapImageType
 	PNG,
 };
 
+/*!
+	Film accumulation modes.
+	Defines how the contributions of the clones of a film are accumulated.
+*/
+enum class FilmAccumulationMode
+{
+	Clone,			//!< Each clone owns a full resolution bitmap, merged into the original film
+	Tiled,			//!< Clones accumulate to cache-local tiles, flushed into a buffer shared with the original film (suitable for coherent writes)
+	Atomic,			//!< Clones concurrently accumulate to a buffer shared with the original film (suitable for scattered splats)
+};
+
 class BitmapImage;
 
 /*!
@@ -58,6 +58,18 @@ public:
 	*/
 	virtual const BitmapImage& Bitmap() const = 0;
 
+	/*!
+		Get width of the texture.
+		\return Width in pixels.
+	*/
+	virtual int Width() const = 0;
+
+	/*!
+		Get height of the texture.
+		\return Height in pixels.
+	*/
+	virtual int Height() const = 0;
+
 };
 
 LM_NAMESPACE_END
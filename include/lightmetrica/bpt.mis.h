@@ -77,6 +77,15 @@ public:
 	*/
 	virtual Math::Float Evaluate(const BPTFullPath& fullPath) const = 0;
 
+	/*!
+		Check if the weight requires the quantities for recursive MIS weights.
+		The quantities are computed in BPTSubpath::Sample only if required,
+		see BPTSubpath::evaluateRecursiveMIS.
+		etval true The weight requires the quantities.
+		etval false The weight does not require the quantities.
+	*/
+	virtual bool RequiresRecursiveQuantities() const { return false; }
+
 };
 
 LM_NAMESPACE_END
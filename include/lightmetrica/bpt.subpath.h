@@ -49,9 +49,11 @@ enum class BPTPathVertexType
 /*!
 	BPT path vertex.
 	Represents a light path vertex.
+	The vertices are constructed in BPTPathVertexPool, which respects the alignment of the type
+	and never calls the destructors, thus the type must be trivially destructible.
 	TODO : Use unrestricted unions in future implementation.
 */
-class BPTPathVertex : public SIMDAlignedType
+class BPTPathVertex
 {
 public:
 
@@ -104,6 +106,15 @@ public:
 	Math::Vec3 wi;							//!< Incoming ray direction
 	Math::Vec3 wo;							//!< Outgoing ray direction
 
+											// # Variables for recursive evaluation of MIS weights
+											// Computed in BPTSubpath::Sample if BPTSubpath::evaluateRecursiveMIS is enabled
+											// (see bpt.mis.powerrecursive.cpp)
+											// --------------------------------------------------
+	Math::Float misPdfA;					//!< PDF of the vertex sampled by the sub-path in area measure
+	Math::Float misDVC;						//!< Partial sum of squared PDF ratios of the strategies sampling more vertices by the other sub-path
+	bool misConnectible;					//!< True if the strategy connecting the vertex and the previous vertex has non-zero PDF
+	bool misPdfAIsZero;						//!< True if the PDF in area measure is zero for the vertex or one of the previous vertices
+
 };
 
 class BPTPathVertexPool;
@@ -191,6 +202,7 @@ public:
 
 	TransportDirection transportDir;
 	std::vector<BPTPathVertex*> vertices;
+	bool evaluateRecursiveMIS;		//!< Compute the quantities for recursive MIS weights in #Sample (default : true)
 
 };
 
@@ -94,6 +94,9 @@ public:
 	virtual EmitterShape* CreateEmitterShape() const = 0;
 
 	/*!
+		Get AABB of the emitter.
+		The bound is available after the primitives are registered.
+		\return AABB of the emitter.
 	*/
 	virtual AABB GetAABB() const = 0;
 
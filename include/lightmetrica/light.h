@@ -50,6 +50,15 @@ public:
 	*/
 	virtual bool EnvironmentLight() const = 0;
 
+	/*!
+		Get power of the light.
+		Estimated power (flux) emitted from the light.
+		The value is used for the light selection proportional to the power,
+		so it must be available after the post configuration of the scene.
+		\return Power of the light.
+	*/
+	virtual Math::Vec3 Power() const = 0;
+
 };
 
 LM_NAMESPACE_END
@@ -0,0 +1,135 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_LIGHT_TREE_H
+#define LIB_LIGHTMETRICA_LIGHT_TREE_H
+
+#include "common.h"
+#include "math.types.h"
+#include "math.distribution.h"
+#include "aabb.h"
+#include <vector>
+#include <unordered_map>
+
+LM_NAMESPACE_BEGIN
+
+class Light;
+
+/*!
+	Light tree.
+	A bounding volume hierarchy of the lights for the light selection
+	according to the estimated contribution to a shading point.
+	Each node stores the bound and the total power of the lights in the subtree,
+	and the traversal chooses a child with the probability proportional to
+	the power divided by the squared distance from the shading point to the bound.
+	Lights without finite bounds (e.g., environment lights) are not included in the hierarchy
+	and selected proportional to the power independent of the shading point.
+	Reference:
+		Conty Estevez, A. and Kulla, C., Importance sampling of many lights with adaptive tree splitting,
+		Proceedings of the ACM on Computer Graphics and Interactive Techniques, 1(2), 2018.
+*/
+class LightTree
+{
+public:
+
+	LM_PUBLIC_API LightTree();
+	LM_PUBLIC_API ~LightTree();
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(LightTree);
+
+public:
+
+	/*!
+		Build the light tree.
+		The same light might be included multiple times in #lights.
+		\param lights Lights.
+		\param weights Selection weights (power) for each element of #lights.
+	*/
+	LM_PUBLIC_API void Build(const std::vector<const Light*>& lights, const std::vector<Math::Float>& weights);
+
+	/*!
+		Choose a light according to the estimated contribution to a point.
+		#u is rescaled to [0, 1) so that it can be reused in the following procedure.
+		\param p Shading point.
+		\param u Sample.
+		\param selectionPdf PDF evaluation of the selection (discrete measure).
+		\return Selected light.
+	*/
+	LM_PUBLIC_API const Light* Sample(const Math::Vec3& p, Math::Float& u, Math::PDFEval& selectionPdf) const;
+
+	/*!
+		Evaluate PDF of the light selection.
+		\param p Shading point.
+		\param light Light.
+		\return Evaluated PDF (discrete measure).
+	*/
+	LM_PUBLIC_API Math::PDFEval EvaluatePDF(const Math::Vec3& p, const Light* light) const;
+
+	/*!
+		Check if the tree is empty.
+		\retval true The tree is empty.
+		\retval false The tree is not empty.
+	*/
+	bool Empty() const { return entries.empty(); }
+
+private:
+
+	struct Node
+	{
+		AABB bound;					// Bound of the lights in the subtree
+		Math::Float weight;			// Sum of the weights of the lights in the subtree
+		int parent;					// Index of the parent node (-1 for the root)
+		int child2;					// Index of the second child (the first child is the next node)
+		int entry;					// Index of the entry for leaf nodes (-1 for intermediate nodes)
+	};
+
+	struct Entry
+	{
+		const Light* light;			// Light
+		Math::Float weight;			// Selection weight
+		AABB bound;					// Bound of the light
+		int leaf;					// Index of the leaf node (-1 for the lights without finite bounds)
+		int globalIndex;			// Index in #globalDist (-1 for the lights in the tree)
+	};
+
+private:
+
+	int BuildNode(int parent, int begin, int end);
+	Math::Float Importance(const Node& node, const Math::Vec3& p) const;
+	Math::Float ChildProbability(int node, int child, const Math::Vec3& p) const;
+	Math::Float EvaluateEntryPDF(const Math::Vec3& p, const Entry& entry) const;
+
+private:
+
+	std::vector<Entry> entries;										// Lights
+	std::vector<int> nodeEntries;									// Indices of the entries in the tree (ordered by the leaves)
+	std::vector<Node> nodes;										// Nodes of the tree
+	std::vector<int> globalEntries;									// Indices of the entries without finite bounds
+	Math::DiscreteAliasDistribution1D globalDist;					// Distribution for the entries without finite bounds
+	Math::Float globalProb;											// Probability to choose the entries without finite bounds
+	std::unordered_map<const Light*, std::vector<int>> lightEntries;	// Indices of the entries for each light
+
+};
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_LIGHT_TREE_H
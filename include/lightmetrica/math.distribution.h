@@ -23,7 +23,9 @@
 
 #include "math.types.h"
 #include "logger.h"
+#include "parallel.h"
 #include <vector>
+#include <algorithm>
 
 LM_NAMESPACE_BEGIN
 LM_MATH_NAMESPACE_BEGIN
@@ -86,6 +88,336 @@ private:
 
 };
 
+/*!
+	Discrete 1D distribution with alias table.
+	Offers interface for creating and sampling from 1D discrete PDF.
+	Unlike DiscreteDistribution1D, the sampling takes constant time
+	using the alias method (Vose's algorithm).
+	Reference:
+		Vose, M. D., A linear algorithm for generating random numbers with a given distribution,
+		IEEE Transactions on Software Engineering, 17(9), pp. 972–975, 1991.
+*/
+class DiscreteAliasDistribution1D
+{
+public:
+
+	DiscreteAliasDistribution1D() { Clear(); }
+
+public:
+
+	void Add(const Math::Float& v)
+	{
+		pdf.push_back(v);
+	}
+
+	/*!
+		Normalize the distribution and build the alias table.
+		If the sum of the values is zero, the distribution is treated as uniform.
+	*/
+	void Normalize()
+	{
+		const size_t n = pdf.size();
+		if (n == 0)
+		{
+			return;
+		}
+
+		Math::Float sum(0);
+		for (const auto& v : pdf)
+		{
+			sum += v;
+		}
+
+		// Normalize PDF
+		if (sum > Math::Float(0))
+		{
+			auto invSum = Math::Float(1) / sum;
+			for (auto& v : pdf)
+			{
+				v *= invSum;
+			}
+		}
+		else
+		{
+			for (auto& v : pdf)
+			{
+				v = Math::Float(1) / Math::Float(n);
+			}
+		}
+
+		// Split the scaled probabilities into the smaller and larger groups than the average
+		std::vector<Math::Float> scaled(n);
+		std::vector<size_t> small, large;
+		for (size_t i = 0; i < n; i++)
+		{
+			scaled[i] = pdf[i] * Math::Float(n);
+			(scaled[i] < Math::Float(1) ? small : large).push_back(i);
+		}
+
+		// Pair the entries of the smaller group with the entries of the larger group
+		table.assign(n, AliasTableEntry());
+		while (!small.empty() && !large.empty())
+		{
+			auto s = small.back(); small.pop_back();
+			auto l = large.back(); large.pop_back();
+			table[s].prob = scaled[s];
+			table[s].alias = l;
+			scaled[l] = (scaled[l] + scaled[s]) - Math::Float(1);
+			(scaled[l] < Math::Float(1) ? small : large).push_back(l);
+		}
+
+		// Remaining entries have the probability of one up to numerical error
+		for (auto i : large)
+		{
+			table[i].prob = Math::Float(1);
+			table[i].alias = i;
+		}
+		for (auto i : small)
+		{
+			table[i].prob = Math::Float(1);
+			table[i].alias = i;
+		}
+	}
+
+	size_t Sample(const Math::Float& u) const
+	{
+		auto u2 = u;
+		return SampleReuse(u2);
+	}
+
+	/*!
+		Sample an index (reusable version).
+		Sample #u is rescaled to [0, 1) so that it can be reused in the following sampling procedure.
+		\param u Sample.
+		\return Sampled index.
+	*/
+	size_t SampleReuse(Math::Float& u) const
+	{
+		const size_t n = table.size();
+		const auto x = u * Math::Float(n);
+		const size_t i = Math::Min(static_cast<size_t>(x), n - 1);
+		const auto& entry = table[i];
+		const auto t = x - Math::Float(i);
+		if (t < entry.prob || entry.prob >= Math::Float(1))
+		{
+			u = t / entry.prob;
+			return i;
+		}
+		else
+		{
+			u = (t - entry.prob) / (Math::Float(1) - entry.prob);
+			return entry.alias;
+		}
+	}
+
+	Math::Float EvaluatePDF(int i) const
+	{
+		return (i < 0 || i >= static_cast<int>(pdf.size())) ? Math::Float(0) : pdf[i];
+	}
+
+	void Clear()
+	{
+		pdf.clear();
+		table.clear();
+	}
+
+	bool Empty() const
+	{
+		return table.empty();
+	}
+
+	size_t Size() const
+	{
+		return pdf.size();
+	}
+
+private:
+
+	struct AliasTableEntry
+	{
+		Math::Float prob;		// Probability to choose the entry itself
+		size_t alias;			// Index of the alias
+	};
+
+	std::vector<Math::Float> pdf;
+	std::vector<AliasTableEntry> table;
+
+};
+
+/*!
+	Piecewise constant 2D distribution.
+	Offers interface for creating and sampling from 2D piecewise constant PDF
+	defined over [0,1]^2 with the marginal and conditional distributions.
+	The domain is divided into width x height cells, where the cell (x, y)
+	covers [x/width, (x+1)/width] x [y/height, (y+1)/height].
+	Reference:
+		Pharr, M. and Humphreys, G., Physically Based Rendering, 2nd ed., Section 13.6.5, 2010.
+*/
+class PiecewiseConstantDistribution2D
+{
+public:
+
+	PiecewiseConstantDistribution2D() { Clear(); }
+
+public:
+
+	/*!
+		Build the distribution.
+		The conditional distributions of the rows are built in parallel.
+		If the sum of the values is zero, the distribution is treated as uniform.
+		\param values Non-negative values of the cells in row-major order (width x height elements).
+		\param width Number of cells in x direction.
+		\param height Number of cells in y direction.
+	*/
+	void Build(const std::vector<Math::Float>& values, int width, int height)
+	{
+		Clear();
+		if (width <= 0 || height <= 0 || values.size() != static_cast<size_t>(width) * static_cast<size_t>(height))
+		{
+			return;
+		}
+
+		this->width = width;
+		this->height = height;
+		const size_t w = static_cast<size_t>(width);
+
+		// Conditional CDFs of the rows
+		conditionalCdf.resize(static_cast<size_t>(height) * (w + 1));
+		std::vector<Math::Float> rowSums(height);
+		Parallel::For(0, static_cast<size_t>(height), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t y = begin; y < end; y++)
+			{
+				const auto* v = &values[y * w];
+				auto* cdf = &conditionalCdf[y * (w + 1)];
+				cdf[0] = Math::Float(0);
+				for (size_t x = 0; x < w; x++)
+				{
+					cdf[x + 1] = cdf[x] + v[x];
+				}
+				rowSums[y] = cdf[w];
+			}
+		});
+
+		// Marginal CDF
+		marginalCdf.resize(height + 1);
+		marginalCdf[0] = Math::Float(0);
+		for (int y = 0; y < height; y++)
+		{
+			marginalCdf[y + 1] = marginalCdf[y] + rowSums[y];
+		}
+
+		sum = marginalCdf[height];
+		if (sum <= Math::Float(0))
+		{
+			// Uniform distribution
+			Parallel::For(0, static_cast<size_t>(height), 1, [&](size_t begin, size_t end)
+			{
+				for (size_t y = begin; y < end; y++)
+				{
+					auto* cdf = &conditionalCdf[y * (w + 1)];
+					for (size_t x = 0; x <= w; x++)
+					{
+						cdf[x] = Math::Float(x);
+					}
+				}
+			});
+			for (int y = 0; y <= height; y++)
+			{
+				marginalCdf[y] = Math::Float(y) * Math::Float(width);
+			}
+			sum = marginalCdf[height];
+		}
+	}
+
+	/*!
+		Sample a point from the distribution.
+		\param u Uniform random numbers in [0,1]^2.
+		\param pdf Evaluated PDF of the sampled point (w.r.t. the area measure on [0,1]^2).
+		\return Sampled point in [0,1]^2.
+	*/
+	Math::Vec2 Sample(const Math::Vec2& u, Math::Float& pdf) const
+	{
+		if (Empty())
+		{
+			pdf = Math::Float(0);
+			return Math::Vec2();
+		}
+
+		// Sample row from the marginal distribution
+		Math::Float dy;
+		const int y = SampleContinuous(&marginalCdf[0], height, u.y, dy);
+
+		// Sample column from the conditional distribution of the row
+		Math::Float dx;
+		const auto* cdf = &conditionalCdf[static_cast<size_t>(y) * (width + 1)];
+		const int x = SampleContinuous(cdf, width, u.x, dx);
+
+		pdf = (cdf[x + 1] - cdf[x]) * Math::Float(width) * Math::Float(height) / sum;
+		return Math::Vec2((Math::Float(x) + dx) / Math::Float(width), (Math::Float(y) + dy) / Math::Float(height));
+	}
+
+	/*!
+		Evaluate the PDF.
+		\param p Point in [0,1]^2.
+		\return Evaluated PDF (w.r.t. the area measure on [0,1]^2).
+	*/
+	Math::Float EvaluatePDF(const Math::Vec2& p) const
+	{
+		if (Empty())
+		{
+			return Math::Float(0);
+		}
+
+		const int x = Math::Clamp(static_cast<int>(p.x * Math::Float(width)), 0, width - 1);
+		const int y = Math::Clamp(static_cast<int>(p.y * Math::Float(height)), 0, height - 1);
+		const auto* cdf = &conditionalCdf[static_cast<size_t>(y) * (width + 1)];
+		return (cdf[x + 1] - cdf[x]) * Math::Float(width) * Math::Float(height) / sum;
+	}
+
+	void Clear()
+	{
+		width = height = 0;
+		sum = Math::Float(0);
+		conditionalCdf.clear();
+		marginalCdf.clear();
+	}
+
+	bool Empty() const
+	{
+		return marginalCdf.empty();
+	}
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+
+private:
+
+	/*
+		Sample an index from the unnormalized CDF with n entries
+		and compute the offset in the selected cell.
+	*/
+	static int SampleContinuous(const Math::Float* cdf, int n, const Math::Float& u, Math::Float& offset)
+	{
+		const auto target = u * cdf[n];
+		const int i = Math::Clamp(static_cast<int>(std::upper_bound(cdf, cdf + n + 1, target) - cdf) - 1, 0, n - 1);
+
+		// Relative position in the cell
+		const auto v = cdf[i + 1] - cdf[i];
+		offset = v > Math::Float(0) ? Math::Clamp((target - cdf[i]) / v, Math::Float(0), Math::Float(1)) : Math::Float(0);
+		return i;
+	}
+
+private:
+
+	int width;
+	int height;
+	Math::Float sum;
+	std::vector<Math::Float> conditionalCdf;	// Unnormalized conditional CDFs (height x (width + 1) elements)
+	std::vector<Math::Float> marginalCdf;		// Unnormalized marginal CDF (height + 1 elements)
+
+};
+
 LM_MATH_NAMESPACE_END
 LM_NAMESPACE_END
 
@@ -0,0 +1,180 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_PARALLEL_H
+#define LIB_LIGHTMETRICA_PARALLEL_H
+
+#include "align.h"
+#include <vector>
+#include <future>
+#include <thread>
+#include <algorithm>
+
+LM_NAMESPACE_BEGIN
+
+/*!
+	Parallel utilities.
+	Helper functions for fork-join style parallel processing,
+	e.g., used in the construction of the acceleration structures.
+	Note that the functions do not capture the arguments by value
+	in order to avoid unaligned allocation of SIMD types in the tasks.
+	The functions might be called from the tasks of a recursive binary fork-join process,
+	where up to 2^depth tasks run concurrently in the depth of the recursion.
+	The number of chunks is divided accordingly in order not to oversubscribe the threads,
+	e.g., the chunks are processed serially in the deep recursion.
+*/
+class Parallel
+{
+public:
+
+	Parallel() = delete;
+
+public:
+
+	/*!
+		Get number of hardware threads.
+		\return Number of threads (at least 1).
+	*/
+	static int NumThreads()
+	{
+		const int n = static_cast<int>(std::thread::hardware_concurrency());
+		return n > 0 ? n : 1;
+	}
+
+	/*!
+		Get maximum depth of the recursion which spawns tasks.
+		Recursive binary fork-join processes spawns tasks until the depth
+		in order to keep the number of threads moderate.
+		\return Maximum depth.
+	*/
+	static int MaxTaskDepth()
+	{
+		int depth = 0;
+		while ((1 << depth) < NumThreads())
+		{
+			depth++;
+		}
+		return depth + 2;
+	}
+
+	/*!
+		Parallel loop over a range.
+		The range [begin, end) is split into contiguous chunks processed in parallel.
+		\param begin Begin of the range.
+		\param end End of the range.
+		\param minChunkSize Minimum number of elements in a chunk.
+		\param chunkFunc Function processing a chunk : void(size_t begin, size_t end).
+		\param depth Depth of the recursion of the caller (0 if the caller is not in a fork-join process).
+	*/
+	template <typename ChunkFunc>
+	static void For(size_t begin, size_t end, size_t minChunkSize, const ChunkFunc& chunkFunc, int depth = 0)
+	{
+		const size_t n = end - begin;
+		const size_t numChunks = NumChunks(n, minChunkSize, depth);
+		if (numChunks <= 1)
+		{
+			chunkFunc(begin, end);
+			return;
+		}
+
+		const size_t chunkSize = (n + numChunks - 1) / numChunks;
+		std::vector<std::future<void>> futures;
+		for (size_t i = 1; i < numChunks; i++)
+		{
+			futures.push_back(std::async(std::launch::async, [&chunkFunc, i, begin, end, chunkSize]()
+			{
+				chunkFunc(std::min(end, begin + i * chunkSize), std::min(end, begin + (i + 1) * chunkSize));
+			}));
+		}
+
+		// The first chunk is processed in the current thread
+		chunkFunc(begin, std::min(end, begin + chunkSize));
+		for (auto& future : futures)
+		{
+			future.get();
+		}
+	}
+
+	/*!
+		Parallel reduction over a range.
+		The range [begin, end) is split into contiguous chunks processed in parallel,
+		and the results are merged in the order of the chunks.
+		Therefore the result is deterministic if #mergeFunc is associative.
+		\tparam Result Type of the result of a chunk.
+		\param begin Begin of the range.
+		\param end End of the range.
+		\param minChunkSize Minimum number of elements in a chunk.
+		\param result Result of the reduction. Must be initialized with the identity element.
+		\param chunkFunc Function processing a chunk : void(size_t begin, size_t end, Result& result).
+		\param mergeFunc Function merging the result of a chunk : void(Result& result, const Result& chunkResult).
+		\param depth Depth of the recursion of the caller (0 if the caller is not in a fork-join process).
+	*/
+	template <typename Result, typename ChunkFunc, typename MergeFunc>
+	static void Reduce(size_t begin, size_t end, size_t minChunkSize, Result& result, const ChunkFunc& chunkFunc, const MergeFunc& mergeFunc, int depth = 0)
+	{
+		const size_t n = end - begin;
+		const size_t numChunks = NumChunks(n, minChunkSize, depth);
+		if (numChunks <= 1)
+		{
+			chunkFunc(begin, end, result);
+			return;
+		}
+
+		// Results for each chunk
+		const size_t chunkSize = (n + numChunks - 1) / numChunks;
+		std::vector<Result, aligned_allocator<Result, std::alignment_of<Result>::value>> chunkResults(numChunks, result);
+		std::vector<std::future<void>> futures;
+		for (size_t i = 1; i < numChunks; i++)
+		{
+			futures.push_back(std::async(std::launch::async, [&chunkFunc, &chunkResults, i, begin, end, chunkSize]()
+			{
+				chunkFunc(std::min(end, begin + i * chunkSize), std::min(end, begin + (i + 1) * chunkSize), chunkResults[i]);
+			}));
+		}
+
+		// The first chunk is processed in the current thread
+		chunkFunc(begin, std::min(end, begin + chunkSize), chunkResults[0]);
+		for (auto& future : futures)
+		{
+			future.get();
+		}
+
+		// Merge
+		for (size_t i = 0; i < numChunks; i++)
+		{
+			mergeFunc(result, chunkResults[i]);
+		}
+	}
+
+private:
+
+	// Number of chunks for #n elements processed in the given depth of the recursion
+	static size_t NumChunks(size_t n, size_t minChunkSize, int depth)
+	{
+		const int maxDepth = static_cast<int>(sizeof(int) * 8 - 2);
+		const size_t numThreads = static_cast<size_t>(NumThreads() >> std::min(std::max(depth, 0), maxDepth));
+		return std::min(std::max(numThreads, static_cast<size_t>(1)), (n + minChunkSize - 1) / minChunkSize);
+	}
+
+};
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_PARALLEL_H
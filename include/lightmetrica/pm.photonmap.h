@@ -58,6 +58,14 @@ public:
 	virtual void CollectPhotons(const Math::Vec3& p, Math::Float& maxDist2, const PhotonCollectFunc& collectFunc) const = 0;
 	virtual void GetPhotons(std::vector<const Photon*>& photons) const = 0;
 
+	/*!
+		Set maximum distance of the queries.
+		A hint for the implementations optimized for fixed-radius queries.
+		The function must be called before #Build to be effective.
+		\param maxDist Maximum distance between the query point and the collected photons.
+	*/
+	virtual void SetMaxQueryDist(const Math::Float& maxDist) {}
+
 };
 
 LM_NAMESPACE_END
@@ -0,0 +1,242 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_PM_PHOTONMAP_HASHGRID_H
+#define LIB_LIGHTMETRICA_PM_PHOTONMAP_HASHGRID_H
+
+#include "pm.photonmap.h"
+#include "align.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+LM_NAMESPACE_BEGIN
+
+/*!
+	Hash grid photon map.
+	Implements photon map with a hashed uniform grid optimized for fixed-radius queries.
+	The cell size is the maximum query distance given by #SetMaxQueryDist,
+	so that a query visits at most 3x3x3 cells.
+	The photons are sorted by the hash of the cells with parallel counting sort.
+	The positions of the photons in a bucket are stored in the blocks of #BlockSize photons
+	in SoA format for SIMD distance tests.
+	The templated CollectPhotons function can be used to avoid the overhead of std::function.
+	Reference:
+		Teschner, M. et al., Optimized Spatial Hashing for Collision Detection of Deformable Objects,
+		Proc. of Vision, Modeling, Visualization, pp. 47-54, 2003.
+*/
+class HashGridPhotonMap final : public PhotonMap
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("hashgrid");
+
+public:
+
+	// Number of photons in a block
+	static const int BlockSize = 4;
+
+public:
+
+	HashGridPhotonMap() : maxQueryDist(0) {}
+	virtual ~HashGridPhotonMap() {}
+
+public:
+
+	LM_PUBLIC_API virtual void Build(const Photons& photons) override;
+	virtual void CollectPhotons(const Math::Vec3& p, Math::Float& maxDist2, const PhotonCollectFunc& collectFunc) const override { CollectPhotons<const PhotonCollectFunc&>(p, maxDist2, collectFunc); }
+	LM_PUBLIC_API virtual void GetPhotons(std::vector<const Photon*>& photons) const override;
+	virtual void SetMaxQueryDist(const Math::Float& maxDist) override { maxQueryDist = maxDist; }
+
+public:
+
+	/*!
+		Collect photons.
+		Same as the virtual version but the collect function is not type-erased.
+		\tparam CollectFunc Type of the function : void (const Math::Vec3& p, const Photon& photon, Math::Float& maxDist2).
+		\param p Query point.
+		\param maxDist2 Maximum squared distance to the collected photons. The collect function can shrink the distance.
+		\param collectFunc Function called when a photon is collected.
+	*/
+	template <typename CollectFunc>
+	void CollectPhotons(const Math::Vec3& p, Math::Float& maxDist2, CollectFunc&& collectFunc) const;
+
+	/*!
+		Get cell size.
+		\return Cell size of the grid.
+	*/
+	Math::Float CellSize() const { return cellSize; }
+
+private:
+
+	// Positions of the photons in SoA format and the indices of the photons in #data.
+	// Unused entries are filled with infinity.
+	struct LM_ALIGN_16 PositionBlock
+	{
+		Math::Float x[BlockSize];
+		Math::Float y[BlockSize];
+		Math::Float z[BlockSize];
+		unsigned int index[BlockSize];
+	};
+
+	template <typename CollectFunc>
+	void CollectPhotonsInBlock(const PositionBlock& block, const Math::Vec3& p, Math::Float& maxDist2, CollectFunc&& collectFunc) const;
+
+	unsigned int CellHash(long long x, long long y, long long z) const
+	{
+		return static_cast<unsigned int>((x * 73856093LL) ^ (y * 19349663LL) ^ (z * 83492791LL)) & hashMask;
+	}
+
+	long long CellCoord(const Math::Float& v, int axis) const
+	{
+		return static_cast<long long>(std::floor((v - origin[axis]) * invCellSize));
+	}
+
+private:
+
+	Math::Float maxQueryDist;				// Maximum query distance (cell size if positive)
+	Math::Float cellSize;					// Cell size
+	Math::Float invCellSize;				// Inverse of #cellSize
+	Math::Vec3 origin;						// Origin of the grid
+	unsigned int hashMask;					// Number of buckets minus one (number of buckets is power of two)
+	std::vector<unsigned int> bucketStart;	// Start index of the blocks in the buckets (number of buckets + 1 elements)
+	std::vector<PositionBlock, aligned_allocator<PositionBlock, std::alignment_of<PositionBlock>::value>> blocks;		// Blocks sorted by the buckets
+	Photons data;							// Photons sorted by the buckets
+
+};
+
+template <typename CollectFunc>
+void HashGridPhotonMap::CollectPhotons(const Math::Vec3& p, Math::Float& maxDist2, CollectFunc&& collectFunc) const
+{
+	if (data.empty())
+	{
+		return;
+	}
+
+	// Fallback to the linear search for the query radius larger than the cell size
+	const auto r = Math::Sqrt(maxDist2);
+	if (r > cellSize)
+	{
+		for (const auto& photon : data)
+		{
+			if (Math::Length2(photon.p - p) < maxDist2)
+			{
+				collectFunc(p, photon, maxDist2);
+			}
+		}
+		return;
+	}
+
+	// Range of the cells overlapping with the bound of the query sphere.
+	// The range is clamped to the neighboring cells of the query point (at most 3x3x3 cells)
+	// because it can be extended by the rounding error if the query radius is close to the cell size.
+	long long minCell[3], maxCell[3];
+	for (int i = 0; i < 3; i++)
+	{
+		const auto cell = CellCoord(p[i], i);
+		minCell[i] = std::max(cell - 1, CellCoord(p[i] - r, i));
+		maxCell[i] = std::min(cell + 1, CellCoord(p[i] + r, i));
+	}
+
+	// Squared distance from the query point to the slab of a cell along an axis
+	const auto CellDist2 = [&](long long cell, int axis) -> Math::Float
+	{
+		const auto cellMin = origin[axis] + Math::Float(cell) * cellSize;
+		const auto d = Math::Max(Math::Max(cellMin - p[axis], p[axis] - (cellMin + cellSize)), Math::Float(0));
+		return d * d;
+	};
+
+	// Different cells might share the same bucket, which must be visited once
+	unsigned int visitedBuckets[27];
+	int numVisitedBuckets = 0;
+	for (long long z = minCell[2]; z <= maxCell[2]; z++)
+	{
+		const auto dz2 = CellDist2(z, 2);
+		for (long long y = minCell[1]; y <= maxCell[1]; y++)
+		{
+			const auto dyz2 = dz2 + CellDist2(y, 1);
+			for (long long x = minCell[0]; x <= maxCell[0]; x++)
+			{
+				// Skip the cells outside of the query sphere
+				if (dyz2 + CellDist2(x, 0) >= maxDist2)
+				{
+					continue;
+				}
+
+				const auto bucket = CellHash(x, y, z);
+				if (std::find(visitedBuckets, visitedBuckets + numVisitedBuckets, bucket) != visitedBuckets + numVisitedBuckets)
+				{
+					continue;
+				}
+				visitedBuckets[numVisitedBuckets++] = bucket;
+
+				for (auto i = bucketStart[bucket]; i < bucketStart[bucket + 1]; i++)
+				{
+					CollectPhotonsInBlock(blocks[i], p, maxDist2, collectFunc);
+				}
+			}
+		}
+	}
+}
+
+template <typename CollectFunc>
+void HashGridPhotonMap::CollectPhotonsInBlock(const PositionBlock& block, const Math::Vec3& p, Math::Float& maxDist2, CollectFunc&& collectFunc) const
+{
+#if LM_SSE2 && LM_SINGLE_PRECISION
+	static_assert(BlockSize == 4, "BlockSize must be 4");
+
+	// Squared distances for 4 photons
+	const auto dx = _mm_sub_ps(_mm_load_ps(block.x), _mm_set1_ps(p.x));
+	const auto dy = _mm_sub_ps(_mm_load_ps(block.y), _mm_set1_ps(p.y));
+	const auto dz = _mm_sub_ps(_mm_load_ps(block.z), _mm_set1_ps(p.z));
+	const auto dist2v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+	const int mask = _mm_movemask_ps(_mm_cmplt_ps(dist2v, _mm_set1_ps(maxDist2)));
+	if (mask == 0)
+	{
+		return;
+	}
+
+	LM_ALIGN_16 float dist2[4];
+	_mm_store_ps(dist2, dist2v);
+	for (int i = 0; i < BlockSize; i++)
+	{
+		// #maxDist2 might be updated in the collect function
+		if ((mask & (1 << i)) && dist2[i] < maxDist2)
+		{
+			collectFunc(p, data[block.index[i]], maxDist2);
+		}
+	}
+#else
+	for (int i = 0; i < BlockSize; i++)
+	{
+		const auto dx = block.x[i] - p.x;
+		const auto dy = block.y[i] - p.y;
+		const auto dz = block.z[i] - p.z;
+		if (dx * dx + dy * dy + dz * dz < maxDist2)
+		{
+			collectFunc(p, data[block.index[i]], maxDist2);
+		}
+	}
+#endif
+}
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_PM_PHOTONMAP_HASHGRID_H
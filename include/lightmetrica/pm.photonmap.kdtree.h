@@ -0,0 +1,205 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_PM_PHOTONMAP_KDTREE_H
+#define LIB_LIGHTMETRICA_PM_PHOTONMAP_KDTREE_H
+
+#include "pm.photonmap.h"
+#include "align.h"
+#include <vector>
+
+LM_NAMESPACE_BEGIN
+
+/*!
+	Kd-tree photon map.
+	Implements photon map with Kd-tree.
+	The tree is a complete binary tree stored in the implicit layout
+	(the children of the node i are 2i+1 and 2i+2), whose leaves are the blocks of #BlockSize photons.
+	The number of leaves is rounded up to a power of two and the photons fill the leaves from the left.
+	The padded leaves are filled with infinity and the nodes whose right subtree is empty are skipped in the traversal.
+	Note that the padding requires up to twice the memory for the nodes and the position blocks
+	(but not for the photons themselves) compared with a left-balanced tree.
+	The positions of the photons in a block are stored in SoA format for SIMD distance tests.
+	The tree is built in parallel and traversed with an explicit stack.
+	The templated CollectPhotons function can be used to avoid the overhead of std::function.
+*/
+class KdTreePhotonMap final : public PhotonMap
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("kdtree");
+
+public:
+
+	//! Number of photons in a leaf.
+	static const int BlockSize = 4;
+
+public:
+
+	KdTreePhotonMap() {}
+	virtual ~KdTreePhotonMap() {}
+
+public:
+
+	LM_PUBLIC_API virtual void Build(const Photons& photons) override;
+	virtual void CollectPhotons(const Math::Vec3& p, Math::Float& maxDist2, const PhotonCollectFunc& collectFunc) const override { CollectPhotons<const PhotonCollectFunc&>(p, maxDist2, collectFunc); }
+	LM_PUBLIC_API virtual void GetPhotons(std::vector<const Photon*>& photons) const override;
+
+public:
+
+	/*!
+		Collect photons.
+		Same as the virtual version but the collect function is not type-erased.
+		\tparam CollectFunc Type of the function : void (const Math::Vec3& p, const Photon& photon, Math::Float& maxDist2).
+		\param p Query point.
+		\param maxDist2 Maximum squared distance to the collected photons. The collect function can shrink the distance.
+		\param collectFunc Function called when a photon is collected.
+	*/
+	template <typename CollectFunc>
+	void CollectPhotons(const Math::Vec3& p, Math::Float& maxDist2, CollectFunc&& collectFunc) const;
+
+private:
+
+	void RecursiveBuild(size_t nodeIndex, size_t leafBegin, size_t leafEnd, const Photons& photons, std::vector<size_t>& photonIndices, int depth, int maxTaskDepth);
+
+	template <typename CollectFunc>
+	void CollectPhotonsInBlock(size_t blockIndex, const Math::Vec3& p, Math::Float& maxDist2, CollectFunc&& collectFunc) const;
+
+private:
+
+	// Intermediate node
+	struct Node
+	{
+		Math::Float splitPos;		// Split position (infinity if the right subtree is empty)
+		int splitAxis;				// Split axis
+	};
+
+	// Positions of the photons in a leaf in SoA format.
+	// Unused entries are filled with infinity.
+	struct LM_ALIGN_16 PositionBlock
+	{
+		Math::Float x[BlockSize];
+		Math::Float y[BlockSize];
+		Math::Float z[BlockSize];
+	};
+
+	std::vector<Node> nodes;			// Intermediate nodes
+	std::vector<PositionBlock, aligned_allocator<PositionBlock, std::alignment_of<PositionBlock>::value>> blocks;		// Leaves
+	Photons data;						// Photons ordered by the leaves
+
+};
+
+template <typename CollectFunc>
+void KdTreePhotonMap::CollectPhotons(const Math::Vec3& p, Math::Float& maxDist2, CollectFunc&& collectFunc) const
+{
+	// Far nodes are pushed to the stack with the squared distance to the split plane
+	struct StackEntry
+	{
+		size_t node;
+		Math::Float dist2;
+	};
+
+	const size_t numNodes = nodes.size();
+	StackEntry stack[64];
+	int stackSize = 0;
+	stack[stackSize].node = 0;
+	stack[stackSize].dist2 = Math::Float(0);
+	stackSize++;
+
+	while (stackSize > 0)
+	{
+		const auto entry = stack[--stackSize];
+		if (entry.dist2 >= maxDist2)
+		{
+			continue;
+		}
+
+		// Descend to the nearer child until a leaf is found
+		auto nodeIndex = entry.node;
+		while (nodeIndex < numNodes)
+		{
+			const auto& node = nodes[nodeIndex];
+			const auto d = p[node.splitAxis] - node.splitPos;
+			auto& far = stack[stackSize++];
+			far.dist2 = d * d;
+			if (d < Math::Float(0))
+			{
+				// Query point is located on left half -> left points are nearer
+				far.node = 2 * nodeIndex + 2;
+				nodeIndex = 2 * nodeIndex + 1;
+			}
+			else
+			{
+				far.node = 2 * nodeIndex + 1;
+				nodeIndex = 2 * nodeIndex + 2;
+			}
+		}
+
+		CollectPhotonsInBlock(nodeIndex - numNodes, p, maxDist2, collectFunc);
+	}
+}
+
+template <typename CollectFunc>
+void KdTreePhotonMap::CollectPhotonsInBlock(size_t blockIndex, const Math::Vec3& p, Math::Float& maxDist2, CollectFunc&& collectFunc) const
+{
+	const auto& block = blocks[blockIndex];
+	const auto* photons = data.data() + blockIndex * BlockSize;
+
+#if LM_SSE2 && LM_SINGLE_PRECISION
+	static_assert(BlockSize == 4, "BlockSize must be 4");
+
+	// Squared distances for 4 photons
+	const auto dx = _mm_sub_ps(_mm_load_ps(block.x), _mm_set1_ps(p.x));
+	const auto dy = _mm_sub_ps(_mm_load_ps(block.y), _mm_set1_ps(p.y));
+	const auto dz = _mm_sub_ps(_mm_load_ps(block.z), _mm_set1_ps(p.z));
+	const auto dist2v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+	const int mask = _mm_movemask_ps(_mm_cmplt_ps(dist2v, _mm_set1_ps(maxDist2)));
+	if (mask == 0)
+	{
+		return;
+	}
+
+	LM_ALIGN_16 float dist2[4];
+	_mm_store_ps(dist2, dist2v);
+	for (int i = 0; i < BlockSize; i++)
+	{
+		// #maxDist2 might be updated in the collect function
+		if ((mask & (1 << i)) && dist2[i] < maxDist2)
+		{
+			collectFunc(p, photons[i], maxDist2);
+		}
+	}
+#else
+	for (int i = 0; i < BlockSize; i++)
+	{
+		const auto dx = block.x[i] - p.x;
+		const auto dy = block.y[i] - p.y;
+		const auto dz = block.z[i] - p.z;
+		if (dx * dx + dy * dy + dz * dz < maxDist2)
+		{
+			collectFunc(p, photons[i], maxDist2);
+		}
+	}
+#endif
+}
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_PM_PHOTONMAP_KDTREE_H
@@ -21,10 +21,169 @@
 #ifndef LIB_LIGHTMETRICA_POOL_H
 #define LIB_LIGHTMETRICA_POOL_H
 
-#include "common.h"
+#include "align.h"
+#include <vector>
+#include <new>
+#include <type_traits>
 
 LM_NAMESPACE_BEGIN
 
+/*!
+	Memory arena.
+	Bump-pointer allocator for the objects with the same lifetime,
+	e.g., the path vertices constructed for a sample.
+	All allocated memory is released at once by #Reset in constant time
+	and the memory blocks are reused for the following allocations.
+	The arena is not thread-safe and intended to be owned by a thread
+	in order to avoid the contention of the global allocator.
+*/
+class MemoryArena
+{
+public:
+
+	//! Default size of a memory block in bytes.
+	static const size_t DefaultBlockSize = 1 << 16;
+
+	//! Alignment of memory blocks in bytes (size of a cache line).
+	static const size_t BlockAlignment = 64;
+
+public:
+
+	LM_PUBLIC_API MemoryArena(size_t blockSize = DefaultBlockSize);
+	LM_PUBLIC_API ~MemoryArena();
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(MemoryArena);
+
+public:
+
+	/*!
+		Allocate memory.
+		\param size Size in bytes.
+		\param align Alignment in bytes (power of two, at most #BlockAlignment).
+		\return Allocated memory.
+	*/
+	void* Allocate(size_t size, size_t align = 16)
+	{
+		size_t offset = (currentOffset + align - 1) & ~(align - 1);
+		if (offset + size > currentSize)
+		{
+			return AllocateFromNextBlock(size);
+		}
+
+		currentOffset = offset + size;
+		return currentBlock + offset;
+	}
+
+	/*!
+		Construct an object.
+		The destructor of the object is not called on #Reset,
+		so the type must not own any resources.
+		\tparam T Type of the object.
+		\return Constructed object.
+	*/
+	template <typename T>
+	T* Construct()
+	{
+		// Global placement new is used in order to bypass class-specific operator new, e.g., of #SIMDAlignedType
+		return ::new (Allocate(sizeof(T), std::alignment_of<T>::value < 16 ? 16 : std::alignment_of<T>::value)) T;
+	}
+
+	/*!
+		Reset the arena.
+		Invalidates all allocated memory in constant time.
+		The memory blocks are kept for reuse.
+	*/
+	void Reset()
+	{
+		currentBlockIndex = 0;
+		currentBlock = blocks.empty() ? nullptr : blocks[0].data;
+		currentSize = blocks.empty() ? 0 : blocks[0].size;
+		currentOffset = 0;
+	}
+
+	/*!
+		Get total size of the memory blocks.
+		\return Size in bytes.
+	*/
+	LM_PUBLIC_API size_t TotalBlockSize() const;
+
+private:
+
+	LM_PUBLIC_API void* AllocateFromNextBlock(size_t size);
+
+private:
+
+	struct Block
+	{
+		unsigned char* data;
+		size_t size;
+	};
+
+	size_t blockSize;
+	std::vector<Block> blocks;
+	size_t currentBlockIndex;
+	unsigned char* currentBlock;
+	size_t currentSize;
+	size_t currentOffset;
+
+};
+
+/*!
+	Object pool.
+	Typed pool of objects constructed in a memory arena.
+	If the type is not trivially destructible, the destructors of
+	the constructed objects are called on #Release.
+	\tparam T Type of the objects.
+*/
+template <typename T>
+class ObjectPool
+{
+public:
+
+	ObjectPool() {}
+	~ObjectPool() { Release(); }
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(ObjectPool);
+
+public:
+
+	/*!
+		Construct an object.
+		\return Constructed object.
+	*/
+	T* Construct()
+	{
+		auto* obj = arena.Construct<T>();
+		if (!std::is_trivially_destructible<T>::value)
+		{
+			objects.push_back(obj);
+		}
+		return obj;
+	}
+
+	/*!
+		Release all constructed objects.
+	*/
+	void Release()
+	{
+		for (auto* obj : objects)
+		{
+			obj->~T();
+		}
+		objects.clear();
+		arena.Reset();
+	}
+
+private:
+
+	MemoryArena arena;
+	std::vector<T*> objects;
+
+};
 
 LM_NAMESPACE_END
 
@@ -86,6 +86,14 @@ public:
 	*/
 	virtual bool IntersectEmitterShapes(Ray& ray, Intersection& isect) const = 0;
 
+	/*!
+		Occlusion query with emitter shapes.
+		\param ray Ray.
+		\retval true The ray is occluded by emitter shapes.
+		\retval false The ray is not occluded by emitter shapes.
+	*/
+	virtual bool OccludedEmitterShapes(const Ray& ray) const = 0;
+
 	/*!
 	*/
 	virtual AABB GetAABBEmitterShapes() const = 0;
@@ -23,16 +23,26 @@
 
 #include "common.h"
 #include "math.types.h"
+#include <vector>
+#include <functional>
 
 LM_NAMESPACE_BEGIN
 
+class Random;
+class Sampler;
+class PSSMLTPathSampler;
+struct PSSMLTSplats;
+
 /*!
 	Light path seed.
 	Required data to generate a seed light path.
+	The seed path is restored by rewinding the stream #stream
+	of the seed samples to the sample index #index.
 */
 struct PSSMLTPathSeed
 {
 
+	int stream;			//!< Index of the stream of seed samples
 	int index;			//!< Sample index of restorable sampler
 	Math::Float I;		//!< Luminance of the sampled light path (used for debugging)
 
@@ -41,8 +51,9 @@ struct PSSMLTPathSeed
 
 	}
 
-	PSSMLTPathSeed(int index, const Math::Float& I)
-		: index(index)
+	PSSMLTPathSeed(int stream, int index, const Math::Float& I)
+		: stream(stream)
+		, index(index)
 		, I(I)
 	{
 
@@ -50,6 +61,92 @@ struct PSSMLTPathSeed
 
 };
 
+/*!
+	Streams of seed samples.
+	Seed samples are split into fixed-size groups, each of which is sampled
+	with an independent stream of random numbers seeded from the base seed and the stream index.
+	This makes the seed sampling parallelizable and keeps the result independent of the number of threads.
+	Moreover the cost of rewinding a stream is bounded by the number of samples in a stream.
+*/
+class PSSMLTSeedStreams
+{
+public:
+
+	PSSMLTSeedStreams() = delete;
+
+public:
+
+	/*!
+		Function sampling light paths for a seed sample.
+		\param pathSampler Path sampler for the current thread.
+		\param sampler Sampler.
+		\param splats Evaluated light paths.
+	*/
+	typedef std::function<void (PSSMLTPathSampler& pathSampler, Sampler& sampler, PSSMLTSplats& splats)> SampleFunc;
+
+	/*!
+		Function reporting progress.
+		\param progress Progress in [0, 1].
+	*/
+	typedef std::function<void (double progress)> ProgressFunc;
+
+public:
+
+	//! Number of seed samples in a stream.
+	static const long long NumSamplesPerStream = 1LL<<10;
+
+	/*!
+		Get number of streams.
+		\param numSeedSamples Number of seed samples.
+		\return Number of streams.
+	*/
+	static long long NumStreams(long long numSeedSamples)
+	{
+		return (numSeedSamples + NumSamplesPerStream - 1) / NumSamplesPerStream;
+	}
+
+	/*!
+		Get seed of a stream.
+		Mixes the base seed and the stream index with a 64-bit finalizer
+		so that the seeds of adjacent streams are decorrelated.
+		\param baseSeed Base seed.
+		\param stream Stream index.
+		\return Seed of the stream.
+	*/
+	static unsigned int StreamSeed(unsigned int baseSeed, int stream)
+	{
+		unsigned long long h = (static_cast<unsigned long long>(baseSeed) << 32) ^ static_cast<unsigned long long>(stream);
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return static_cast<unsigned int>(h);
+	}
+
+	/*!
+		Sample candidates of the seeds.
+		Takes #numSeedSamples seed samples in the streams, which are sampled in parallel with rewindable samplers.
+		Samples with non-zero luminance are stored as the candidates in the order of the streams,
+		thus the candidates are independent of the number of threads.
+		\param numSeedSamples Number of seed samples.
+		\param baseSeed Base seed of the streams.
+		\param numThreads Number of threads.
+		\param rng Random number generator cloned for the samplers of the threads.
+		\param pathSampler Path sampler cloned for the threads.
+		\param sampleFunc Function sampling light paths.
+		\param progressFunc Function reporting progress, which is called only from the calling thread.
+		\param candidates Sampled candidates.
+		\param sumI Sum of the luminance of the seed samples.
+		\retval true Succeeded to sample.
+		\retval false Failed to sample.
+	*/
+	LM_PUBLIC_API static bool SampleCandidates(
+		long long numSeedSamples, unsigned int baseSeed, int numThreads, const Random& rng, const PSSMLTPathSampler& pathSampler,
+		const SampleFunc& sampleFunc, const ProgressFunc& progressFunc, std::vector<PSSMLTPathSeed>& candidates, Math::Float& sumI);
+
+};
+
 LM_NAMESPACE_END
 
 #endif // LIB_LIGHTMETRICA_PSSMLT_PATH_SEED_H
\ No newline at end of file
@@ -65,6 +65,26 @@ public:
 	*/
 	virtual Random* Clone() const = 0;
 
+	/*!
+		Generate multiple pseudorandom numbers as floating point type.
+		The generated sequence is same as the sequence generated by calling #Next
+		#n times. Implementations might override the function for bulk generation.
+		\param values Output array of the generated numbers.
+		\param n Number of numbers to generate.
+	*/
+	virtual void NextBlock(Math::Float* values, int n);
+
+	/*!
+		Seek to the given position of the sequence.
+		Moves the position of the sequence generated after the last call of #SetSeed to #index,
+		i.e., the next call of #NextUInt returns the #index-th number of the sequence.
+		Only the random number generators supporting random access implement the function.
+		\param index Index of the number in the sequence.
+		\retval true Succeeded to seek.
+		\retval false The generator does not support seeking.
+	*/
+	virtual bool Seek(unsigned long long index) { return false; }
+
 public:
 
 	/*!
@@ -35,4 +35,12 @@ LM_FORCE_INLINE Math::Vec2 Random::NextVec2()
 	return Math::Vec2(u1, u2);
 }
 
+inline void Random::NextBlock(Math::Float* values, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		values[i] = Next();
+	}
+}
+
 LM_NAMESPACE_END
\ No newline at end of file
@@ -68,6 +68,22 @@ public:
 	*/
 	virtual void ProcessSingleSample(const Scene& scene) = 0;
 
+	/*!
+		Process multiple samples.
+		The default implementation calls #ProcessSingleSample #numSamples times.
+		Override the function if the process can benefit from processing
+		samples together, e.g., batched intersection queries for primary rays.
+		\param scene Scene.
+		\param numSamples Number of samples.
+	*/
+	virtual void ProcessMultipleSamples(const Scene& scene, long long numSamples)
+	{
+		for (long long sample = 0; sample < numSamples; sample++)
+		{
+			ProcessSingleSample(scene);
+		}
+	}
+
 	/*!
 		Get film.
 		Gets internal film associate with the process.
@@ -95,6 +111,23 @@ public:
 	*/
 	virtual void ProcessSinglePixel(const Scene& scene, const Math::Vec2i& pixel) = 0;
 
+	/*!
+		Process multiple pixels.
+		The default implementation calls #ProcessSinglePixel for each pixel.
+		Override the function if the process can benefit from processing
+		pixels together, e.g., batched intersection queries for primary rays.
+		\param scene Scene.
+		\param pixels Array of pixel coordinates.
+		\param numPixels Number of pixels.
+	*/
+	virtual void ProcessMultiplePixels(const Scene& scene, const Math::Vec2i* pixels, int numPixels)
+	{
+		for (int i = 0; i < numPixels; i++)
+		{
+			ProcessSinglePixel(scene, pixels[i]);
+		}
+	}
+
 };
 
 LM_NAMESPACE_END
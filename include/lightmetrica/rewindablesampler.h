@@ -63,6 +63,8 @@ public:
 		The index values can be obtained by #SampleIndex function.
 		In the condition of the same seed, this function guarantees
 		to generate same sequence of samples after #index.
+		Rewinding takes constant time if the underlying random number generator
+		supports seeking (see Random::Seek), otherwise it regenerates #index numbers.
 		\param index Sample index.
 		\sa SampleIndex
 	*/
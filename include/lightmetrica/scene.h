@@ -24,7 +24,9 @@
 #include "component.h"
 #include "math.types.h"
 #include "aabb.h"
+#include "math.distribution.h"
 #include <string>
+#include <unordered_map>
 #include <functional>
 #include <memory>
 #include <boost/signals2.hpp>
@@ -35,6 +37,7 @@ class Assets;
 class ConfigNode;
 class Camera;
 class Light;
+class LightTree;
 class Primitives;
 struct Primitive;
 struct Ray;
@@ -68,9 +71,21 @@ public:
 	*/
 	LM_PUBLIC_API void Load(Primitives* primitives);
 
+	/*!
+		Precompute world-space triangles.
+		Stores the world-space geometry normals, vertex normals and texture coordinates
+		of the triangles in separate per-triangle arrays,
+		so that the intersection data is reconstructed without
+		the indirection through the faces of the meshes and the transformation by the primitives.
+		The function requires additional memory proportional to the number of triangles.
+		The function must be called after #Load and before any intersection queries.
+	*/
+	LM_PUBLIC_API void PrecomputeTriangles();
+
 	/*!
 		Post configuration of the scene.
 		This function must be called after #Build.
+		The function also creates the distribution and the light tree for the light selection.
 		\retval true Succeeded to configure the scene.
 		\retval false Failed to configure the scene.
 	*/
@@ -87,6 +102,32 @@ public:
 	*/
 	LM_PUBLIC_API bool Intersect(Ray& ray, Intersection& isect) const;
 
+	/*!
+		Occlusion query.
+		The function checks if #ray hits with the scene in the range of [#minT, #maxT].
+		Unlike #Intersect, the query terminates with the first found hit
+		and information on the hit point is not computed.
+		Use this function for visibility tests, e.g., shadow rays.
+		\param ray Ray.
+		\retval true The ray is occluded.
+		\retval false The ray is not occluded.
+	*/
+	LM_PUBLIC_API bool Occluded(const Ray& ray) const;
+
+	/*!
+		Batched intersection query.
+		Checks intersections of #n rays at once.
+		The function is supposed to be used with coherent rays, e.g., primary rays,
+		where the implementation can amortize the cost of the traversal over the rays.
+		The result is same as calling #Intersect for each ray.
+		\param rays Array of #n rays.
+		\param isects Array of #n intersection data.
+		\param hits Array of #n flags. Set to true if the corresponding ray is intersected.
+		\param n Number of rays.
+		\return Number of intersected rays.
+	*/
+	LM_PUBLIC_API size_t IntersectBatch(Ray* rays, Intersection* isects, bool* hits, size_t n) const;
+
 	/*!
 		Get a main camera.
 		\return Main camera.
@@ -95,6 +136,8 @@ public:
 
 	/*!
 		Choose a light included in the scene (reusable version).
+		The light is chosen proportional to its power after #PostConfigure is called,
+		otherwise uniformly chosen.
 		Note that only the x component of #lightSampleP is used
 		and reusable in the following procedure, e.g. positional sampling on the light.
 		\param lightSampleP Light sample.
@@ -113,9 +156,32 @@ public:
 
 	/*!
 		PDF evaluation for light selection sampling.
-		\return Evaluated PDF.
+		\param light Light.
+		\return Evaluated PDF (discrete measure).
+	*/
+	LM_PUBLIC_API Math::PDFEval LightSelectionPdf(const Light* light) const;
+
+	/*!
+		Choose a light according to the estimated contribution to a point (reusable version).
+		The light is chosen with the light tree after #PostConfigure is called,
+		otherwise same as #SampleLightSelection without the point.
+		Use the function for the direct light sampling from a shading point.
+		Note that only the x component of #lightSampleP is used and reusable.
+		\param p Shading point.
+		\param lightSampleP Light sample.
+		\param selectionPdf PDF evaluation of the selection (discrete measure).
+		\return Selected light.
+	*/
+	LM_PUBLIC_API const Light* SampleLightSelection(const Math::Vec3& p, Math::Vec2& lightSampleP, Math::PDFEval& selectionPdf) const;
+
+	/*!
+		PDF evaluation for light selection sampling from a shading point.
+		Corresponds to #SampleLightSelection with a shading point.
+		\param p Shading point.
+		\param light Light.
+		\return Evaluated PDF (discrete measure).
 	*/
-	LM_PUBLIC_API Math::PDFEval LightSelectionPdf() const;
+	LM_PUBLIC_API Math::PDFEval LightSelectionPdf(const Math::Vec3& p, const Light* light) const;
 
 	/*!
 		Get AABB of the scene.
@@ -155,6 +221,27 @@ public:
 	*/
 	virtual bool IntersectTriangles(Ray& ray, Intersection& isect) const = 0;
 
+	/*!
+		Occlusion query with triangles.
+		The function checks if #ray hits with any triangles in the scene.
+		The traversal can be terminated as soon as any hit is found.
+		\param ray Ray.
+		\retval true The ray is occluded by triangles.
+		\retval false The ray is not occluded by triangles.
+	*/
+	virtual bool OccludedTriangles(const Ray& ray) const = 0;
+
+	/*!
+		Batched intersection query with triangles.
+		The default implementation calls #IntersectTriangles for each ray.
+		Override the function if the acceleration structure supports batched traversal.
+		\param rays Array of #n rays.
+		\param isects Array of #n intersection data.
+		\param hits Array of #n flags. Set to true if the corresponding ray is intersected.
+		\param n Number of rays.
+	*/
+	LM_PUBLIC_API virtual void IntersectTrianglesBatch(Ray* rays, Intersection* isects, bool* hits, size_t n) const;
+
 	/*!
 		Get AABB of triangles in the scene.
 		\return AABB of triangles in the scene.
@@ -188,6 +275,15 @@ protected:
 
 	std::unique_ptr<Primitives> primitives;
 
+private:
+
+	struct PrecomputedTriangles;
+
+	Math::DiscreteAliasDistribution1D lightSelectionDist;				//!< Distribution for the light selection
+	std::unordered_map<const Light*, Math::Float> lightSelectionPdfs;	//!< PDF of the light selection for each light
+	std::unique_ptr<LightTree> lightTree;								//!< Light tree for the light selection from a shading point
+	std::unique_ptr<PrecomputedTriangles> precomputedTriangles;			//!< World-space triangles (if precomputed)
+
 };
 
 LM_NAMESPACE_END
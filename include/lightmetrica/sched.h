@@ -93,6 +93,14 @@ public:
 	*/
 	virtual bool Render(Renderer& renderer, const Scene& scene) const = 0;
 
+	/*!
+		Get number of threads.
+		Renderers can use the function to parallelize the preprocess
+		with the same number of threads as the render processes.
+		\return Number of threads.
+	*/
+	virtual int NumThreads() const = 0;
+
 	/*!
 		Connect to ReportProgress signal.
 		The signal is emitted when the progress of asset loading is changed.
@@ -0,0 +1,297 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_SHARED_FILM_BUFFER_H
+#define LIB_LIGHTMETRICA_SHARED_FILM_BUFFER_H
+
+#include "common.h"
+#include "math.types.h"
+#include "align.h"
+#include "bitmapfilm.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+LM_NAMESPACE_BEGIN
+
+/*!
+	Shared film buffer.
+	Accumulation buffer shared among the clones of a film.
+	The buffer is divided into square tiles and each tile is protected by a lock,
+	so that the threads can flush the tiles concurrently.
+	Contributions to single pixels are accumulated under striped spin locks,
+	which is cheaper than per-component atomic operations and
+	also works with the multi-precision floating-point type.
+*/
+class SharedFilmBuffer
+{
+public:
+
+	//! Width and height of a tile in pixels.
+	static const int TileSize = 16;
+
+	//! Number of spin locks for the accumulation to single pixels.
+	static const int NumStripes = 1024;
+
+public:
+
+	LM_PUBLIC_API SharedFilmBuffer(int width, int height);
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(SharedFilmBuffer);
+
+public:
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+	int NumTiles() const { return numTilesX * numTilesY; }
+
+	/*!
+		Get the index of the tile containing the pixel.
+		\param pixel Pixel position.
+		\return Tile index.
+	*/
+	int TileIndex(const Math::Vec2i& pixel) const { return (pixel.y / TileSize) * numTilesX + pixel.x / TileSize; }
+
+	/*!
+		Accumulate the contribution of a tile.
+		\param tileIndex Tile index.
+		\param tileData Contribution of the tile (#TileSize * #TileSize RGB values in row-major order).
+		\param rowMask Bit mask of the rows of the tile to be accumulated.
+	*/
+	LM_PUBLIC_API void AccumulateTile(int tileIndex, const Math::Float* tileData, unsigned int rowMask);
+
+	/*!
+		Accumulate the contribution to the pixel.
+		Safe to be called concurrently from multiple threads,
+		but not concurrently with #AccumulateTile.
+		\param pixel Pixel position.
+		\param contrb Contribution.
+	*/
+	LM_PUBLIC_API void AccumulateContribution(const Math::Vec2i& pixel, const Math::Vec3& contrb);
+
+	/*!
+		Record the contribution to the pixel.
+		\param pixel Pixel position.
+		\param contrb Contribution.
+	*/
+	LM_PUBLIC_API void RecordContribution(const Math::Vec2i& pixel, const Math::Vec3& contrb);
+
+	/*!
+		Accumulate the contents of the buffer to the data of a bitmap.
+		The data is processed in parallel.
+		\param data Bitmap data (#Width * #Height RGB values).
+	*/
+	LM_PUBLIC_API void AccumulateTo(std::vector<Math::Float>& data) const;
+
+private:
+
+	int width;
+	int height;
+	int numTilesX;
+	int numTilesY;
+	std::vector<Math::Float> data;
+	std::unique_ptr<std::mutex[]> tileMutexes;
+
+	// Spin lock for a stripe of pixels
+	// Aligned to the cache line in order to avoid false sharing
+	struct LM_ALIGN(64) StripeLock
+	{
+		std::atomic_flag flag;
+		StripeLock() { flag.clear(); }
+		void Lock() { while (flag.test_and_set(std::memory_order_acquire)); }
+		void Unlock() { flag.clear(std::memory_order_release); }
+	};
+	std::vector<StripeLock, aligned_allocator<StripeLock, 64>> stripeLocks;
+
+};
+
+/*!
+	Film tile cache.
+	Per-thread direct-mapped cache of the tiles of a shared film buffer.
+	Contributions are accumulated to the cached tiles, which are
+	small enough to be resident in the cache of the processor,
+	and the tiles are flushed to the shared buffer when evicted.
+	Memory consumption is independent of the resolution of the film.
+*/
+class FilmTileCache
+{
+public:
+
+	//! Number of cached tiles.
+	static const int NumSlots = 64;
+
+public:
+
+	LM_PUBLIC_API FilmTileCache(const std::shared_ptr<SharedFilmBuffer>& buffer);
+	LM_PUBLIC_API ~FilmTileCache();
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(FilmTileCache);
+
+public:
+
+	/*!
+		Accumulate the contribution to the pixel.
+		\param pixel Pixel position.
+		\param contrb Contribution.
+	*/
+	LM_PUBLIC_API void AccumulateContribution(const Math::Vec2i& pixel, const Math::Vec3& contrb);
+
+	/*!
+		Flush all cached tiles to the shared buffer.
+	*/
+	LM_PUBLIC_API void Flush();
+
+	/*!
+		Get the shared buffer.
+		\return Shared buffer.
+	*/
+	const std::shared_ptr<SharedFilmBuffer>& Buffer() const { return buffer; }
+
+private:
+
+	void FlushSlot(int slot);
+
+private:
+
+	std::shared_ptr<SharedFilmBuffer> buffer;
+	std::vector<int> slotTileIndices;		// Index of the tile cached in each slot (-1 if empty)
+	std::vector<unsigned int> slotRowMasks;	// Bit mask of the rows with contributions for each slot
+	std::vector<Math::Float> slotData;		// Contributions of the cached tiles
+
+};
+
+class ConfigNode;
+
+/*!
+	Shared film accumulation.
+	Manages the tiled and atomic accumulation modes of bitmap films (see FilmAccumulationMode).
+	The clones of the original film do not have bitmaps but accumulate
+	the contributions to the buffer shared with the original film,
+	via the tile caches in the tiled mode or directly in the atomic mode.
+	The shared buffer is accumulated to the bitmap of the original film
+	when the bitmap is accessed next time (see #Resolve).
+*/
+class SharedFilmAccumulation
+{
+public:
+
+	LM_PUBLIC_API SharedFilmAccumulation();
+	LM_PUBLIC_API ~SharedFilmAccumulation();
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(SharedFilmAccumulation);
+
+public:
+
+	/*!
+		Load the accumulation mode.
+		Reads the optional 'accumulation_mode' element of the film.
+		\param node A XML element which consists of \a film element.
+		\retval true Succeeded to load.
+		\retval false Failed to load.
+	*/
+	LM_PUBLIC_API bool Load(const ConfigNode& node);
+
+	/*!
+		Check if the film is a clone accumulating to the shared buffer.
+		Such films have no bitmaps.
+		\retval true The film is a clone accumulating to the shared buffer.
+		\retval false The film has its own bitmap.
+	*/
+	bool SharedClone() const { return sharedClone; }
+
+	/*!
+		Record the contribution to the shared buffer.
+		\param pixel Pixel position.
+		\param contrb Contribution.
+		\retval true The contribution is recorded to the shared buffer.
+		\retval false The film is not a clone and the contribution must be recorded to the bitmap.
+	*/
+	LM_PUBLIC_API bool RecordContribution(const Math::Vec2i& pixel, const Math::Vec3& contrb);
+
+	/*!
+		Accumulate the contribution to the shared buffer.
+		\param pixel Pixel position.
+		\param contrb Contribution.
+		\retval true The contribution is accumulated to the shared buffer.
+		\retval false The film is not a clone and the contribution must be accumulated to the bitmap.
+	*/
+	LM_PUBLIC_API bool AccumulateContribution(const Math::Vec2i& pixel, const Math::Vec3& contrb);
+
+	/*!
+		Accumulate the contributions of another film.
+		If the other film is a clone, its contributions are accumulated on the next #Resolve.
+		Otherwise the bitmap data of the other film is accumulated in parallel.
+		\param other Shared accumulation state of the other film.
+		\param data Bitmap data of the film.
+		\param otherData Bitmap data of the other film.
+	*/
+	LM_PUBLIC_API void AccumulateFilm(const SharedFilmAccumulation& other, std::vector<Math::Float>& data, std::vector<Math::Float>& otherData) const;
+
+	/*!
+		Accumulate the pending contents of the shared buffer to the bitmap data.
+		Must be called before the bitmap data is accessed.
+		\param data Bitmap data of the film.
+	*/
+	LM_PUBLIC_API void Resolve(std::vector<Math::Float>& data) const;
+
+	/*!
+		Configure the accumulation of a clone of the film.
+		\param clone Shared accumulation state of the clone.
+		\param width Width of the film.
+		\param height Height of the film.
+		\param data Bitmap data of the film.
+		\retval true The clone accumulates to the shared buffer.
+		\retval false The clone requires a copy of the bitmap.
+	*/
+	LM_PUBLIC_API bool ConfigureClone(SharedFilmAccumulation& clone, int width, int height, std::vector<Math::Float>& data) const;
+
+	/*!
+		Clear the pending contents.
+		The shared buffer keeps the contributions of the clones,
+		which are accumulated again by #AccumulateFilm.
+	*/
+	void Clear() { sharedPending = false; }
+
+	/*!
+		Reset the state.
+		Called when the bitmap of the film is reallocated.
+	*/
+	LM_PUBLIC_API void Reset();
+
+private:
+
+	FilmAccumulationMode mode;
+	mutable std::shared_ptr<SharedFilmBuffer> sharedBuffer;		// Shared buffer
+	mutable bool sharedPending;									// True if the shared buffer is not yet accumulated to the bitmap (only for the original film)
+	bool sharedClone;											// True if the film is a clone accumulating to the shared buffer
+	std::unique_ptr<FilmTileCache> tileCache;					// Tile cache (only for the clones in the tiled mode)
+
+};
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_SHARED_FILM_BUFFER_H
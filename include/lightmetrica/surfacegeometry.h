@@ -36,29 +36,43 @@ LM_NAMESPACE_BEGIN
 struct SurfaceGeometry
 {
 
-	bool degenerated;				//!< The surface geometry is positionally degenerated if true
-
 	Math::Vec3 p;					//!< Intersection point
 	Math::Vec3 gn;					//!< Geometry normal
 	Math::Vec3 sn;					//!< Shading normal
 	Math::Vec3 ss, st;				//!< Tangent vectors w.r.t. shading normal
 	Math::Vec2 uv;					//!< Texture coordinates
 
-	Math::Mat3 worldToShading;		//!< Convarsion to local shading coordinates from world coordinates
-	Math::Mat3 shadingToWorld;		//!< Convarsion to world coordinates from local shading coordinates
+	// Placed after #uv in order to fill the padding of the structure
+	bool degenerated;				//!< The surface geometry is positionally degenerated if true
 
 	/*!
 		Compute tangent space w.r.t. shading normal.
-		Computes #sn, #sn, #worldToShading and #shadingToWorld from #sn.
+		Computes #ss and #st from #sn.
+		(#ss, #st, #sn) is the orthonormal frame of the local shading coordinates.
 	*/
 	LM_FORCE_INLINE void ComputeTangentSpace()
 	{
-		// Tangent vectors
 		Math::OrthonormalBasis(sn, ss, st);
+	}
+
+	/*!
+		Convert a vector to local shading coordinates from world coordinates.
+		\param v Vector in world coordinates.
+		\return Vector in local shading coordinates.
+	*/
+	LM_FORCE_INLINE Math::Vec3 WorldToShading(const Math::Vec3& v) const
+	{
+		return Math::Vec3(Math::Dot(ss, v), Math::Dot(st, v), Math::Dot(sn, v));
+	}
 
-		// Shading coordinates conversion
-		shadingToWorld = Math::Mat3(ss, st, sn);
-		worldToShading = Math::Transpose(shadingToWorld);
+	/*!
+		Convert a vector to world coordinates from local shading coordinates.
+		\param v Vector in local shading coordinates.
+		\return Vector in world coordinates.
+	*/
+	LM_FORCE_INLINE Math::Vec3 ShadingToWorld(const Math::Vec3& v) const
+	{
+		return ss * v.x + st * v.y + sn * v.z;
 	}
 
 };
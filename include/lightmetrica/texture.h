@@ -46,6 +46,16 @@ public:
 
 	virtual Math::Vec3 Evaluate(const Math::Vec2& uv) const = 0;
 
+	/*!
+		Evaluate the texture with a filter footprint.
+		The textures with mipmaps select the level according to the footprint.
+		The default implementation ignores the footprint.
+		\param uv Texture coordinates.
+		\param footprint Width of the footprint in the texture coordinates.
+		\return Texture value.
+	*/
+	virtual Math::Vec3 Evaluate(const Math::Vec2& uv, const Math::Float& footprint) const { return Evaluate(uv); }
+
 };
 
 LM_NAMESPACE_END
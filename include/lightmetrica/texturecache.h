@@ -0,0 +1,232 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_TEXTURE_CACHE_H
+#define LIB_LIGHTMETRICA_TEXTURE_CACHE_H
+
+#include "common.h"
+#include "math.types.h"
+#include <vector>
+#include <string>
+#include <functional>
+
+LM_NAMESPACE_BEGIN
+
+/*!
+	Texture cache.
+	Holds the tiles of the textures within the memory budget.
+	The tiles are loaded on the first request and
+	the least recently used tiles are evicted if the memory usage exceeds the budget.
+	The tiles are distributed to the shards by the keys, each of which
+	has its own lock, LRU list, and the share of the memory budget.
+	In addition, each thread has a small lookup cache of the recently used tiles,
+	so that the lookup of the tiles frequently used by a thread needs no locks.
+	The tiles referred by the lookup caches are not released until they are replaced,
+	thus the memory usage might exceed the budget by #ThreadLookupCacheSize tiles per thread.
+*/
+class LM_PUBLIC_API TextureCache
+{
+public:
+
+	//! Tile data.
+	typedef std::vector<float> Tile;
+
+	/*!
+		Function to load a tile.
+		\param tile Tile to be loaded.
+		\retval true Succeeded to load the tile.
+		\retval false Failed to load the tile.
+	*/
+	typedef std::function<bool (Tile& tile)> LoadTileFunc;
+
+	//! Number of entries of the per-thread lookup cache.
+	static const int ThreadLookupCacheSize = 32;
+
+public:
+
+	/*!
+		Constructor.
+		\param memoryBudget Memory budget in bytes.
+		\param numShards Number of shards.
+	*/
+	TextureCache(size_t memoryBudget, int numShards = 64);
+	~TextureCache();
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(TextureCache);
+
+public:
+
+	/*!
+		Get the shared texture cache.
+		The cache is shared among the textures in the process.
+		\return Shared texture cache.
+	*/
+	static TextureCache& Shared();
+
+public:
+
+	/*!
+		Set memory budget.
+		The tiles are evicted on the next requests if the memory usage exceeds the new budget.
+		\param memoryBudget Memory budget in bytes.
+	*/
+	void SetMemoryBudget(size_t memoryBudget);
+
+	/*!
+		Get memory budget.
+		\return Memory budget in bytes.
+	*/
+	size_t MemoryBudget() const;
+
+	/*!
+		Get memory usage.
+		The tiles only referred by the per-thread lookup caches are not counted.
+		\return Memory usage of the cached tiles in bytes.
+	*/
+	size_t MemoryUsage() const;
+
+	/*!
+		Get the number of loaded tiles.
+		Includes the tiles loaded again after the eviction.
+		\return Number of tiles loaded by the load functions.
+	*/
+	long long NumLoadedTiles() const;
+
+	/*!
+		Create a new ID of a texture.
+		The ID is used as the upper 32 bits of the keys of the tiles of a texture.
+		\return Unique ID.
+	*/
+	unsigned int NewTextureID();
+
+	/*!
+		Get a tile.
+		Loads the tile with #loadFunc if the tile is not in the cache.
+		The returned reference is valid until the next call of #GetTile in the same thread.
+		\param key Key of the tile.
+		\param loadFunc Function to load the tile.
+		\return Tile (empty if failed to load).
+	*/
+	const Tile& GetTile(unsigned long long key, const LoadTileFunc& loadFunc);
+
+	/*!
+		Clear the cache.
+		Releases all tiles except for the ones referred by the per-thread lookup caches.
+	*/
+	void Clear();
+
+private:
+
+	class Impl;
+	Impl* p;
+
+};
+
+// --------------------------------------------------------------------------------
+
+/*!
+	Tiled mipmap image.
+	An RGB image stored as a mipmap pyramid of square tiles in a tile file.
+	The tile file is memory-mapped and the tiles are loaded lazily through the texture cache,
+	thus only the tiles used in the rendering are resident in the memory.
+	The levels are created with 2x2 box filter until the size of the level becomes 1x1.
+*/
+class LM_PUBLIC_API TiledMipmapImage
+{
+public:
+
+	TiledMipmapImage();
+	~TiledMipmapImage();
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(TiledMipmapImage);
+
+public:
+
+	/*!
+		Build a tile file.
+		\param data RGB pixel values in the row-major order (3 * #width * #height elements).
+		\param width Width of the image.
+		\param height Height of the image.
+		\param tileSize Width and height of a tile.
+		\param path Path to the tile file.
+		\retval true Succeeded to build the tile file.
+		\retval false Failed to build the tile file.
+	*/
+	static bool Build(const std::vector<float>& data, int width, int height, int tileSize, const std::string& path);
+
+public:
+
+	/*!
+		Open a tile file.
+		\param path Path to the tile file.
+		\param cache Texture cache used to load the tiles.
+		\retval true Succeeded to open the tile file.
+		\retval false Failed to open the tile file.
+	*/
+	bool Open(const std::string& path, TextureCache& cache);
+
+	/*!
+		Close the tile file.
+	*/
+	void Close();
+
+	/*!
+		Get the number of levels.
+		\return Number of levels (0 if the file is not opened).
+	*/
+	int NumLevels() const;
+
+	/*!
+		Get width of a level.
+		\param level Level.
+		\return Width in pixels.
+	*/
+	int Width(int level) const;
+
+	/*!
+		Get height of a level.
+		\param level Level.
+		\return Height in pixels.
+	*/
+	int Height(int level) const;
+
+	/*!
+		Get a texel.
+		\param x X coordinate in [0, #Width(level)).
+		\param y Y coordinate in [0, #Height(level)).
+		\param level Level in [0, #NumLevels).
+		\return RGB value of the texel.
+	*/
+	Math::Vec3 Texel(int x, int y, int level) const;
+
+private:
+
+	class Impl;
+	Impl* p;
+
+};
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_TEXTURE_CACHE_H
@@ -0,0 +1,113 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef LIB_LIGHTMETRICA_THREAD_POOL_H
+#define LIB_LIGHTMETRICA_THREAD_POOL_H
+
+#include "common.h"
+#include <functional>
+
+LM_NAMESPACE_BEGIN
+
+/*!
+	Work-stealing thread pool.
+	Processes a range of work units (e.g., samples or lines) in parallel.
+	The range is initially distributed evenly among per-thread deques.
+	A thread takes the newest range from its own deque and splits it in halves
+	until the size of the range is no more than the grain size,
+	pushing the remaining halves back to the deque.
+	An idle thread steals the oldest (and thus the largest) range from the deques of other threads.
+	As a result, the sizes of the processed blocks adapt to the load imbalance
+	without the idle time at the end of fixed-size block sweeps.
+	The calling thread participates in the processing as the thread #0.
+*/
+class LM_PUBLIC_API ThreadPool
+{
+public:
+
+	/*!
+		Function processing a block of work units.
+		\param threadId Index of the thread in [0, #NumThreads).
+		\param begin Begin of the block.
+		\param end End of the block.
+	*/
+	typedef std::function<void (int threadId, long long begin, long long end)> BlockFunc;
+
+public:
+
+	/*!
+		Constructor.
+		Creates #numThreads - 1 worker threads.
+		\param numThreads Number of threads including the calling thread.
+	*/
+	ThreadPool(int numThreads);
+	~ThreadPool();
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(ThreadPool);
+
+public:
+
+	/*!
+		Get number of threads.
+		\return Number of threads including the calling thread.
+	*/
+	int NumThreads() const;
+
+	/*!
+		Process work units in [0, n) in parallel.
+		The function blocks until all work units are processed or the operation is canceled.
+		Blocks processed by a thread never overlap with the blocks processed by the other threads
+		and a block is never processed concurrently by two threads with the same thread ID.
+		Not reentrant: #func must not call #ParallelFor of the same pool.
+		\param n Number of work units.
+		\param grainSize Maximum number of work units in a block.
+		\param func Function processing a block.
+		\retval true Succeeded to process (including the case of cancellation by #Cancel).
+		\retval false An exception was thrown in #func.
+	*/
+	bool ParallelFor(long long n, long long grainSize, const BlockFunc& func);
+
+	/*!
+		Cancel the current #ParallelFor operation.
+		Cancellation is cooperative: blocks already being processed are completed
+		and no further blocks are started.
+		The function can be called from #func or from other threads.
+	*/
+	void Cancel();
+
+	/*!
+		Check if the current or the last #ParallelFor operation is canceled.
+		\retval true The operation is canceled.
+		\retval false The operation is not canceled.
+	*/
+	bool Canceled() const;
+
+private:
+
+	class Impl;
+	Impl* p;
+
+};
+
+LM_NAMESPACE_END
+
+#endif // LIB_LIGHTMETRICA_THREAD_POOL_H
@@ -54,7 +54,7 @@ public:
 
 	virtual bool SampleDirection(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
+		auto localWi = geom.WorldToShading(query.wi);
 		auto cosThetaI = Math::CosThetaZUp(localWi);
 		if ((query.type & BSDFTypes()) == 0 || cosThetaI <= 0)
 		{
@@ -65,7 +65,7 @@ public:
 		{
 			// Diffuse reflection
 			auto localWo = Math::CosineSampleHemisphere(query.sample);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::DiffuseReflection;
 			result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo) * ComponentProb;
 		}
@@ -73,7 +73,7 @@ public:
 		{
 			// Specular reflection
 			auto localWo = Math::ReflectZUp(localWi);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::SpecularReflection;
 			result.pdf = Math::PDFEval(ComponentProb / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
 		}
@@ -83,7 +83,7 @@ public:
 
 	virtual Math::Vec3 SampleAndEstimateDirection(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
+		auto localWi = geom.WorldToShading(query.wi);
 		auto cosThetaI = Math::CosThetaZUp(localWi);
 		if ((query.type & BSDFTypes()) == 0 || cosThetaI <= 0)
 		{
@@ -94,7 +94,7 @@ public:
 		{
 			// Diffuse reflection
 			auto localWo = Math::CosineSampleHemisphere(query.sample);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::DiffuseReflection;
 			result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo) * ComponentProb;
 
@@ -110,7 +110,7 @@ public:
 		{
 			// Specular reflection
 			auto localWo = Math::ReflectZUp(localWi);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::SpecularReflection;
 			result.pdf = Math::PDFEval(ComponentProb / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
 
@@ -126,7 +126,7 @@ public:
 
 	virtual bool SampleAndEstimateDirectionBidir(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleBidirResult& result) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
+		auto localWi = geom.WorldToShading(query.wi);
 		auto cosThetaI = Math::CosThetaZUp(localWi);
 		if ((query.type & BSDFTypes()) == 0 || cosThetaI <= 0)
 		{
@@ -137,7 +137,7 @@ public:
 		{
 			// Diffuse reflection
 			auto localWo = Math::CosineSampleHemisphere(query.sample);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::DiffuseReflection;
 			result.pdf[query.transportDir] = Math::CosineSampleHemispherePDFProjSA(localWo) * ComponentProb;
 			result.pdf[1 - query.transportDir] = Math::CosineSampleHemispherePDFProjSA(localWi) * ComponentProb;
@@ -161,7 +161,7 @@ public:
 		{
 			// Specular reflection
 			auto localWo = Math::ReflectZUp(localWi);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::SpecularReflection;
 			result.pdf[query.transportDir] = Math::PDFEval(ComponentProb / Math::CosThetaZUp(localWo), Math::ProbabilityMeasure::ProjectedSolidAngle);
 			result.pdf[1 - query.transportDir] = result.pdf[query.transportDir];
@@ -187,8 +187,8 @@ public:
 
 	virtual Math::Vec3 EvaluateDirection(const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
-		auto localWo = geom.worldToShading * query.wo;
+		auto localWi = geom.WorldToShading(query.wi);
+		auto localWo = geom.WorldToShading(query.wo);
 		if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0 || Math::CosThetaZUp(localWo) <= 0)
 		{
 			return Math::Vec3();
@@ -215,8 +215,8 @@ public:
 			{
 				auto localWoTemp = Math::ReflectZUp(localWi);
 				auto localWiTemp = Math::ReflectZUp(localWo);
-				auto woTemp = geom.shadingToWorld * localWoTemp;
-				auto wiTemp = geom.shadingToWorld * localWiTemp;
+				auto woTemp = geom.ShadingToWorld(localWoTemp);
+				auto wiTemp = geom.ShadingToWorld(localWiTemp);
 				if (woTemp != query.wo && wiTemp != query.wi)
 				{
 					return Math::Vec3();
@@ -237,8 +237,8 @@ public:
 
 	virtual Math::PDFEval EvaluateDirectionPDF(const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
-		auto localWo = geom.worldToShading * query.wo;
+		auto localWi = geom.WorldToShading(query.wi);
+		auto localWo = geom.WorldToShading(query.wo);
 		if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0 || Math::CosThetaZUp(localWo) <= 0)
 		{
 			return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
@@ -259,8 +259,8 @@ public:
 			{
 				auto localWoTemp = Math::ReflectZUp(localWi);
 				auto localWiTemp = Math::ReflectZUp(localWo);
-				auto woTemp = geom.shadingToWorld * localWoTemp;
-				auto wiTemp = geom.shadingToWorld * localWiTemp;
+				auto woTemp = geom.ShadingToWorld(localWoTemp);
+				auto wiTemp = geom.ShadingToWorld(localWiTemp);
 				if (woTemp != query.wo && wiTemp != query.wi)
 				{
 					return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
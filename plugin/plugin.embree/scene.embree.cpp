@@ -54,6 +54,7 @@ public:
 	virtual boost::signals2::connection Connect_ReportBuildProgress(const std::function<void(double, bool) >& func) override { return signal_ReportBuildProgress.connect(func); }
 	virtual bool Build() override;
 	virtual bool IntersectTriangles(Ray& ray, Intersection& isect) const override;
+	virtual bool OccludedTriangles(const Ray& ray) const override;
 	virtual AABB GetAABBTriangles() const override { return aabbTris; }
 
 public:
@@ -241,6 +242,30 @@ bool EmbreeScene::IntersectTriangles( Ray& ray, Intersection& isect ) const
 	return true;
 }
 
+bool EmbreeScene::OccludedTriangles( const Ray& ray ) const
+{
+	// Convert #ray to RTCRay
+	RTCRay rtcRay;
+	rtcRay.org[0] = ray.o[0];
+	rtcRay.org[1] = ray.o[1];
+	rtcRay.org[2] = ray.o[2];
+	rtcRay.dir[0] = ray.d[0];
+	rtcRay.dir[1] = ray.d[1];
+	rtcRay.dir[2] = ray.d[2];
+	rtcRay.tnear = ray.minT;
+	rtcRay.tfar = ray.maxT;
+	rtcRay.geomID = RTC_INVALID_GEOMETRY_ID;
+	rtcRay.primID = RTC_INVALID_GEOMETRY_ID;
+	rtcRay.instID = RTC_INVALID_GEOMETRY_ID;
+	rtcRay.mask = 0xFFFFFFFF;
+	rtcRay.time = 0;
+
+	// Occlusion query
+	// #geomID is set to 0 if the ray is occluded
+	rtcOccluded(rtcScene, rtcRay);
+	return rtcRay.geomID == 0;
+}
+
 LM_COMPONENT_REGISTER_PLUGIN_IMPL(EmbreeScene, Scene);
 
 #endif
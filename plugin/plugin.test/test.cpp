@@ -46,14 +46,14 @@ public:
 
 	virtual bool SampleDirection(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
+		auto localWi = geom.WorldToShading(query.wi);
 		if ((query.type & GeneralizedBSDFType::DiffuseReflection) == 0 || Math::CosThetaZUp(localWi) <= 0)
 		{
 			return false;
 		}
 
 		auto localWo = Math::CosineSampleHemisphere(query.sample);
-		result.wo = geom.shadingToWorld * localWo;
+		result.wo = geom.ShadingToWorld(localWo);
 		result.sampledType = GeneralizedBSDFType::DiffuseReflection;
 		result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
 
@@ -62,14 +62,14 @@ public:
 
 	virtual Math::Vec3 SampleAndEstimateDirection(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
+		auto localWi = geom.WorldToShading(query.wi);
 		if ((query.type & GeneralizedBSDFType::DiffuseReflection) == 0 || Math::CosThetaZUp(localWi) <= 0)
 		{
 			return Math::Vec3();
 		}
 
 		auto localWo = Math::CosineSampleHemisphere(query.sample);
-		result.wo = geom.shadingToWorld * localWo;
+		result.wo = geom.ShadingToWorld(localWo);
 		result.sampledType = GeneralizedBSDFType::DiffuseReflection;
 		result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
 
@@ -84,14 +84,14 @@ public:
 
 	virtual bool SampleAndEstimateDirectionBidir(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleBidirResult& result) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
+		auto localWi = geom.WorldToShading(query.wi);
 		if ((query.type & GeneralizedBSDFType::DiffuseReflection) == 0 || Math::CosThetaZUp(localWi) <= 0)
 		{
 			return false;
 		}
 
 		auto localWo = Math::CosineSampleHemisphere(query.sample);
-		result.wo = geom.shadingToWorld * localWo;
+		result.wo = geom.ShadingToWorld(localWo);
 		result.sampledType = GeneralizedBSDFType::DiffuseReflection;
 		result.pdf[query.transportDir] = Math::CosineSampleHemispherePDFProjSA(localWo);
 		result.pdf[1-query.transportDir] = Math::CosineSampleHemispherePDFProjSA(localWi);
@@ -116,8 +116,8 @@ public:
 
 	virtual Math::Vec3 EvaluateDirection(const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
-		auto localWo = geom.worldToShading * query.wo;
+		auto localWi = geom.WorldToShading(query.wi);
+		auto localWo = geom.WorldToShading(query.wo);
 		if ((query.type & GeneralizedBSDFType::DiffuseReflection) == 0 || Math::CosThetaZUp(localWi) <= 0 || Math::CosThetaZUp(localWo) <= 0)
 		{
 			return Math::Vec3();
@@ -134,8 +134,8 @@ public:
 
 	virtual Math::PDFEval EvaluateDirectionPDF(const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom) const override
 	{
-		auto localWi = geom.worldToShading * query.wi;
-		auto localWo = geom.worldToShading * query.wo;
+		auto localWi = geom.WorldToShading(query.wi);
+		auto localWo = geom.WorldToShading(query.wo);
 		if ((query.type & GeneralizedBSDFType::DiffuseReflection) == 0 || Math::CosThetaZUp(localWi) <= 0 || Math::CosThetaZUp(localWo) <= 0)
 		{
 			return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
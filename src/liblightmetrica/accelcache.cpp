@@ -0,0 +1,425 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/accelcache.h>
+#include <lightmetrica/primitive.h>
+#include <lightmetrica/primitives.h>
+#include <lightmetrica/trianglemesh.h>
+#include <lightmetrica/logger.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fstream>
+
+LM_NAMESPACE_BEGIN
+
+namespace
+{
+
+	// Magic number and version of the cache file
+	// Increment the version when the layout of the cached data is changed
+	const char CacheMagic[8] = { 'L', 'M', 'A', 'C', 'C', 'E', 'L', '\0' };
+	const unsigned int CacheVersion = 2;
+
+	// Sections are aligned to the boundary
+	const size_t CacheSectionAlignment = 64;
+
+	/*
+		Header of the cache file.
+		The key of arbitrary length follows the header as the first section,
+		which is compared on read.
+	*/
+	struct CacheHeader
+	{
+		char magic[8];
+		unsigned int version;
+		unsigned int floatSize;
+		unsigned long long hash;
+		unsigned long long keySize;
+	};
+
+	LM_FORCE_INLINE size_t AlignedSize(size_t size)
+	{
+		return (size + CacheSectionAlignment - 1) / CacheSectionAlignment * CacheSectionAlignment;
+	}
+
+	/*
+		Incremental 64-bit hash.
+		Data is processed in 8-byte words for efficiency.
+	*/
+	class ContentHash
+	{
+	public:
+
+		ContentHash() : h(14695981039346656037ULL) {}
+
+	public:
+
+		void Update(const void* data, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			size_t i = 0;
+			for (; i + 8 <= size; i += 8)
+			{
+				unsigned long long word;
+				std::memcpy(&word, bytes + i, 8);
+				Mix(word);
+			}
+			unsigned long long word = 0;
+			std::memcpy(&word, bytes + i, size - i);
+			Mix(word ^ static_cast<unsigned long long>(size));
+		}
+
+		template <typename T>
+		void Update(const T& value)
+		{
+			Update(&value, sizeof(T));
+		}
+
+		unsigned long long Value() const
+		{
+			// Final avalanche
+			unsigned long long v = h;
+			v ^= v >> 33;
+			v *= 0xff51afd7ed558ccdULL;
+			v ^= v >> 33;
+			v *= 0xc4ceb9fe1a85ec53ULL;
+			v ^= v >> 33;
+			return v;
+		}
+
+	private:
+
+		LM_FORCE_INLINE void Mix(unsigned long long word)
+		{
+			h ^= word;
+			h *= 1099511628211ULL;
+			h ^= h >> 29;
+		}
+
+	private:
+
+		unsigned long long h;
+
+	};
+
+}
+
+// --------------------------------------------------------------------------------
+
+class AccelerationCache::Impl
+{
+public:
+
+	Impl();
+
+public:
+
+	bool OpenForRead(const std::string& path, const std::string& key, unsigned long long hash);
+	bool OpenForWrite(const std::string& path, const std::string& key, unsigned long long hash);
+	bool Close();
+	bool ReadSection(const void*& data, size_t& size);
+	bool WriteSection(const void* data, size_t size);
+
+private:
+
+	bool WritePadding(size_t size);
+	void InitializeHeader(CacheHeader& header, const std::string& key, unsigned long long hash) const;
+
+private:
+
+	// Reading
+	boost::interprocess::file_mapping mapping;
+	boost::interprocess::mapped_region region;
+	size_t readOffset;
+
+	// Writing
+	std::ofstream out;
+	std::string path;
+	std::string tempPath;
+
+};
+
+AccelerationCache::Impl::Impl()
+	: readOffset(0)
+{
+
+}
+
+void AccelerationCache::Impl::InitializeHeader( CacheHeader& header, const std::string& key, unsigned long long hash ) const
+{
+	std::memset(&header, 0, sizeof(CacheHeader));
+	std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+	header.version = CacheVersion;
+	header.floatSize = static_cast<unsigned int>(sizeof(Math::Float));
+	header.hash = hash;
+	header.keySize = key.size();
+}
+
+bool AccelerationCache::Impl::OpenForRead( const std::string& path, const std::string& key, unsigned long long hash )
+{
+	if (!boost::filesystem::exists(path))
+	{
+		return false;
+	}
+
+	try
+	{
+		mapping = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+		region = boost::interprocess::mapped_region(mapping, boost::interprocess::read_only);
+	}
+	catch (const boost::interprocess::interprocess_exception& e)
+	{
+		LM_LOG_WARN("Failed to map cache file '" + path + "' : " + e.what());
+		return false;
+	}
+
+	// Validate header
+	CacheHeader expected;
+	InitializeHeader(expected, key, hash);
+	if (region.get_size() < AlignedSize(sizeof(CacheHeader)) || std::memcmp(region.get_address(), &expected, sizeof(CacheHeader)) != 0)
+	{
+		LM_LOG_WARN("Invalid or outdated cache file '" + path + "'");
+		Close();
+		return false;
+	}
+
+	// Validate key
+	readOffset = AlignedSize(sizeof(CacheHeader));
+	const void* keyData;
+	size_t keySize;
+	if (!ReadSection(keyData, keySize) || keySize != key.size() || std::memcmp(keyData, key.data(), keySize) != 0)
+	{
+		LM_LOG_WARN("Invalid or outdated cache file '" + path + "'");
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool AccelerationCache::Impl::OpenForWrite( const std::string& path, const std::string& key, unsigned long long hash )
+{
+	// Create the directory if it does not exist
+	auto dir = boost::filesystem::path(path).parent_path();
+	boost::system::error_code ec;
+	if (!dir.empty() && !boost::filesystem::exists(dir))
+	{
+		boost::filesystem::create_directories(dir, ec);
+		if (ec)
+		{
+			LM_LOG_WARN("Failed to create cache directory '" + dir.string() + "'");
+			return false;
+		}
+	}
+
+	// Write to the unique temporary file so that concurrent writers never share the file
+	this->path = path;
+	tempPath = boost::filesystem::unique_path(path + ".%%%%-%%%%-%%%%-%%%%.tmp", ec).string();
+	if (ec)
+	{
+		LM_LOG_WARN("Failed to create temporary file name for '" + path + "'");
+		return false;
+	}
+
+	out.open(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		LM_LOG_WARN("Failed to open cache file '" + tempPath + "'");
+		return false;
+	}
+
+	CacheHeader header;
+	InitializeHeader(header, key, hash);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+	return WritePadding(sizeof(CacheHeader)) && WriteSection(key.data(), key.size());
+}
+
+bool AccelerationCache::Impl::Close()
+{
+	// Reading
+	region = boost::interprocess::mapped_region();
+	mapping = boost::interprocess::file_mapping();
+	readOffset = 0;
+
+	// Writing
+	if (out.is_open())
+	{
+		// Incomplete file is discarded if some write operation has failed
+		out.close();
+		if (!out)
+		{
+			LM_LOG_WARN("Failed to write cache file '" + tempPath + "'");
+			boost::system::error_code ec;
+			boost::filesystem::remove(tempPath, ec);
+			return false;
+		}
+
+		// Replace the cache file
+		// Other processes never see the incomplete file
+		boost::system::error_code ec;
+		boost::filesystem::rename(tempPath, path, ec);
+		if (ec)
+		{
+			LM_LOG_WARN("Failed to rename cache file '" + tempPath + "' to '" + path + "'");
+			boost::filesystem::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool AccelerationCache::Impl::ReadSection( const void*& data, size_t& size )
+{
+	const auto* base = static_cast<const char*>(region.get_address());
+	const size_t regionSize = region.get_size();
+	if (base == nullptr || readOffset + sizeof(unsigned long long) > regionSize)
+	{
+		return false;
+	}
+
+	// Size of the section
+	unsigned long long sectionSize;
+	std::memcpy(&sectionSize, base + readOffset, sizeof(unsigned long long));
+	readOffset += AlignedSize(sizeof(unsigned long long));
+	if (readOffset + sectionSize > regionSize)
+	{
+		return false;
+	}
+
+	// Data
+	data = base + readOffset;
+	size = static_cast<size_t>(sectionSize);
+	readOffset += AlignedSize(size);
+
+	return true;
+}
+
+bool AccelerationCache::Impl::WriteSection( const void* data, size_t size )
+{
+	if (!out.is_open())
+	{
+		return false;
+	}
+
+	unsigned long long sectionSize = size;
+	out.write(reinterpret_cast<const char*>(&sectionSize), sizeof(unsigned long long));
+	if (!WritePadding(sizeof(unsigned long long)))
+	{
+		return false;
+	}
+
+	if (size > 0)
+	{
+		out.write(static_cast<const char*>(data), size);
+	}
+
+	return WritePadding(size);
+}
+
+bool AccelerationCache::Impl::WritePadding( size_t size )
+{
+	static const char zeros[CacheSectionAlignment] = {};
+	out.write(zeros, AlignedSize(size) - size);
+	return !out.fail();
+}
+
+// --------------------------------------------------------------------------------
+
+AccelerationCache::AccelerationCache()
+	: p(new Impl)
+{
+
+}
+
+AccelerationCache::~AccelerationCache()
+{
+	LM_SAFE_DELETE(p);
+}
+
+unsigned long long AccelerationCache::ComputeHash( const Primitives& primitives )
+{
+	ContentHash hash;
+	hash.Update(primitives.NumPrimitives());
+	for (int i = 0; i < primitives.NumPrimitives(); i++)
+	{
+		const auto* primitive = primitives.PrimitiveByIndex(i);
+		hash.Update(primitive->transform);
+
+		const auto* mesh = primitive->mesh;
+		if (mesh)
+		{
+			hash.Update(mesh->NumVertices());
+			hash.Update(mesh->NumFaces());
+			// Note that #NumVertices and #NumFaces returns the number of elements in the arrays
+			hash.Update(mesh->Positions(), sizeof(Math::Float) * mesh->NumVertices());
+			hash.Update(mesh->Faces(), sizeof(unsigned int) * mesh->NumFaces());
+		}
+		else
+		{
+			hash.Update(-1);
+		}
+	}
+
+	return hash.Value();
+}
+
+std::string AccelerationCache::CachePath( const std::string& dir, const std::string& key, unsigned long long hash )
+{
+	return (boost::filesystem::path(dir) / boost::str(boost::format("%s_%016x.cache") % key % hash)).string();
+}
+
+bool AccelerationCache::ValidTriangle( const Primitives& primitives, int primitiveIndex, int faceIndex )
+{
+	if (primitiveIndex < 0 || primitiveIndex >= primitives.NumPrimitives())
+	{
+		return false;
+	}
+
+	const auto* mesh = primitives.PrimitiveByIndex(primitiveIndex)->mesh;
+	return mesh != nullptr && faceIndex >= 0 && faceIndex < mesh->NumFaces() / 3;
+}
+
+bool AccelerationCache::OpenForRead( const std::string& path, const std::string& key, unsigned long long hash )
+{
+	return p->OpenForRead(path, key, hash);
+}
+
+bool AccelerationCache::OpenForWrite( const std::string& path, const std::string& key, unsigned long long hash )
+{
+	return p->OpenForWrite(path, key, hash);
+}
+
+bool AccelerationCache::Close()
+{
+	return p->Close();
+}
+
+bool AccelerationCache::ReadSection( const void*& data, size_t& size )
+{
+	return p->ReadSection(data, size);
+}
+
+bool AccelerationCache::WriteSection( const void* data, size_t size )
+{
+	return p->WriteSection(data, size);
+}
+
+LM_NAMESPACE_END
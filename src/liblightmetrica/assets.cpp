@@ -23,7 +23,11 @@
 #include <lightmetrica/confignode.h>
 #include <lightmetrica/logger.h>
 #include <lightmetrica/pugihelper.h>
+#include <lightmetrica/threadpool.h>
+#include <lightmetrica/math.basic.h>
 #include <thread>
+#include <mutex>
+#include <atomic>
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/topological_sort.hpp>
 
@@ -74,6 +78,7 @@ private:
 	std::unordered_map<std::string, AssetInterfaceInfo> interfaceInfo;		// Registered interfaces
 	std::vector<Asset*> assetInstances;										// Asset instances
 	std::vector<ConfigNode> assetInstanceNodes;								// Config nodes for corresponding assets
+	std::vector<int> assetInstanceLevels;									// Dependency levels of the interfaces of corresponding assets
 	boost::unordered_map<std::string, size_t> assetIndexMap;				// For search query
 
 };
@@ -95,6 +100,7 @@ bool AssetsImpl::Load( const ConfigNode& node )
 
 	std::vector<std::string> interfaces;
 	std::deque<size_t> orderedIndices;
+	std::vector<int> interfaceLevels;
 	{
 		LM_LOG_INFO("Stage : Resolving dependency");
 
@@ -138,6 +144,17 @@ bool AssetsImpl::Load( const ConfigNode& node )
 			return false;
 		}
 
+		// Dependency level of the interfaces, i.e., the length of the longest path to the interface.
+		// The assets of the interfaces in the same level are independent of each other.
+		interfaceLevels.assign(interfaces.size(), 0);
+		for (size_t i : orderedIndices)
+		{
+			for (auto& dependency : interfaceInfo[interfaces[i]].dependencies)
+			{
+				interfaceLevels[i] = Math::Max(interfaceLevels[i], interfaceLevels[interfaceNameIndexMap[dependency]] + 1);
+			}
+		}
+
 #ifdef LM_DEBUG_MODE
 		{
 			LM_LOG_DEBUG("Resolved dependency");
@@ -222,6 +239,7 @@ bool AssetsImpl::Load( const ConfigNode& node )
 					assetIndexMap[idAttribute] = assetInstances.size();
 					assetInstances.push_back(asset);
 					assetInstanceNodes.push_back(assetNode);
+					assetInstanceLevels.push_back(interfaceLevels[interfaceIndex]);
 				}
 			}
 		}
@@ -233,24 +251,70 @@ bool AssetsImpl::Load( const ConfigNode& node )
 		LM_LOG_INFO("Stage : Loading assets");
 		LM_LOG_INDENTER();
 
-		signal_ReportProgress(0, false);
+		// 'num_threads' (optional)
+		int numThreads;
+		node.ChildValueOrDefault("num_threads", static_cast<int>(std::thread::hardware_concurrency()), numThreads);
+		if (numThreads <= 0)
+		{
+			numThreads = Math::Max(1, static_cast<int>(std::thread::hardware_concurrency()) + numThreads);
+		}
+		LM_LOG_INFO("Number of threads : " + std::to_string(numThreads));
 
+		// Group the assets by the dependency levels
+		std::vector<std::vector<size_t>> levels;
 		for (size_t i = 0; i < assetInstances.size(); i++)
 		{
-			auto* asset = assetInstances[i];
+			const auto level = static_cast<size_t>(assetInstanceLevels[i]);
+			if (levels.size() <= level)
+			{
+				levels.resize(level + 1);
+			}
+			levels[level].push_back(i);
+		}
 
-			LM_LOG_INFO(boost::str(boost::format("Loading asset (id : '%s', type : '%s')") % asset->ID() % asset->ComponentInterfaceTypeName()));
-			LM_LOG_INDENTER();
+		signal_ReportProgress(0, false);
 
-			// Load
-			if (!asset->Load(assetInstanceNodes[i], *this))
+		// Load the assets level by level.
+		// The assets in a level are loaded in parallel after all assets in the previous levels are loaded.
+		ThreadPool pool(numThreads);
+		std::mutex progressMutex;
+		size_t numLoadedAssets = 0;
+		std::atomic<bool> failed(false);
+		for (const auto& level : levels)
+		{
+			const bool result = pool.ParallelFor(static_cast<long long>(level.size()), 1, [&](int /*threadId*/, long long begin, long long end)
 			{
-				LM_LOG_ERROR("Failed to load the asset.");
+				for (long long i = begin; i < end; i++)
+				{
+					auto* asset = assetInstances[level[i]];
+
+					// Indentation of the logger is shared among threads and never changed here
+					LM_LOG_INFO(boost::str(boost::format("Loading asset (id : '%s', type : '%s')") % asset->ID() % asset->ComponentInterfaceTypeName()));
+
+					// Load
+					if (!asset->Load(assetInstanceNodes[level[i]], *this))
+					{
+						LM_LOG_ERROR(boost::str(boost::format("Failed to load the asset (id : '%s').") % asset->ID()));
+						failed = true;
+						pool.Cancel();
+						return;
+					}
+
+					// Update progress
+					std::unique_lock<std::mutex> lock(progressMutex);
+					numLoadedAssets++;
+					signal_ReportProgress(static_cast<double>(numLoadedAssets) / assetInstances.size(), numLoadedAssets == assetInstances.size());
+				}
+			});
+
+			if (!result || failed)
+			{
+				if (!result)
+				{
+					LM_LOG_ERROR("Failed to load the assets : an exception is thrown.");
+				}
 				return false;
 			}
-
-			// Update progress
-			signal_ReportProgress(static_cast<double>(i+1) / assetInstances.size(), i+1 == assetInstances.size());
 		}
 
 		LM_LOG_INFO("Successfully loaded " + std::to_string(assetInstances.size()) + " assets");
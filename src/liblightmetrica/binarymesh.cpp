@@ -0,0 +1,448 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/binarymesh.h>
+#include <lightmetrica/trianglemesh.h>
+#include <lightmetrica/logger.h>
+#include <lightmetrica/confignode.h>
+#include <lightmetrica/config.h>
+#include <lightmetrica/pathutils.h>
+#include <lightmetrica/math.cast.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fstream>
+
+LM_NAMESPACE_BEGIN
+
+namespace
+{
+
+	// Magic number and version of the binary mesh file
+	// Increment the version when the layout of the file is changed
+	const char BinaryMeshMagic[8] = { 'L', 'M', 'M', 'E', 'S', 'H', '\0', '\0' };
+	const unsigned int BinaryMeshVersion = 1;
+
+	// Arrays are aligned to the boundary
+	const size_t BinaryMeshAlignment = 64;
+
+	// Type of the floating-point values written to the file
+	typedef std::conditional<sizeof(Math::Float) == sizeof(float), float, double>::type StoredFloat;
+
+	/*
+		Header of the binary mesh file.
+		Number of elements follows the convention of TriangleMesh,
+		e.g., #numPositions is three times the number of vertices.
+		Offsets are in bytes from the beginning of the file.
+	*/
+	struct BinaryMeshHeader
+	{
+		char magic[8];
+		unsigned int version;
+		unsigned int floatSize;
+		unsigned long long numPositions;
+		unsigned long long numNormals;
+		unsigned long long numTexCoords;
+		unsigned long long numFaces;
+		unsigned long long positionsOffset;
+		unsigned long long normalsOffset;
+		unsigned long long texcoordsOffset;
+		unsigned long long facesOffset;
+	};
+
+	LM_FORCE_INLINE unsigned long long AlignedSize(unsigned long long size)
+	{
+		return (size + BinaryMeshAlignment - 1) / BinaryMeshAlignment * BinaryMeshAlignment;
+	}
+
+	/*
+		Compute the offsets of the arrays from the number of elements and the size of floating-point values.
+		The arrays are placed contiguously after the header.
+		\param header Header of the binary mesh file.
+		\return Size of the file.
+	*/
+	unsigned long long LayoutArrays(BinaryMeshHeader& header)
+	{
+		header.positionsOffset = AlignedSize(sizeof(BinaryMeshHeader));
+		header.normalsOffset = header.positionsOffset + AlignedSize(header.floatSize * header.numPositions);
+		header.texcoordsOffset = header.normalsOffset + AlignedSize(header.floatSize * header.numNormals);
+		header.facesOffset = header.texcoordsOffset + AlignedSize(header.floatSize * header.numTexCoords);
+		return header.facesOffset + AlignedSize(sizeof(unsigned int) * header.numFaces);
+	}
+
+	bool WritePadding(std::ofstream& out, unsigned long long size)
+	{
+		static const char zeros[BinaryMeshAlignment] = {};
+		out.write(zeros, static_cast<std::streamsize>(AlignedSize(size) - size));
+		return !out.fail();
+	}
+
+	bool WriteFloatArray(std::ofstream& out, const Math::Float* data, size_t n)
+	{
+		if (n == 0)
+		{
+			return true;
+		}
+
+		if (std::is_same<StoredFloat, Math::Float>::value)
+		{
+			out.write(reinterpret_cast<const char*>(data), sizeof(StoredFloat) * n);
+		}
+		else
+		{
+			// Convert the values in chunks
+			const size_t ChunkSize = 1<<16;
+			std::vector<StoredFloat> chunk;
+			for (size_t i = 0; i < n; i += ChunkSize)
+			{
+				const size_t m = Math::Min(ChunkSize, n - i);
+				chunk.resize(m);
+				for (size_t j = 0; j < m; j++)
+				{
+					chunk[j] = Math::Cast<StoredFloat>(data[i + j]);
+				}
+				out.write(reinterpret_cast<const char*>(&chunk[0]), sizeof(StoredFloat) * m);
+			}
+		}
+
+		return WritePadding(out, sizeof(StoredFloat) * n);
+	}
+
+	template <typename T>
+	void ConvertFloatArray(const void* data, size_t n, std::vector<Math::Float>& result)
+	{
+		const auto* values = static_cast<const T*>(data);
+		result.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			result[i] = Math::Float(values[i]);
+		}
+	}
+
+}
+
+// --------------------------------------------------------------------------------
+
+/*!
+	Binary mesh.
+	Implements an triangle mesh loaded from the binary mesh file (see BinaryMeshUtils).
+	The file is memory-mapped and the arrays are directly used without copies
+	if the precision of the stored values matches with Math::Float,
+	otherwise the values are converted.
+*/
+class BinaryMesh final : public TriangleMesh
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("binary");
+
+public:
+
+	BinaryMesh();
+	virtual ~BinaryMesh() override {}
+
+public:
+
+	virtual bool Load(const ConfigNode& node, const Assets& assets) override;
+
+public:
+
+	virtual int NumVertices() const override				{ return numPositions; }
+	virtual int NumFaces() const override					{ return numFaces; }
+	virtual const Math::Float* Positions() const override	{ return positions; }
+	virtual const Math::Float* Normals() const override		{ return normals; }
+	virtual const Math::Float* TexCoords() const override	{ return texcoords; }
+	virtual const unsigned int* Faces() const override		{ return faces; }
+
+private:
+
+	void Clear();
+	const Math::Float* FloatArray(const BinaryMeshHeader& header, unsigned long long offset, unsigned long long n, std::vector<Math::Float>& converted) const;
+
+private:
+
+	boost::interprocess::file_mapping mapping;
+	boost::interprocess::mapped_region region;
+
+	int numPositions;
+	int numFaces;
+	const Math::Float* positions;
+	const Math::Float* normals;
+	const Math::Float* texcoords;
+	const unsigned int* faces;
+
+	// Converted arrays used if the precision of the file does not match with Math::Float
+	std::vector<Math::Float> convertedPositions;
+	std::vector<Math::Float> convertedNormals;
+	std::vector<Math::Float> convertedTexCoords;
+
+};
+
+BinaryMesh::BinaryMesh()
+{
+	Clear();
+}
+
+void BinaryMesh::Clear()
+{
+	region = boost::interprocess::mapped_region();
+	mapping = boost::interprocess::file_mapping();
+	numPositions = 0;
+	numFaces = 0;
+	positions = nullptr;
+	normals = nullptr;
+	texcoords = nullptr;
+	faces = nullptr;
+	convertedPositions.clear();
+	convertedNormals.clear();
+	convertedTexCoords.clear();
+}
+
+bool BinaryMesh::Load( const ConfigNode& node, const Assets& /*assets*/ )
+{
+	Clear();
+
+	// 'path' required
+	std::string path;
+	if (!node.ChildValue("path", path))
+	{
+		return false;
+	}
+
+	// Resolve the path
+	path = PathUtils::ResolveAssetPath(*node.GetConfig(), path);
+
+	// Map the file
+	try
+	{
+		mapping = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+		region = boost::interprocess::mapped_region(mapping, boost::interprocess::read_only);
+	}
+	catch (const boost::interprocess::interprocess_exception& e)
+	{
+		LM_LOG_ERROR("Failed to map binary mesh file '" + path + "' : " + e.what());
+		Clear();
+		return false;
+	}
+
+	// Validate header
+	const auto regionSize = static_cast<unsigned long long>(region.get_size());
+	if (regionSize < sizeof(BinaryMeshHeader))
+	{
+		LM_LOG_ERROR("Invalid binary mesh file '" + path + "'");
+		Clear();
+		return false;
+	}
+
+	BinaryMeshHeader header;
+	std::memcpy(&header, region.get_address(), sizeof(BinaryMeshHeader));
+	if (std::memcmp(header.magic, BinaryMeshMagic, sizeof(BinaryMeshMagic)) != 0)
+	{
+		LM_LOG_ERROR("Invalid binary mesh file '" + path + "'");
+		Clear();
+		return false;
+	}
+	if (header.version != BinaryMeshVersion)
+	{
+		LM_LOG_ERROR(boost::str(boost::format("Unsupported binary mesh version %d (expected %d)") % header.version % BinaryMeshVersion));
+		Clear();
+		return false;
+	}
+	if (header.floatSize != sizeof(float) && header.floatSize != sizeof(double))
+	{
+		LM_LOG_ERROR(boost::str(boost::format("Invalid size of floating-point values : %d") % header.floatSize));
+		Clear();
+		return false;
+	}
+
+	// Validate the number of elements
+	// Note that the limits also ensure the computation of the layout never overflows
+	if (header.numPositions > static_cast<unsigned long long>(std::numeric_limits<int>::max()) ||
+		header.numFaces > static_cast<unsigned long long>(std::numeric_limits<int>::max()))
+	{
+		LM_LOG_ERROR("Too many vertices or faces in binary mesh file '" + path + "'");
+		Clear();
+		return false;
+	}
+
+	// 'positions', 'normals', and 'faces' are required
+	if (header.numPositions == 0 || header.numNormals != header.numPositions || header.numFaces == 0)
+	{
+		LM_LOG_ERROR("Missing positions, normals, or faces in binary mesh file '" + path + "'");
+		Clear();
+		return false;
+	}
+
+	if (header.numPositions % 3 != 0 ||
+		header.numFaces % 3 != 0 ||
+		(header.numTexCoords != 0 && header.numTexCoords != header.numPositions / 3 * 2))
+	{
+		LM_LOG_ERROR("Inconsistent number of elements in binary mesh file '" + path + "'");
+		Clear();
+		return false;
+	}
+
+	// Validate arrays
+	// The offsets and the size of the file must match with the layout written by BinaryMeshUtils::Save,
+	// which rejects truncated files.
+	BinaryMeshHeader expected = header;
+	const auto expectedSize = LayoutArrays(expected);
+	if (header.positionsOffset != expected.positionsOffset ||
+		header.normalsOffset != expected.normalsOffset ||
+		header.texcoordsOffset != expected.texcoordsOffset ||
+		header.facesOffset != expected.facesOffset ||
+		regionSize != expectedSize)
+	{
+		LM_LOG_ERROR("Invalid array in binary mesh file '" + path + "'");
+		Clear();
+		return false;
+	}
+
+	// Validate faces
+	const auto* mappedFaces = reinterpret_cast<const unsigned int*>(static_cast<const char*>(region.get_address()) + header.facesOffset);
+	const auto numVertices = static_cast<unsigned int>(header.numPositions / 3);
+	for (unsigned long long i = 0; i < header.numFaces; i++)
+	{
+		if (mappedFaces[i] >= numVertices)
+		{
+			LM_LOG_ERROR(boost::str(boost::format("Invalid vertex index %d in binary mesh file '%s'") % mappedFaces[i] % path));
+			Clear();
+			return false;
+		}
+	}
+
+	if (header.floatSize != sizeof(Math::Float) || !std::is_floating_point<Math::Float>::value)
+	{
+		LM_LOG_WARN(boost::str(boost::format("Converting %d-byte floating-point values in binary mesh file") % header.floatSize));
+	}
+
+	numPositions = static_cast<int>(header.numPositions);
+	numFaces = static_cast<int>(header.numFaces);
+	positions = FloatArray(header, header.positionsOffset, header.numPositions, convertedPositions);
+	normals = FloatArray(header, header.normalsOffset, header.numNormals, convertedNormals);
+	texcoords = FloatArray(header, header.texcoordsOffset, header.numTexCoords, convertedTexCoords);
+	faces = mappedFaces;
+
+	return true;
+}
+
+const Math::Float* BinaryMesh::FloatArray( const BinaryMeshHeader& header, unsigned long long offset, unsigned long long n, std::vector<Math::Float>& converted ) const
+{
+	if (n == 0)
+	{
+		return nullptr;
+	}
+
+	const auto* data = static_cast<const char*>(region.get_address()) + offset;
+	if (header.floatSize == sizeof(Math::Float) && std::is_floating_point<Math::Float>::value)
+	{
+		// Use the mapped array as it is
+		return reinterpret_cast<const Math::Float*>(data);
+	}
+
+	if (header.floatSize == sizeof(float))
+	{
+		ConvertFloatArray<float>(data, static_cast<size_t>(n), converted);
+	}
+	else
+	{
+		ConvertFloatArray<double>(data, static_cast<size_t>(n), converted);
+	}
+
+	return &converted[0];
+}
+
+LM_COMPONENT_REGISTER_IMPL(BinaryMesh, TriangleMesh);
+
+// --------------------------------------------------------------------------------
+
+bool BinaryMeshUtils::Save( const TriangleMesh& mesh, const std::string& path )
+{
+	const auto numPositions = static_cast<unsigned long long>(mesh.NumVertices());
+	const auto numFaces = static_cast<unsigned long long>(mesh.NumFaces());
+	const auto numTexCoords = mesh.TexCoords() ? numPositions / 3 * 2 : 0;
+	if (numPositions == 0 || mesh.Positions() == nullptr || mesh.Normals() == nullptr || numFaces == 0 || mesh.Faces() == nullptr)
+	{
+		LM_LOG_ERROR("Missing positions, normals, or faces in the mesh '" + mesh.ID() + "'");
+		return false;
+	}
+
+	// Header
+	BinaryMeshHeader header;
+	std::memset(&header, 0, sizeof(BinaryMeshHeader));
+	std::memcpy(header.magic, BinaryMeshMagic, sizeof(BinaryMeshMagic));
+	header.version = BinaryMeshVersion;
+	header.floatSize = static_cast<unsigned int>(sizeof(StoredFloat));
+	header.numPositions = numPositions;
+	header.numNormals = numPositions;
+	header.numTexCoords = numTexCoords;
+	header.numFaces = numFaces;
+	LayoutArrays(header);
+
+	// Write to the temporary file and replace the file after all data is written
+	// The name of the temporary file is unique so that concurrent writers never share the file
+	boost::system::error_code ec;
+	const auto tempPath = boost::filesystem::unique_path(path + ".%%%%-%%%%-%%%%-%%%%.tmp", ec).string();
+	if (ec)
+	{
+		LM_LOG_ERROR("Failed to create temporary file name for '" + path + "'");
+		return false;
+	}
+
+	{
+		std::ofstream out(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			LM_LOG_ERROR("Failed to open file '" + tempPath + "'");
+			return false;
+		}
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(BinaryMeshHeader));
+		bool result =
+			WritePadding(out, sizeof(BinaryMeshHeader)) &&
+			WriteFloatArray(out, mesh.Positions(), static_cast<size_t>(numPositions)) &&
+			WriteFloatArray(out, mesh.Normals(), static_cast<size_t>(numPositions)) &&
+			WriteFloatArray(out, mesh.TexCoords(), static_cast<size_t>(numTexCoords));
+		if (result)
+		{
+			out.write(reinterpret_cast<const char*>(mesh.Faces()), sizeof(unsigned int) * numFaces);
+			result = WritePadding(out, sizeof(unsigned int) * numFaces);
+		}
+
+		out.close();
+		if (!result || !out)
+		{
+			LM_LOG_ERROR("Failed to write file '" + tempPath + "'");
+			boost::filesystem::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	boost::filesystem::rename(tempPath, path, ec);
+	if (ec)
+	{
+		LM_LOG_ERROR("Failed to rename file '" + tempPath + "' to '" + path + "'");
+		boost::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	return true;
+}
+
+LM_NAMESPACE_END
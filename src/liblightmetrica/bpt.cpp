@@ -126,7 +126,7 @@ public:
 		, subpathL(TransportDirection::LE)
 		, subpathE(TransportDirection::EL)
 	{
-
+		subpathL.evaluateRecursiveMIS = subpathE.evaluateRecursiveMIS = renderer.misWeight->RequiresRecursiveQuantities();
 	}
 
 private:
@@ -258,8 +258,7 @@ Math::Vec3 BPTFullPath::EvaluateUnweightContribution( const Scene& scene, Math::
 			visible = scene.MainCamera()->RayToRasterPosition(vE->geom.p, -shadowRay.d, rasterPosition);
 		}
 
-		Intersection shadowIsect;
-		if (visible && !scene.Intersect(shadowRay, shadowIsect))
+		if (visible && !scene.Occluded(shadowRay))
 		{			
 			GeneralizedBSDFEvaluateQuery bsdfEQ;
 			bsdfEQ.type = GeneralizedBSDFType::NonDelta;
@@ -0,0 +1,146 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/bpt.mis.h>
+#include <lightmetrica/bpt.fullpath.h>
+#include <lightmetrica/bpt.subpath.h>
+#include <lightmetrica/generalizedbsdf.h>
+#include <lightmetrica/renderutils.h>
+#include <lightmetrica/confignode.h>
+#include <lightmetrica/logger.h>
+
+LM_NAMESPACE_BEGIN
+
+/*!
+	Power heuristics MIS weight (recursive version).
+	Implements power heuristics with the recursive formulation
+	similar to the one in [Georgiev et al. 2012] (dVC).
+	The partial sums of the PDF ratios are cached in the path vertices
+	when the sub-paths are sampled (see BPTSubpath::Sample),
+	so the weight is evaluated in constant time for each full-path.
+	The weight is same as the one of 'power' weight with the exponent 2.
+	Only the exponent 2 is supported because the exponent is baked
+	into the partial sums computed in BPTSubpath::Sample.
+*/
+class BPTPowerHeuristicsRecursiveMISWeight final : public BPTMISWeight
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("powerrecursive");
+
+public:
+
+	virtual bool Configure(const ConfigNode& node, const Assets& assets) override;
+	virtual BPTMISWeight* Clone() const override;
+	virtual Math::Float Evaluate(const BPTFullPath& fullPath) const override;
+	virtual bool RequiresRecursiveQuantities() const override { return true; }
+
+private:
+
+	/*!
+		Evaluate sum of squared PDF ratios for a sub-path.
+		Computes \sum_i (p_i/p_s)^2 for the strategies sampling
+		more vertices by the other sub-path than the strategy p_s.
+		\param vs Number of vertices in the sub-path (#s or #t).
+		\param subpath Sub-path.
+		\param pdfDRev PDF evaluation for the sub-path endpoint toward the previous vertex.
+		\param pdfARev PDF of the sub-path endpoint sampled by the other sub-path in area measure.
+		\return Sum of squared PDF ratios.
+	*/
+	Math::Float EvaluateSubpathPDFRatioSum(int vs, const BPTSubpath& subpath, const Math::PDFEval& pdfDRev, const Math::Float& pdfARev) const;
+
+};
+
+bool BPTPowerHeuristicsRecursiveMISWeight::Configure( const ConfigNode& node, const Assets& assets )
+{
+	// Same parameter as the 'power' weight
+	Math::Float betaCoeff;
+	node.ChildValueOrDefault("beta_coeff", Math::Float(2), betaCoeff);
+	if (betaCoeff != Math::Float(2))
+	{
+		LM_LOG_ERROR(boost::str(boost::format("Unsupported 'beta_coeff' = %f (only 2 is supported)") % betaCoeff));
+		return false;
+	}
+
+	return true;
+}
+
+BPTMISWeight* BPTPowerHeuristicsRecursiveMISWeight::Clone() const
+{
+	return new BPTPowerHeuristicsRecursiveMISWeight;
+}
+
+Math::Float BPTPowerHeuristicsRecursiveMISWeight::Evaluate( const BPTFullPath& fullPath ) const
+{
+	const int s = fullPath.s;
+	const int t = fullPath.t;
+	const auto* y = s > 0 ? fullPath.lightSubpath.vertices[s-1] : nullptr;
+	const auto* z = t > 0 ? fullPath.eyeSubpath.vertices[t-1] : nullptr;
+
+	// p_s is zero if one of the vertices has zero PDF
+	if ((y && y->misPdfAIsZero) || (z && z->misPdfAIsZero))
+	{
+		return Math::Float(0);
+	}
+
+	// p_s is zero if one of the connection vertices is degenerated
+	if (y && z && ((y->bsdf->BSDFTypes() & GeneralizedBSDFType::NonDelta) == 0 || (z->bsdf->BSDFTypes() & GeneralizedBSDFType::NonDelta) == 0))
+	{
+		return Math::Float(0);
+	}
+
+	// Inverse of the weight 1/w_{s,t}. Initial weight is p_s/p_s = 1
+	Math::Float invWeight(1);
+
+	// PDFs of the connection vertices sampled by the other sub-path in area measure.
+	// If one of the sub-paths is empty, the endpoint of the other sub-path is sampled as an emitter.
+	if (y)
+	{
+		auto pdfARev = z ? fullPath.pdfDE[TransportDirection::EL].v * RenderUtils::GeneralizedGeometryTerm(z->geom, y->geom) : y->pdfP.v;
+		invWeight += EvaluateSubpathPDFRatioSum(s, fullPath.lightSubpath, fullPath.pdfDL[TransportDirection::EL], pdfARev);
+	}
+	if (z)
+	{
+		auto pdfARev = y ? fullPath.pdfDL[TransportDirection::LE].v * RenderUtils::GeneralizedGeometryTerm(y->geom, z->geom) : z->pdfP.v;
+		invWeight += EvaluateSubpathPDFRatioSum(t, fullPath.eyeSubpath, fullPath.pdfDE[TransportDirection::LE], pdfARev);
+	}
+
+	return Math::Float(1) / invWeight;
+}
+
+Math::Float BPTPowerHeuristicsRecursiveMISWeight::EvaluateSubpathPDFRatioSum( int vs, const BPTSubpath& subpath, const Math::PDFEval& pdfDRev, const Math::Float& pdfARev ) const
+{
+	const auto* v = subpath.vertices[vs-1];
+
+	// Sum for the strategies sampling the previous vertices by the other sub-path
+	// The PDF evaluation toward the previous vertex is invalid if #vs = 1
+	Math::Float prevSum(0);
+	if (vs > 1)
+	{
+		prevSum = pdfDRev.v * pdfDRev.v * v->misDVC;
+	}
+
+	auto ratio = pdfARev / v->misPdfA;
+	return ratio * ratio * ((v->misConnectible ? Math::Float(1) : Math::Float(0)) + prevSum);
+}
+
+LM_COMPONENT_REGISTER_IMPL(BPTPowerHeuristicsRecursiveMISWeight, BPTMISWeight);
+
+LM_NAMESPACE_END
@@ -20,10 +20,18 @@
 #include "pch.h"
 #include <lightmetrica/bpt.subpath.h>
 #include <lightmetrica/bpt.pool.h>
-#include <lightmetrica/align.h>
+#include <lightmetrica/pool.h>
+#include <type_traits>
 
 LM_NAMESPACE_BEGIN
 
+/*
+	Path vertices are constructed in a memory arena.
+	Since #BPTPathVertex does not own any resources,
+	the vertices are released in constant time without calling the destructors.
+*/
+static_assert(std::is_trivially_destructible<BPTPathVertex>::value, "BPTPathVertex must be trivially destructible because the destructors are not called");
+
 class BPTPathVertexPool::Impl
 {
 public:
@@ -34,19 +42,17 @@ public:
 
 	BPTPathVertex* Construct()
 	{
-		pool.push_back(new BPTPathVertex);
-		return pool.back();
+		return arena.Construct<BPTPathVertex>();
 	}
 
 	void Release()
 	{
-		for (auto* v : pool) { LM_SAFE_DELETE(v); }
-		pool.clear();
+		arena.Reset();
 	}
 
 private:
 
-	std::vector<BPTPathVertex*> pool;
+	MemoryArena arena;
 
 };
 
@@ -32,6 +32,7 @@
 #include <lightmetrica/ray.h>
 #include <lightmetrica/intersection.h>
 #include <lightmetrica/primitive.h>
+#include <lightmetrica/renderutils.h>
 
 LM_NAMESPACE_BEGIN
 
@@ -118,6 +119,7 @@ void BPTPathVertex::DebugPrint() const
 
 BPTSubpath::BPTSubpath( TransportDirection transportDir )
 	: transportDir(transportDir)
+	, evaluateRecursiveMIS(true)
 {
 
 }
@@ -207,6 +209,17 @@ void BPTSubpath::Sample( const Scene& scene, Sampler& sampler, BPTPathVertexPool
 	// Number of vertices is always greater than 1
 	v->pdfRR = Math::PDFEval(Math::Float(1), Math::ProbabilityMeasure::Discrete);
 
+	// ## Quantities for recursive MIS weights
+	// The strategy sampling the endpoint by the other sub-path is possible
+	// only if the endpoint is an area light or an area camera
+	if (evaluateRecursiveMIS)
+	{
+		v->misPdfA = v->pdfP.v;
+		v->misPdfAIsZero = Math::IsZero(v->misPdfA);
+		v->misDVC = Math::Float(0);
+		v->misConnectible = transportDir == TransportDirection::LE ? v->areaL != nullptr : v->areaE != nullptr;
+	}
+
 	vertices.push_back(v);
 
 	// --------------------------------------------------------------------------------
@@ -266,8 +279,12 @@ void BPTSubpath::Sample( const Scene& scene, Sampler& sampler, BPTPathVertexPool
 		if (v->emitter)
 		{
 			// Calculate #pdfP for intersected emitter
+			// Selection PDF is multiplied only for lights
 			v->pdfP = v->emitter->EvaluatePositionPDF(v->geom);
-			v->pdfP.v *= scene.LightSelectionPdf().v;
+			if (v->areaL)
+			{
+				v->pdfP.v *= scene.LightSelectionPdf(v->areaL).v;
+			}
 		}
 		else
 		{
@@ -276,6 +293,38 @@ void BPTSubpath::Sample( const Scene& scene, Sampler& sampler, BPTPathVertexPool
 
 		// --------------------------------------------------------------------------------
 
+		// ## Quantities for recursive MIS weights
+		// For the vertex v_k, #misDVC stores
+		//   (G(v_k\leftrightarrow v_{k-1}) / p_A(v_{k-1}))^2 * (c_{k-1} + S_{k-2}),
+		// where S_{k-2} is the sum of squared ratios p_i/p_{k-1} for the strategies which sample
+		// the vertices v_0 to v_{k-2} with the other sub-path, and c_{k-1} is 1 if the strategy
+		// sampling v_{k-1} by the other sub-path is possible.
+		// Then S_{k-1} = p_{\sigma^\bot}(v_k\to v_{k-1})^2 * #misDVC.
+		if (evaluateRecursiveMIS)
+		{
+			auto G = RenderUtils::GeneralizedGeometryTerm(pv->geom, v->geom);
+			v->misPdfA = pv->pdfD[transportDir].v * G;
+			v->misPdfAIsZero = pv->misPdfAIsZero || Math::IsZero(v->misPdfA);
+			v->misConnectible =
+				(pv->bsdf->BSDFTypes() & GeneralizedBSDFType::NonDelta) != 0 &&
+				(v->bsdf->BSDFTypes() & GeneralizedBSDFType::NonDelta) != 0;
+
+			if (pv->misPdfAIsZero)
+			{
+				// The full-paths containing the vertex have zero PDF (weights are not used)
+				v->misDVC = Math::Float(0);
+			}
+			else
+			{
+				auto pvPdfDRev = pv->pdfD[1-transportDir].v;
+				auto prevSum = vertices.size() > 1 ? pvPdfDRev * pvPdfDRev * pv->misDVC : Math::Float(0);
+				auto ratio = G / pv->misPdfA;
+				v->misDVC = ratio * ratio * ((pv->misConnectible ? Math::Float(1) : Math::Float(0)) + prevSum);
+			}
+		}
+
+		// --------------------------------------------------------------------------------
+
 		// ## Path termination
 
 		// Apply RR
@@ -0,0 +1,212 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/texture.h>
+#include <lightmetrica/bitmaptexture.h>
+#include <lightmetrica/texturecache.h>
+#include <lightmetrica/logger.h>
+#include <lightmetrica/confignode.h>
+#include <lightmetrica/pathutils.h>
+#include <lightmetrica/bitmap.h>
+#include <lightmetrica/math.cast.h>
+#include <boost/functional/hash.hpp>
+
+LM_NAMESPACE_BEGIN
+
+/*!
+	Cached bitmap texture.
+	Implements a bitmap texture whose texels are loaded lazily through the shared texture cache.
+	The decoded image is converted to a tile file of the mipmap pyramid (see TiledMipmapImage).
+	If the 'cache' element is specified, the tile file is stored in the directory
+	and reused in the later runs unless the image or the parameters are modified.
+	Otherwise the tile file is created in the temporary directory and removed on destruction.
+*/
+class CachedBitmapTexture final : public Texture
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("cached_bitmap");
+
+public:
+
+	CachedBitmapTexture() {}
+	virtual ~CachedBitmapTexture();
+
+public:
+
+	virtual bool Load(const ConfigNode& node, const Assets& assets) override;
+
+public:
+
+	virtual Math::Vec3 Evaluate(const Math::Vec2& uv) const override;
+	virtual Math::Vec3 Evaluate(const Math::Vec2& uv, const Math::Float& footprint) const override;
+
+private:
+
+	bool BuildTileFile(const std::string& path, bool verticalFlip, int tileSize, const std::string& tilePath);
+	Math::Vec3 Lookup(const Math::Vec2& uv, int level) const;
+
+private:
+
+	TiledMipmapImage image;
+	std::string temporaryTilePath;		// Path to the tile file removed on destruction
+
+};
+
+CachedBitmapTexture::~CachedBitmapTexture()
+{
+	image.Close();
+	if (!temporaryTilePath.empty())
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove(temporaryTilePath, ec);
+	}
+}
+
+bool CachedBitmapTexture::Load( const ConfigNode& node, const Assets& /*assets*/ )
+{
+	// 'path' element
+	std::string path;
+	if (!node.ChildValue("path", path))
+	{
+		return false;
+	}
+
+	// Resolve the path
+	path = PathUtils::ResolveAssetPath(*node.GetConfig(), path);
+
+	// 'vertical_flip' element
+	bool verticalFlip;
+	node.ChildValueOrDefault("vertical_flip", false, verticalFlip);
+
+	// 'tile_size' element
+	int tileSize;
+	node.ChildValueOrDefault("tile_size", 64, tileSize);
+	if (tileSize <= 0)
+	{
+		LM_LOG_ERROR("Invalid value for 'tile_size'");
+		return false;
+	}
+
+	// 'cache' element
+	std::string cacheDir;
+	node.ChildValueOrDefault("cache", std::string(""), cacheDir);
+
+	std::string tilePath;
+	if (!cacheDir.empty())
+	{
+		// The name of the tile file is the hash of the image and the parameters
+		boost::system::error_code ec;
+		const auto fileSize = boost::filesystem::file_size(path, ec);
+		if (ec)
+		{
+			LM_LOG_ERROR("Failed to open image '" + path + "'");
+			return false;
+		}
+		const auto lastWriteTime = boost::filesystem::last_write_time(path, ec);
+
+		size_t hash = 0;
+		boost::hash_combine(hash, boost::filesystem::absolute(path).string());
+		boost::hash_combine(hash, static_cast<unsigned long long>(fileSize));
+		boost::hash_combine(hash, static_cast<long long>(lastWriteTime));
+		boost::hash_combine(hash, tileSize);
+		boost::hash_combine(hash, verticalFlip);
+
+		if (!boost::filesystem::exists(cacheDir) && !boost::filesystem::create_directories(cacheDir, ec))
+		{
+			LM_LOG_ERROR("Failed to create directory '" + cacheDir + "'");
+			return false;
+		}
+
+		tilePath = (boost::filesystem::path(cacheDir) / boost::str(boost::format("%016x.lmtiled") % hash)).string();
+	}
+	else
+	{
+		tilePath = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("lightmetrica-%%%%-%%%%-%%%%-%%%%.lmtiled")).string();
+		temporaryTilePath = tilePath;
+	}
+
+	// Reuse the tile file if exists
+	if (!temporaryTilePath.empty() || !image.Open(tilePath, TextureCache::Shared()))
+	{
+		if (!BuildTileFile(path, verticalFlip, tileSize, tilePath))
+		{
+			return false;
+		}
+		if (!image.Open(tilePath, TextureCache::Shared()))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CachedBitmapTexture::BuildTileFile( const std::string& path, bool verticalFlip, int tileSize, const std::string& tilePath )
+{
+	// Decode the image with the bitmap texture
+	std::unique_ptr<BitmapTexture> bitmapTexture(dynamic_cast<BitmapTexture*>(ComponentFactory::Create<Texture>("bitmap")));
+	if (bitmapTexture == nullptr)
+	{
+		LM_LOG_ERROR("Failed to create bitmap texture");
+		return false;
+	}
+	if (!bitmapTexture->Load(path, verticalFlip))
+	{
+		return false;
+	}
+
+	const auto& bitmapData = bitmapTexture->Bitmap().InternalData();
+	std::vector<float> data(bitmapData.size());
+	for (size_t i = 0; i < bitmapData.size(); i++)
+	{
+		data[i] = Math::Cast<float>(bitmapData[i]);
+	}
+
+	LM_LOG_INFO("Building tile file '" + tilePath + "'");
+	return TiledMipmapImage::Build(data, bitmapTexture->Width(), bitmapTexture->Height(), tileSize, tilePath);
+}
+
+Math::Vec3 CachedBitmapTexture::Evaluate( const Math::Vec2& uv ) const
+{
+	return Lookup(uv, 0);
+}
+
+Math::Vec3 CachedBitmapTexture::Evaluate( const Math::Vec2& uv, const Math::Float& footprint ) const
+{
+	// Select the level where the footprint covers about a texel
+	const auto texels = Math::Cast<double>(footprint) * Math::Max(image.Width(0), image.Height(0));
+	const int level = texels > 1.0 ? Math::Min(static_cast<int>(std::log2(texels)), image.NumLevels() - 1) : 0;
+	return Lookup(uv, level);
+}
+
+Math::Vec3 CachedBitmapTexture::Lookup( const Math::Vec2& uv, int level ) const
+{
+	// 'repeat' texture coordinates
+	const int width = image.Width(level);
+	const int height = image.Height(level);
+	const int x = Math::Clamp((int)(Math::Fract(uv.x) * width), 0, width - 1);
+	const int y = Math::Clamp((int)(Math::Fract(uv.y) * height), 0, height - 1);
+	return image.Texel(x, y, level);
+}
+
+LM_COMPONENT_REGISTER_IMPL(CachedBitmapTexture, Texture);
+
+LM_NAMESPACE_END
@@ -39,7 +39,7 @@ public:
 
 public:
 
-	DefaultBitmapTexture() {}
+	DefaultBitmapTexture() : width(0), height(0) {}
 	virtual ~DefaultBitmapTexture() {}
 
 public:
@@ -50,6 +50,8 @@ public:
 
 	virtual bool Load(const std::string& path, bool verticalFlip) override;
 	virtual const BitmapImage& Bitmap() const override { return bitmap; }
+	virtual int Width() const override { return width; }
+	virtual int Height() const override { return height; }
 
 public:
 
@@ -87,7 +87,7 @@ bool DielectricBSDF::SampleDirection( const GeneralizedBSDFSampleQuery& query, c
 		return false;
 	}
 
-	auto localWi = geom.worldToShading * query.wi;
+	auto localWi = geom.WorldToShading(query.wi);
 	auto cosThetaI = Math::CosThetaZUp(localWi);
 	bool entering = cosThetaI > Math::Float(0);
 
@@ -112,7 +112,7 @@ bool DielectricBSDF::SampleDirection( const GeneralizedBSDFSampleQuery& query, c
 		{
 			// Reflection
 			auto localWo = Math::ReflectZUp(localWi);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::SpecularReflection;
 			result.pdf = Math::PDFEval(Fr / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
 		}
@@ -120,7 +120,7 @@ bool DielectricBSDF::SampleDirection( const GeneralizedBSDFSampleQuery& query, c
 		{
 			// Transmission
 			auto localWo = Math::RefractZUp(localWi, eta, cosThetaT);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::SpecularTransmission;
 			result.pdf = Math::PDFEval((Math::Float(1) - Fr) / Math::Abs(cosThetaT), Math::ProbabilityMeasure::ProjectedSolidAngle);
 		}
@@ -128,7 +128,7 @@ bool DielectricBSDF::SampleDirection( const GeneralizedBSDFSampleQuery& query, c
 	else if (useR)
 	{
 		auto localWo = Math::ReflectZUp(localWi);
-		result.wo = geom.shadingToWorld * localWo;
+		result.wo = geom.ShadingToWorld(localWo);
 		result.sampledType = GeneralizedBSDFType::SpecularReflection;
 		result.pdf = Math::PDFEval(Math::Float(1) / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
 	}
@@ -141,7 +141,7 @@ bool DielectricBSDF::SampleDirection( const GeneralizedBSDFSampleQuery& query, c
 		}
 
 		auto localWo = Math::RefractZUp(localWi, eta, cosThetaT);
-		result.wo = geom.shadingToWorld * localWo;
+		result.wo = geom.ShadingToWorld(localWo);
 		result.sampledType = GeneralizedBSDFType::SpecularTransmission;
 		result.pdf = Math::PDFEval(Math::Float(1) / Math::Abs(cosThetaT), Math::ProbabilityMeasure::ProjectedSolidAngle);
 	}
@@ -159,7 +159,7 @@ Math::Vec3 DielectricBSDF::SampleAndEstimateDirection( const GeneralizedBSDFSamp
 		return false;
 	}
 
-	auto localWi = geom.worldToShading * query.wi;
+	auto localWi = geom.WorldToShading(query.wi);
 	auto cosThetaI = Math::CosThetaZUp(localWi);
 	bool entering = cosThetaI > Math::Float(0);
 
@@ -184,7 +184,7 @@ Math::Vec3 DielectricBSDF::SampleAndEstimateDirection( const GeneralizedBSDFSamp
 		{
 			// Reflection
 			auto localWo = Math::ReflectZUp(localWi);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::SpecularReflection;
 			result.pdf = Math::PDFEval(Fr / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
 
@@ -205,7 +205,7 @@ Math::Vec3 DielectricBSDF::SampleAndEstimateDirection( const GeneralizedBSDFSamp
 		{
 			// Transmission
 			auto localWo = Math::RefractZUp(localWi, eta, cosThetaT);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::SpecularTransmission;
 			result.pdf = Math::PDFEval((Math::Float(1) - Fr) / Math::Abs(cosThetaT), Math::ProbabilityMeasure::ProjectedSolidAngle);
 
@@ -236,7 +236,7 @@ Math::Vec3 DielectricBSDF::SampleAndEstimateDirection( const GeneralizedBSDFSamp
 	{
 		// Reflection
 		auto localWo = Math::ReflectZUp(localWi);
-		result.wo = geom.shadingToWorld * localWo;
+		result.wo = geom.ShadingToWorld(localWo);
 		result.sampledType = GeneralizedBSDFType::SpecularReflection;
 		result.pdf = Math::PDFEval(Math::Float(1) / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
 
@@ -259,7 +259,7 @@ Math::Vec3 DielectricBSDF::SampleAndEstimateDirection( const GeneralizedBSDFSamp
 
 		// Transmission
 		auto localWo = Math::RefractZUp(localWi, eta, cosThetaT);
-		result.wo = geom.shadingToWorld * localWo;
+		result.wo = geom.ShadingToWorld(localWo);
 		result.sampledType = GeneralizedBSDFType::SpecularTransmission;
 		result.pdf = Math::PDFEval(Math::Float(1) / Math::Abs(cosThetaT), Math::ProbabilityMeasure::ProjectedSolidAngle);
 
@@ -289,7 +289,7 @@ bool DielectricBSDF::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSampl
 		return false;
 	}
 
-	auto localWi = geom.worldToShading * query.wi;
+	auto localWi = geom.WorldToShading(query.wi);
 	auto cosThetaI = Math::CosThetaZUp(localWi);
 	bool entering = cosThetaI > Math::Float(0);
 
@@ -314,7 +314,7 @@ bool DielectricBSDF::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSampl
 		{
 			// Reflection
 			auto localWo = Math::ReflectZUp(localWi);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::SpecularReflection;
 			result.pdf[query.transportDir] = Math::PDFEval(Fr / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
 			result.pdf[1 - query.transportDir] = result.pdf[query.transportDir];
@@ -339,7 +339,7 @@ bool DielectricBSDF::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSampl
 		{
 			// Transmission
 			auto localWo = Math::RefractZUp(localWi, eta, cosThetaT);
-			result.wo = geom.shadingToWorld * localWo;
+			result.wo = geom.ShadingToWorld(localWo);
 			result.sampledType = GeneralizedBSDFType::SpecularTransmission;
 			result.pdf[query.transportDir] = Math::PDFEval((Math::Float(1) - Fr) / Math::Abs(cosThetaT), Math::ProbabilityMeasure::ProjectedSolidAngle);
 			result.pdf[1 - query.transportDir] = Math::PDFEval((Math::Float(1) - Fr) / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
@@ -369,7 +369,7 @@ bool DielectricBSDF::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSampl
 	{
 		// Reflection
 		auto localWo = Math::ReflectZUp(localWi);
-		result.wo = geom.shadingToWorld * localWo;
+		result.wo = geom.ShadingToWorld(localWo);
 		result.sampledType = GeneralizedBSDFType::SpecularReflection;
 		result.pdf[query.transportDir] = Math::PDFEval(Math::Float(1) / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
 		result.pdf[1 - query.transportDir] = result.pdf[query.transportDir];
@@ -400,7 +400,7 @@ bool DielectricBSDF::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSampl
 
 		// Transmission
 		auto localWo = Math::RefractZUp(localWi, eta, cosThetaT);
-		result.wo = geom.shadingToWorld * localWo;
+		result.wo = geom.ShadingToWorld(localWo);
 		result.sampledType = GeneralizedBSDFType::SpecularTransmission;
 		result.pdf[query.transportDir] = Math::PDFEval(Math::Float(1) / Math::Abs(cosThetaT), Math::ProbabilityMeasure::ProjectedSolidAngle);
 		result.pdf[1 - query.transportDir] = Math::PDFEval(Math::Float(1) / Math::Abs(cosThetaI), Math::ProbabilityMeasure::ProjectedSolidAngle);
@@ -438,8 +438,8 @@ Math::Vec3 DielectricBSDF::EvaluateDirection( const GeneralizedBSDFEvaluateQuery
 		return Math::Vec3();
 	}
 
-	auto localWi = geom.worldToShading * query.wi;
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWi = geom.WorldToShading(query.wi);
+	auto localWo = geom.WorldToShading(query.wo);
 	auto cosThetaI = Math::CosThetaZUp(localWi);
 	auto cosThetaT = Math::CosThetaZUp(localWo);
 	bool entering = cosThetaI > Math::Float(0);
@@ -466,8 +466,8 @@ Math::Vec3 DielectricBSDF::EvaluateDirection( const GeneralizedBSDFEvaluateQuery
 		{
 			auto localWoTemp = Math::ReflectZUp(localWi);
 			auto localWiTemp = Math::ReflectZUp(localWo);
-			auto woTemp = geom.shadingToWorld * localWoTemp;
-			auto wiTemp = geom.shadingToWorld * localWiTemp;
+			auto woTemp = geom.ShadingToWorld(localWoTemp);
+			auto wiTemp = geom.ShadingToWorld(localWiTemp);
 			if (woTemp != query.wo && wiTemp != query.wi)
 			{
 				return Math::Vec3();
@@ -494,8 +494,8 @@ Math::Vec3 DielectricBSDF::EvaluateDirection( const GeneralizedBSDFEvaluateQuery
 		EvalFrDielectic(etaT, etaI, cosThetaT, cosThetaT2Rev);
 		auto localWoTemp = Math::RefractZUp(localWi, etaI / etaT, cosThetaT2);
 		auto localWiTemp = Math::RefractZUp(localWo, etaT / etaI, cosThetaT2Rev);
-		auto woTemp = geom.shadingToWorld * localWoTemp;
-		auto wiTemp = geom.shadingToWorld * localWiTemp;
+		auto woTemp = geom.ShadingToWorld(localWoTemp);
+		auto wiTemp = geom.ShadingToWorld(localWiTemp);
 		if (!useT || (woTemp != query.wo && wiTemp != query.wi))
 		{
 			return Math::Vec3();
@@ -531,8 +531,8 @@ Math::PDFEval DielectricBSDF::EvaluateDirectionPDF( const GeneralizedBSDFEvaluat
 		return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
 	}
 
-	auto localWi = geom.worldToShading * query.wi;
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWi = geom.WorldToShading(query.wi);
+	auto localWo = geom.WorldToShading(query.wo);
 	auto cosThetaI = Math::CosThetaZUp(localWi);
 	auto cosThetaT = Math::CosThetaZUp(localWo);
 	bool entering = cosThetaI > Math::Float(0);
@@ -557,8 +557,8 @@ Math::PDFEval DielectricBSDF::EvaluateDirectionPDF( const GeneralizedBSDFEvaluat
 		{
 			auto localWoTemp = Math::ReflectZUp(localWi);
 			auto localWiTemp = Math::ReflectZUp(localWo);
-			auto woTemp = geom.shadingToWorld * localWoTemp;
-			auto wiTemp = geom.shadingToWorld * localWiTemp;
+			auto woTemp = geom.ShadingToWorld(localWoTemp);
+			auto wiTemp = geom.ShadingToWorld(localWiTemp);
 			if (woTemp != query.wo && wiTemp != query.wi)
 			{
 				return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
@@ -576,8 +576,8 @@ Math::PDFEval DielectricBSDF::EvaluateDirectionPDF( const GeneralizedBSDFEvaluat
 		EvalFrDielectic(etaT, etaI, cosThetaT, cosThetaT2Rev);
 		auto localWoTemp = Math::RefractZUp(localWi, etaI / etaT, cosThetaT2);
 		auto localWiTemp = Math::RefractZUp(localWo, etaT / etaI, cosThetaT2Rev);
-		auto woTemp = geom.shadingToWorld * localWoTemp;
-		auto wiTemp = geom.shadingToWorld * localWiTemp;
+		auto woTemp = geom.ShadingToWorld(localWoTemp);
+		auto wiTemp = geom.ShadingToWorld(localWiTemp);
 		if (!useT || (woTemp != query.wo && wiTemp != query.wi))
 		{
 			return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
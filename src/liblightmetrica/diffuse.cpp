@@ -116,14 +116,14 @@ bool DiffuseBSDF::Load(std::map<std::string, boost::any>& params)
 
 bool DiffuseBSDF::SampleDirection( const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
+	auto localWi = geom.WorldToShading(query.wi);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0)
 	{
 		return false;
 	}
 
 	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.sampledType = GeneralizedBSDFType::DiffuseReflection;
 	result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
 
@@ -132,14 +132,14 @@ bool DiffuseBSDF::SampleDirection( const GeneralizedBSDFSampleQuery& query, cons
 
 Math::Vec3 DiffuseBSDF::SampleAndEstimateDirection( const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
+	auto localWi = geom.WorldToShading(query.wi);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0)
 	{
 		return Math::Vec3();
 	}
 
 	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.sampledType = GeneralizedBSDFType::DiffuseReflection;
 	result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
 
@@ -158,14 +158,14 @@ Math::Vec3 DiffuseBSDF::SampleAndEstimateDirection( const GeneralizedBSDFSampleQ
 
 bool DiffuseBSDF::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleBidirResult& result ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
+	auto localWi = geom.WorldToShading(query.wi);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0)
 	{
 		return false;
 	}
 
 	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.sampledType = GeneralizedBSDFType::DiffuseReflection;
 	result.pdf[query.transportDir] = Math::CosineSampleHemispherePDFProjSA(localWo);
 	result.pdf[1-query.transportDir] = Math::CosineSampleHemispherePDFProjSA(localWi);
@@ -191,8 +191,8 @@ bool DiffuseBSDF::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSampleQu
 
 Math::Vec3 DiffuseBSDF::EvaluateDirection( const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWi = geom.WorldToShading(query.wi);
+	auto localWo = geom.WorldToShading(query.wo);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0 || Math::CosThetaZUp(localWo) <= 0)
 	{
 		return Math::Vec3();
@@ -209,8 +209,8 @@ Math::Vec3 DiffuseBSDF::EvaluateDirection( const GeneralizedBSDFEvaluateQuery& q
 
 Math::PDFEval DiffuseBSDF::EvaluateDirectionPDF( const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWi = geom.WorldToShading(query.wi);
+	auto localWo = geom.WorldToShading(query.wo);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0 || Math::CosThetaZUp(localWo) <= 0)
 	{
 		return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
@@ -23,6 +23,7 @@
 #include <lightmetrica/logger.h>
 #include <lightmetrica/assert.h>
 #include <lightmetrica/bitmap.h>
+#include <lightmetrica/sharedfilmbuffer.h>
 #include <FreeImage.h>
 
 LM_NAMESPACE_BEGIN
@@ -60,7 +61,7 @@ public:
 	virtual void Allocate(int width, int height) override;
 	virtual void SetImageType(BitmapImageType type) override { this->type = type; }
 	virtual BitmapImageType ImageType() const override { return type; }
-	virtual BitmapImage& Bitmap() override { return bitmap; }
+	virtual BitmapImage& Bitmap() override { shared.Resolve(bitmap.InternalData()); return bitmap; }
 
 public:
 
@@ -71,7 +72,8 @@ private:
 	int width;
 	int height;
 	BitmapImageType type;		// Type of the image to be saved
-	BitmapImage bitmap;
+	mutable BitmapImage bitmap;
+	SharedFilmAccumulation shared;		// State of the tiled and atomic accumulation modes
 
 };
 
@@ -97,6 +99,12 @@ bool LDRBitmapFilm::Load( const ConfigNode& node, const Assets& assets )
 		return false;
 	}
 
+	// Find 'accumulation_mode' element (optional)
+	if (!shared.Load(node))
+	{
+		return false;
+	}
+
 	// Allocate image data
 	Allocate(width, height);
 
@@ -129,6 +137,12 @@ void LDRBitmapFilm::RecordContribution( const Math::Vec2& rasterPos, const Math:
 		Math::Clamp(Math::Cast<int>(Math::Float(rasterPos.y * Math::Float(height))), 0, height-1));
 
 	// Record contribution
+	if (shared.RecordContribution(pixelPos, contrb))
+	{
+		return;
+	}
+
+	shared.Resolve(bitmap.InternalData());
 	size_t idx = pixelPos.y * width + pixelPos.x;
 	auto& data = bitmap.InternalData();
 	data[3 * idx    ] = contrb[0];
@@ -151,6 +165,11 @@ void LDRBitmapFilm::AccumulateContribution( const Math::Vec2& rasterPos, const M
 		Math::Clamp(Math::Cast<int>(Math::Float(rasterPos.y * Math::Float(height))), 0, height-1));
 
 	// Accumulate contribution
+	if (shared.AccumulateContribution(pixelPos, contrb))
+	{
+		return;
+	}
+
 	size_t idx = pixelPos.y * width + pixelPos.x;
 	auto& data = bitmap.InternalData();
 	data[3 * idx    ] += contrb[0];
@@ -175,17 +194,19 @@ void LDRBitmapFilm::AccumulateContribution( const Film& film )
 	}
 
 	// Accumulate data
-	const auto& otherData = dynamic_cast<const LDRBitmapFilm&>(film).bitmap.InternalData();
-	auto& data = bitmap.InternalData();
-	LM_ASSERT(data.size() == otherData.size());
-	for (size_t i = 0; i < data.size(); i++)
-	{
-		data[i] += otherData[i];
-	}
+	const auto& other = dynamic_cast<const LDRBitmapFilm&>(film);
+	shared.AccumulateFilm(other.shared, bitmap.InternalData(), other.bitmap.InternalData());
 }
 
 bool LDRBitmapFilm::RescaleAndSave( const std::string& path, const Math::Float& weight ) const
 {
+	// Clones in the tiled or atomic mode have no bitmap
+	if (shared.SharedClone())
+	{
+		LM_LOG_ERROR("Cannot save the clone of a film accumulating to the shared buffer");
+		return false;
+	}
+
 	// Error handing of FreeImage
 	FreeImage_SetOutputMessage(FreeImageErrorCallback);
 
@@ -208,6 +229,7 @@ bool LDRBitmapFilm::RescaleAndSave( const std::string& path, const Math::Float&
 	}
 
 	// Copy data
+	shared.Resolve(bitmap.InternalData());
 	auto& data = bitmap.InternalData();
 	for (int y = 0; y < height; y++)
 	{
@@ -283,12 +305,17 @@ Film* LDRBitmapFilm::Clone() const
 	film->width = width;
 	film->height = height;
 	film->type = type;
-	film->bitmap = bitmap;
+	if (!shared.ConfigureClone(film->shared, width, height, bitmap.InternalData()))
+	{
+		film->bitmap = bitmap;
+	}
+
 	return film;
 }
 
 void LDRBitmapFilm::Clear()
 {
+	shared.Clear();
 	auto& data = bitmap.InternalData();
 	for (auto& v : data)
 	{
@@ -301,10 +328,12 @@ void LDRBitmapFilm::Allocate( int width, int height )
 	this->width = width;
 	this->height = height;
 	bitmap.InternalData().assign(width * height * 3, Math::Float(0));
+	shared.Reset();
 }
 
 void LDRBitmapFilm::Rescale( const Math::Float& weight )
 {
+	shared.Resolve(bitmap.InternalData());
 	auto& data = bitmap.InternalData();
 	for (auto& v : data)
 	{
@@ -26,6 +26,7 @@
 #include <lightmetrica/pugihelper.h>
 #include <lightmetrica/math.stats.h>
 #include <lightmetrica/math.linalgebra.h>
+#include <lightmetrica/math.distribution.h>
 #include <lightmetrica/confignode.h>
 #include <lightmetrica/align.h>
 
@@ -67,20 +68,22 @@ public:
 	virtual void RegisterPrimitives(const std::vector<Primitive*>& primitives) override;
 	virtual void PostConfigure(const Scene& scene) override {}
 	virtual EmitterShape* CreateEmitterShape() const override { return nullptr; }
-	virtual AABB GetAABB() const override { return AABB(); }		// Not used (included in triangles)
+	virtual AABB GetAABB() const override { return bound; }
 
 public:
 
 	virtual bool EnvironmentLight() const override { return false; }
+	virtual Math::Vec3 Power() const override { return power; }
 
 private:
 
 	Math::Vec3 Le;
 	typedef std::tuple<Math::Vec3, Math::Vec3, Math::Vec3> TrianglePosition;
 	std::vector<TrianglePosition, aligned_allocator<TrianglePosition, std::alignment_of<TrianglePosition>::value>> triangles;
-	std::vector<Math::Float> triangleAreaCdf;
+	Math::DiscreteAliasDistribution1D triangleAreaDist;
 	Math::Float area, invArea;
 	Math::Vec3 power;
+	AABB bound;
 
 };
 
@@ -108,9 +111,11 @@ bool AreaLight::Load( const ConfigNode& node, const Assets& /*assets*/ )
 
 void AreaLight::RegisterPrimitives( const std::vector<Primitive*>& primitives )
 {
-	// Create CDF
-	triangleAreaCdf.clear();
-	triangleAreaCdf.push_back(Math::Float(0));
+	// Create distribution according to the area of the triangles
+	triangles.clear();
+	triangleAreaDist.Clear();
+	area = Math::Float(0);
+	bound = AABB();
 	for (size_t i = 0; i < primitives.size(); i++)
 	{
 		auto& primitive = primitives[i];
@@ -125,20 +130,18 @@ void AreaLight::RegisterPrimitives( const std::vector<Primitive*>& primitives )
 			Math::Vec3 p2(primitive->transform * Math::Vec4(ps[3*v2], ps[3*v2+1], ps[3*v2+2], Math::Float(1)));
 			Math::Vec3 p3(primitive->transform * Math::Vec4(ps[3*v3], ps[3*v3+1], ps[3*v3+2], Math::Float(1)));
 			triangles.push_back(std::make_tuple(p1, p2, p3));
+			bound = bound.Union(p1).Union(p2).Union(p3);
 
 			// Area of the triangle
-			auto area = Math::Length(Math::Cross(p2 - p1, p3 - p1)) / Math::Float(2);
-			triangleAreaCdf.push_back(triangleAreaCdf.back() + area);
+			auto triangleArea = Math::Length(Math::Cross(p2 - p1, p3 - p1)) / Math::Float(2);
+			triangleAreaDist.Add(triangleArea);
+			area += triangleArea;
 		}
 	}
 
 	// Normalize
-	area = triangleAreaCdf.back();
+	triangleAreaDist.Normalize();
 	invArea = Math::Float(1) / area;
-	for (auto& v : triangleAreaCdf)
-	{
-		v *= invArea;
-	}
 
 	power = Le * Math::Constants::Pi() * area;
 }
@@ -148,13 +151,8 @@ void AreaLight::SamplePosition( const Math::Vec2& sample, SurfaceGeometry& geom,
 	Math::Vec2 ps(sample);
 
 	// Choose a primitive according to the area
-	int index =
-		Math::Clamp(
-		static_cast<int>(std::upper_bound(triangleAreaCdf.begin(), triangleAreaCdf.end(), ps.y) - triangleAreaCdf.begin() - 1),
-		0, static_cast<int>(triangleAreaCdf.size()) - 2);
-
-	// Reuse sample
-	ps.y = (ps.y - triangleAreaCdf[index]) / (triangleAreaCdf[index+1] - triangleAreaCdf[index]);
+	// The sample is reused for the positional sampling on the triangle
+	size_t index = triangleAreaDist.SampleReuse(ps.y);
 
 	// Triangle vertex positions
 	const auto& p1 = std::get<0>(triangles[index]);
@@ -187,7 +185,7 @@ bool AreaLight::SampleDirection( const GeneralizedBSDFSampleQuery& query, const
 
 	result.sampledType = GeneralizedBSDFType::LightDirection;
 	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
 
 	return true;
@@ -202,7 +200,7 @@ Math::Vec3 AreaLight::SampleAndEstimateDirection( const GeneralizedBSDFSampleQue
 
 	result.sampledType = GeneralizedBSDFType::LightDirection;
 	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
 
 	// Le_D / p_{\sigma^\bot}
@@ -221,7 +219,7 @@ bool AreaLight::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSampleQuer
 
 	result.sampledType = GeneralizedBSDFType::LightDirection;
 	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.pdf[query.transportDir] = Math::CosineSampleHemispherePDFProjSA(localWo);
 	result.pdf[1-query.transportDir] = Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
 	result.weight[query.transportDir] = Math::Vec3(Math::Float(1));
@@ -242,7 +240,7 @@ Math::PDFEval AreaLight::EvaluatePositionPDF( const SurfaceGeometry& /*geom*/ )
 
 Math::Vec3 AreaLight::EvaluateDirection( const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom ) const
 {
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWo = geom.WorldToShading(query.wo);
 	if ((query.type & BSDFTypes()) == 0 || (query.transportDir != TransportDirection::LE) || Math::CosThetaZUp(localWo) <= 0)
 	{
 		return Math::Vec3();
@@ -253,7 +251,7 @@ Math::Vec3 AreaLight::EvaluateDirection( const GeneralizedBSDFEvaluateQuery& que
 
 Math::PDFEval AreaLight::EvaluateDirectionPDF( const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom ) const
 {
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWo = geom.WorldToShading(query.wo);
 	if ((query.type & BSDFTypes()) == 0 || (query.transportDir != TransportDirection::LE) || Math::CosThetaZUp(localWo) <= 0)
 	{
 		return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
@@ -26,14 +26,22 @@
 #include <lightmetrica/scene.h>
 #include <lightmetrica/emittershape.h>
 #include <lightmetrica/texture.h>
+#include <lightmetrica/bitmaptexture.h>
 #include <lightmetrica/assets.h>
 #include <lightmetrica/math.transform.h>
+#include <lightmetrica/math.distribution.h>
+#include <lightmetrica/parallel.h>
+#include <algorithm>
 
 LM_NAMESPACE_BEGIN
 
 /*!
 	Bitmap environment light.
 	Implements environment light with environment map.
+	Positions and directions are importance sampled according to the luminance of the light probe
+	with the piecewise constant distribution over the uv coordinates of the light probe.
+	In order to be robust against the approximation by the bounding sphere,
+	the distribution is combined with the uniform (resp. cosine-weighted) sampling.
 */
 class EnvmapEnvironmentLight final : public Light
 {
@@ -72,10 +80,29 @@ public:
 public:
 
 	virtual bool EnvironmentLight() const override { return true; }
+	virtual Math::Vec3 Power() const override { return power; }
 
 private:
 
 	Math::Vec3 EvaluateLightProbe(const Math::Vec3& d) const;
+	Math::Vec2 LightProbeUV(const Math::Vec3& d) const;
+	Math::Vec3 LightProbeDirection(const Math::Vec2& uv, Math::Float& jacobian) const;
+	bool SampleLightProbeDirection(const Math::Vec2& sample, Math::Vec3& d) const;
+	Math::Float LightProbeDirectionPDF(const Math::Vec3& d) const;
+	bool SampleLightDirection(const Math::Vec2& sample, const SurfaceGeometry& geom, Math::Vec3& wo, Math::PDFEval& pdf) const;
+	Math::PDFEval LightDirectionPDF(const Math::Vec3& wo, const SurfaceGeometry& geom) const;
+
+private:
+
+	// Probability of uniform sampling of positions on the bounding sphere.
+	// The positions are also used as the origins of light paths thus should be spread over the sphere.
+	static const Math::Float UniformPositionSamplingProb;
+
+	// Probability of cosine-weighted sampling of directions
+	static const Math::Float CosineDirectionSamplingProb;
+
+	// Resolution of the distribution for non-bitmap textures
+	static const int DefaultDistributionResolution = 512;
 
 private:
 
@@ -85,9 +112,14 @@ private:
 	Math::Float invArea;		//!< Inverse of #area.
 	Math::Float rotate;			//!< Rotation of environemnt map (counterclockwise).
 	Math::Float scale;			//!< Scale in radiance.
+	Math::Vec3 power;			//!< Power of the light.
+	Math::PiecewiseConstantDistribution2D lightProbeDist;	//!< Distribution for importance sampling over the uv coordinates of the light probe.
 
 };
 
+const Math::Float EnvmapEnvironmentLight::UniformPositionSamplingProb(0.5);
+const Math::Float EnvmapEnvironmentLight::CosineDirectionSamplingProb(0.1);
+
 bool EnvmapEnvironmentLight::Load(const ConfigNode& node, const Assets& assets)
 {
 	auto textureNode = node.Child("texture");
@@ -121,6 +153,69 @@ void EnvmapEnvironmentLight::PostConfigure(const Scene& scene)
 	// Compute area
 	area = Math::Float(4) * Math::Constants::Pi() * bsphere.radius * bsphere.radius;
 	invArea = Math::Float(1) / area;
+
+	// Average luminance over the sphere of directions
+	// estimated with a stratified grid of directions
+	const int NumPhiSteps = 64;
+	const int NumThetaSteps = 32;
+	Math::Vec3 sumLe;
+	for (int i = 0; i < NumThetaSteps; i++)
+	{
+		for (int j = 0; j < NumPhiSteps; j++)
+		{
+			const Math::Vec2 u((Math::Float(i) + Math::Float(0.5)) / Math::Float(NumThetaSteps), (Math::Float(j) + Math::Float(0.5)) / Math::Float(NumPhiSteps));
+			sumLe += EvaluateLightProbe(Math::UniformSampleSphere(u));
+		}
+	}
+
+	// Power incident to the disk with the radius of the bounding sphere
+	power = sumLe / Math::Float(NumThetaSteps * NumPhiSteps) * Math::Constants::Pi() * Math::Constants::Pi() * bsphere.radius * bsphere.radius;
+
+	// Resolution of the distribution
+	int width = DefaultDistributionResolution;
+	int height = DefaultDistributionResolution;
+	const auto* bitmapTexture = dynamic_cast<const BitmapTexture*>(Le);
+	if (bitmapTexture && bitmapTexture->Width() > 0 && bitmapTexture->Height() > 0)
+	{
+		width = bitmapTexture->Width();
+		height = bitmapTexture->Height();
+	}
+
+	// Weight of the cells : luminance times the Jacobian between the solid angle and the uv coordinates.
+	// The cells which are not entirely inside the light probe are excluded
+	// so that the sampled uv coordinates are always mapped to valid directions.
+	std::vector<Math::Float> values(static_cast<size_t>(width) * static_cast<size_t>(height));
+	Parallel::For(0, static_cast<size_t>(height), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t y = begin; y < end; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				// Farthest corner of the cell from the center of the light probe
+				const auto cx = Math::Max(Math::Abs(Math::Float(2 * x) / Math::Float(width) - Math::Float(1)), Math::Abs(Math::Float(2 * (x + 1)) / Math::Float(width) - Math::Float(1)));
+				const auto cy = Math::Max(Math::Abs(Math::Float(2 * y) / Math::Float(height) - Math::Float(1)), Math::Abs(Math::Float(2 * (y + 1)) / Math::Float(height) - Math::Float(1)));
+				auto& v = values[y * width + x];
+				if (cx * cx + cy * cy > Math::Float(1))
+				{
+					v = Math::Float(0);
+					continue;
+				}
+
+				const Math::Vec2 uv((Math::Float(x) + Math::Float(0.5)) / Math::Float(width), (Math::Float(y) + Math::Float(0.5)) / Math::Float(height));
+				Math::Float jacobian;
+				LightProbeDirection(uv, jacobian);
+				v = Math::Max(Math::Float(0), Math::Luminance(Le->Evaluate(uv))) * jacobian;
+			}
+		}
+	});
+
+	// Build the distribution
+	// If the light probe is entirely black, only the uniform (resp. cosine-weighted) sampling is used
+	lightProbeDist.Clear();
+	if (std::any_of(values.begin(), values.end(), [](const Math::Float& v){ return v > Math::Float(0); }))
+	{
+		lightProbeDist.Build(values, width, height);
+	}
 }
 
 EmitterShape* EnvmapEnvironmentLight::CreateEmitterShape() const
@@ -157,11 +252,7 @@ bool EnvmapEnvironmentLight::SampleDirection(const GeneralizedBSDFSampleQuery& q
 	}
 
 	result.sampledType = GeneralizedBSDFType::LightDirection;
-	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
-	result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
-
-	return true;
+	return SampleLightDirection(query.sample, geom, result.wo, result.pdf);
 }
 
 Math::Vec3 EnvmapEnvironmentLight::SampleAndEstimateDirection(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result) const
@@ -172,11 +263,12 @@ Math::Vec3 EnvmapEnvironmentLight::SampleAndEstimateDirection(const GeneralizedB
 	}
 
 	result.sampledType = GeneralizedBSDFType::LightDirection;
-	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
-	result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
+	if (!SampleLightDirection(query.sample, geom, result.wo, result.pdf))
+	{
+		return Math::Vec3();
+	}
 
-	return EvaluateLightProbe(-result.wo);
+	return EvaluateLightProbe(-result.wo) * Math::Constants::InvPi() / result.pdf.v;
 }
 
 bool EnvmapEnvironmentLight::SampleAndEstimateDirectionBidir(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleBidirResult& result) const
@@ -187,11 +279,13 @@ bool EnvmapEnvironmentLight::SampleAndEstimateDirectionBidir(const GeneralizedBS
 	}
 
 	result.sampledType = GeneralizedBSDFType::LightDirection;
-	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
-	result.pdf[query.transportDir] = Math::CosineSampleHemispherePDFProjSA(localWo);
+	if (!SampleLightDirection(query.sample, geom, result.wo, result.pdf[query.transportDir]))
+	{
+		return false;
+	}
+
 	result.pdf[1 - query.transportDir] = Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
-	result.weight[query.transportDir] = EvaluateLightProbe(-result.wo);
+	result.weight[query.transportDir] = EvaluateLightProbe(-result.wo) * Math::Constants::InvPi() / result.pdf[query.transportDir].v;
 	result.weight[1 - query.transportDir] = Math::Vec3();
 
 	return true;
@@ -199,7 +293,7 @@ bool EnvmapEnvironmentLight::SampleAndEstimateDirectionBidir(const GeneralizedBS
 
 Math::Vec3 EnvmapEnvironmentLight::EvaluateDirection(const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom) const
 {
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWo = geom.WorldToShading(query.wo);
 	if ((query.type & GeneralizedBSDFType::LightDirection) == 0 || (query.transportDir != TransportDirection::LE) || Math::CosThetaZUp(localWo) <= 0)
 	{
 		return Math::Vec3();
@@ -210,23 +304,37 @@ Math::Vec3 EnvmapEnvironmentLight::EvaluateDirection(const GeneralizedBSDFEvalua
 
 Math::PDFEval EnvmapEnvironmentLight::EvaluateDirectionPDF(const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom) const
 {
-	auto localWo = geom.worldToShading * query.wo;
-	if ((query.type & GeneralizedBSDFType::LightDirection) == 0 || (query.transportDir != TransportDirection::LE) || Math::CosThetaZUp(localWo) <= 0)
+	if ((query.type & GeneralizedBSDFType::LightDirection) == 0 || (query.transportDir != TransportDirection::LE))
 	{
 		return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
 	}
 
-	return CosineSampleHemispherePDFProjSA(localWo);
+	return LightDirectionPDF(query.wo, geom);
 }
 
 void EnvmapEnvironmentLight::SamplePosition(const Math::Vec2& sample, SurfaceGeometry& geom, Math::PDFEval& pdf) const
 {
-	auto d = Math::UniformSampleSphere(sample);
+	// Select the strategy reusing the sample
+	Math::Vec3 d;
+	if (lightProbeDist.Empty() || sample.x < UniformPositionSamplingProb)
+	{
+		const auto prob = lightProbeDist.Empty() ? Math::Float(1) : UniformPositionSamplingProb;
+		d = Math::UniformSampleSphere(Math::Vec2(Math::Min(sample.x / prob, Math::Float(1)), sample.y));
+	}
+	else
+	{
+		const Math::Vec2 u(Math::Min((sample.x - UniformPositionSamplingProb) / (Math::Float(1) - UniformPositionSamplingProb), Math::Float(1)), sample.y);
+		if (!SampleLightProbeDirection(u, d))
+		{
+			d = Math::UniformSampleSphere(sample);
+		}
+	}
+
 	geom.degenerated = false;
 	geom.p = bsphere.center + d * bsphere.radius;
 	geom.gn = geom.sn = -d;
 	geom.ComputeTangentSpace();
-	pdf = Math::PDFEval(invArea, Math::ProbabilityMeasure::Area);
+	pdf = EvaluatePositionPDF(geom);
 }
 
 Math::Vec3 EnvmapEnvironmentLight::EvaluatePosition(const SurfaceGeometry& geom) const
@@ -236,19 +344,135 @@ Math::Vec3 EnvmapEnvironmentLight::EvaluatePosition(const SurfaceGeometry& geom)
 
 Math::PDFEval EnvmapEnvironmentLight::EvaluatePositionPDF(const SurfaceGeometry& geom) const
 {
-	return Math::PDFEval(invArea, Math::ProbabilityMeasure::Area);
+	if (lightProbeDist.Empty())
+	{
+		return Math::PDFEval(invArea, Math::ProbabilityMeasure::Area);
+	}
+
+	// Convert the PDF w.r.t. solid angle from the center to the area measure on the sphere
+	const auto pdfSA = LightProbeDirectionPDF(-geom.gn);
+	return Math::PDFEval(
+		UniformPositionSamplingProb * invArea + (Math::Float(1) - UniformPositionSamplingProb) * pdfSA / (bsphere.radius * bsphere.radius),
+		Math::ProbabilityMeasure::Area);
 }
 
 Math::Vec3 EnvmapEnvironmentLight::EvaluateLightProbe(const Math::Vec3& d) const
+{
+	return Le->Evaluate(LightProbeUV(d)) * scale;
+}
+
+Math::Vec2 EnvmapEnvironmentLight::LightProbeUV(const Math::Vec3& d) const
 {
 	// Rotated direction
 	const auto t = Math::Vec3(Math::Rotate(-rotate, Math::Vec3(0, 1, 0)) * Math::Vec4(d));
 
 	// Convert ray direction to the uv coordinates of light probe
 	// See http://www.pauldebevec.com/Probes/ for details
-	const auto r = Math::Constants::InvPi() * std::acos(Math::Clamp(t.z, Math::Float(-1), Math::Float(1))) / Math::Sqrt(t.x*t.x + t.y*t.y);
-	const auto uv = (Math::Vec2(t.x * r, t.y * r) + Math::Vec2(1)) / Math::Float(2);
-	return Le->Evaluate(uv) * scale;
+	const auto l = Math::Sqrt(t.x*t.x + t.y*t.y);
+	const auto r = l > Math::Float(0) ? Math::Constants::InvPi() * std::acos(Math::Clamp(t.z, Math::Float(-1), Math::Float(1))) / l : Math::Float(0);
+	return (Math::Vec2(t.x * r, t.y * r) + Math::Vec2(1)) / Math::Float(2);
+}
+
+Math::Vec3 EnvmapEnvironmentLight::LightProbeDirection(const Math::Vec2& uv, Math::Float& jacobian) const
+{
+	// Inverse of #LightProbeUV
+	// Distance from the center of the light probe is proportional to the angle to z axis
+	const auto s = uv * Math::Float(2) - Math::Vec2(1);
+	const auto rho = Math::Sqrt(s.x*s.x + s.y*s.y);
+	if (rho > Math::Float(1))
+	{
+		jacobian = Math::Float(0);
+		return Math::Vec3();
+	}
+
+	// Jacobian between the solid angle and the uv coordinates : d\omega / d(uv) = 4\pi \sin(\pi\rho) / \rho
+	const auto theta = Math::Constants::Pi() * rho;
+	const auto sinTheta = Math::Sin(theta);
+	Math::Vec3 t;
+	if (rho > Math::Float(0))
+	{
+		jacobian = Math::Float(4) * Math::Constants::Pi() * sinTheta / rho;
+		t = Math::Vec3(s.x / rho * sinTheta, s.y / rho * sinTheta, Math::Cos(theta));
+	}
+	else
+	{
+		jacobian = Math::Float(4) * Math::Constants::Pi() * Math::Constants::Pi();
+		t = Math::Vec3(0, 0, 1);
+	}
+
+	return Math::Vec3(Math::Rotate(rotate, Math::Vec3(0, 1, 0)) * Math::Vec4(t));
+}
+
+bool EnvmapEnvironmentLight::SampleLightProbeDirection(const Math::Vec2& sample, Math::Vec3& d) const
+{
+	Math::Float pdfUV;
+	const auto uv = lightProbeDist.Sample(sample, pdfUV);
+	if (pdfUV <= Math::Float(0))
+	{
+		return false;
+	}
+
+	Math::Float jacobian;
+	d = LightProbeDirection(uv, jacobian);
+	return jacobian > Math::Float(0);
+}
+
+Math::Float EnvmapEnvironmentLight::LightProbeDirectionPDF(const Math::Vec3& d) const
+{
+	const auto uv = LightProbeUV(d);
+	Math::Float jacobian;
+	LightProbeDirection(uv, jacobian);
+	if (jacobian <= Math::Float(0))
+	{
+		return Math::Float(0);
+	}
+
+	return lightProbeDist.EvaluatePDF(uv) / jacobian;
+}
+
+bool EnvmapEnvironmentLight::SampleLightDirection(const Math::Vec2& sample, const SurfaceGeometry& geom, Math::Vec3& wo, Math::PDFEval& pdf) const
+{
+	// Select the strategy reusing the sample
+	if (lightProbeDist.Empty() || sample.x < CosineDirectionSamplingProb)
+	{
+		const auto prob = lightProbeDist.Empty() ? Math::Float(1) : CosineDirectionSamplingProb;
+		wo = geom.ShadingToWorld(Math::CosineSampleHemisphere(Math::Vec2(Math::Min(sample.x / prob, Math::Float(1)), sample.y)));
+	}
+	else
+	{
+		// Light propagates to the opposite direction of the sampled direction of the light probe
+		Math::Vec3 d;
+		const Math::Vec2 u(Math::Min((sample.x - CosineDirectionSamplingProb) / (Math::Float(1) - CosineDirectionSamplingProb), Math::Float(1)), sample.y);
+		if (!SampleLightProbeDirection(u, d))
+		{
+			return false;
+		}
+		wo = -d;
+	}
+
+	pdf = LightDirectionPDF(wo, geom);
+	return pdf.v > Math::Float(0);
+}
+
+Math::PDFEval EnvmapEnvironmentLight::LightDirectionPDF(const Math::Vec3& wo, const SurfaceGeometry& geom) const
+{
+	const auto localWo = geom.WorldToShading(wo);
+	const auto cosTheta = Math::CosThetaZUp(localWo);
+	if (cosTheta <= 0)
+	{
+		return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
+	}
+
+	const auto cosinePdf = Math::CosineSampleHemispherePDFProjSA(localWo);
+	if (lightProbeDist.Empty())
+	{
+		return cosinePdf;
+	}
+
+	// Convert the PDF w.r.t. solid angle to the projected solid angle
+	return Math::PDFEval(
+		CosineDirectionSamplingProb * cosinePdf.v + (Math::Float(1) - CosineDirectionSamplingProb) * LightProbeDirectionPDF(-wo) / cosTheta,
+		Math::ProbabilityMeasure::ProjectedSolidAngle);
 }
 
 LM_COMPONENT_REGISTER_IMPL(EnvmapEnvironmentLight, Light);
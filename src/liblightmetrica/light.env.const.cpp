@@ -69,6 +69,7 @@ public:
 public:
 
 	virtual bool EnvironmentLight() const override { return true; }
+	virtual Math::Vec3 Power() const override { return power; }
 
 private:
 
@@ -76,6 +77,7 @@ private:
 	BoundingSphere bsphere;		//!< Bounding sphere containing the entire scene.
 	Math::Float area;			//!< Area of the bounding sphere.
 	Math::Float invArea;		//!< Inverse of #area.
+	Math::Vec3 power;			//!< Power of the light.
 
 };
 
@@ -95,6 +97,9 @@ void ConstantEnvironmentLight::PostConfigure( const Scene& scene )
 	// Compute area
 	area = Math::Float(4) * Math::Constants::Pi() * bsphere.radius * bsphere.radius;
 	invArea = Math::Float(1) / area;
+
+	// Power incident to the disk with the radius of the bounding sphere
+	power = Le * Math::Constants::Pi() * Math::Constants::Pi() * bsphere.radius * bsphere.radius;
 }
 
 EmitterShape* ConstantEnvironmentLight::CreateEmitterShape() const
@@ -132,7 +137,7 @@ bool ConstantEnvironmentLight::SampleDirection( const GeneralizedBSDFSampleQuery
 
 	result.sampledType = GeneralizedBSDFType::LightDirection;
 	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
 
 	return true;
@@ -147,7 +152,7 @@ Math::Vec3 ConstantEnvironmentLight::SampleAndEstimateDirection( const Generaliz
 
 	result.sampledType = GeneralizedBSDFType::LightDirection;
 	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.pdf = Math::CosineSampleHemispherePDFProjSA(localWo);
 
 	return Math::Vec3(Math::Float(1));
@@ -162,7 +167,7 @@ bool ConstantEnvironmentLight::SampleAndEstimateDirectionBidir( const Generalize
 
 	result.sampledType = GeneralizedBSDFType::LightDirection;
 	auto localWo = Math::CosineSampleHemisphere(query.sample);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.pdf[query.transportDir] = Math::CosineSampleHemispherePDFProjSA(localWo);
 	result.pdf[1-query.transportDir] = Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
 	result.weight[query.transportDir] = Math::Vec3(Math::Float(1));
@@ -173,7 +178,7 @@ bool ConstantEnvironmentLight::SampleAndEstimateDirectionBidir( const Generalize
 
 Math::Vec3 ConstantEnvironmentLight::EvaluateDirection( const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom ) const
 {
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWo = geom.WorldToShading(query.wo);
 	if ((query.type & GeneralizedBSDFType::LightDirection) == 0 || (query.transportDir != TransportDirection::LE) || Math::CosThetaZUp(localWo) <= 0)
 	{
 		return Math::Vec3();
@@ -184,7 +189,7 @@ Math::Vec3 ConstantEnvironmentLight::EvaluateDirection( const GeneralizedBSDFEva
 
 Math::PDFEval ConstantEnvironmentLight::EvaluateDirectionPDF( const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom ) const
 {
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWo = geom.WorldToShading(query.wo);
 	if ((query.type & GeneralizedBSDFType::LightDirection) == 0 || (query.transportDir != TransportDirection::LE) || Math::CosThetaZUp(localWo) <= 0)
 	{
 		return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
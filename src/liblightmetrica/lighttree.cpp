@@ -0,0 +1,255 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/lighttree.h>
+#include <lightmetrica/light.h>
+#include <algorithm>
+
+LM_NAMESPACE_BEGIN
+
+LightTree::LightTree()
+	: globalProb(0)
+{
+
+}
+
+LightTree::~LightTree()
+{
+
+}
+
+void LightTree::Build( const std::vector<const Light*>& lights, const std::vector<Math::Float>& weights )
+{
+	entries.clear();
+	nodeEntries.clear();
+	nodes.clear();
+	globalEntries.clear();
+	globalDist.Clear();
+	lightEntries.clear();
+
+	// Classify the lights by the bounds
+	Math::Float sumTreeWeight(0);
+	Math::Float sumGlobalWeight(0);
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		Entry entry;
+		entry.light = lights[i];
+		entry.weight = weights[i];
+		entry.bound = lights[i]->GetAABB();
+		entry.leaf = -1;
+		entry.globalIndex = -1;
+
+		const int index = static_cast<int>(entries.size());
+		const bool finiteBound = !entry.light->EnvironmentLight() && entry.bound.min.x <= entry.bound.max.x;
+		if (finiteBound)
+		{
+			nodeEntries.push_back(index);
+			sumTreeWeight += entry.weight;
+		}
+		else
+		{
+			entry.globalIndex = static_cast<int>(globalEntries.size());
+			globalEntries.push_back(index);
+			globalDist.Add(entry.weight);
+			sumGlobalWeight += entry.weight;
+		}
+
+		entries.push_back(entry);
+		lightEntries[entry.light].push_back(index);
+	}
+
+	// Probability to choose the lights without finite bounds
+	globalDist.Normalize();
+	if (nodeEntries.empty())
+	{
+		globalProb = Math::Float(1);
+	}
+	else if (globalEntries.empty())
+	{
+		globalProb = Math::Float(0);
+	}
+	else
+	{
+		const auto sum = sumTreeWeight + sumGlobalWeight;
+		globalProb = sum > Math::Float(0) ? sumGlobalWeight / sum : Math::Float(globalEntries.size()) / Math::Float(entries.size());
+	}
+
+	// Build the hierarchy
+	if (!nodeEntries.empty())
+	{
+		nodes.reserve(2 * nodeEntries.size() - 1);
+		BuildNode(-1, 0, static_cast<int>(nodeEntries.size()));
+	}
+}
+
+int LightTree::BuildNode( int parent, int begin, int end )
+{
+	const int index = static_cast<int>(nodes.size());
+	nodes.emplace_back();
+
+	{
+		auto& node = nodes[index];
+		node.parent = parent;
+		node.child2 = -1;
+		node.entry = -1;
+		node.weight = Math::Float(0);
+		for (int i = begin; i < end; i++)
+		{
+			const auto& entry = entries[nodeEntries[i]];
+			node.bound = node.bound.Union(entry.bound);
+			node.weight += entry.weight;
+		}
+	}
+
+	// Leaf node
+	if (end - begin == 1)
+	{
+		nodes[index].entry = nodeEntries[begin];
+		entries[nodeEntries[begin]].leaf = index;
+		return index;
+	}
+
+	// Split at the median of the centroids along the longest axis of the centroid bound
+	AABB centroidBound;
+	for (int i = begin; i < end; i++)
+	{
+		const auto& bound = entries[nodeEntries[i]].bound;
+		centroidBound = centroidBound.Union((bound.min + bound.max) * Math::Float(0.5));
+	}
+
+	const int axis = centroidBound.LongestAxis();
+	const int mid = (begin + end) / 2;
+	std::nth_element(nodeEntries.begin() + begin, nodeEntries.begin() + mid, nodeEntries.begin() + end, [&](int i1, int i2)
+	{
+		const auto& b1 = entries[i1].bound;
+		const auto& b2 = entries[i2].bound;
+		return b1.min[axis] + b1.max[axis] < b2.min[axis] + b2.max[axis];
+	});
+
+	// The first child is placed next to the node
+	BuildNode(index, begin, mid);
+	const int child2 = BuildNode(index, mid, end);
+	nodes[index].child2 = child2;
+
+	return index;
+}
+
+Math::Float LightTree::Importance( const Node& node, const Math::Vec3& p ) const
+{
+	// Squared distance to the center of the bound
+	// clamped by the squared radius of the bound in order to avoid singularity
+	const auto center = (node.bound.min + node.bound.max) * Math::Float(0.5);
+	const auto dist2 = Math::Length2(p - center);
+	const auto radius2 = Math::Length2(node.bound.max - node.bound.min) * Math::Float(0.25);
+	return node.weight / Math::Max(Math::Max(dist2, radius2), Math::Constants::Eps());
+}
+
+Math::Float LightTree::ChildProbability( int node, int child, const Math::Vec3& p ) const
+{
+	const int child1 = node + 1;
+	const int child2 = nodes[node].child2;
+	const auto importance1 = Importance(nodes[child1], p);
+	const auto importance2 = Importance(nodes[child2], p);
+	const auto sum = importance1 + importance2;
+	if (sum <= Math::Float(0))
+	{
+		return Math::Float(0.5);
+	}
+
+	return (child == child1 ? importance1 : importance2) / sum;
+}
+
+const Light* LightTree::Sample( const Math::Vec3& p, Math::Float& u, Math::PDFEval& selectionPdf ) const
+{
+	if (entries.empty())
+	{
+		selectionPdf = Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::Discrete);
+		return nullptr;
+	}
+
+	int entryIndex;
+	if (u < globalProb)
+	{
+		// Lights without finite bounds
+		u /= globalProb;
+		entryIndex = globalEntries[globalDist.SampleReuse(u)];
+	}
+	else
+	{
+		// Traverse the tree
+		u = (u - globalProb) / (Math::Float(1) - globalProb);
+		int node = 0;
+		while (nodes[node].entry < 0)
+		{
+			const auto prob1 = ChildProbability(node, node + 1, p);
+			if (u < prob1)
+			{
+				u /= prob1;
+				node = node + 1;
+			}
+			else
+			{
+				u = (u - prob1) / (Math::Float(1) - prob1);
+				node = nodes[node].child2;
+			}
+		}
+		entryIndex = nodes[node].entry;
+	}
+
+	// PDF is evaluated in the same way as #EvaluatePDF
+	// because the same light might be included multiple times
+	const auto* light = entries[entryIndex].light;
+	selectionPdf = EvaluatePDF(p, light);
+	return light;
+}
+
+Math::PDFEval LightTree::EvaluatePDF( const Math::Vec3& p, const Light* light ) const
+{
+	Math::Float pdf(0);
+	auto it = lightEntries.find(light);
+	if (it != lightEntries.end())
+	{
+		for (int entryIndex : it->second)
+		{
+			pdf += EvaluateEntryPDF(p, entries[entryIndex]);
+		}
+	}
+
+	return Math::PDFEval(pdf, Math::ProbabilityMeasure::Discrete);
+}
+
+Math::Float LightTree::EvaluateEntryPDF( const Math::Vec3& p, const Entry& entry ) const
+{
+	if (entry.globalIndex >= 0)
+	{
+		return globalProb * globalDist.EvaluatePDF(entry.globalIndex);
+	}
+
+	// Product of the probabilities to choose the nodes from the root to the leaf
+	auto pdf = Math::Float(1) - globalProb;
+	for (int node = entry.leaf; nodes[node].parent >= 0; node = nodes[node].parent)
+	{
+		pdf *= ChildProbability(nodes[node].parent, node, p);
+	}
+
+	return pdf;
+}
+
+LM_NAMESPACE_END
@@ -67,14 +67,14 @@ bool PerfectMirrorBSDF::Load( const ConfigNode& node, const Assets& assets )
 
 bool PerfectMirrorBSDF::SampleDirection( const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
+	auto localWi = geom.WorldToShading(query.wi);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0)
 	{
 		return false;
 	}
 
 	auto localWo = Math::ReflectZUp(localWi);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.sampledType = GeneralizedBSDFType::SpecularReflection;
 	result.pdf = Math::PDFEval(Math::Float(1) / Math::CosThetaZUp(localWo), Math::ProbabilityMeasure::ProjectedSolidAngle);
 
@@ -83,14 +83,14 @@ bool PerfectMirrorBSDF::SampleDirection( const GeneralizedBSDFSampleQuery& query
 
 Math::Vec3 PerfectMirrorBSDF::SampleAndEstimateDirection( const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
+	auto localWi = geom.WorldToShading(query.wi);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0)
 	{
 		return Math::Vec3();
 	}
 
 	auto localWo = Math::ReflectZUp(localWi);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.sampledType = GeneralizedBSDFType::SpecularReflection;
 	result.pdf = Math::PDFEval(Math::Float(1) / Math::CosThetaZUp(localWo), Math::ProbabilityMeasure::ProjectedSolidAngle);
 
@@ -108,14 +108,14 @@ Math::Vec3 PerfectMirrorBSDF::SampleAndEstimateDirection( const GeneralizedBSDFS
 
 bool PerfectMirrorBSDF::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleBidirResult& result ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
+	auto localWi = geom.WorldToShading(query.wi);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0)
 	{
 		return false;
 	}
 
 	auto localWo = Math::ReflectZUp(localWi);
-	result.wo = geom.shadingToWorld * localWo;
+	result.wo = geom.ShadingToWorld(localWo);
 	result.sampledType = GeneralizedBSDFType::SpecularReflection;
 	result.pdf[query.transportDir] = Math::PDFEval(Math::Float(1) / Math::CosThetaZUp(localWo), Math::ProbabilityMeasure::ProjectedSolidAngle);
 	result.pdf[1-query.transportDir] = result.pdf[query.transportDir];
@@ -140,8 +140,8 @@ bool PerfectMirrorBSDF::SampleAndEstimateDirectionBidir( const GeneralizedBSDFSa
 
 Math::Vec3 PerfectMirrorBSDF::EvaluateDirection( const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWi = geom.WorldToShading(query.wi);
+	auto localWo = geom.WorldToShading(query.wo);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0 || Math::CosThetaZUp(localWo) <= 0)
 	{
 		return Math::Vec3();
@@ -155,8 +155,8 @@ Math::Vec3 PerfectMirrorBSDF::EvaluateDirection( const GeneralizedBSDFEvaluateQu
 		// TODO : This smells.
 		auto localWoTemp = Math::ReflectZUp(localWi);
 		auto localWiTemp = Math::ReflectZUp(localWo);
-		auto woTemp = geom.shadingToWorld * localWoTemp;
-		auto wiTemp = geom.shadingToWorld * localWiTemp;
+		auto woTemp = geom.ShadingToWorld(localWoTemp);
+		auto wiTemp = geom.ShadingToWorld(localWiTemp);
 		if (woTemp != query.wo && wiTemp != query.wi)
 		{
 			return Math::Vec3();
@@ -181,8 +181,8 @@ Math::Vec3 PerfectMirrorBSDF::EvaluateDirection( const GeneralizedBSDFEvaluateQu
 
 Math::PDFEval PerfectMirrorBSDF::EvaluateDirectionPDF( const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom ) const
 {
-	auto localWi = geom.worldToShading * query.wi;
-	auto localWo = geom.worldToShading * query.wo;
+	auto localWi = geom.WorldToShading(query.wi);
+	auto localWo = geom.WorldToShading(query.wo);
 	if ((query.type & BSDFTypes()) == 0 || Math::CosThetaZUp(localWi) <= 0 || Math::CosThetaZUp(localWo) <= 0)
 	{
 		return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
@@ -196,8 +196,8 @@ Math::PDFEval PerfectMirrorBSDF::EvaluateDirectionPDF( const GeneralizedBSDFEval
 		// TODO : This smells.
 		auto localWoTemp = Math::ReflectZUp(localWi);
 		auto localWiTemp = Math::ReflectZUp(localWo);
-		auto woTemp = geom.shadingToWorld * localWoTemp;
-		auto wiTemp = geom.shadingToWorld * localWiTemp;
+		auto woTemp = geom.ShadingToWorld(localWoTemp);
+		auto wiTemp = geom.ShadingToWorld(localWiTemp);
 		if (woTemp != query.wo && wiTemp != query.wi)
 		{
 			return Math::PDFEval(Math::Float(0), Math::ProbabilityMeasure::ProjectedSolidAngle);
@@ -31,6 +31,7 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <boost/regex.hpp>
+#include <mutex>
 
 LM_NAMESPACE_BEGIN
 
@@ -76,6 +77,53 @@ private:
 
 };
 
+/*
+	Scoped default logger of Assimp.
+	The logger of Assimp is a global object shared by the meshes loaded in parallel,
+	so that it is created by the first loader and destroyed by the last one.
+*/
+class AssimpLoggerScope final
+{
+public:
+
+	AssimpLoggerScope()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (refCount++ == 0)
+		{
+			Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
+			Assimp::DefaultLogger::get()->attachStream(new LogStream(Logger::LogLevel::Information), Assimp::Logger::Info);
+			Assimp::DefaultLogger::get()->attachStream(new LogStream(Logger::LogLevel::Warning), Assimp::Logger::Warn);
+			Assimp::DefaultLogger::get()->attachStream(new LogStream(Logger::LogLevel::Error), Assimp::Logger::Err);
+#if LM_DEBUG_MODE
+			Assimp::DefaultLogger::get()->attachStream(new LogStream(Logger::LogLevel::Debug), Assimp::Logger::Debugging);
+#endif
+		}
+	}
+
+	~AssimpLoggerScope()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (--refCount == 0)
+		{
+			Assimp::DefaultLogger::kill();
+		}
+	}
+
+private:
+
+	LM_DISABLE_COPY_AND_MOVE(AssimpLoggerScope);
+
+private:
+
+	static std::mutex mutex;
+	static int refCount;
+
+};
+
+std::mutex AssimpLoggerScope::mutex;
+int AssimpLoggerScope::refCount = 0;
+
 /*!
 	Obj mesh.
 	Triangle mesh implementation for Wavefront obj files.
@@ -132,13 +180,7 @@ bool ObjMesh::Load( const ConfigNode& node, const Assets& /*assets*/ )
 	//std::string groupName = node.child("group").child_value();
 
 	// Prepare for the logger of Assimp
-	Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
-	Assimp::DefaultLogger::get()->attachStream(new LogStream(Logger::LogLevel::Information), Assimp::Logger::Info);
-	Assimp::DefaultLogger::get()->attachStream(new LogStream(Logger::LogLevel::Warning), Assimp::Logger::Warn);
-	Assimp::DefaultLogger::get()->attachStream(new LogStream(Logger::LogLevel::Error), Assimp::Logger::Err);
-#if LM_DEBUG_MODE
-	Assimp::DefaultLogger::get()->attachStream(new LogStream(Logger::LogLevel::Debug), Assimp::Logger::Debugging);
-#endif
+	AssimpLoggerScope loggerScope;
 
 #if LM_STRICT_FP && LM_PLATFORM_WINDOWS
 	if (!FloatintPointUtils::EnableFPControl())
@@ -218,8 +260,6 @@ bool ObjMesh::Load( const ConfigNode& node, const Assets& /*assets*/ )
 		lastNumFaces += mesh->mNumFaces;
 	}
 
-	Assimp::DefaultLogger::kill();
-
 	return true;
 }
 
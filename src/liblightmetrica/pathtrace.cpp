@@ -107,8 +107,14 @@ private:
 public:
 
 	virtual void ProcessSingleSample(const Scene& scene) override;
+	virtual void ProcessMultipleSamples(const Scene& scene, long long numSamples) override;
 	virtual const Film* GetFilm() const override { return film.get(); }
 
+private:
+
+	void SampleCameraRay(const Scene& scene, Math::Vec2& rasterPos, Ray& ray, Math::Vec3& We_Estimated);
+	Math::Vec3 TracePath(const Scene& scene, Ray& ray, const Math::Vec3& We_Estimated, Intersection& isect, bool intersected);
+
 private:
 
 	const PathtraceRenderer& renderer;
@@ -163,9 +169,49 @@ RenderProcess* PathtraceRenderer::CreateRenderProcess(const Scene& scene, int th
 // --------------------------------------------------------------------------------
 
 void PathtraceRenderer_RenderProcess::ProcessSingleSample(const Scene& scene)
+{
+	Ray ray;
+	Math::Vec2 rasterPos;
+	Math::Vec3 We_Estimated;
+	SampleCameraRay(scene, rasterPos, ray, We_Estimated);
+
+	Intersection isect;
+	bool intersected = scene.Intersect(ray, isect);
+	film->AccumulateContribution(rasterPos, TracePath(scene, ray, We_Estimated, isect, intersected));
+}
+
+void PathtraceRenderer_RenderProcess::ProcessMultipleSamples(const Scene& scene, long long numSamples)
+{
+	// Primary rays are traced in batches of #BatchSize rays
+	// Note that the order of consumption of the random numbers differs from #ProcessSingleSample.
+	const int BatchSize = 64;
+	Ray rays[BatchSize];
+	Intersection isects[BatchSize];
+	Math::Vec2 rasterPoss[BatchSize];
+	Math::Vec3 We_Estimateds[BatchSize];
+	bool hits[BatchSize];
+
+	for (long long begin = 0; begin < numSamples; begin += BatchSize)
+	{
+		int n = static_cast<int>(Math::Min(static_cast<long long>(BatchSize), numSamples - begin));
+		for (int i = 0; i < n; i++)
+		{
+			SampleCameraRay(scene, rasterPoss[i], rays[i], We_Estimateds[i]);
+		}
+
+		scene.IntersectBatch(rays, isects, hits, n);
+
+		for (int i = 0; i < n; i++)
+		{
+			film->AccumulateContribution(rasterPoss[i], TracePath(scene, rays[i], We_Estimateds[i], isects[i], hits[i]));
+		}
+	}
+}
+
+void PathtraceRenderer_RenderProcess::SampleCameraRay(const Scene& scene, Math::Vec2& rasterPos, Ray& ray, Math::Vec3& We_Estimated)
 {
 	// Raster position
-	auto rasterPos = sampler->NextVec2();
+	rasterPos = sampler->NextVec2();
 
 	// Sample position on camera
 	SurfaceGeometry geomE;
@@ -178,15 +224,17 @@ void PathtraceRenderer_RenderProcess::ProcessSingleSample(const Scene& scene)
 	bsdfSQ.sample = rasterPos;
 	bsdfSQ.transportDir = TransportDirection::EL;
 	bsdfSQ.type = GeneralizedBSDFType::EyeDirection;
-	auto We_Estimated = scene.MainCamera()->SampleAndEstimateDirection(bsdfSQ, geomE, bsdfSR);
+	We_Estimated = scene.MainCamera()->SampleAndEstimateDirection(bsdfSQ, geomE, bsdfSR);
 
 	// Construct initial ray
-	Ray ray;
 	ray.o = geomE.p;
 	ray.d = bsdfSR.wo;
 	ray.minT = Math::Float(0);
 	ray.maxT = Math::Constants::Inf();
+}
 
+Math::Vec3 PathtraceRenderer_RenderProcess::TracePath(const Scene& scene, Ray& ray, const Math::Vec3& We_Estimated, Intersection& isect, bool intersected)
+{
 	Math::Vec3 throughput = We_Estimated;
 	Math::Vec3 L;
 	int numPathVertices = 1;
@@ -201,8 +249,12 @@ void PathtraceRenderer_RenderProcess::ProcessSingleSample(const Scene& scene)
 		// --------------------------------------------------------------------------------
 
 		// Check intersection
-		Intersection isect;
-		if (!scene.Intersect(ray, isect))
+		// The intersection with the primary ray is given by the caller
+		if (numPathVertices > 1)
+		{
+			intersected = scene.Intersect(ray, isect);
+		}
+		if (!intersected)
 		{
 			break;
 		}
@@ -262,7 +314,7 @@ void PathtraceRenderer_RenderProcess::ProcessSingleSample(const Scene& scene)
 		numPathVertices++;
 	}
 
-	film->AccumulateContribution(rasterPos, L);
+	return L;
 }
 
 LM_COMPONENT_REGISTER_IMPL(PathtraceRenderer, Renderer);
@@ -202,7 +202,7 @@ void DirectPathtraceRenderer_RenderProcess::ProcessSingleSample(const Scene& sce
 			Math::PDFEval pdfPL;
 			auto lightSampleP = sampler->NextVec2();
 			Math::PDFEval lightSelectionPdf;
-			const auto* light = scene.SampleLightSelection(lightSampleP, lightSelectionPdf);
+			const auto* light = scene.SampleLightSelection(currGeom.p, lightSampleP, lightSelectionPdf);
 			light->SamplePosition(lightSampleP, geomL, pdfPL);
 			pdfPL.v *= lightSelectionPdf.v;
 
@@ -199,7 +199,7 @@ void MISPathtraceRenderer_RenderProcess::ProcessSingleSample(const Scene& scene)
 			Math::PDFEval pdfPL;
 			auto lightSampleP = sampler->NextVec2();
 			Math::PDFEval lightSelectionPdf;
-			const auto* light = scene.SampleLightSelection(lightSampleP, lightSelectionPdf);
+			const auto* light = scene.SampleLightSelection(currGeom.p, lightSampleP, lightSelectionPdf);
 			light->SamplePosition(lightSampleP, geomL, pdfPL);
 			pdfPL.v *= lightSelectionPdf.v;
 
@@ -346,7 +346,7 @@ void MISPathtraceRenderer_RenderProcess::ProcessSingleSample(const Scene& scene)
 				{
 					// PDF for direct light sampling
 					auto G = RenderUtils::GeneralizedGeometryTerm(currGeom, isect.geom);
-					auto pdfD_DirectLight = Math::IsZero(G) ? Math::Float(0) : scene.LightSelectionPdf().v * light->EvaluatePositionPDF(isect.geom).v / G;
+					auto pdfD_DirectLight = Math::IsZero(G) ? Math::Float(0) : scene.LightSelectionPdf(currGeom.p, light).v * light->EvaluatePositionPDF(isect.geom).v / G;
 
 					// MIS weight
 					auto w = bsdfSR.pdf.v / (bsdfSR.pdf.v + pdfD_DirectLight);
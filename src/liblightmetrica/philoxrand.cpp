@@ -0,0 +1,268 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "simdsupport.h"
+#include <lightmetrica/random.h>
+#include <lightmetrica/align.h>
+#if LM_SSE2
+#include <emmintrin.h>
+#endif
+
+LM_NAMESPACE_BEGIN
+
+namespace
+{
+
+	// Constants of Philox4x32
+	const unsigned int PhiloxM0 = 0xD2511F53;
+	const unsigned int PhiloxM1 = 0xCD9E8D57;
+	const unsigned int PhiloxW0 = 0x9E3779B9;
+	const unsigned int PhiloxW1 = 0xBB67AE85;
+	const int PhiloxRounds = 10;
+
+	LM_FORCE_INLINE unsigned int MulHiLo(unsigned int a, unsigned int b, unsigned int& hi)
+	{
+		const unsigned long long p = static_cast<unsigned long long>(a) * static_cast<unsigned long long>(b);
+		hi = static_cast<unsigned int>(p >> 32);
+		return static_cast<unsigned int>(p);
+	}
+
+#if LM_SSE2
+
+	// Multiply four unsigned 32-bit integers and get lower and higher 32 bits of the products
+	LM_FORCE_INLINE void MulHiLo4(const __m128i& a, const __m128i& b, __m128i& lo, __m128i& hi)
+	{
+		// Products of the elements 0 and 2, and 1 and 3
+		const __m128i p02 = _mm_mul_epu32(a, b);
+		const __m128i p13 = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+		// Interleave lower and higher parts
+		const __m128i lo02 = _mm_shuffle_epi32(p02, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128i lo13 = _mm_shuffle_epi32(p13, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128i hi02 = _mm_shuffle_epi32(p02, _MM_SHUFFLE(3, 1, 3, 1));
+		const __m128i hi13 = _mm_shuffle_epi32(p13, _MM_SHUFFLE(3, 1, 3, 1));
+		lo = _mm_unpacklo_epi32(lo02, lo13);
+		hi = _mm_unpacklo_epi32(hi02, hi13);
+	}
+
+#endif
+
+}
+
+/*!
+	Philox random number generator.
+	A counter-based random number generator using Philox4x32-10.
+	The n-th number of the sequence is computed directly from the seed and n,
+	so the generator supports seeking in constant time.
+	Reference:
+		Salmon, J. K., Moraes, M. A., Dror, R. O., and Shaw, D. E.,
+		Parallel random numbers: as easy as 1, 2, 3,
+		In Proceedings of SC '11, 2011.
+*/
+class PhiloxRandom final : public Random
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("philox");
+
+public:
+
+	PhiloxRandom()
+	{
+		SetSeed(0);
+	}
+
+public:
+
+	virtual unsigned int NextUInt() override
+	{
+		if (bufferIndex == 4)
+		{
+			GenerateBlock(counter++, buffer);
+			bufferIndex = 0;
+		}
+		return buffer[bufferIndex++];
+	}
+
+	virtual void SetSeed(unsigned int seed) override
+	{
+		key[0] = seed;
+		key[1] = 0;
+		counter = 0;
+		bufferIndex = 4;
+	}
+
+	virtual Random* Clone() const override
+	{
+		return new PhiloxRandom;
+	}
+
+	virtual void NextBlock(Math::Float* values, int n) override;
+
+	virtual bool Seek(unsigned long long index) override
+	{
+		// Each block contains four numbers
+		counter = index >> 2;
+		bufferIndex = 4;
+		if ((index & 3) != 0)
+		{
+			GenerateBlock(counter++, buffer);
+			bufferIndex = static_cast<int>(index & 3);
+		}
+		return true;
+	}
+
+private:
+
+	/*!
+		Generate a block of four numbers.
+		\param blockIndex Index of the block used as the counter.
+		\param out Generated numbers.
+	*/
+	void GenerateBlock(unsigned long long blockIndex, unsigned int* out) const
+	{
+		unsigned int c[4] =
+		{
+			static_cast<unsigned int>(blockIndex),
+			static_cast<unsigned int>(blockIndex >> 32),
+			0,
+			0
+		};
+		unsigned int k0 = key[0];
+		unsigned int k1 = key[1];
+
+		for (int round = 0; round < PhiloxRounds; round++)
+		{
+			unsigned int hi0, hi1;
+			const unsigned int lo0 = MulHiLo(PhiloxM0, c[0], hi0);
+			const unsigned int lo1 = MulHiLo(PhiloxM1, c[2], hi1);
+			c[0] = hi1 ^ c[1] ^ k0;
+			c[1] = lo1;
+			c[2] = hi0 ^ c[3] ^ k1;
+			c[3] = lo0;
+			k0 += PhiloxW0;
+			k1 += PhiloxW1;
+		}
+
+		for (int i = 0; i < 4; i++)
+		{
+			out[i] = c[i];
+		}
+	}
+
+	/*!
+		Generate four blocks of four numbers.
+		The numbers are stored in the order of the sequence.
+		\param blockIndex Index of the first block.
+		\param out Generated numbers (16 elements).
+	*/
+	void GenerateBlocks4(unsigned long long blockIndex, unsigned int* out) const;
+
+private:
+
+	unsigned int key[2];			// Key (seed)
+	unsigned long long counter;		// Index of the next block
+	unsigned int buffer[4];			// Numbers of the current block
+	int bufferIndex;				// Index of the next number in the current block
+
+};
+
+void PhiloxRandom::GenerateBlocks4(unsigned long long blockIndex, unsigned int* out) const
+{
+#if LM_SSE2
+	// Counters of four blocks in SOA format
+	LM_ALIGN_16 unsigned int c0[4], c1[4];
+	for (int i = 0; i < 4; i++)
+	{
+		c0[i] = static_cast<unsigned int>(blockIndex + i);
+		c1[i] = static_cast<unsigned int>((blockIndex + i) >> 32);
+	}
+
+	__m128i x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(c0));
+	__m128i x1 = _mm_load_si128(reinterpret_cast<const __m128i*>(c1));
+	__m128i x2 = _mm_setzero_si128();
+	__m128i x3 = _mm_setzero_si128();
+	const __m128i m0 = _mm_set1_epi32(static_cast<int>(PhiloxM0));
+	const __m128i m1 = _mm_set1_epi32(static_cast<int>(PhiloxM1));
+	unsigned int k0 = key[0];
+	unsigned int k1 = key[1];
+
+	for (int round = 0; round < PhiloxRounds; round++)
+	{
+		__m128i lo0, hi0, lo1, hi1;
+		MulHiLo4(m0, x0, lo0, hi0);
+		MulHiLo4(m1, x2, lo1, hi1);
+		x0 = _mm_xor_si128(_mm_xor_si128(hi1, x1), _mm_set1_epi32(static_cast<int>(k0)));
+		x1 = lo1;
+		x2 = _mm_xor_si128(_mm_xor_si128(hi0, x3), _mm_set1_epi32(static_cast<int>(k1)));
+		x3 = lo0;
+		k0 += PhiloxW0;
+		k1 += PhiloxW1;
+	}
+
+	// Transpose to AOS format
+	const __m128i t0 = _mm_unpacklo_epi32(x0, x1);
+	const __m128i t1 = _mm_unpacklo_epi32(x2, x3);
+	const __m128i t2 = _mm_unpackhi_epi32(x0, x1);
+	const __m128i t3 = _mm_unpackhi_epi32(x2, x3);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 0), _mm_unpacklo_epi64(t0, t1));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi64(t0, t1));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpacklo_epi64(t2, t3));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm_unpackhi_epi64(t2, t3));
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		GenerateBlock(blockIndex + i, out + 4 * i);
+	}
+#endif
+}
+
+void PhiloxRandom::NextBlock(Math::Float* values, int n)
+{
+	int i = 0;
+
+	// Consume remaining numbers in the current block
+	while (i < n && bufferIndex < 4)
+	{
+		values[i++] = Math::Float(buffer[bufferIndex++] * (1.0/4294967296.0));
+	}
+
+	// Generate four blocks at once
+	LM_ALIGN_16 unsigned int blocks[16];
+	while (n - i >= 16)
+	{
+		GenerateBlocks4(counter, blocks);
+		counter += 4;
+		for (int j = 0; j < 16; j++)
+		{
+			values[i++] = Math::Float(blocks[j] * (1.0/4294967296.0));
+		}
+	}
+
+	// Remaining numbers
+	while (i < n)
+	{
+		values[i++] = Next();
+	}
+}
+
+LM_COMPONENT_REGISTER_IMPL(PhiloxRandom, Random);
+
+LM_NAMESPACE_END
@@ -22,6 +22,8 @@
 #include <lightmetrica/renderproc.h>
 #include <lightmetrica/pm.photon.h>
 #include <lightmetrica/pm.photonmap.h>
+#include <lightmetrica/pm.photonmap.kdtree.h>
+#include <lightmetrica/pm.photonmap.hashgrid.h>
 #include <lightmetrica/pm.kernel.h>
 #include <lightmetrica/confignode.h>
 #include <lightmetrica/logger.h>
@@ -36,14 +38,32 @@
 #include <lightmetrica/bsdf.h>
 #include <lightmetrica/primitive.h>
 #include <lightmetrica/film.h>
-#include <thread>
-#include <atomic>
+#include <lightmetrica/sched.h>
+#include <lightmetrica/threadpool.h>
+#include <mutex>
 #include <omp.h>
 
 LM_NAMESPACE_BEGIN
 
 typedef std::pair<const Photon*, Math::Float> CollectedPhotonInfo;
 
+namespace
+{
+
+	// Seed of the sampler for a chunk of light paths in photon tracing step
+	unsigned int PhotonTraceChunkSeed(unsigned int baseSeed, long long chunk)
+	{
+		unsigned long long h = (static_cast<unsigned long long>(baseSeed) << 32) ^ static_cast<unsigned long long>(chunk);
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return static_cast<unsigned int>(h);
+	}
+
+}
+
 /*!
 	Photon mapping renderer.
 	Implements photon mapping. Unoptimized version.
@@ -74,7 +94,14 @@ public:
 
 private:
 
-	void TracePhotons(const Scene& scene, Photons& photons, long long& tracedPaths) const;
+	bool TracePhotons(const Scene& scene, int numThreads, Photons& photons, long long& tracedPaths) const;
+
+	// Traces the light paths in a chunk with the sampler seeded from the chunk index.
+	// Tracing stops if the number of stored photons reaches #maxStoredPhotons. Returns the number of traced light paths.
+	long long TracePhotonChunk(const Scene& scene, Sampler& sampler, unsigned int baseSeed, long long chunk, size_t maxStoredPhotons, Photons& photons) const;
+
+	// Traces a light path and stores photons. Returns false if the number of stored photons reaches #maxStoredPhotons.
+	bool TracePhotonPath(const Scene& scene, Sampler& sampler, Photons& photons, size_t maxStoredPhotons) const;
 	void VisualizePhotons(const Scene& scene, Film& film) const;
 
 private:
@@ -97,6 +124,10 @@ private:
 	std::unique_ptr<PhotonDensityEstimationKernel> pdeKernel;	// Photon density estimation kernel
 	long long tracedLightPaths;									// # of traced light paths (used for density estimation)
 
+private:
+
+	static const long long TracePhotonsChunkSize = 1LL<<10;		// Number of light paths traced per chunk in photon tracing step
+
 };
 
 // --------------------------------------------------------------------------------
@@ -114,6 +145,8 @@ public:
 		: renderer(renderer)
 		, sampler(sampler)
 		, film(film)
+		, kdTreePhotonMap(dynamic_cast<const KdTreePhotonMap*>(renderer.photonMap.get()))
+		, hashGridPhotonMap(dynamic_cast<const HashGridPhotonMap*>(renderer.photonMap.get()))
 	{
 		collectedPhotonInfo.reserve(renderer.numNNQueryPhotons);
 	}
@@ -133,6 +166,8 @@ private:
 	std::unique_ptr<Sampler> sampler;
 	std::unique_ptr<Film> film;
 	std::vector<CollectedPhotonInfo> collectedPhotonInfo;
+	const KdTreePhotonMap* kdTreePhotonMap;		// Photon map if the implementation is kd-tree (used to avoid type-erased collect function)
+	const HashGridPhotonMap* hashGridPhotonMap;	// Photon map if the implementation is hash grid
 
 };
 
@@ -163,6 +198,7 @@ bool PhotonMappingRenderer::Configure(const ConfigNode& node, const Assets& asse
 	{
 		return false;
 	}
+	photonMap->SetMaxQueryDist(maxNNQueryDist);
 
 	// 'pde_kernel'
 	std::string pdeKernelType;
@@ -219,8 +255,11 @@ bool PhotonMappingRenderer::Preprocess(const Scene& scene, const RenderProcessSc
 		LM_LOG_INDENTER();
 
 		tracedLightPaths = 0;
-		photons.reserve(maxPhotons);
-		TracePhotons(scene, photons, tracedLightPaths);
+		if (!TracePhotons(scene, Math::Max(1, sched.NumThreads()), photons, tracedLightPaths))
+		{
+			LM_LOG_ERROR("Failed to trace photons");
+			return false;
+		}
 
 		LM_LOG_INFO("Completed");
 		LM_LOG_INFO("Traced " + std::to_string(tracedLightPaths) + " light paths");
@@ -282,111 +321,231 @@ void PhotonMappingRenderer::VisualizePhotons(const Scene& scene, Film& film) con
 	}
 }
 
-void PhotonMappingRenderer::TracePhotons(const Scene& scene, Photons& photons, long long& tracedPaths) const
+bool PhotonMappingRenderer::TracePhotons(const Scene& scene, int numThreads, Photons& photons, long long& tracedPaths) const
 {
-	std::unique_ptr<Sampler> sampler(initialSampler->Clone());
-	sampler->SetSeed(initialSampler->NextUInt());
-	
-	for (long long sample = 0; sample < numPhotonTraceSamples && static_cast<long long>(photons.size()) < maxPhotons; sample++)
+	// Light paths are traced in chunks of #TracePhotonsChunkSize paths.
+	// Each chunk is traced with the sampler seeded from the chunk index and stores the photons into its own buffer.
+	// The buffers are merged in the order of the chunks, thus the photons are independent of the number of threads.
+	struct PhotonTraceChunkResult
 	{
-		tracedPaths++;
-
-		SurfaceGeometry geomL;
-		Math::PDFEval pdfPL;
-
-		// Sample a position on the light
-		auto lightSampleP = sampler->NextVec2();
-		Math::PDFEval lightSelectionPdf;
-		const auto* light = scene.SampleLightSelection(lightSampleP, lightSelectionPdf);
-		light->SamplePosition(lightSampleP, geomL, pdfPL);
-		pdfPL.v *= lightSelectionPdf.v;
-
-		// Evaluate positional component of Le
-		auto positionalLe = light->EvaluatePosition(geomL);
+		Photons photons;
+		long long tracedPaths;
+		bool completed;
+		PhotonTraceChunkResult() : tracedPaths(0), completed(false) {}
+	};
+
+	const unsigned int baseSeed = initialSampler->NextUInt();
+	const long long numChunks = (numPhotonTraceSamples + TracePhotonsChunkSize - 1) / TracePhotonsChunkSize;
+	std::vector<PhotonTraceChunkResult> chunkResults(numChunks);
+
+	// Per-thread samplers
+	ThreadPool pool(numThreads);
+	std::vector<std::unique_ptr<Sampler>> samplers(pool.NumThreads());
+	for (auto& sampler : samplers)
+	{
+		sampler.reset(initialSampler->Clone());
+	}
 
-		// Trace light particle and evaluate importance
-		auto throughput = positionalLe / pdfPL.v;
-		auto currGeom = geomL;
-		Math::Vec3 currWi;
-		const GeneralizedBSDF* currBsdf = light;
-		int depth = 0;
+	// The frontier is the number of leading completed chunks.
+	// Once the photons in the chunks before the frontier reach #maxPhotons,
+	// the subsequent chunks are never used and the operation is canceled.
+	std::mutex frontierMutex;
+	long long frontier = 0;
+	long long frontierPhotons = 0;
 
-		while (true)
+	const bool result = pool.ParallelFor(numChunks, 1, [&](int threadID, long long begin, long long end)
+	{
+		for (long long chunk = begin; chunk < end; chunk++)
 		{
-			// Sample generalized BSDF
-			GeneralizedBSDFSampleQuery bsdfSQ;
-			bsdfSQ.sample = sampler->NextVec2();
-			bsdfSQ.uComp = sampler->Next();
-			bsdfSQ.transportDir = TransportDirection::LE;
-			bsdfSQ.type = GeneralizedBSDFType::All;
-			bsdfSQ.wi = currWi;
-
-			GeneralizedBSDFSampleResult bsdfSR;
-			auto fs_Estimated = currBsdf->SampleAndEstimateDirection(bsdfSQ, currGeom, bsdfSR);
-			if (Math::IsZero(fs_Estimated))
-			{
-				break;
-			}
-
-			auto nextThroughput = throughput * fs_Estimated;
+			auto& chunkResult = chunkResults[chunk];
+			chunkResult.tracedPaths = TracePhotonChunk(scene, *samplers[threadID], baseSeed, chunk, static_cast<size_t>(maxPhotons), chunkResult.photons);
 
-			// Russian roulette for path termination
-			if (depth >= 1)
+			double progress;
 			{
-				auto continueProb = Math::Min(Math::Float(1), Math::Luminance(nextThroughput) / Math::Luminance(throughput));
-				if (sampler->Next() > continueProb)
+				std::unique_lock<std::mutex> lock(frontierMutex);
+				chunkResult.completed = true;
+				while (frontier < numChunks && frontierPhotons < maxPhotons && chunkResults[frontier].completed)
+				{
+					frontierPhotons += static_cast<long long>(chunkResults[frontier].photons.size());
+					frontier++;
+				}
+				if (frontierPhotons >= maxPhotons)
 				{
-					break;
+					pool.Cancel();
 				}
 
-				throughput = nextThroughput / continueProb;
+				const auto sampleProgress = static_cast<double>(frontier) / numChunks;
+				const auto photonProgress = static_cast<double>(Math::Min(frontierPhotons, maxPhotons)) / maxPhotons;
+				progress = Math::Max(sampleProgress, photonProgress);
 			}
-			else
+
+			// Report progress from the main thread
+			if (threadID == 0)
 			{
-				throughput = nextThroughput;
+				signal_ReportProgress(progress, false);
 			}
+		}
+	});
 
-			// --------------------------------------------------------------------------------
+	if (!result)
+	{
+		return false;
+	}
+
+	// Merge the chunks in order until the number of photons reaches #maxPhotons
+	size_t numPhotons = 0;
+	for (long long chunk = 0; chunk < frontier; chunk++)
+	{
+		numPhotons += chunkResults[chunk].photons.size();
+	}
+	photons.reserve(Math::Min(numPhotons, static_cast<size_t>(maxPhotons)));
+	for (long long chunk = 0; chunk < frontier; chunk++)
+	{
+		auto& chunkResult = chunkResults[chunk];
+		const size_t remainingPhotons = static_cast<size_t>(maxPhotons) - photons.size();
+		if (chunkResult.photons.size() >= remainingPhotons)
+		{
+			// The chunk contains the light path which reaches #maxPhotons.
+			// The chunk is traced again with the remaining number of photons
+			// in order to find the number of light paths traced until the path.
+			Photons().swap(chunkResult.photons);
+			tracedPaths += TracePhotonChunk(scene, *samplers[0], baseSeed, chunk, remainingPhotons, chunkResult.photons);
+			photons.insert(photons.end(), chunkResult.photons.begin(), chunkResult.photons.end());
+			break;
+		}
+
+		tracedPaths += chunkResult.tracedPaths;
+		photons.insert(photons.end(), chunkResult.photons.begin(), chunkResult.photons.end());
+		Photons().swap(chunkResult.photons);
+	}
+
+	return true;
+}
 
-			// Setup next ray
-			Ray ray;
-			ray.d = bsdfSR.wo;
-			ray.o = currGeom.p;
-			ray.minT = Math::Constants::Eps();
-			ray.maxT = Math::Constants::Inf();
+long long PhotonMappingRenderer::TracePhotonChunk(const Scene& scene, Sampler& sampler, unsigned int baseSeed, long long chunk, size_t maxStoredPhotons, Photons& photons) const
+{
+	sampler.SetSeed(PhotonTraceChunkSeed(baseSeed, chunk));
+
+	long long tracedPaths = 0;
+	const long long begin = chunk * TracePhotonsChunkSize;
+	const long long end = Math::Min(begin + TracePhotonsChunkSize, numPhotonTraceSamples);
+	for (long long sample = begin; sample < end; sample++)
+	{
+		tracedPaths++;
+		if (!TracePhotonPath(scene, sampler, photons, maxStoredPhotons))
+		{
+			break;
+		}
+	}
 
-			// Intersection query
-			Intersection isect;
-			if (!scene.Intersect(ray, isect))
+	return tracedPaths;
+}
+
+bool PhotonMappingRenderer::TracePhotonPath(const Scene& scene, Sampler& sampler, Photons& photons, size_t maxStoredPhotons) const
+{
+	SurfaceGeometry geomL;
+	Math::PDFEval pdfPL;
+
+	// Sample a position on the light
+	auto lightSampleP = sampler.NextVec2();
+	Math::PDFEval lightSelectionPdf;
+	const auto* light = scene.SampleLightSelection(lightSampleP, lightSelectionPdf);
+	light->SamplePosition(lightSampleP, geomL, pdfPL);
+	pdfPL.v *= lightSelectionPdf.v;
+
+	// Evaluate positional component of Le
+	auto positionalLe = light->EvaluatePosition(geomL);
+
+	// Trace light particle and evaluate importance
+	auto throughput = positionalLe / pdfPL.v;
+	auto currGeom = geomL;
+	Math::Vec3 currWi;
+	const GeneralizedBSDF* currBsdf = light;
+	int depth = 0;
+
+	while (true)
+	{
+		// Sample generalized BSDF
+		GeneralizedBSDFSampleQuery bsdfSQ;
+		bsdfSQ.sample = sampler.NextVec2();
+		bsdfSQ.uComp = sampler.Next();
+		bsdfSQ.transportDir = TransportDirection::LE;
+		bsdfSQ.type = GeneralizedBSDFType::All;
+		bsdfSQ.wi = currWi;
+
+		GeneralizedBSDFSampleResult bsdfSR;
+		auto fs_Estimated = currBsdf->SampleAndEstimateDirection(bsdfSQ, currGeom, bsdfSR);
+		if (Math::IsZero(fs_Estimated))
+		{
+			break;
+		}
+
+		auto nextThroughput = throughput * fs_Estimated;
+
+		// Russian roulette for path termination
+		if (depth >= 1)
+		{
+			auto continueProb = Math::Min(Math::Float(1), Math::Luminance(nextThroughput) / Math::Luminance(throughput));
+			if (sampler.Next() > continueProb)
 			{
 				break;
 			}
 
-			// --------------------------------------------------------------------------------
+			throughput = nextThroughput / continueProb;
+		}
+		else
+		{
+			throughput = nextThroughput;
+		}
+
+		// --------------------------------------------------------------------------------
+
+		// Setup next ray
+		Ray ray;
+		ray.d = bsdfSR.wo;
+		ray.o = currGeom.p;
+		ray.minT = Math::Constants::Eps();
+		ray.maxT = Math::Constants::Inf();
+
+		// Intersection query
+		Intersection isect;
+		if (!scene.Intersect(ray, isect))
+		{
+			break;
+		}
+
+		// --------------------------------------------------------------------------------
+
+		// If intersected surface is non-specular, store the photon into photon map
+		if ((isect.bsdf->BSDFTypes() & GeneralizedBSDFType::NonDelta) > 0)
+		{
+			Photon photon;
+			photon.p = isect.geom.p;
+			photon.throughput = throughput;
+			photon.wi = -ray.d;
 
-			// If intersected surface is non-specular, store the photon into photon map
-			if ((isect.bsdf->BSDFTypes() & GeneralizedBSDFType::NonDelta) > 0)
+			if (photons.size() >= maxStoredPhotons)
 			{
-				Photon photon;
-				photon.p = isect.geom.p;
-				photon.throughput = throughput;
-				photon.wi = -ray.d;
-				photons.push_back(photon);
-				if (photons.size() == static_cast<size_t>(maxPhotons))
-				{
-					break;
-				}
+				return false;
 			}
 
-			// --------------------------------------------------------------------------------
-
-			// Update information
-			currGeom = isect.geom;
-			currWi = -ray.d;
-			currBsdf = isect.bsdf;
-			depth++;
+			photons.push_back(photon);
+			if (photons.size() == maxStoredPhotons)
+			{
+				return false;
+			}
 		}
+
+		// --------------------------------------------------------------------------------
+
+		// Update information
+		currGeom = isect.geom;
+		currWi = -ray.d;
+		currBsdf = isect.bsdf;
+		depth++;
 	}
+
+	return true;
 }
 
 // --------------------------------------------------------------------------------
@@ -479,7 +638,7 @@ void PhotonMappingRenderer_RenderProcess::ProcessSingleSample(const Scene& scene
 			Math::Float maxDist2 = renderer.maxNNQueryDist2;
 			collectedPhotonInfo.clear();
 			const size_t n = static_cast<size_t>(renderer.numNNQueryPhotons);
-			renderer.photonMap->CollectPhotons(isect.geom.p, maxDist2, [&n, this](const Math::Vec3& p, const Photon& photon, Math::Float& maxDist2)
+			const auto collectFunc = [&n, this](const Math::Vec3& p, const Photon& photon, Math::Float& maxDist2)
 			{
 				auto dist2 = Math::Length2(photon.p - p);
 				const auto comp = [](const CollectedPhotonInfo& p1, const CollectedPhotonInfo& p2)
@@ -505,7 +664,20 @@ void PhotonMappingRenderer_RenderProcess::ProcessSingleSample(const Scene& scene
 					std::push_heap(collectedPhotonInfo.begin(), collectedPhotonInfo.end(), comp);
 					maxDist2 = collectedPhotonInfo.front().second;
 				}
-			});
+			};
+
+			if (kdTreePhotonMap)
+			{
+				kdTreePhotonMap->CollectPhotons(isect.geom.p, maxDist2, collectFunc);
+			}
+			else if (hashGridPhotonMap)
+			{
+				hashGridPhotonMap->CollectPhotons(isect.geom.p, maxDist2, collectFunc);
+			}
+			else
+			{
+				renderer.photonMap->CollectPhotons(isect.geom.p, maxDist2, collectFunc);
+			}
 
 			// Density estimation
 			for (const auto& info : collectedPhotonInfo)
@@ -0,0 +1,185 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/pm.photonmap.hashgrid.h>
+#include <lightmetrica/aabb.h>
+#include <lightmetrica/parallel.h>
+#include <atomic>
+
+LM_NAMESPACE_BEGIN
+
+namespace
+{
+
+	// Minimum number of elements in a chunk processed in parallel
+	const size_t HashGridParallelMinChunkSize = 1<<14;
+
+}
+
+void HashGridPhotonMap::Build( const Photons& photons )
+{
+	const size_t n = photons.size();
+	data.clear();
+	blocks.clear();
+	bucketStart.assign(2, 0);
+	hashMask = 0;
+	cellSize = invCellSize = Math::Float(1);
+	origin = Math::Vec3();
+	if (n == 0)
+	{
+		return;
+	}
+
+	// Bound of the photons
+	AABB bound;
+	Parallel::Reduce(0, n, HashGridParallelMinChunkSize, bound,
+		[&](size_t begin, size_t end, AABB& result)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				result = result.Union(photons[i].p);
+			}
+		},
+		[](AABB& result, const AABB& chunkResult)
+		{
+			result = result.Union(chunkResult);
+		});
+	origin = bound.min;
+
+	// Cell size
+	if (maxQueryDist > Math::Float(0))
+	{
+		cellSize = maxQueryDist;
+	}
+	else
+	{
+		// If the maximum query distance is not given,
+		// the cell size is determined so that the bound is divided into about #n cells
+		const auto extent = bound.max - bound.min;
+		const auto maxExtent = Math::Max(extent.x, Math::Max(extent.y, extent.z));
+		if (maxExtent > Math::Float(0))
+		{
+			cellSize = maxExtent / Math::Max(Math::Float(1), Math::Float(std::cbrt(static_cast<double>(n))));
+		}
+	}
+	invCellSize = Math::Float(1) / cellSize;
+
+	// Number of buckets is the power of two not less than the number of photons
+	size_t numBuckets = 1;
+	while (numBuckets < n)
+	{
+		numBuckets *= 2;
+	}
+	hashMask = static_cast<unsigned int>(numBuckets - 1);
+
+	// Counting sort by the hash of the cells
+	// Count the number of photons in each bucket
+	std::vector<unsigned int> hashes(n);
+	std::vector<std::atomic<unsigned int>> counts(numBuckets);
+	Parallel::For(0, numBuckets, HashGridParallelMinChunkSize, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			counts[i].store(0, std::memory_order_relaxed);
+		}
+	});
+	Parallel::For(0, n, HashGridParallelMinChunkSize, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const auto& p = photons[i].p;
+			hashes[i] = CellHash(CellCoord(p.x, 0), CellCoord(p.y, 1), CellCoord(p.z, 2));
+			counts[hashes[i]].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+
+	// Start index of the photons and the blocks in the buckets
+	std::vector<unsigned int> photonStart(numBuckets + 1);
+	photonStart[0] = 0;
+	bucketStart.resize(numBuckets + 1);
+	bucketStart[0] = 0;
+	for (size_t i = 0; i < numBuckets; i++)
+	{
+		const auto count = counts[i].load(std::memory_order_relaxed);
+		photonStart[i + 1] = photonStart[i] + count;
+		bucketStart[i + 1] = bucketStart[i] + (count + BlockSize - 1) / BlockSize;
+		counts[i].store(photonStart[i], std::memory_order_relaxed);
+	}
+
+	// Scatter the indices of the photons
+	std::vector<unsigned int> sortedIndices(n);
+	Parallel::For(0, n, HashGridParallelMinChunkSize, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			sortedIndices[counts[hashes[i]].fetch_add(1, std::memory_order_relaxed)] = static_cast<unsigned int>(i);
+		}
+	});
+
+	// Sort the indices in each bucket in order to make the result independent of the scheduling,
+	// reorder the photons, and create the blocks
+	data.resize(n);
+	blocks.resize(bucketStart[numBuckets]);
+	Parallel::For(0, numBuckets, HashGridParallelMinChunkSize, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			std::sort(sortedIndices.begin() + photonStart[i], sortedIndices.begin() + photonStart[i + 1]);
+			for (unsigned int j = photonStart[i]; j < photonStart[i + 1]; j++)
+			{
+				data[j] = photons[sortedIndices[j]];
+			}
+
+			for (unsigned int j = bucketStart[i]; j < bucketStart[i + 1]; j++)
+			{
+				auto& block = blocks[j];
+				for (int k = 0; k < BlockSize; k++)
+				{
+					const auto index = photonStart[i] + (j - bucketStart[i]) * BlockSize + k;
+					if (index < photonStart[i + 1])
+					{
+						block.x[k] = data[index].p.x;
+						block.y[k] = data[index].p.y;
+						block.z[k] = data[index].p.z;
+						block.index[k] = index;
+					}
+					else
+					{
+						block.x[k] = block.y[k] = block.z[k] = Math::Constants::Inf();
+						block.index[k] = 0;
+					}
+				}
+			}
+		}
+	});
+}
+
+void HashGridPhotonMap::GetPhotons( std::vector<const Photon*>& photons ) const
+{
+	photons.clear();
+	for (const auto& photon : data)
+	{
+		photons.push_back(&photon);
+	}
+}
+
+LM_COMPONENT_REGISTER_IMPL(HashGridPhotonMap, PhotonMap);
+
+LM_NAMESPACE_END
\ No newline at end of file
@@ -18,188 +18,125 @@
 */
 
 #include "pch.h"
-#include <lightmetrica/pm.photonmap.h>
+#include <lightmetrica/pm.photonmap.kdtree.h>
 #include <lightmetrica/aabb.h>
+#include <lightmetrica/parallel.h>
+#include <algorithm>
+#include <numeric>
 
 LM_NAMESPACE_BEGIN
 
-/*!
-	Kd-tree node.
-	Compressed Kd-tree node for photon map.
-*/
-struct PhotonKdTreeNode
-{
-
-	// Initialize as internal node
-	void InitializeIntermediateNode(const Math::Float& p, unsigned int axis)
-	{
-		splitPos = p;
-		splitAxis = axis;
-		hasLeftChild = 0;
-		rightChild = (1<<29)-1;
-	}
-
-	// Initialize as leaf node
-	void InitializeLeaf()
-	{
-		splitAxis = 3;
-		rightChild = (1<<29)-1;
-		hasLeftChild = 0;
-	}
-
-	bool Leaf() const { return splitAxis == 3; }
-
-	Math::Float splitPos;
-	
-	// 0 - split axis is X
-	// 1 - split axis is Y
-	// 2 - split axis is Z
-	// 3 - leaf node
-	unsigned int splitAxis		: 2;
-	unsigned int hasLeftChild	: 1;
-	unsigned int rightChild		: 29;
-
-};
-
-/*!
-	Kd-tree photon map.
-	Implements photon map with Kd-tree.
-*/
-class KdTreePhotonMap final : public PhotonMap
+namespace
 {
-public:
-
-	LM_COMPONENT_IMPL_DEF("kdtree");
 
-public:
+	// Minimum number of photons in the both sides of a split to be processed in parallel
+	const size_t ParallelBuildMinPhotons = 1<<12;
 
-	virtual void Build(const Photons& photons) override;
-	virtual void CollectPhotons(const Math::Vec3& p, Math::Float& maxDist2, const PhotonCollectFunc& collectFunc) const override;
-	virtual void GetPhotons(std::vector<const Photon*>& photons) const override;
-
-private:
-
-	void RecursiveBuild(size_t nodeIndex, int start, int end, const Photons& photons, std::vector<size_t>& photonIndices, unsigned int& nextNodeIndex);
-	void RecursiveCollectPhotons(size_t nodeIndex, const Math::Vec3& p, Math::Float& maxDist2, const PhotonCollectFunc& collectFunc) const;
-
-public:
-
-	std::vector<PhotonKdTreeNode> nodes;
-	Photons data;
-
-};
+}
 
 void KdTreePhotonMap::Build( const Photons& photons )
 {
-	// Reverse node and data store
-	nodes.assign(photons.size(), PhotonKdTreeNode());
-	data.assign(photons.size(), Photon());
-
-	// Temporary array
-	std::vector<size_t> photonIndices(photons.size());
-	for (size_t i = 0; i < photons.size(); i++)
+	// Number of leaves (power of two)
+	// The leaves after the ceil(n / BlockSize)-th leaf are padding
+	const size_t n = photons.size();
+	size_t numLeaves = 1;
+	while (numLeaves * BlockSize < n)
 	{
-		photonIndices[i] = i;
+		numLeaves *= 2;
 	}
 
-	// Build recursively
-	unsigned int nextNodeIndex = 1;
-	RecursiveBuild(0, 0, static_cast<int>(photons.size()), photons, photonIndices, nextNodeIndex);
+	// Build intermediate nodes recursively
+	// The photons are sorted so that the leaf i contains the photons [i * BlockSize, (i + 1) * BlockSize)
+	nodes.assign(numLeaves - 1, Node());
+	std::vector<size_t> photonIndices(n);
+	std::iota(photonIndices.begin(), photonIndices.end(), 0);
+	RecursiveBuild(0, 0, numLeaves, photons, photonIndices, 0, Parallel::MaxTaskDepth());
+
+	// Create leaves
+	data.resize(n);
+	blocks.resize(numLeaves);
+	Parallel::For(0, numLeaves, 1<<10, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			auto& block = blocks[i];
+			for (int j = 0; j < BlockSize; j++)
+			{
+				const size_t index = i * BlockSize + j;
+				if (index < n)
+				{
+					const auto& photon = photons[photonIndices[index]];
+					data[index] = photon;
+					block.x[j] = photon.p.x;
+					block.y[j] = photon.p.y;
+					block.z[j] = photon.p.z;
+				}
+				else
+				{
+					block.x[j] = block.y[j] = block.z[j] = Math::Constants::Inf();
+				}
+			}
+		}
+	});
 }
 
-void KdTreePhotonMap::RecursiveBuild( size_t nodeIndex, int start, int end, const Photons& photons, std::vector<size_t>& photonIndices, unsigned int& nextNodeIndex )
+void KdTreePhotonMap::RecursiveBuild( size_t nodeIndex, size_t leafBegin, size_t leafEnd, const Photons& photons, std::vector<size_t>& photonIndices, int depth, int maxTaskDepth )
 {
 	// Leaf node
-	if (start + 1 == end)
+	if (leafBegin + 1 == leafEnd)
 	{
-		nodes[nodeIndex].InitializeLeaf();
-		data[nodeIndex] = photons[photonIndices[start]];
 		return;
 	}
 
-	// Split axis and position
-	AABB bound;
-	for (int i = start; i < end; i++)
-	{
-		bound = bound.Union(photons[photonIndices[i]].p);
-	}
-	int splitAxis = bound.LongestAxis();
-	int splitPos = (start + end) / 2;
-	std::nth_element(&photonIndices[start], &photonIndices[splitPos], &photonIndices[end-1]+1, [&](size_t i1, size_t i2)
-	{
-		const auto& p1 = photons[i1];
-		const auto& p2 = photons[i2];
-		return p1.p[splitAxis] == p2.p[splitAxis] ? i1 < i2 : p1.p[splitAxis] < p2.p[splitAxis];
-	});
-	
-	// Create intermediate node
-	const auto& splitPhoton = photons[photonIndices[splitPos]];
-	nodes[nodeIndex].InitializeIntermediateNode(splitPhoton.p[splitAxis], splitAxis);
-	data[nodeIndex] = splitPhoton;
+	// Range of the photons
+	// The photons fill the leaves from the left, so only the right subtree can be (partially) empty
+	const size_t n = photons.size();
+	const size_t leafMid = (leafBegin + leafEnd) / 2;
+	const size_t start = Math::Min(leafBegin * BlockSize, n);
+	const size_t splitPos = Math::Min(leafMid * BlockSize, n);
+	const size_t end = Math::Min(leafEnd * BlockSize, n);
 
-	// Continue recursively
-	if (start < splitPos)
-	{
-		nodes[nodeIndex].hasLeftChild = 1;
-		RecursiveBuild(nextNodeIndex++, start, splitPos, photons, photonIndices, nextNodeIndex);
-	}
-	if (splitPos + 1 < end)
+	auto& node = nodes[nodeIndex];
+	if (splitPos >= end)
 	{
-		nodes[nodeIndex].rightChild = nextNodeIndex++;
-		RecursiveBuild(nodes[nodeIndex].rightChild, splitPos+1, end, photons, photonIndices, nextNodeIndex);
+		// Right subtree is empty
+		node.splitPos = Math::Constants::Inf();
+		node.splitAxis = 0;
 	}
-}
-
-void KdTreePhotonMap::CollectPhotons( const Math::Vec3& p, Math::Float& maxDist2, const PhotonCollectFunc& collectFunc ) const
-{
-	RecursiveCollectPhotons(0, p, maxDist2, collectFunc);
-}
-
-void KdTreePhotonMap::RecursiveCollectPhotons( size_t nodeIndex, const Math::Vec3& p, Math::Float& maxDist2, const PhotonCollectFunc& collectFunc ) const
-{
-	const auto& node = nodes[nodeIndex];
-	if (!node.Leaf())
+	else
 	{
-		// Process children
-		int axis = node.splitAxis;
-		auto dist2 = (p[axis] - node.splitPos) * (p[axis] - node.splitPos);
-		if (p[axis] <= node.splitPos)
+		// Split axis and position
+		AABB bound;
+		for (size_t i = start; i < end; i++)
 		{
-			// Query point is located on left half -> left points are nearer
-			if (node.hasLeftChild)
-			{
-				// Left children
-				RecursiveCollectPhotons(nodeIndex + 1, p, maxDist2, collectFunc);
-			}
-			if (dist2 < maxDist2 && node.rightChild < static_cast<unsigned int>(nodes.size()))
-			{
-				// Right children
-				// Distances to the all photons in right half is no less than #dist2
-				RecursiveCollectPhotons(node.rightChild, p, maxDist2, collectFunc);
-			}
+			bound = bound.Union(photons[photonIndices[i]].p);
 		}
-		else
+		const int splitAxis = bound.LongestAxis();
+		std::nth_element(photonIndices.begin() + start, photonIndices.begin() + splitPos, photonIndices.begin() + end, [&](size_t i1, size_t i2)
 		{
-			// Query point is located on right half -> right points are nearer
-			if (node.rightChild < static_cast<unsigned int>(nodes.size()))
-			{
-				// Right children
-				RecursiveCollectPhotons(node.rightChild, p, maxDist2, collectFunc);
-			}
-			if (dist2 < maxDist2 && node.hasLeftChild)
-			{
-				// Left children
-				// Distances to the all photons in left half is no less than #dist2
-				RecursiveCollectPhotons(nodeIndex + 1, p, maxDist2, collectFunc);
-			}
-		}
+			const auto& p1 = photons[i1];
+			const auto& p2 = photons[i2];
+			return p1.p[splitAxis] == p2.p[splitAxis] ? i1 < i2 : p1.p[splitAxis] < p2.p[splitAxis];
+		});
+
+		node.splitPos = photons[photonIndices[splitPos]].p[splitAxis];
+		node.splitAxis = splitAxis;
 	}
 
-	// Dispatch photon collect function
-	auto dist2 = Math::Length2(data[nodeIndex].p - p);
-	if (dist2 < maxDist2)
+	// Continue recursively
+	if (depth < maxTaskDepth && splitPos - start >= ParallelBuildMinPhotons && end - splitPos >= ParallelBuildMinPhotons)
+	{
+		auto future = std::async(std::launch::async, [&, nodeIndex, leafBegin, leafMid, depth, maxTaskDepth]()
+		{
+			RecursiveBuild(2 * nodeIndex + 1, leafBegin, leafMid, photons, photonIndices, depth + 1, maxTaskDepth);
+		});
+		RecursiveBuild(2 * nodeIndex + 2, leafMid, leafEnd, photons, photonIndices, depth + 1, maxTaskDepth);
+		future.get();
+	}
+	else
 	{
-		collectFunc(p, data[nodeIndex], maxDist2);
+		RecursiveBuild(2 * nodeIndex + 1, leafBegin, leafMid, photons, photonIndices, depth + 1, maxTaskDepth);
+		RecursiveBuild(2 * nodeIndex + 2, leafMid, leafEnd, photons, photonIndices, depth + 1, maxTaskDepth);
 	}
 }
 
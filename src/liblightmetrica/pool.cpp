@@ -0,0 +1,83 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/pool.h>
+
+LM_NAMESPACE_BEGIN
+
+MemoryArena::MemoryArena( size_t blockSize )
+	: blockSize(blockSize)
+	, currentBlockIndex(0)
+	, currentBlock(nullptr)
+	, currentSize(0)
+	, currentOffset(0)
+{
+
+}
+
+MemoryArena::~MemoryArena()
+{
+	for (auto& block : blocks)
+	{
+		aligned_free(block.data);
+	}
+}
+
+void* MemoryArena::AllocateFromNextBlock( size_t size )
+{
+	// Find a subsequent block large enough for the request
+	// Blocks are aligned to #BlockAlignment, so the offset 0 satisfies any alignment
+	size_t nextIndex = currentBlock == nullptr ? 0 : currentBlockIndex + 1;
+	while (nextIndex < blocks.size() && blocks[nextIndex].size < size)
+	{
+		nextIndex++;
+	}
+
+	// Allocate a new block if not found
+	if (nextIndex == blocks.size())
+	{
+		Block block;
+		block.size = std::max(blockSize, size);
+		block.data = static_cast<unsigned char*>(aligned_malloc(block.size, BlockAlignment));
+		if (block.data == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		blocks.push_back(block);
+	}
+
+	currentBlockIndex = nextIndex;
+	currentBlock = blocks[nextIndex].data;
+	currentSize = blocks[nextIndex].size;
+	currentOffset = size;
+	return currentBlock;
+}
+
+size_t MemoryArena::TotalBlockSize() const
+{
+	size_t total = 0;
+	for (const auto& block : blocks)
+	{
+		total += block.size;
+	}
+	return total;
+}
+
+LM_NAMESPACE_END
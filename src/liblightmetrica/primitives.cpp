@@ -50,6 +50,7 @@ public:
 	virtual bool Load(const ConfigNode& node, const Assets& assets) override;
 	virtual bool PostConfigure(const Scene& scene) override;
 	virtual bool IntersectEmitterShapes(Ray& ray, Intersection& isect) const override;
+	virtual bool OccludedEmitterShapes(const Ray& ray) const override;
 	virtual AABB GetAABBEmitterShapes() const override;
 	virtual void Reset() override;
 	virtual int NumPrimitives() const override										{ return static_cast<int>(primitives.size()); }
@@ -166,9 +167,9 @@ bool PrimitivesImpl::Load( const ConfigNode& node, const Assets& assets )
 	}
 
 	// ## Light
-	referencedPrimitives.clear();
 	for (auto* light : lights)
 	{
+		referencedPrimitives.clear();
 		for (auto& primitive : primitives)
 		{
 			if (primitive->light == light)
@@ -178,7 +179,7 @@ bool PrimitivesImpl::Load( const ConfigNode& node, const Assets& assets )
 		}
 		light->RegisterPrimitives(referencedPrimitives);
 	}
-	if (environmentLightNode.Empty() && referencedPrimitives.empty())
+	if (lights.empty())
 	{
 		LM_LOG_WARN("Missing lights in the scene");
 	}
@@ -237,6 +238,22 @@ bool PrimitivesImpl::IntersectEmitterShapes( Ray& ray, Intersection& isect ) con
 	return intersected;
 }
 
+bool PrimitivesImpl::OccludedEmitterShapes( const Ray& ray ) const
+{
+	for (const auto& shape : emitterShapes)
+	{
+		// #Intersect might modify the ray, so we pass a copy
+		Ray shapeRay = ray;
+		Math::Float t;
+		if (shape->Intersect(shapeRay, t))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 AABB PrimitivesImpl::GetAABBEmitterShapes() const
 {
 	AABB aabb;
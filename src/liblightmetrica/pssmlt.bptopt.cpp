@@ -41,6 +41,7 @@
 #include <lightmetrica/camera.h>
 #include <lightmetrica/film.h>
 #include <lightmetrica/math.distribution.h>
+#include <lightmetrica/sched.h>
 #include <thread>
 #include <atomic>
 #include <omp.h>
@@ -93,7 +94,7 @@ private:
 private:
 
 	Math::Float normFactor;									//!< Normalization factor
-	std::unique_ptr<RewindableSampler> rewindableSampler;	//!< Rewindable sampler for light path generation
+	unsigned int seedStreamBaseSeed;						//!< Base seed of the streams of seed samples
 	std::vector<PSSMLTPathSeed> seedCandidates;				//!< Candidates of seeds for each thread
 	Math::DiscreteDistribution1D seedCandidateDist;			//!< Distribution for seed selection
 
@@ -208,39 +209,31 @@ bool BPTOptimizedPSSMLTRenderer::Preprocess( const Scene& scene, const RenderPro
 
 	// --------------------------------------------------------------------------------
 
-	// Initialize sampler
-	rewindableSampler.reset(ComponentFactory::Create<RewindableSampler>());
-	rewindableSampler->Configure(initialSampler->Rng()->Clone());
-	rewindableSampler->SetSeed(initialSampler->NextUInt());
+	// # Seed of the streams
+	seedStreamBaseSeed = initialSampler->NextUInt();
 
 	// --------------------------------------------------------------------------------
 
 	// # Sample candidates for seeds
 
-	// Take #numSeedSamples path samples and generate seeds for each thread
-	// This process must be done in a single thread in order to keep consistency of sample indexes
-
-	PSSMLTSplats splats;
-	Math::Float sumI(0);
-
-	for (long long sample = 0; sample < numSeedSamples; sample++)
-	{
-		// Current sample index
-		int index = rewindableSampler->SampleIndex();
-
-		// Sample light paths
-		// We note that path sampler might generate multiple light paths
-		pathSampler->SampleAndEvaluateBidir(scene, *rewindableSampler, *rewindableSampler, splats, rrDepth, -1);
-
-		// Calculate sum of luminance
-		auto I = splats.SumI();
-		if (!Math::IsZero(I))
+	// Take #numSeedSamples path samples and generate seeds for each thread (see PSSMLTSeedStreams)
+	Math::Float sumI;
+	const bool result = PSSMLTSeedStreams::SampleCandidates(
+		numSeedSamples, seedStreamBaseSeed, sched.NumThreads(), *initialSampler->Rng(), *pathSampler,
+		[&](PSSMLTPathSampler& localPathSampler, Sampler& sampler, PSSMLTSplats& splats)
+		{
+			// We note that path sampler might generate multiple light paths
+			localPathSampler.SampleAndEvaluateBidir(scene, sampler, sampler, splats, rrDepth, -1);
+		},
+		[this](double progress)
 		{
-			sumI += I;
-			seedCandidates.emplace_back(index, I);
-		}
+			signal_ReportProgress(progress, false);
+		},
+		seedCandidates, sumI);
 
-		signal_ReportProgress(static_cast<double>(sample) / numSeedSamples, false);
+	if (!result)
+	{
+		return false;
 	}
 
 	// --------------------------------------------------------------------------------
@@ -298,9 +291,12 @@ bool BPTOptimizedPSSMLTRenderer_RenderProcess::Configure(const Scene& scene, con
 	randomSampler->SetSeed(renderer.initialSampler->NextUInt());
 
 	// Restore state of the seed path
-	renderer.rewindableSampler->Rewind(seed.index);
-	subpathSamplerL->BeginRestore(*renderer.rewindableSampler);
-	subpathSamplerE->BeginRestore(*renderer.rewindableSampler);
+	std::unique_ptr<RewindableSampler> rewindableSampler(ComponentFactory::Create<RewindableSampler>());
+	rewindableSampler->Configure(renderer.initialSampler->Rng()->Clone());
+	rewindableSampler->SetSeed(PSSMLTSeedStreams::StreamSeed(renderer.seedStreamBaseSeed, seed.stream));
+	rewindableSampler->Rewind(seed.index);
+	subpathSamplerL->BeginRestore(*rewindableSampler);
+	subpathSamplerE->BeginRestore(*rewindableSampler);
 	pathSampler->SampleAndEvaluateBidir(scene, *subpathSamplerL, *subpathSamplerE, Current(), renderer.rrDepth, -1);
 	subpathSamplerE->EndRestore();
 	subpathSamplerL->EndRestore();
@@ -41,6 +41,7 @@
 #include <lightmetrica/camera.h>
 #include <lightmetrica/film.h>
 #include <lightmetrica/math.distribution.h>
+#include <lightmetrica/sched.h>
 #include <thread>
 #include <atomic>
 #include <omp.h>
@@ -110,7 +111,7 @@ private:
 private:
 
 	Math::Float normFactor;									//!< Normalization factor
-	std::unique_ptr<RewindableSampler> rewindableSampler;	//!< Rewindable sampler for light path generation
+	unsigned int seedStreamBaseSeed;						//!< Base seed of the streams of seed samples
 	std::vector<PSSMLTPathSeed> seedCandidates;				//!< Candidates of seeds for each thread
 	Math::DiscreteDistribution1D seedCandidateDist;			//!< Distribution for seed selection
 
@@ -264,39 +265,31 @@ bool PSSMLTRenderer::Preprocess( const Scene& scene, const RenderProcessSchedule
 
 	// --------------------------------------------------------------------------------
 
-	// # Initialize sampler
-	rewindableSampler.reset(ComponentFactory::Create<RewindableSampler>());
-	rewindableSampler->Configure(initialSampler->Rng()->Clone());
-	rewindableSampler->SetSeed(initialSampler->NextUInt());
+	// # Seed of the streams
+	seedStreamBaseSeed = initialSampler->NextUInt();
 
 	// --------------------------------------------------------------------------------
 
 	// # Sample candidates for seeds
 
-	// Take #numSeedSamples path samples and generate seeds for each thread
-	// This process must be done in a single thread in order to keep consistency of sample indexes
-
-	PSSMLTSplats splats;
-	Math::Float sumI(0);
-
-	for (long long sample = 0; sample < numSeedSamples; sample++)
-	{
-		// Current sample index
-		int index = rewindableSampler->SampleIndex();
-
-		// Sample light paths
-		// We note that path sampler might generate multiple light paths
-		pathSampler->SampleAndEvaluate(scene, *rewindableSampler, splats, rrDepth, -1);
-
-		// Calculate sum of luminance
-		auto I = splats.SumI();
-		if (!Math::IsZero(I))
+	// Take #numSeedSamples path samples and generate seeds for each thread (see PSSMLTSeedStreams)
+	Math::Float sumI;
+	const bool result = PSSMLTSeedStreams::SampleCandidates(
+		numSeedSamples, seedStreamBaseSeed, sched.NumThreads(), *initialSampler->Rng(), *pathSampler,
+		[&](PSSMLTPathSampler& localPathSampler, Sampler& sampler, PSSMLTSplats& splats)
 		{
-			sumI += I;
-			seedCandidates.emplace_back(index, I);
-		}
+			// We note that path sampler might generate multiple light paths
+			localPathSampler.SampleAndEvaluate(scene, sampler, splats, rrDepth, -1);
+		},
+		[this](double progress)
+		{
+			signal_ReportProgress(progress, false);
+		},
+		seedCandidates, sumI);
 
-		signal_ReportProgress(static_cast<double>(sample) / numSeedSamples, false);
+	if (!result)
+	{
+		return false;
 	}
 
 	// --------------------------------------------------------------------------------
@@ -352,9 +345,14 @@ bool PSSMLTRenderer_RenderProcess::Configure(const Scene& scene, const PSSMLTPat
 	randomSampler->SetSeed(renderer.initialSampler->NextUInt());
 
 	// Restore state of the seed path
-	renderer.rewindableSampler->Rewind(seed.index);
-	sampler->BeginRestore(*renderer.rewindableSampler);
-	renderer.pathSampler->SampleAndEvaluate(scene, *sampler, Current(), renderer.rrDepth, -1);
+	// The stream of the seed is rewound with a process-local sampler,
+	// so the cost is bounded by the number of samples in a stream.
+	std::unique_ptr<RewindableSampler> rewindableSampler(ComponentFactory::Create<RewindableSampler>());
+	rewindableSampler->Configure(renderer.initialSampler->Rng()->Clone());
+	rewindableSampler->SetSeed(PSSMLTSeedStreams::StreamSeed(renderer.seedStreamBaseSeed, seed.stream));
+	rewindableSampler->Rewind(seed.index);
+	sampler->BeginRestore(*rewindableSampler);
+	pathSampler->SampleAndEvaluate(scene, *sampler, Current(), renderer.rrDepth, -1);
 	sampler->EndRestore();
 
 	// Sanity check
@@ -104,6 +104,7 @@ bool PSSMLTBPTPathSampler::Configure( const ConfigNode& node, const Assets& asse
 		return false;
 	}
 
+	subpathL.evaluateRecursiveMIS = subpathE.evaluateRecursiveMIS = misWeight->RequiresRecursiveQuantities();
 	pool.reset(new BPTPathVertexPool);
 
 	return true;
@@ -113,6 +114,7 @@ PSSMLTPathSampler* PSSMLTBPTPathSampler::Clone() const
 {
 	auto* sampler = new PSSMLTBPTPathSampler;
 	sampler->misWeight.reset(misWeight->Clone());
+	sampler->subpathL.evaluateRecursiveMIS = sampler->subpathE.evaluateRecursiveMIS = misWeight->RequiresRecursiveQuantities();
 	sampler->pool.reset(new BPTPathVertexPool);
 	return sampler;
 }
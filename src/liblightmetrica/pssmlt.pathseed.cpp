@@ -0,0 +1,106 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/pssmlt.pathseed.h>
+#include <lightmetrica/pssmlt.pathsampler.h>
+#include <lightmetrica/pssmlt.splat.h>
+#include <lightmetrica/rewindablesampler.h>
+#include <lightmetrica/random.h>
+#include <lightmetrica/threadpool.h>
+#include <lightmetrica/logger.h>
+#include <atomic>
+
+LM_NAMESPACE_BEGIN
+
+bool PSSMLTSeedStreams::SampleCandidates(
+	long long numSeedSamples, unsigned int baseSeed, int numThreads, const Random& rng, const PSSMLTPathSampler& pathSampler,
+	const SampleFunc& sampleFunc, const ProgressFunc& progressFunc, std::vector<PSSMLTPathSeed>& candidates, Math::Float& sumI)
+{
+	const long long numStreams = NumStreams(numSeedSamples);
+	std::vector<std::vector<PSSMLTPathSeed>> streamCandidates(numStreams);
+	std::vector<Math::Float> streamSumI(numStreams, Math::Float(0));
+	std::atomic<long long> processedSamples(0);
+
+	// Thread-local samplers
+	ThreadPool pool(Math::Max(1, numThreads));
+	std::vector<std::unique_ptr<RewindableSampler>> rewindableSamplers(pool.NumThreads());
+	std::vector<std::unique_ptr<PSSMLTPathSampler>> pathSamplers(pool.NumThreads());
+	std::vector<PSSMLTSplats> splats(pool.NumThreads());
+	for (int i = 0; i < pool.NumThreads(); i++)
+	{
+		rewindableSamplers[i].reset(ComponentFactory::Create<RewindableSampler>());
+		rewindableSamplers[i]->Configure(rng.Clone());
+		pathSamplers[i].reset(pathSampler.Clone());
+	}
+
+	const bool result = pool.ParallelFor(numStreams, 1, [&](int threadID, long long begin, long long end)
+	{
+		auto& rewindableSampler = *rewindableSamplers[threadID];
+		for (long long stream = begin; stream < end; stream++)
+		{
+			const int streamIndex = static_cast<int>(stream);
+			const long long streamBegin = stream * NumSamplesPerStream;
+			const long long streamEnd = Math::Min(numSeedSamples, streamBegin + NumSamplesPerStream);
+			rewindableSampler.SetSeed(StreamSeed(baseSeed, streamIndex));
+
+			for (long long sample = streamBegin; sample < streamEnd; sample++)
+			{
+				// Current sample index
+				int index = rewindableSampler.SampleIndex();
+
+				// Sample light paths
+				sampleFunc(*pathSamplers[threadID], rewindableSampler, splats[threadID]);
+
+				// Calculate sum of luminance
+				auto I = splats[threadID].SumI();
+				if (!Math::IsZero(I))
+				{
+					streamSumI[stream] += I;
+					streamCandidates[stream].emplace_back(streamIndex, index, I);
+				}
+			}
+
+			// Progress is reported only from the calling thread
+			auto processed = processedSamples += streamEnd - streamBegin;
+			if (threadID == 0)
+			{
+				progressFunc(static_cast<double>(processed) / numSeedSamples);
+			}
+		}
+	});
+
+	if (!result)
+	{
+		LM_LOG_ERROR("Failed to sample seed candidates");
+		return false;
+	}
+
+	// Merge the candidates
+	sumI = Math::Float(0);
+	for (long long stream = 0; stream < numStreams; stream++)
+	{
+		sumI += streamSumI[stream];
+		candidates.insert(candidates.end(), streamCandidates[stream].begin(), streamCandidates[stream].end());
+	}
+
+	return true;
+}
+
+LM_NAMESPACE_END
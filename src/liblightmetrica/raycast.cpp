@@ -81,6 +81,12 @@ private:
 public:
 
 	virtual void ProcessSinglePixel(const Scene& scene, const Math::Vec2i& pixel) override;
+	virtual void ProcessMultiplePixels(const Scene& scene, const Math::Vec2i* pixels, int numPixels) override;
+
+private:
+
+	void GenerateRay(const Scene& scene, const Math::Vec2i& pixel, Math::Vec2& rasterPos, Ray& ray) const;
+	void RecordResult(const Scene& scene, const Math::Vec2& rasterPos, const Ray& ray, const Intersection& isect, bool intersected) const;
 
 };
 
@@ -94,11 +100,49 @@ RenderProcess* RaycastRenderer::CreateRenderProcess(const Scene& scene, int thre
 // --------------------------------------------------------------------------------
 
 void RaycastRenderer_RenderProcess::ProcessSinglePixel(const Scene& scene, const Math::Vec2i& pixel)
+{
+	Ray ray;
+	Math::Vec2 rasterPos;
+	GenerateRay(scene, pixel, rasterPos, ray);
+
+	// Check intersection
+	Intersection isect;
+	bool intersected = scene.Intersect(ray, isect);
+	RecordResult(scene, rasterPos, ray, isect, intersected);
+}
+
+void RaycastRenderer_RenderProcess::ProcessMultiplePixels(const Scene& scene, const Math::Vec2i* pixels, int numPixels)
+{
+	// Primary rays are traced in batches of #BatchSize rays
+	const int BatchSize = 64;
+	Ray rays[BatchSize];
+	Intersection isects[BatchSize];
+	Math::Vec2 rasterPoss[BatchSize];
+	bool hits[BatchSize];
+
+	for (int begin = 0; begin < numPixels; begin += BatchSize)
+	{
+		int n = Math::Min(BatchSize, numPixels - begin);
+		for (int i = 0; i < n; i++)
+		{
+			GenerateRay(scene, pixels[begin + i], rasterPoss[i], rays[i]);
+		}
+
+		scene.IntersectBatch(rays, isects, hits, n);
+
+		for (int i = 0; i < n; i++)
+		{
+			RecordResult(scene, rasterPoss[i], rays[i], isects[i], hits[i]);
+		}
+	}
+}
+
+void RaycastRenderer_RenderProcess::GenerateRay(const Scene& scene, const Math::Vec2i& pixel, Math::Vec2& rasterPos, Ray& ray) const
 {
 	auto* film = scene.MainCamera()->GetFilm();
 
 	// Raster position
-	Math::Vec2 rasterPos(
+	rasterPos = Math::Vec2(
 		(Math::Float(0.5) + Math::Float(pixel.x)) / Math::Float(film->Width()),
 		(Math::Float(0.5) + Math::Float(pixel.y)) / Math::Float(film->Height()));
 
@@ -115,15 +159,16 @@ void RaycastRenderer_RenderProcess::ProcessSinglePixel(const Scene& scene, const
 	bsdfSQ.type = GeneralizedBSDFType::EyeDirection;
 	scene.MainCamera()->SampleDirection(bsdfSQ, geomE, bsdfSR);
 
-	Ray ray;
 	ray.d = bsdfSR.wo;
 	ray.o = geomE.p;
 	ray.minT = Math::Float(0);
 	ray.maxT = Math::Constants::Inf();
+}
 
-	// Check intersection
-	Intersection isect;
-	if (scene.Intersect(ray, isect))
+void RaycastRenderer_RenderProcess::RecordResult(const Scene& scene, const Math::Vec2& rasterPos, const Ray& ray, const Intersection& isect, bool intersected) const
+{
+	auto* film = scene.MainCamera()->GetFilm();
+	if (intersected)
 	{
 		// Intersected : while color
 		Math::Float c = Math::Abs(Math::Dot(isect.geom.sn, -ray.d));
@@ -21,7 +21,6 @@
 #include <lightmetrica/renderutils.h>
 #include <lightmetrica/surfacegeometry.h>
 #include <lightmetrica/ray.h>
-#include <lightmetrica/intersection.h>
 #include <lightmetrica/scene.h>
 
 LM_NAMESPACE_BEGIN
@@ -65,8 +64,7 @@ bool RenderUtils::Visible( const Scene& scene, const Math::Vec3& p1, const Math:
 	shadowRay.minT = Math::Constants::Eps();
 	shadowRay.maxT = p1p2_Length * (Math::Float(1) - Math::Constants::Eps());
 
-	Intersection _;
-	return !scene.Intersect(shadowRay, _);
+	return !scene.Occluded(shadowRay);
 }
 
 Math::Float RenderUtils::GeneralizedGeometryTermWithVisibility( const Scene& scene, const SurfaceGeometry& geom1, const SurfaceGeometry& geom2 )
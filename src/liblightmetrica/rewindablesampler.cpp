@@ -80,7 +80,15 @@ public:
 		currentIndex = 0;
 		rng->SetSeed(initialSeed);
 
-		// Generate samples until the given index
+		// Seek directly if the random number generator supports random access.
+		// We note that the sample index is equal to the number of generated numbers.
+		if (rng->Seek(static_cast<unsigned long long>(index)))
+		{
+			currentIndex = index;
+			return;
+		}
+
+		// Otherwise generate samples until the given index
 		while (currentIndex < index)
 		{
 			// Discard the value
@@ -28,7 +28,12 @@
 #include <lightmetrica/logger.h>
 #include <lightmetrica/aabb.h>
 #include <lightmetrica/align.h>
+#include <lightmetrica/parallel.h>
+#include <lightmetrica/accelcache.h>
+#include <lightmetrica/confignode.h>
 #include <thread>
+#include <atomic>
+#include <mutex>
 
 LM_NAMESPACE_BEGIN
 
@@ -72,6 +77,20 @@ struct BVHNode : public SIMDAlignedType
 
 };
 
+/*
+	Flattened BVH node used for the acceleration structure cache.
+	Nodes are stored in depth-first order,
+	i.e., the left child of an internal node immediately follows the node.
+*/
+struct BVHCacheNode
+{
+	AABB bound;
+	int type;			// 0 : leaf, 1 : internal
+	int begin, end;		// Leaf node data
+	int splitAxis;		// Internal node data
+	int right;			// Index of the right child
+};
+
 struct BVHBuildData
 {
 	// Bounds of the triangles
@@ -163,23 +182,35 @@ public:
 
 public:
 
-	BVHScene() : maxTriInNode(255) {}
+	BVHScene() : maxTriInNode(255), parallelBuild(true) {}
 
 public:
 
 	virtual bool Build() override;
 	virtual bool IntersectTriangles(Ray& ray, Intersection& isect) const override;
+	virtual bool OccludedTriangles(const Ray& ray) const override;
 	virtual AABB GetAABBTriangles() const override { return aabbTris; }
 	virtual boost::signals2::connection Connect_ReportBuildProgress(const std::function<void(double, bool)>& func) override { return signal_ReportBuildProgress.connect(func); }
-	virtual bool Configure(const ConfigNode& node) override { return true; }
+	virtual bool Configure(const ConfigNode& node) override;
 
 private:
 
 	bool Intersect(const std::shared_ptr<BVHNode>& node, BVHTraversalData& data) const;
 	bool Intersect(const AABB& bound, BVHTraversalData& data) const;
-	std::shared_ptr<BVHNode> Build(const BVHBuildData& data, int begin, int end);
+	bool Occluded(const std::shared_ptr<BVHNode>& node, BVHTraversalData& data) const;
+	std::shared_ptr<BVHNode> Build(const BVHBuildData& data, int begin, int end, int depth);
 	void LoadPrimitives(const std::string& scenePath);
 
+private:
+
+	// Load or save the built acceleration structure from/to the cache file
+	std::string CacheKey() const;
+	bool LoadCache(const std::string& path, unsigned long long hash);
+	bool SaveCache(const std::string& path, unsigned long long hash) const;
+	void FlattenNodes(const std::shared_ptr<BVHNode>& node, std::vector<BVHCacheNode>& cacheNodes) const;
+	std::shared_ptr<BVHNode> UnflattenNodes(const std::vector<BVHCacheNode>& cacheNodes, int index) const;
+	bool ValidateCache(const std::vector<BVHCacheNode>& cacheNodes) const;
+
 private:
 
 	// The function is called when a leaf node is created
@@ -194,15 +225,74 @@ private:
 	std::shared_ptr<BVHNode> root;
 	std::vector<TriAccel> triAccels;
 	boost::signals2::signal<void (double, bool)> signal_ReportBuildProgress;
-	int numProcessedTris;
+	std::atomic<int> numProcessedTris;
+	std::mutex progressMutex;
+	int maxTaskDepth;
 	AABB aabbTris;
+	std::string cacheDir;		// Directory of the acceleration structure cache (empty if the cache is disabled)
+	bool parallelBuild;			// Build the tree in parallel (the result is same as the serial build)
+
+};
+
+// Minimum number of triangles processed in a separated task in the parallel build
+const int BVHParallelBuildMinTris = 1 << 14;
+
+// Minimum number of triangles processed in a thread in the parallel binning
+const size_t BVHParallelMinChunkSize = 1 << 15;
+
+// Number of buckets for the SAH evaluation
+const int BVHNumBuckets = 12;
+
+// Bounds of the triangles and the centroids used in the parallel build
+struct BVHBuildBounds
+{
+	AABB bound;
+	AABB centroidBound;
+};
 
+// Bounds and # of triangles for each bucket used in the parallel build
+template <int NumBuckets>
+struct BVHBuildBuckets
+{
+	AABB bound[NumBuckets];
+	int count[NumBuckets];
+	BVHBuildBuckets() { std::fill(count, count + NumBuckets, 0); }
 };
 
+bool BVHScene::Configure( const ConfigNode& node )
+{
+	// Optional cache directory
+	auto cacheNode = node.Child("cache");
+	if (!cacheNode.Empty())
+	{
+		cacheDir = cacheNode.Value();
+	}
+
+	// Optional serial build, e.g., for comparison
+	node.ChildValueOrDefault("parallel_build", true, parallelBuild);
+
+	return true;
+}
+
 bool BVHScene::Build()
 {
 	BVHBuildData data;
 
+	// Try to load from the cache
+	std::string cachePath;
+	unsigned long long hash = 0;
+	if (!cacheDir.empty())
+	{
+		hash = AccelerationCache::ComputeHash(*primitives);
+		cachePath = AccelerationCache::CachePath(cacheDir, CacheKey(), hash);
+		if (LoadCache(cachePath, hash))
+		{
+			LM_LOG_INFO("Loaded BVH from cache '" + cachePath + "'");
+			signal_ReportBuildProgress(1, true);
+			return true;
+		}
+	}
+
 	{
 		LM_LOG_INFO("Creating triaccels");
 		LM_LOG_INDENTER();
@@ -256,28 +346,220 @@ bool BVHScene::Build()
 
 		ResetProgress();
 
+		// The recursion starting from the maximum depth spawns no task, i.e., the build is serial
+		maxTaskDepth = Parallel::MaxTaskDepth();
+		const int rootDepth = parallelBuild ? 0 : maxTaskDepth;
+
 		auto start = std::chrono::high_resolution_clock::now();
-		root = Build(data, 0, static_cast<int>(triAccels.size()));
+		root = Build(data, 0, static_cast<int>(triAccels.size()), rootDepth);
 		auto end = std::chrono::high_resolution_clock::now();
 
 		double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) / 1000.0;
 		LM_LOG_INFO("Completed in " + std::to_string(elapsed) + " seconds");
 	}
 
+	// Save to the cache
+	// Failure to save the cache is not critical
+	if (!cachePath.empty())
+	{
+		if (SaveCache(cachePath, hash))
+		{
+			LM_LOG_INFO("Saved BVH to cache '" + cachePath + "'");
+		}
+		else
+		{
+			LM_LOG_WARN("Failed to save BVH to cache '" + cachePath + "'");
+		}
+	}
+
 	return true;
 }
 
-std::shared_ptr<BVHNode> BVHScene::Build( const BVHBuildData& data, int begin, int end )
+std::string BVHScene::CacheKey() const
 {
-	std::shared_ptr<BVHNode> node;
+	// All parameters affecting the structure of the tree
+	return boost::str(boost::format("bvh-leaf%d-buckets%d") % maxTriInNode % BVHNumBuckets);
+}
 
-	// Bound of the primitive [begin, end)
-	AABB bound;
-	for (int i = begin; i < end; i++)
+bool BVHScene::LoadCache( const std::string& path, unsigned long long hash )
+{
+	AccelerationCache cache;
+	if (!cache.OpenForRead(path, CacheKey(), hash))
+	{
+		return false;
+	}
+
+	std::vector<BVHCacheNode> cacheNodes;
+	if (!cache.ReadValue(aabbTris) ||
+		!cache.Read(triAccels) ||
+		!cache.Read(bvhTriIndices) ||
+		!cache.Read(cacheNodes) ||
+		!ValidateCache(cacheNodes))
+	{
+		LM_LOG_WARN("Broken cache file '" + path + "'");
+		aabbTris = AABB();
+		triAccels.clear();
+		bvhTriIndices.clear();
+		cache.Close();
+		return false;
+	}
+
+	root = UnflattenNodes(cacheNodes, 0);
+	return cache.Close();
+}
+
+bool BVHScene::SaveCache( const std::string& path, unsigned long long hash ) const
+{
+	std::vector<BVHCacheNode> cacheNodes;
+	FlattenNodes(root, cacheNodes);
+
+	AccelerationCache cache;
+	if (!cache.OpenForWrite(path, CacheKey(), hash))
+	{
+		return false;
+	}
+
+	if (!cache.WriteValue(aabbTris) ||
+		!cache.Write(triAccels) ||
+		!cache.Write(bvhTriIndices) ||
+		!cache.Write(cacheNodes))
+	{
+		cache.Close();
+		return false;
+	}
+
+	return cache.Close();
+}
+
+void BVHScene::FlattenNodes( const std::shared_ptr<BVHNode>& node, std::vector<BVHCacheNode>& cacheNodes ) const
+{
+	int index = static_cast<int>(cacheNodes.size());
+	cacheNodes.push_back(BVHCacheNode());
+	cacheNodes[index].bound = node->bound;
+	if (node->type == BVHNode::NodeType::Leaf)
+	{
+		cacheNodes[index].type = 0;
+		cacheNodes[index].begin = node->begin;
+		cacheNodes[index].end = node->end;
+	}
+	else
+	{
+		cacheNodes[index].type = 1;
+		cacheNodes[index].splitAxis = node->splitAxis;
+		FlattenNodes(node->left, cacheNodes);
+		cacheNodes[index].right = static_cast<int>(cacheNodes.size());
+		FlattenNodes(node->right, cacheNodes);
+	}
+}
+
+std::shared_ptr<BVHNode> BVHScene::UnflattenNodes( const std::vector<BVHCacheNode>& cacheNodes, int index ) const
+{
+	const auto& cacheNode = cacheNodes[index];
+	if (cacheNode.type == 0)
+	{
+		return std::shared_ptr<BVHNode>(new BVHNode(cacheNode.begin, cacheNode.end, cacheNode.bound));
+	}
+
+	auto left = UnflattenNodes(cacheNodes, index + 1);
+	auto right = UnflattenNodes(cacheNodes, cacheNode.right);
+	std::shared_ptr<BVHNode> node(new BVHNode(cacheNode.splitAxis, left, right));
+	node->bound = cacheNode.bound;
+	return node;
+}
+
+bool BVHScene::ValidateCache( const std::vector<BVHCacheNode>& cacheNodes ) const
+{
+	// Triangles must refer to the faces of the primitives
+	for (const auto& triAccel : triAccels)
+	{
+		if (!AccelerationCache::ValidTriangle(*primitives, static_cast<int>(triAccel.primIndex), static_cast<int>(triAccel.shapeIndex)))
+		{
+			return false;
+		}
+	}
+
+	const int numTris = static_cast<int>(triAccels.size());
+	for (int triIdx : bvhTriIndices)
 	{
-		bound = bound.Union(data.triBounds[bvhTriIndices[i]]);
+		if (triIdx < 0 || triIdx >= numTris)
+		{
+			return false;
+		}
 	}
 
+	// Nodes must form a tree in depth-first order.
+	// Children always follow the parent and are referred exactly once,
+	// which ensures #UnflattenNodes terminates and creates each node only once.
+	const int numNodes = static_cast<int>(cacheNodes.size());
+	const int numIndices = static_cast<int>(bvhTriIndices.size());
+	std::vector<int> numReferences(numNodes, 0);
+	for (int i = 0; i < numNodes; i++)
+	{
+		const auto& cacheNode = cacheNodes[i];
+		if (cacheNode.type == 0)
+		{
+			if (cacheNode.begin < 0 || cacheNode.begin > cacheNode.end || cacheNode.end > numIndices)
+			{
+				return false;
+			}
+		}
+		else if (cacheNode.type == 1)
+		{
+			if (cacheNode.splitAxis < 0 || cacheNode.splitAxis > 2 || cacheNode.right <= i + 1 || cacheNode.right >= numNodes)
+			{
+				return false;
+			}
+
+			numReferences[i + 1]++;
+			numReferences[cacheNode.right]++;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	if (numNodes == 0 || numReferences[0] != 0)
+	{
+		return false;
+	}
+
+	for (int i = 1; i < numNodes; i++)
+	{
+		if (numReferences[i] != 1)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::shared_ptr<BVHNode> BVHScene::Build( const BVHBuildData& data, int begin, int end, int depth )
+{
+	std::shared_ptr<BVHNode> node;
+
+	// Bound of the primitive [begin, end) and the centroids
+	// Large ranges (e.g., near the root) are processed in parallel.
+	// Note that the union of the bounds is independent of the order,
+	// so the result is same as the serial one.
+	BVHBuildBounds bounds;
+	Parallel::Reduce(begin, end, BVHParallelMinChunkSize, bounds,
+		[&](size_t chunkBegin, size_t chunkEnd, BVHBuildBounds& result)
+		{
+			for (size_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				result.bound = result.bound.Union(data.triBounds[bvhTriIndices[i]]);
+				result.centroidBound = result.centroidBound.Union(data.triBoundCentroids[bvhTriIndices[i]]);
+			}
+		},
+		[](BVHBuildBounds& result, const BVHBuildBounds& chunkResult)
+		{
+			result.bound = result.bound.Union(chunkResult.bound);
+			result.centroidBound = result.centroidBound.Union(chunkResult.centroidBound);
+		}, depth);
+	const auto& bound = bounds.bound;
+
 	// Number of primitives in the node
 	int numPrimitives = end - begin;
 	if (numPrimitives == 1)
@@ -290,14 +572,8 @@ std::shared_ptr<BVHNode> BVHScene::Build( const BVHBuildData& data, int begin, i
 	{
 		// Internal node
 
-		// Choose the axis to split
-		AABB centroidBound;
-		for (int i = begin; i < end; i++)
-		{
-			centroidBound = centroidBound.Union(data.triBoundCentroids[bvhTriIndices[i]]);
-		}
-
 		// Select split axis
+		const auto& centroidBound = bounds.centroidBound;
 		int splitAxis = centroidBound.LongestAxis();
 
 		// If the centroid bound according to the split axis is degenerated, take the node as a leaf.
@@ -314,19 +590,32 @@ std::shared_ptr<BVHNode> BVHScene::Build( const BVHBuildData& data, int begin, i
 			// and reduce the combination of the partitions.
 
 			// Create buckets
-			const int numBuckets = 12;
-			AABB bucketTriBound[numBuckets];
-			int bucketTriCount[numBuckets] = {0};
-			for (int i = begin; i < end; i++)
-			{
-				int bucketIdx = Math::Cast<int>(Math::Float(
-					Math::Float(numBuckets) * ((data.triBoundCentroids[bvhTriIndices[i]][splitAxis] - centroidBound.min[splitAxis])
-						/ (centroidBound.max[splitAxis] - centroidBound.min[splitAxis]))));
-
-				bucketIdx = Math::Min(bucketIdx, numBuckets - 1);
-				bucketTriCount[bucketIdx]++;
-				bucketTriBound[bucketIdx] = bucketTriBound[bucketIdx].Union(data.triBounds[bvhTriIndices[i]]);
-			}
+			const int numBuckets = BVHNumBuckets;
+			BVHBuildBuckets<numBuckets> buckets;
+			Parallel::Reduce(begin, end, BVHParallelMinChunkSize, buckets,
+				[&](size_t chunkBegin, size_t chunkEnd, BVHBuildBuckets<numBuckets>& result)
+				{
+					for (size_t i = chunkBegin; i < chunkEnd; i++)
+					{
+						int bucketIdx = Math::Cast<int>(Math::Float(
+							Math::Float(numBuckets) * ((data.triBoundCentroids[bvhTriIndices[i]][splitAxis] - centroidBound.min[splitAxis])
+								/ (centroidBound.max[splitAxis] - centroidBound.min[splitAxis]))));
+
+						bucketIdx = Math::Min(bucketIdx, numBuckets - 1);
+						result.count[bucketIdx]++;
+						result.bound[bucketIdx] = result.bound[bucketIdx].Union(data.triBounds[bvhTriIndices[i]]);
+					}
+				},
+				[&](BVHBuildBuckets<numBuckets>& result, const BVHBuildBuckets<numBuckets>& chunkResult)
+				{
+					for (int i = 0; i < numBuckets; i++)
+					{
+						result.count[i] += chunkResult.count[i];
+						result.bound[i] = result.bound[i].Union(chunkResult.bound[i]);
+					}
+				}, depth);
+			const auto* bucketTriBound = buckets.bound;
+			const auto* bucketTriCount = buckets.count;
 
 			// For each partition compute the cost
 			// Note that the number of possible partitions is numBuckets - 1
@@ -373,7 +662,23 @@ std::shared_ptr<BVHNode> BVHScene::Build( const BVHBuildData& data, int begin, i
 			if (minCost < Math::Float(numPrimitives) || numPrimitives > maxTriInNode)
 			{
 				int mid = static_cast<int>(std::partition(&bvhTriIndices[begin], &bvhTriIndices[end - 1] + 1, CompareToBucket(splitAxis, numBuckets, minCostIdx, data, centroidBound)) - &bvhTriIndices[0]);
-				node = std::shared_ptr<BVHNode>(new BVHNode(splitAxis, Build(data, begin, mid), Build(data, mid, end)));
+
+				// The two children refer to the disjoint ranges of #bvhTriIndices,
+				// so the left child can be processed in another thread.
+				std::shared_ptr<BVHNode> left, right;
+				if (depth < maxTaskDepth && mid - begin >= BVHParallelBuildMinTris && end - mid >= BVHParallelBuildMinTris)
+				{
+					auto future = std::async(std::launch::async, [this, &data, &left, begin, mid, depth]() { left = Build(data, begin, mid, depth + 1); });
+					right = Build(data, mid, end, depth + 1);
+					future.get();
+				}
+				else
+				{
+					left = Build(data, begin, mid, depth + 1);
+					right = Build(data, mid, end, depth + 1);
+				}
+
+				node = std::shared_ptr<BVHNode>(new BVHNode(splitAxis, left, right));
 			}
 			else
 			{
@@ -447,6 +752,46 @@ bool BVHScene::Intersect( const std::shared_ptr<BVHNode>& node, BVHTraversalData
 	return intersected;
 }
 
+bool BVHScene::OccludedTriangles( const Ray& ray ) const
+{
+	// The traversal data requires mutable ray
+	Ray occlusionRay = ray;
+	BVHTraversalData data(occlusionRay);
+	return Occluded(root, data);
+}
+
+bool BVHScene::Occluded( const std::shared_ptr<BVHNode>& node, BVHTraversalData& data ) const
+{
+	if (!Intersect(node->bound, data))
+	{
+		return false;
+	}
+
+	if (node->type == BVHNode::NodeType::Leaf)
+	{
+		// Terminate immediately if any triangle in the leaf is intersected
+		for (int i = node->begin; i < node->end; i++)
+		{
+			Math::Float t;
+			Math::Vec2 b;
+			if (triAccels[bvhTriIndices[i]].Intersect(data.ray, data.ray.minT, data.ray.maxT, b[0], b[1], t))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Visit the nearer child first in order to find a hit earlier
+	if (data.rayDirNegative[node->splitAxis])
+	{
+		return Occluded(node->right, data) || Occluded(node->left, data);
+	}
+
+	return Occluded(node->left, data) || Occluded(node->right, data);
+}
+
 bool BVHScene::Intersect( const AABB& bound, BVHTraversalData& data ) const
 {
 	auto& rayDirNegative = data.rayDirNegative;
@@ -474,8 +819,9 @@ bool BVHScene::Intersect( const AABB& bound, BVHTraversalData& data ) const
 
 void BVHScene::ReportProgress( int begin, int end )
 {
-	numProcessedTris += end - begin;
-	signal_ReportBuildProgress(static_cast<double>(numProcessedTris) / triAccels.size(), numProcessedTris == static_cast<int>(triAccels.size()));
+	int processed = numProcessedTris += end - begin;
+	std::unique_lock<std::mutex> lock(progressMutex);
+	signal_ReportBuildProgress(static_cast<double>(processed) / triAccels.size(), processed == static_cast<int>(triAccels.size()));
 }
 
 void BVHScene::ResetProgress()
@@ -26,9 +26,23 @@
 #include <lightmetrica/primitive.h>
 #include <lightmetrica/primitives.h>
 #include <lightmetrica/camera.h>
+#include <lightmetrica/light.h>
+#include <lightmetrica/lighttree.h>
 
 LM_NAMESPACE_BEGIN
 
+/*
+	World-space triangles.
+	The attributes are stored in separate arrays in order to load only the required attributes.
+*/
+struct Scene::PrecomputedTriangles
+{
+	std::vector<size_t> offsets;			// Index of the first triangle of each primitive
+	std::vector<Math::Float> gn;			// Geometry normals (3 elements per triangle)
+	std::vector<Math::Float> sn;			// Vertex normals (9 elements per triangle)
+	std::vector<Math::Float> uv;			// Vertex texture coordinates (6 elements per triangle, zero if not available)
+};
+
 Scene::Scene()
 {
 
@@ -42,6 +56,87 @@ Scene::~Scene()
 void Scene::Load( Primitives* primitives )
 {
 	this->primitives.reset(primitives);
+	precomputedTriangles.reset();
+}
+
+void Scene::PrecomputeTriangles()
+{
+	std::unique_ptr<PrecomputedTriangles> triangles(new PrecomputedTriangles);
+
+	// Offsets of the primitives
+	const int numPrimitives = primitives->NumPrimitives();
+	size_t numTriangles = 0;
+	for (int i = 0; i < numPrimitives; i++)
+	{
+		triangles->offsets.push_back(numTriangles);
+		const auto* mesh = primitives->PrimitiveByIndex(i)->mesh;
+		if (mesh)
+		{
+			numTriangles += mesh->NumFaces() / 3;
+		}
+	}
+
+	triangles->gn.resize(3 * numTriangles);
+	triangles->sn.resize(9 * numTriangles);
+	triangles->uv.resize(6 * numTriangles, Math::Float(0));
+
+	for (int i = 0; i < numPrimitives; i++)
+	{
+		const auto* primitive = primitives->PrimitiveByIndex(i);
+		const auto* mesh = primitive->mesh;
+		if (!mesh)
+		{
+			continue;
+		}
+
+		const auto* positions = mesh->Positions();
+		const auto* normals = mesh->Normals();
+		const auto* texcoords = mesh->TexCoords();
+		const auto* faces = mesh->Faces();
+		const int numFaces = mesh->NumFaces() / 3;
+		for (int f = 0; f < numFaces; f++)
+		{
+			const size_t t = triangles->offsets[i] + f;
+
+			// Geometry normal
+			// Computed in the same way as #StoreIntersectionFromBarycentricCoords without precomputation
+			int v1 = faces[3*f  ];
+			int v2 = faces[3*f+1];
+			int v3 = faces[3*f+2];
+			Math::Vec3 p1(primitive->transform * Math::Vec4(positions[3*v1], positions[3*v1+1], positions[3*v1+2], Math::Float(1)));
+			Math::Vec3 p2(primitive->transform * Math::Vec4(positions[3*v2], positions[3*v2+1], positions[3*v2+2], Math::Float(1)));
+			Math::Vec3 p3(primitive->transform * Math::Vec4(positions[3*v3], positions[3*v3+1], positions[3*v3+2], Math::Float(1)));
+			const auto gn = Math::Normalize(Math::Cross(p2 - p1, p3 - p1));
+			for (int k = 0; k < 3; k++)
+			{
+				triangles->gn[3*t+k] = gn[k];
+			}
+
+			// Vertex normals
+			const int vs[] = { v1, v2, v3 };
+			for (int j = 0; j < 3; j++)
+			{
+				const int v = vs[j];
+				const Math::Vec3 n(primitive->normalTransform * Math::Vec3(normals[3*v], normals[3*v+1], normals[3*v+2]));
+				for (int k = 0; k < 3; k++)
+				{
+					triangles->sn[9*t+3*j+k] = n[k];
+				}
+			}
+
+			// Texture coordinates
+			if (texcoords)
+			{
+				for (int j = 0; j < 3; j++)
+				{
+					triangles->uv[6*t+2*j  ] = texcoords[2*vs[j]  ];
+					triangles->uv[6*t+2*j+1] = texcoords[2*vs[j]+1];
+				}
+			}
+		}
+	}
+
+	precomputedTriangles = std::move(triangles);
 }
 
 bool Scene::PostConfigure()
@@ -52,6 +147,39 @@ bool Scene::PostConfigure()
 		return false;
 	}
 
+	// Create distribution for the light selection proportional to the power of the lights.
+	// The same light might be registered multiple times,
+	// so the weight of the light is split into its registrations.
+	const int nl = primitives->NumLights();
+	std::unordered_map<const Light*, int> numRegistrations;
+	for (int i = 0; i < nl; i++)
+	{
+		numRegistrations[primitives->LightByIndex(i)]++;
+	}
+
+	std::vector<const Light*> lights;
+	std::vector<Math::Float> weights;
+	lightSelectionDist.Clear();
+	for (int i = 0; i < nl; i++)
+	{
+		const auto* light = primitives->LightByIndex(i);
+		const auto weight = Math::Max(Math::Float(0), Math::Luminance(light->Power())) / Math::Float(numRegistrations[light]);
+		lightSelectionDist.Add(weight);
+		lights.push_back(light);
+		weights.push_back(weight);
+	}
+	lightSelectionDist.Normalize();
+
+	lightSelectionPdfs.clear();
+	for (int i = 0; i < nl; i++)
+	{
+		lightSelectionPdfs[primitives->LightByIndex(i)] += lightSelectionDist.EvaluatePDF(i);
+	}
+
+	// Light tree
+	lightTree.reset(new LightTree);
+	lightTree->Build(lights, weights);
+
 	return true;
 }
 
@@ -71,6 +199,37 @@ bool Scene::Intersect( Ray& ray, Intersection& isect ) const
 	return isectT || primitives->IntersectEmitterShapes(ray, isect);
 }
 
+bool Scene::Occluded( const Ray& ray ) const
+{
+	return OccludedTriangles(ray) || primitives->OccludedEmitterShapes(ray);
+}
+
+size_t Scene::IntersectBatch( Ray* rays, Intersection* isects, bool* hits, size_t n ) const
+{
+	IntersectTrianglesBatch(rays, isects, hits, n);
+
+	size_t numHits = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		// Same as #Intersect, emitter shapes are checked only if triangles are not intersected
+		hits[i] = hits[i] || primitives->IntersectEmitterShapes(rays[i], isects[i]);
+		if (hits[i])
+		{
+			numHits++;
+		}
+	}
+
+	return numHits;
+}
+
+void Scene::IntersectTrianglesBatch( Ray* rays, Intersection* isects, bool* hits, size_t n ) const
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		hits[i] = IntersectTriangles(rays[i], isects[i]);
+	}
+}
+
 const Camera* Scene::MainCamera() const
 {
 	return primitives->MainCamera();
@@ -78,24 +237,66 @@ const Camera* Scene::MainCamera() const
 
 const Light* Scene::SampleLightSelection( Math::Vec2& lightSampleP, Math::PDFEval& selectionPdf ) const
 {
-	int nl = primitives->NumLights();
-	int li = Math::Min(static_cast<int>(lightSampleP.x * nl), nl - 1);
-	lightSampleP.x = lightSampleP.x * nl - Math::Float(li);
-	selectionPdf = Math::PDFEval(Math::Float(1) / Math::Float(nl), Math::ProbabilityMeasure::Discrete);
-	return primitives->LightByIndex(li);
+	if (lightSelectionDist.Empty())
+	{
+		// Uniform selection
+		int nl = primitives->NumLights();
+		int li = Math::Min(static_cast<int>(lightSampleP.x * nl), nl - 1);
+		lightSampleP.x = lightSampleP.x * nl - Math::Float(li);
+		selectionPdf = Math::PDFEval(Math::Float(1) / Math::Float(nl), Math::ProbabilityMeasure::Discrete);
+		return primitives->LightByIndex(li);
+	}
+
+	const auto* light = primitives->LightByIndex(static_cast<int>(lightSelectionDist.SampleReuse(lightSampleP.x)));
+	selectionPdf = LightSelectionPdf(light);
+	return light;
 }
 
 const Light* Scene::SampleLightSelection( const Math::Float& lightSample, Math::PDFEval& selectionPdf ) const
 {
-	int nl = primitives->NumLights();
-	int li = Math::Min(static_cast<int>(lightSample * nl), nl - 1);
-	selectionPdf = Math::PDFEval(Math::Float(1) / Math::Float(nl), Math::ProbabilityMeasure::Discrete);
-	return primitives->LightByIndex(li);
+	if (lightSelectionDist.Empty())
+	{
+		// Uniform selection
+		int nl = primitives->NumLights();
+		int li = Math::Min(static_cast<int>(lightSample * nl), nl - 1);
+		selectionPdf = Math::PDFEval(Math::Float(1) / Math::Float(nl), Math::ProbabilityMeasure::Discrete);
+		return primitives->LightByIndex(li);
+	}
+
+	const auto* light = primitives->LightByIndex(static_cast<int>(lightSelectionDist.Sample(lightSample)));
+	selectionPdf = LightSelectionPdf(light);
+	return light;
+}
+
+Math::PDFEval Scene::LightSelectionPdf( const Light* light ) const
+{
+	if (lightSelectionDist.Empty())
+	{
+		return Math::PDFEval(Math::Float(1) / Math::Float(primitives->NumLights()), Math::ProbabilityMeasure::Discrete);
+	}
+
+	auto it = lightSelectionPdfs.find(light);
+	return Math::PDFEval(it == lightSelectionPdfs.end() ? Math::Float(0) : it->second, Math::ProbabilityMeasure::Discrete);
+}
+
+const Light* Scene::SampleLightSelection( const Math::Vec3& p, Math::Vec2& lightSampleP, Math::PDFEval& selectionPdf ) const
+{
+	if (!lightTree || lightTree->Empty())
+	{
+		return SampleLightSelection(lightSampleP, selectionPdf);
+	}
+
+	return lightTree->Sample(p, lightSampleP.x, selectionPdf);
 }
 
-Math::PDFEval Scene::LightSelectionPdf() const
+Math::PDFEval Scene::LightSelectionPdf( const Math::Vec3& p, const Light* light ) const
 {
-	return Math::PDFEval(Math::Float(1) / Math::Float(primitives->NumLights()), Math::ProbabilityMeasure::Discrete);
+	if (!lightTree || lightTree->Empty())
+	{
+		return LightSelectionPdf(light);
+	}
+
+	return lightTree->EvaluatePDF(p, light);
 }
 
 void Scene::StoreIntersectionFromBarycentricCoords( unsigned int primitiveIndex, unsigned int triangleIndex, const Ray& ray, const Math::Vec2& b, Intersection& isect ) const
@@ -108,37 +309,59 @@ void Scene::StoreIntersectionFromBarycentricCoords( unsigned int primitiveIndex,
 	isect.camera = primitive->camera;
 	isect.light = primitive->light;
 
+	// Intersection point
+	isect.geom.p = ray.o + ray.d * ray.maxT;
+
 	const auto* mesh = primitive->mesh;
-	const auto* positions = mesh->Positions();
-	const auto* normals = mesh->Normals();
 	const auto* texcoords = mesh->TexCoords();
-	const auto* faces = mesh->Faces();
+	if (precomputedTriangles)
+	{
+		const size_t t = precomputedTriangles->offsets[primitiveIndex] + triangleIndex;
 
-	// Intersection point
-	isect.geom.p = ray.o + ray.d * ray.maxT;
+		// Geometry normal
+		const auto* gn = &precomputedTriangles->gn[3*t];
+		isect.geom.gn = Math::Vec3(gn[0], gn[1], gn[2]);
+
+		// Shading normal
+		const auto* n = &precomputedTriangles->sn[9*t];
+		isect.geom.sn = Math::Normalize(Math::Vec3(n[0], n[1], n[2]) * (Math::Float(1) - b[0] - b[1]) + Math::Vec3(n[3], n[4], n[5]) * b[0] + Math::Vec3(n[6], n[7], n[8]) * b[1]);
 
-	// Geometry normal
-	int v1 = faces[3*triangleIndex  ];
-	int v2 = faces[3*triangleIndex+1];
-	int v3 = faces[3*triangleIndex+2];
-	Math::Vec3 p1(primitive->transform * Math::Vec4(positions[3*v1], positions[3*v1+1], positions[3*v1+2], Math::Float(1)));
-	Math::Vec3 p2(primitive->transform * Math::Vec4(positions[3*v2], positions[3*v2+1], positions[3*v2+2], Math::Float(1)));
-	Math::Vec3 p3(primitive->transform * Math::Vec4(positions[3*v3], positions[3*v3+1], positions[3*v3+2], Math::Float(1)));
-	isect.geom.gn = Math::Normalize(Math::Cross(p2 - p1, p3 - p1));
-
-	// Shading normal
-	Math::Vec3 n1(primitive->normalTransform * Math::Vec3(normals[3*v1], normals[3*v1+1], normals[3*v1+2]));
-	Math::Vec3 n2(primitive->normalTransform * Math::Vec3(normals[3*v2], normals[3*v2+1], normals[3*v2+2]));
-	Math::Vec3 n3(primitive->normalTransform * Math::Vec3(normals[3*v3], normals[3*v3+1], normals[3*v3+2]));
-	isect.geom.sn = Math::Normalize(n1 * (Math::Float(1) - b[0] - b[1]) + n2 * b[0] + n3 * b[1]);
-
-	// Texture coordinates
-	if (texcoords)
+		// Texture coordinates
+		if (texcoords)
+		{
+			const auto* uv = &precomputedTriangles->uv[6*t];
+			isect.geom.uv = Math::Vec2(uv[0], uv[1]) * Math::Float(Math::Float(1) - b[0] - b[1]) + Math::Vec2(uv[2], uv[3]) * b[0] + Math::Vec2(uv[4], uv[5]) * b[1];
+		}
+	}
+	else
 	{
-		Math::Vec2 uv1(texcoords[2*v1], texcoords[2*v1+1]);
-		Math::Vec2 uv2(texcoords[2*v2], texcoords[2*v2+1]);
-		Math::Vec2 uv3(texcoords[2*v3], texcoords[2*v3+1]);
-		isect.geom.uv = uv1 * Math::Float(Math::Float(1) - b[0] - b[1]) + uv2 * b[0] + uv3 * b[1];
+		const auto* positions = mesh->Positions();
+		const auto* normals = mesh->Normals();
+		const auto* faces = mesh->Faces();
+
+		// Geometry normal
+		int v1 = faces[3*triangleIndex  ];
+		int v2 = faces[3*triangleIndex+1];
+		int v3 = faces[3*triangleIndex+2];
+		Math::Vec3 p1(primitive->transform * Math::Vec4(positions[3*v1], positions[3*v1+1], positions[3*v1+2], Math::Float(1)));
+		Math::Vec3 p2(primitive->transform * Math::Vec4(positions[3*v2], positions[3*v2+1], positions[3*v2+2], Math::Float(1)));
+		Math::Vec3 p3(primitive->transform * Math::Vec4(positions[3*v3], positions[3*v3+1], positions[3*v3+2], Math::Float(1)));
+		isect.geom.gn = Math::Normalize(Math::Cross(p2 - p1, p3 - p1));
+
+		// Shading normal
+		Math::Vec3 n1(primitive->normalTransform * Math::Vec3(normals[3*v1], normals[3*v1+1], normals[3*v1+2]));
+		Math::Vec3 n2(primitive->normalTransform * Math::Vec3(normals[3*v2], normals[3*v2+1], normals[3*v2+2]));
+		Math::Vec3 n3(primitive->normalTransform * Math::Vec3(normals[3*v3], normals[3*v3+1], normals[3*v3+2]));
+		isect.geom.sn = Math::Normalize(n1 * (Math::Float(1) - b[0] - b[1]) + n2 * b[0] + n3 * b[1]);
+
+		// Texture coordinates
+		if (texcoords)
+		{
+			Math::Vec2 uv1(texcoords[2*v1], texcoords[2*v1+1]);
+			Math::Vec2 uv2(texcoords[2*v2], texcoords[2*v2+1]);
+			Math::Vec2 uv3(texcoords[2*v3], texcoords[2*v3+1]);
+			isect.geom.uv = uv1 * Math::Float(Math::Float(1) - b[0] - b[1]) + uv2 * b[0] + uv3 * b[1];
+		}
 	}
 
 	// Scene surface is not degenerated
@@ -38,6 +38,7 @@ public:
 
 	virtual bool Build() override;
 	virtual bool IntersectTriangles(Ray& ray, Intersection& isect) const override;
+	virtual bool OccludedTriangles(const Ray& ray) const override;
 	virtual AABB GetAABBTriangles() const override { return aabbTris; }
 	virtual boost::signals2::connection Connect_ReportBuildProgress(const std::function<void(double, bool)>& func) override { return signal_ReportBuildProgress.connect(func); }
 	virtual bool Configure(const ConfigNode& node) override { return true; }
@@ -123,6 +124,21 @@ bool NaiveScene::IntersectTriangles( Ray& ray, Intersection& isect ) const
 	return intersected;
 }
 
+bool NaiveScene::OccludedTriangles( const Ray& ray ) const
+{
+	for (const auto& triAccel : triAccels)
+	{
+		Math::Float t;
+		Math::Vec2 b;
+		if (triAccel.Intersect(ray, ray.minT, ray.maxT, b[0], b[1], t))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 LM_COMPONENT_REGISTER_IMPL(NaiveScene, Scene);
 
 LM_NAMESPACE_END
\ No newline at end of file
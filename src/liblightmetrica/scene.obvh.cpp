@@ -0,0 +1,696 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "simdsupport.h"
+#include <lightmetrica/scene.h>
+#include <lightmetrica/logger.h>
+#include <lightmetrica/ray.h>
+#include <lightmetrica/primitive.h>
+#include <lightmetrica/primitives.h>
+#include <lightmetrica/trianglemesh.h>
+#include <lightmetrica/aabb.h>
+#include <lightmetrica/align.h>
+#include <lightmetrica/triangleref.h>
+#include <lightmetrica/binnedsah.h>
+#include <lightmetrica/confignode.h>
+#include <lightmetrica/intersection.h>
+
+LM_NAMESPACE_BEGIN
+
+#if LM_AVX && LM_SINGLE_PRECISION
+
+// Octuple ray structure in SOA format
+struct LM_ALIGN_32 Ray8
+{
+
+	__m256 ox, oy, oz;
+	__m256 dx, dy, dz;
+	__m256 minT, maxT;
+
+	LM_FORCE_INLINE Ray8(const Ray& ray)
+	{
+		ox = _mm256_set1_ps(ray.o.x);
+		oy = _mm256_set1_ps(ray.o.y);
+		oz = _mm256_set1_ps(ray.o.z);
+		dx = _mm256_set1_ps(ray.d.x);
+		dy = _mm256_set1_ps(ray.d.y);
+		dz = _mm256_set1_ps(ray.d.z);
+		minT = _mm256_set1_ps(ray.minT);
+		maxT = _mm256_set1_ps(ray.maxT);
+	}
+
+};
+
+// Octuple triangle structure for AVX optimized triangle intersection
+struct LM_ALIGN_32 OctTriangle
+{
+
+	__m256 origx, origy, origz;
+	__m256 edge1x, edge1y, edge1z;
+	__m256 edge2x, edge2y, edge2z;
+
+	// Index of a triangle reference for each triangle
+	unsigned int triRefIndex[8];
+
+	/*
+		Load triangles.
+		\param positions 3*8 = 24 elements of triangle positions.
+	*/
+	LM_FORCE_INLINE void Load(const Math::Vec3* positions)
+	{
+		for (size_t i = 0; i < 8; i++)
+		{
+			const auto& p1 = positions[i*3  ];
+			const auto& p2 = positions[i*3+1];
+			const auto& p3 = positions[i*3+2];
+			reinterpret_cast<float*>(&origx)[i] = p1.x;
+			reinterpret_cast<float*>(&origy)[i] = p1.y;
+			reinterpret_cast<float*>(&origz)[i] = p1.z;
+			reinterpret_cast<float*>(&edge1x)[i] = p2.x - p1.x;
+			reinterpret_cast<float*>(&edge1y)[i] = p2.y - p1.y;
+			reinterpret_cast<float*>(&edge1z)[i] = p2.z - p1.z;
+			reinterpret_cast<float*>(&edge2x)[i] = p3.x - p1.x;
+			reinterpret_cast<float*>(&edge2y)[i] = p3.y - p1.y;
+			reinterpret_cast<float*>(&edge2z)[i] = p3.z - p1.z;
+		}
+	}
+
+	/*
+		Intersection mask computation.
+		Checks 8 intersections simultaneously and returns the mask of intersected triangles.
+		The same algorithm as QuadTriangle::IntersectMask in QBVH.
+		\param ray8 Octuple ray structure.
+		\param t Distances to the intersection points.
+		\param b1 First barycentric coordinates.
+		\param b2 Second barycentric coordinates.
+		\return Intersection mask (a bit per triangle).
+	*/
+	LM_FORCE_INLINE int IntersectMask(const Ray8& ray8, __m256& t, __m256& b1, __m256& b2) const
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 s1x = _mm256_sub_ps(_mm256_mul_ps(ray8.dy, edge2z), _mm256_mul_ps(ray8.dz, edge2y));
+		const __m256 s1y = _mm256_sub_ps(_mm256_mul_ps(ray8.dz, edge2x), _mm256_mul_ps(ray8.dx, edge2z));
+		const __m256 s1z = _mm256_sub_ps(_mm256_mul_ps(ray8.dx, edge2y), _mm256_mul_ps(ray8.dy, edge2x));
+		const __m256 divisor = _mm256_add_ps(_mm256_mul_ps(s1x, edge1x), _mm256_add_ps(_mm256_mul_ps(s1y, edge1y), _mm256_mul_ps(s1z, edge1z)));
+		const __m256 divisorZeroMask = _mm256_cmp_ps(zero, divisor, _CMP_EQ_OQ);
+		const __m256 tempDivisor = _mm256_add_ps(divisor, _mm256_and_ps(one, divisorZeroMask)); // Making zero to some other value in order to avoid divide by zero exception
+		__m256 intersected = _mm256_cmp_ps(divisor, zero, _CMP_NEQ_UQ);
+		const __m256 dx = _mm256_sub_ps(ray8.ox, origx);
+		const __m256 dy = _mm256_sub_ps(ray8.oy, origy);
+		const __m256 dz = _mm256_sub_ps(ray8.oz, origz);
+		b1 = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(dx, s1x), _mm256_add_ps(_mm256_mul_ps(dy, s1y), _mm256_mul_ps(dz, s1z))), tempDivisor);
+		intersected = _mm256_and_ps(intersected, _mm256_cmp_ps(b1, zero, _CMP_GE_OQ));
+		const __m256 s2x = _mm256_sub_ps(_mm256_mul_ps(dy, edge1z), _mm256_mul_ps(dz, edge1y));
+		const __m256 s2y = _mm256_sub_ps(_mm256_mul_ps(dz, edge1x), _mm256_mul_ps(dx, edge1z));
+		const __m256 s2z = _mm256_sub_ps(_mm256_mul_ps(dx, edge1y), _mm256_mul_ps(dy, edge1x));
+		b2 = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(ray8.dx, s2x), _mm256_add_ps(_mm256_mul_ps(ray8.dy, s2y), _mm256_mul_ps(ray8.dz, s2z))), tempDivisor);
+		const __m256 b0 = _mm256_sub_ps(one, _mm256_add_ps(b1, b2));
+		intersected = _mm256_and_ps(intersected, _mm256_and_ps(_mm256_cmp_ps(b2, zero, _CMP_GE_OQ), _mm256_cmp_ps(b0, zero, _CMP_GE_OQ)));
+		t = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(edge2x, s2x), _mm256_add_ps(_mm256_mul_ps(edge2y, s2y), _mm256_mul_ps(edge2z, s2z))), tempDivisor);
+		intersected = _mm256_and_ps(intersected, _mm256_and_ps(_mm256_cmp_ps(t, ray8.minT, _CMP_GT_OQ), _mm256_cmp_ps(t, ray8.maxT, _CMP_LT_OQ)));
+		return _mm256_movemask_ps(intersected);
+	}
+
+	/*
+		Intersection query.
+		\param ray8 Octuple ray structure.
+		\param ray Ray structure.
+		\param resultB Barycentric coordinates of the nearest intersection.
+		\param resultOffset Offset of the nearest intersected triangle in the structure.
+		\return true if any of 8 triangles is intersected.
+	*/
+	LM_FORCE_INLINE bool Intersect(Ray8& ray8, Ray& ray, Math::Vec2& resultB, unsigned int& resultOffset) const
+	{
+		__m256 t, b1, b2;
+		int mask = IntersectMask(ray8, t, b1, b2);
+		if (mask == 0)
+		{
+			return false;
+		}
+
+		// Find nearest one among at most 8 intersected triangles
+		unsigned int hit = 8;
+		for (unsigned int i = 0; i < 8; ++i)
+		{
+			if ((mask & (1 << i)) && reinterpret_cast<const float*>(&t)[i] < ray.maxT)
+			{
+				hit = i;
+				ray.maxT = reinterpret_cast<const float*>(&t)[i];
+			}
+		}
+		if (hit == 8)
+		{
+			return false;
+		}
+
+		// Update maximum distance
+		ray8.maxT = _mm256_set1_ps(ray.maxT);
+
+		// Store information needed to fill an intersection structure
+		resultOffset = hit;
+		resultB = Math::Vec2(
+			reinterpret_cast<const float*>(&b1)[hit],
+			reinterpret_cast<const float*>(&b2)[hit]);
+
+		return true;
+	}
+
+	/*
+		Occlusion query.
+		\param ray8 Octuple ray structure.
+		\return true if any of 8 triangles is intersected.
+	*/
+	LM_FORCE_INLINE bool Occluded(const Ray8& ray8) const
+	{
+		__m256 t, b1, b2;
+		return IntersectMask(ray8, t, b1, b2) != 0;
+	}
+
+};
+
+// OBVH node (256 bytes)
+struct LM_ALIGN_32 OBVHNode
+{
+
+	// Constant which indicates a empty leaf node
+	static const int EmptyLeafNode = 0xffffffff;
+
+	/*
+		Bounds for 8 nodes in SOA format.
+		The layout is same as QBVHNode.
+	*/
+	__m256 bounds[2][3];
+
+	/*
+		Child nodes
+		If the node is a leaf, the reference to the primitive is encoded to
+			[31:31] : 1
+			[30:27] : # of octuple triangles in the leaf
+			[26: 0] : An index of the first octuple triangles
+		If the node is a intermediate node, 
+			[31:31] : 0
+			[30: 0] : An index of the child node
+	*/
+	int children[8];
+
+	LM_FORCE_INLINE OBVHNode()
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			// Deliberately use INF instead of FLT_MAX
+			bounds[0][i] = _mm256_set1_ps( std::numeric_limits<float>::infinity());
+			bounds[1][i] = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+		}
+		for (int i = 0; i < 8; i++)
+		{
+			children[i] = EmptyLeafNode;
+		}
+	}
+
+	LM_FORCE_INLINE void SetBound(int childIndex, const AABB& bound)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			reinterpret_cast<float*>(&(bounds[0][axis]))[childIndex] = bound.min[axis];
+			reinterpret_cast<float*>(&(bounds[1][axis]))[childIndex] = bound.max[axis];
+		}
+	}
+
+	LM_FORCE_INLINE void InitializeLeaf(int childIndex, unsigned int size, unsigned int offset)
+	{
+		if (size == 0)
+		{
+			children[childIndex] = EmptyLeafNode;
+		}
+		else
+		{
+			children[childIndex]  = 0x80000000;
+			children[childIndex] |= ((static_cast<int>(size) - 1) & 0xf) << 27;
+			children[childIndex] |= static_cast<int>(offset) & 0x07ffffff;
+		}
+	}
+
+	LM_FORCE_INLINE void InitializeIntermediateNode(int childIndex, unsigned int index)
+	{
+		children[childIndex] = static_cast<int>(index);
+	}
+
+	LM_FORCE_INLINE static void ExtractLeafData(int data, unsigned int& size, unsigned int& offset)
+	{
+		size = static_cast<unsigned int>(((data >> 27) & 0xf) + 1);
+		offset = data & 0x07ffffff;
+	}
+
+	/*
+		AVX optimized intersection query.
+		\param ray8 Octuple ray.
+		\param invRayDirMinT Precomputed inverse of ray direction for near distances.
+		\param invRayDirMaxT Precomputed inverse of ray direction for far distances.
+		\param rayDirSign Specifies the component of the ray direction is negative.
+		\return Intersection mask (a bit per child).
+	*/
+	LM_FORCE_INLINE int Intersect(const Ray8& ray8, const __m256 invRayDirMinT[3], const __m256 invRayDirMaxT[3], const int rayDirSign[3]) const
+	{
+		__m256 minT = ray8.minT;
+		__m256 maxT = ray8.maxT;
+
+		// X coordinate
+		minT = _mm256_max_ps(minT, _mm256_mul_ps(_mm256_sub_ps(bounds[rayDirSign[0]][0], ray8.ox), invRayDirMinT[0]));
+		maxT = _mm256_min_ps(maxT, _mm256_mul_ps(_mm256_sub_ps(bounds[1 - rayDirSign[0]][0], ray8.ox), invRayDirMaxT[0]));
+
+		// Y coordinate
+		minT = _mm256_max_ps(minT, _mm256_mul_ps(_mm256_sub_ps(bounds[rayDirSign[1]][1], ray8.oy), invRayDirMinT[1]));
+		maxT = _mm256_min_ps(maxT, _mm256_mul_ps(_mm256_sub_ps(bounds[1 - rayDirSign[1]][1], ray8.oy), invRayDirMaxT[1]));
+
+		// Z coordinate
+		minT = _mm256_max_ps(minT, _mm256_mul_ps(_mm256_sub_ps(bounds[rayDirSign[2]][2], ray8.oz), invRayDirMinT[2]));
+		maxT = _mm256_min_ps(maxT, _mm256_mul_ps(_mm256_sub_ps(bounds[1 - rayDirSign[2]][2], ray8.oz), invRayDirMaxT[2]));
+
+		return _mm256_movemask_ps(_mm256_cmp_ps(maxT, minT, _CMP_GE_OQ));
+	}
+
+};
+
+// --------------------------------------------------------------------------------
+
+/*!
+	OBVH scene.
+	An implementation of 8-wide BVH (OBVH) utilizing AVX instructions.
+	The structure is the 8-wide extension of QBVH,
+	which fills all 8 lanes of the AVX registers for the node and triangle tests.
+	The SAH binning is shared with QBVH (see BinnedSAH).
+	Reference:
+		Wald, I. et al., Getting Rid of Packets - Efficient SIMD Single-Ray Traversal using Multi-branching BVHs,
+		IEEE Symposium on Interactive Ray Tracing, 2008.
+*/
+class OBVHScene final : public Scene
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("obvh");
+
+public:
+
+	virtual bool Build() override;
+	virtual bool IntersectTriangles(Ray& ray, Intersection& isect) const override;
+	virtual bool OccludedTriangles(const Ray& ray) const override;
+	virtual AABB GetAABBTriangles() const override { return aabbTris; }
+	virtual boost::signals2::connection Connect_ReportBuildProgress(const std::function<void(double, bool) >& func) override { return signal_ReportBuildProgress.connect(func); }
+	virtual bool Configure(const ConfigNode& node) override { return true; }
+
+private:
+
+	/*
+		Build a part of OBVH.
+		[begin, end) is the range of primitive indices.
+		The range is split into at most 8 child ranges by repeatedly splitting the largest one.
+		Returns the index of the created node.
+	*/
+	unsigned int Build(const BinnedSAHBuildData& data, unsigned int begin, unsigned int end);
+
+	/*
+		Split the range [begin, end) into two.
+		If the SAH split fails, the range is split at the middle.
+	*/
+	unsigned int Split(const BinnedSAHBuildData& data, unsigned int begin, unsigned int end);
+
+	// Create octuple triangles for [begin, end) and returns the offset of the first one
+	unsigned int CreateOctTriangles(unsigned int begin, unsigned int end);
+
+	// Transformed positions of the triangle
+	void TrianglePositions(const TriangleRef& triRef, Math::Vec3& p1, Math::Vec3& p2, Math::Vec3& p3) const;
+
+private:
+
+	// Maximum # of triangles in a leaf
+	static const unsigned int MaxElementsInLeaf = 32;
+
+private:
+
+	boost::signals2::signal<void (double, bool)> signal_ReportBuildProgress;
+	unsigned int numProcessedTris;
+	AABB aabbTris;
+
+	std::vector<TriangleRef> triRefs;												// List of triangle references
+	std::vector<unsigned int> triIndices;											// List of triangle indices. The list is rearranged through build process.
+	std::vector<OctTriangle, aligned_allocator<OctTriangle, 32>> octTris;			// List of octuple triangles
+	std::vector<OBVHNode, aligned_allocator<OBVHNode, 32>> nodes;					// List of OBVH nodes
+
+};
+
+bool OBVHScene::Build()
+{
+	BinnedSAHBuildData data;
+
+	signal_ReportBuildProgress(0, false);
+
+	{
+		LM_LOG_INFO("Creating triangle references");
+		LM_LOG_INDENTER();
+
+		for (int i = 0; i < primitives->NumPrimitives(); i++)
+		{
+			const auto* primitive = primitives->PrimitiveByIndex(i);
+			const auto* mesh = primitive->mesh;
+			if (mesh)
+			{
+				for (int j = 0; j < mesh->NumFaces() / 3; j++)
+				{
+					triIndices.push_back(static_cast<unsigned int>(triRefs.size()));
+					triRefs.push_back(TriangleRef());
+					triRefs.back().primitiveIndex = i;
+					triRefs.back().faceIndex = j;
+
+					Math::Vec3 p1, p2, p3;
+					TrianglePositions(triRefs.back(), p1, p2, p3);
+					AABB triBound(p1, p2);
+					triBound = triBound.Union(p3);
+					aabbTris = aabbTris.Union(triBound);
+					data.triBounds.push_back(triBound);
+					data.triBoundCentroids.push_back((triBound.min + triBound.max) * Math::Float(0.5));
+				}
+			}
+		}
+	}
+
+	{
+		LM_LOG_INFO("Building OBVH");
+		LM_LOG_INDENTER();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		numProcessedTris = 0;
+		Build(data, 0, static_cast<unsigned int>(triRefs.size()));
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) / 1000.0;
+		LM_LOG_INFO("Completed in " + std::to_string(elapsed) + " seconds");
+		LM_LOG_INFO("# of nodes : " + std::to_string(nodes.size()));
+	}
+
+	signal_ReportBuildProgress(1, true);
+
+	return true;
+}
+
+unsigned int OBVHScene::Build( const BinnedSAHBuildData& data, unsigned int begin, unsigned int end )
+{
+	// Split [begin, end) into at most 8 ranges
+	unsigned int rangeBegin[8] = { begin };
+	unsigned int rangeEnd[8] = { end };
+	int numRanges = 1;
+	while (numRanges < 8)
+	{
+		// Find the largest range which is to be split
+		int target = -1;
+		unsigned int maxSize = MaxElementsInLeaf;
+		for (int i = 0; i < numRanges; i++)
+		{
+			if (rangeEnd[i] - rangeBegin[i] > maxSize)
+			{
+				maxSize = rangeEnd[i] - rangeBegin[i];
+				target = i;
+			}
+		}
+		if (target < 0)
+		{
+			break;
+		}
+
+		unsigned int splitTriIndex = Split(data, rangeBegin[target], rangeEnd[target]);
+		rangeBegin[numRanges] = splitTriIndex;
+		rangeEnd[numRanges] = rangeEnd[target];
+		rangeEnd[target] = splitTriIndex;
+		numRanges++;
+	}
+
+	// Create a node
+	const unsigned int current = static_cast<unsigned int>(nodes.size());
+	nodes.emplace_back();
+
+	for (int i = 0; i < numRanges; i++)
+	{
+		AABB bound;
+		for (unsigned int j = rangeBegin[i]; j < rangeEnd[i]; j++)
+		{
+			bound = bound.Union(data.triBounds[triIndices[j]]);
+		}
+
+		const unsigned int size = rangeEnd[i] - rangeBegin[i];
+		if (size <= MaxElementsInLeaf)
+		{
+			// Leaf node
+			unsigned int offset = CreateOctTriangles(rangeBegin[i], rangeEnd[i]);
+			nodes[current].InitializeLeaf(i, (size + 7) / 8, offset);
+			nodes[current].SetBound(i, bound);
+		}
+		else
+		{
+			// Intermediate node
+			// Note that #nodes could be reallocated in the recursive call
+			unsigned int child = Build(data, rangeBegin[i], rangeEnd[i]);
+			nodes[current].InitializeIntermediateNode(i, child);
+			nodes[current].SetBound(i, bound);
+		}
+	}
+
+	return current;
+}
+
+unsigned int OBVHScene::Split( const BinnedSAHBuildData& data, unsigned int begin, unsigned int end )
+{
+	int axis;
+	Math::Float splitPosition;
+	if (BinnedSAH::SplitAxisAndPosition(data, triIndices, begin, end, axis, splitPosition))
+	{
+		unsigned int splitTriIndex;
+		BinnedSAH::PartitionPrimitives(data, triIndices, begin, end, axis, splitPosition, splitTriIndex);
+		if (splitTriIndex != begin && splitTriIndex != end)
+		{
+			return splitTriIndex;
+		}
+	}
+
+	// The primitive bound is degenerated -> split at the middle
+	// in order to keep the number of triangles in a leaf bounded
+	return begin + (end - begin) / 2;
+}
+
+unsigned int OBVHScene::CreateOctTriangles( unsigned int begin, unsigned int end )
+{
+	const unsigned int offset = static_cast<unsigned int>(octTris.size());
+	
+	for (unsigned int i = begin; i < end; i += 8)
+	{
+		Math::Vec3 positions[24];
+		octTris.emplace_back();
+		auto& oct = octTris.back();
+
+		for (unsigned int k = 0; k < 8; k++)
+		{
+			// Pad with the last triangle if the number of triangles is not a multiple of 8
+			unsigned int triRefIndex = triIndices[std::min(i + k, end - 1)];
+			oct.triRefIndex[k] = triRefIndex;
+			TrianglePositions(triRefs[triRefIndex], positions[3*k], positions[3*k+1], positions[3*k+2]);
+		}
+
+		oct.Load(positions);
+	}
+
+	numProcessedTris += end - begin;
+	if (!triRefs.empty())
+	{
+		signal_ReportBuildProgress(static_cast<double>(numProcessedTris) / triRefs.size(), false);
+	}
+
+	return offset;
+}
+
+void OBVHScene::TrianglePositions( const TriangleRef& triRef, Math::Vec3& p1, Math::Vec3& p2, Math::Vec3& p3 ) const
+{
+	const auto* primitive = primitives->PrimitiveByIndex(triRef.primitiveIndex);
+	const auto* ps = primitive->mesh->Positions();
+	const auto* fs = primitive->mesh->Faces();
+	unsigned int i1 = fs[3*triRef.faceIndex  ];
+	unsigned int i2 = fs[3*triRef.faceIndex+1];
+	unsigned int i3 = fs[3*triRef.faceIndex+2];
+	p1 = Math::Vec3(primitive->transform * Math::Vec4(ps[3*i1], ps[3*i1+1], ps[3*i1+2], Math::Float(1)));
+	p2 = Math::Vec3(primitive->transform * Math::Vec4(ps[3*i2], ps[3*i2+1], ps[3*i2+2], Math::Float(1)));
+	p3 = Math::Vec3(primitive->transform * Math::Vec4(ps[3*i3], ps[3*i3+1], ps[3*i3+2], Math::Float(1)));
+}
+
+bool OBVHScene::IntersectTriangles( Ray& ray, Intersection& isect ) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	bool intersected = false;
+	unsigned int intersectedOctIndex = 0;
+	unsigned int intersectedOctOffset = 0;
+	Math::Vec2 intersectedTriB;
+
+	// Some required data for intersection query
+	Ray8 ray8(ray);
+
+	__m256 invRayDirMinT[3], invRayDirMaxT[3];
+	invRayDirMinT[0] = _mm256_set1_ps(Math::IsZero(ray.d.x) ? Math::Constants::Eps() : Math::Float(1) / ray.d.x);
+	invRayDirMinT[1] = _mm256_set1_ps(Math::IsZero(ray.d.y) ? Math::Constants::Eps() : Math::Float(1) / ray.d.y);
+	invRayDirMinT[2] = _mm256_set1_ps(Math::IsZero(ray.d.z) ? Math::Constants::Eps() : Math::Float(1) / ray.d.z);
+	invRayDirMaxT[0] = _mm256_set1_ps(Math::IsZero(ray.d.x) ? Math::Constants::Inf() : Math::Float(1) / ray.d.x);
+	invRayDirMaxT[1] = _mm256_set1_ps(Math::IsZero(ray.d.y) ? Math::Constants::Inf() : Math::Float(1) / ray.d.y);
+	invRayDirMaxT[2] = _mm256_set1_ps(Math::IsZero(ray.d.z) ? Math::Constants::Inf() : Math::Float(1) / ray.d.z);
+
+	int rayDirSign[3];
+	rayDirSign[0] = ray.d.x < 0.0f;
+	rayDirSign[1] = ray.d.y < 0.0f;
+	rayDirSign[2] = ray.d.z < 0.0f;
+
+	// Stack for traversal
+	// Each node pushes at most 8 entries
+	const int StackSize = 256;
+	int stack[StackSize];
+	int stackIndex = 0;
+	stack[0] = 0;
+
+	while (stackIndex >= 0)
+	{
+		int data = stack[stackIndex--];
+		if (data < 0)
+		{
+			// Leaf node
+			if (data == OBVHNode::EmptyLeafNode)
+			{
+				continue;
+			}
+
+			unsigned int size, offset;
+			OBVHNode::ExtractLeafData(data, size, offset);
+			for (unsigned int i = offset; i < offset + size; i++)
+			{
+				Math::Vec2 b;
+				unsigned int octOffset;
+				if (octTris[i].Intersect(ray8, ray, b, octOffset))
+				{
+					intersectedOctIndex = i;
+					intersectedOctOffset = octOffset;
+					intersectedTriB = b;
+					intersected = true;
+				}
+			}
+		}
+		else
+		{
+			// Intermediate node
+			const auto& node = nodes[data];
+			int mask = node.Intersect(ray8, invRayDirMinT, invRayDirMaxT, rayDirSign);
+			for (int i = 0; i < 8; i++)
+			{
+				if (mask & (1 << i))
+				{
+					stack[++stackIndex] = node.children[i];
+				}
+			}
+		}
+	}
+
+	if (!intersected)
+	{
+		return false;
+	}
+
+	// Store required data for the intersection structure
+	const auto& triRef = triRefs[octTris[intersectedOctIndex].triRefIndex[intersectedOctOffset]];
+	StoreIntersectionFromBarycentricCoords(triRef.primitiveIndex, triRef.faceIndex, ray, intersectedTriB, isect);
+
+	return true;
+}
+
+bool OBVHScene::OccludedTriangles( const Ray& ray ) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	Ray8 ray8(ray);
+
+	__m256 invRayDirMinT[3], invRayDirMaxT[3];
+	invRayDirMinT[0] = _mm256_set1_ps(Math::IsZero(ray.d.x) ? Math::Constants::Eps() : Math::Float(1) / ray.d.x);
+	invRayDirMinT[1] = _mm256_set1_ps(Math::IsZero(ray.d.y) ? Math::Constants::Eps() : Math::Float(1) / ray.d.y);
+	invRayDirMinT[2] = _mm256_set1_ps(Math::IsZero(ray.d.z) ? Math::Constants::Eps() : Math::Float(1) / ray.d.z);
+	invRayDirMaxT[0] = _mm256_set1_ps(Math::IsZero(ray.d.x) ? Math::Constants::Inf() : Math::Float(1) / ray.d.x);
+	invRayDirMaxT[1] = _mm256_set1_ps(Math::IsZero(ray.d.y) ? Math::Constants::Inf() : Math::Float(1) / ray.d.y);
+	invRayDirMaxT[2] = _mm256_set1_ps(Math::IsZero(ray.d.z) ? Math::Constants::Inf() : Math::Float(1) / ray.d.z);
+
+	int rayDirSign[3];
+	rayDirSign[0] = ray.d.x < 0.0f;
+	rayDirSign[1] = ray.d.y < 0.0f;
+	rayDirSign[2] = ray.d.z < 0.0f;
+
+	const int StackSize = 256;
+	int stack[StackSize];
+	int stackIndex = 0;
+	stack[0] = 0;
+
+	while (stackIndex >= 0)
+	{
+		int data = stack[stackIndex--];
+		if (data < 0)
+		{
+			if (data == OBVHNode::EmptyLeafNode)
+			{
+				continue;
+			}
+
+			// Any intersection terminates the traversal
+			unsigned int size, offset;
+			OBVHNode::ExtractLeafData(data, size, offset);
+			for (unsigned int i = offset; i < offset + size; i++)
+			{
+				if (octTris[i].Occluded(ray8))
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			const auto& node = nodes[data];
+			int mask = node.Intersect(ray8, invRayDirMinT, invRayDirMaxT, rayDirSign);
+			for (int i = 0; i < 8; i++)
+			{
+				if (mask & (1 << i))
+				{
+					stack[++stackIndex] = node.children[i];
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+LM_COMPONENT_REGISTER_IMPL(OBVHScene, Scene);
+
+#endif
+
+LM_NAMESPACE_END
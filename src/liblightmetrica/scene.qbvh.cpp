@@ -28,7 +28,13 @@
 #include <lightmetrica/aabb.h>
 #include <lightmetrica/align.h>
 #include <lightmetrica/triangleref.h>
+#include <lightmetrica/binnedsah.h>
 #include <lightmetrica/confignode.h>
+#include <lightmetrica/intersection.h>
+#include <lightmetrica/parallel.h>
+#include <lightmetrica/accelcache.h>
+#include <atomic>
+#include <mutex>
 
 LM_NAMESPACE_BEGIN
 
@@ -42,7 +48,10 @@ struct LM_ALIGN_16 Ray4
 	__m128 dx, dy, dz;
 	__m128 minT, maxT;
 
-	LM_FORCE_INLINE Ray4(const Ray& ray)
+	LM_FORCE_INLINE Ray4() {}
+	LM_FORCE_INLINE Ray4(const Ray& ray) { Load(ray); }
+
+	LM_FORCE_INLINE void Load(const Ray& ray)
 	{
 		ox = _mm_set1_ps(ray.o.x);
 		oy = _mm_set1_ps(ray.o.y);
@@ -91,13 +100,16 @@ struct LM_ALIGN_16 QuadTriangle
 	}
 
 	/*
-		Intersection query.
+		Intersection mask computation.
+		Checks 4 intersections simultaneously and returns the mask of intersected triangles.
 		\param ray4 Quad ray structure.
-		\param ray Ray structure.
+		\param t Distances to the intersection points.
+		\param b1 First barycentric coordinates.
+		\param b2 Second barycentric coordinates.
+		\return Intersection mask.
 	*/
-	LM_FORCE_INLINE bool Intersect(Ray4& ray4, Ray& ray, Math::Vec2& resultB, unsigned int& resultOffset)
+	LM_FORCE_INLINE __m128 IntersectMask(const Ray4& ray4, __m128& t, __m128& b1, __m128& b2) const
 	{
-		// Check 4 intersections simultaneously
 		const __m128 zero = _mm_setzero_ps();
 		const __m128 one = _mm_set1_ps(1.0f);
 		const __m128 s1x = _mm_sub_ps(_mm_mul_ps(ray4.dy, edge2z), _mm_mul_ps(ray4.dz, edge2y));
@@ -110,16 +122,28 @@ struct LM_ALIGN_16 QuadTriangle
 		const __m128 dx = _mm_sub_ps(ray4.ox, origx);
 		const __m128 dy = _mm_sub_ps(ray4.oy, origy);
 		const __m128 dz = _mm_sub_ps(ray4.oz, origz);
-		const __m128 b1 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(dx, s1x), _mm_add_ps(_mm_mul_ps(dy, s1y), _mm_mul_ps(dz, s1z))), tempDivisor);
+		b1 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(dx, s1x), _mm_add_ps(_mm_mul_ps(dy, s1y), _mm_mul_ps(dz, s1z))), tempDivisor);
 		intersected = _mm_and_ps(intersected, _mm_cmpge_ps(b1, zero));
 		const __m128 s2x = _mm_sub_ps(_mm_mul_ps(dy, edge1z), _mm_mul_ps(dz, edge1y));
 		const __m128 s2y = _mm_sub_ps(_mm_mul_ps(dz, edge1x), _mm_mul_ps(dx, edge1z));
 		const __m128 s2z = _mm_sub_ps(_mm_mul_ps(dx, edge1y), _mm_mul_ps(dy, edge1x));
-		const __m128 b2 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(ray4.dx, s2x), _mm_add_ps(_mm_mul_ps(ray4.dy, s2y), _mm_mul_ps(ray4.dz, s2z))), tempDivisor);
+		b2 = _mm_div_ps(_mm_add_ps(_mm_mul_ps(ray4.dx, s2x), _mm_add_ps(_mm_mul_ps(ray4.dy, s2y), _mm_mul_ps(ray4.dz, s2z))), tempDivisor);
 		const __m128 b0 = _mm_sub_ps(one, _mm_add_ps(b1, b2));
 		intersected = _mm_and_ps(intersected, _mm_and_ps(_mm_cmpge_ps(b2, zero), _mm_cmpge_ps(b0, zero)));
-		const __m128 t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(edge2x, s2x), _mm_add_ps(_mm_mul_ps(edge2y, s2y), _mm_mul_ps(edge2z, s2z))), tempDivisor);
+		t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(edge2x, s2x), _mm_add_ps(_mm_mul_ps(edge2y, s2y), _mm_mul_ps(edge2z, s2z))), tempDivisor);
 		intersected = _mm_and_ps(intersected, _mm_and_ps(_mm_cmpgt_ps(t, ray4.minT), _mm_cmplt_ps(t, ray4.maxT)));
+		return intersected;
+	}
+
+	/*
+		Intersection query.
+		\param ray4 Quad ray structure.
+		\param ray Ray structure.
+	*/
+	LM_FORCE_INLINE bool Intersect(Ray4& ray4, Ray& ray, Math::Vec2& resultB, unsigned int& resultOffset) const
+	{
+		__m128 t, b1, b2;
+		__m128 intersected = IntersectMask(ray4, t, b1, b2);
 
 		// Find nearest one among at most 4 intersected triangles
 		unsigned int hit = 4;
@@ -149,10 +173,22 @@ struct LM_ALIGN_16 QuadTriangle
 		return true;
 	}
 
+	/*
+		Occlusion query.
+		\param ray4 Quad ray structure.
+		\return true if any of 4 triangles is intersected.
+	*/
+	LM_FORCE_INLINE bool Occluded(const Ray4& ray4) const
+	{
+		__m128 t, b1, b2;
+		return _mm_movemask_ps(IntersectMask(ray4, t, b1, b2)) != 0;
+	}
+
 };
 
 // QBVH node (128 bytes)
-struct QBVHNode
+// Aligned to 64 bytes so that a node occupies exactly two cache lines
+struct LM_ALIGN(64) QBVHNode
 {
 	
 	// Constant which indicates a empty leaf node
@@ -266,7 +302,7 @@ struct QBVHNode
 		\param rayDirSign Specifies the component of the ray direction is negative.
 		\return Intersection mask.
 	*/
-	LM_FORCE_INLINE int Intersect(const Ray4& ray4, const __m128 invRayDirMinT[3], const __m128 invRayDirMaxT[3], const int rayDirSign[3])
+	LM_FORCE_INLINE int Intersect(const Ray4& ray4, const __m128 invRayDirMinT[3], const __m128 invRayDirMaxT[3], const int rayDirSign[3]) const
 	{
 #if 0
 		__m128 minT = ray4.minT;
@@ -312,15 +348,61 @@ struct QBVHNode
 
 };
 
-// The structure is used on QBVHScene::Build
-struct QBVHBuildData
+// Per-ray data used in the batched traversal
+struct LM_ALIGN_16 QBVHPacketRay
+{
+
+	Ray4 ray4;
+	__m128 invRayDirMinT[3];
+	__m128 invRayDirMaxT[3];
+	int rayDirSign[3];
+
+	// Intersected triangle (filled when intersected)
+	bool intersected;
+	unsigned int intersectedTriIndex;
+	unsigned int intersectedQuadOffset;
+	Math::Vec2 intersectedTriB;
+
+	LM_FORCE_INLINE void Load(const Ray& ray)
+	{
+		ray4.Load(ray);
+
+		invRayDirMinT[0] = _mm_set1_ps(Math::IsZero(ray.d.x) ? Math::Constants::Eps() : Math::Float(1) / ray.d.x);
+		invRayDirMinT[1] = _mm_set1_ps(Math::IsZero(ray.d.y) ? Math::Constants::Eps() : Math::Float(1) / ray.d.y);
+		invRayDirMinT[2] = _mm_set1_ps(Math::IsZero(ray.d.z) ? Math::Constants::Eps() : Math::Float(1) / ray.d.z);
+		invRayDirMaxT[0] = _mm_set1_ps(Math::IsZero(ray.d.x) ? Math::Constants::Inf() : Math::Float(1) / ray.d.x);
+		invRayDirMaxT[1] = _mm_set1_ps(Math::IsZero(ray.d.y) ? Math::Constants::Inf() : Math::Float(1) / ray.d.y);
+		invRayDirMaxT[2] = _mm_set1_ps(Math::IsZero(ray.d.z) ? Math::Constants::Inf() : Math::Float(1) / ray.d.z);
+
+		rayDirSign[0] = ray.d.x < 0.0f;
+		rayDirSign[1] = ray.d.y < 0.0f;
+		rayDirSign[2] = ray.d.z < 0.0f;
+
+		intersected = false;
+	}
+
+};
+
+// Maximum number of rays processed in a packet
+// Active rays in the packet are managed with 64-bit masks
+const size_t QBVHPacketSize = 64;
+
+/*
+	Intermediate binary tree used in the construction of QBVH.
+	The tree records the result of the splits (the expensive part of the build),
+	which is computed in parallel. QBVH nodes are then created from the tree
+	in the same order as the serial construction.
+*/
+struct QBVHBuildNode : public SIMDAlignedType
 {
-	// Bounds of the triangles
-	std::vector<AABB, aligned_allocator<AABB, std::alignment_of<AABB>::value>> triBounds;
-	// Centroids of the bounds of the triangles
-	std::vector<Math::Vec3, aligned_allocator<Math::Vec3, std::alignment_of<Math::Vec3>::value>> triBoundCentroids;
+	unsigned int begin, end;					// Range of the triangle indices
+	AABB bound;									// Bound of the triangles in [begin, end)
+	std::unique_ptr<QBVHBuildNode> left, right;	// Child nodes (nullptr if the node is a leaf)
 };
 
+// Minimum number of triangles processed in a separated task in the parallel build
+const unsigned int QBVHParallelBuildMinTris = 1 << 14;
+
 enum class QBVHIntersectionMode
 {
 	SSE,			// Use SSE optimized quad triangles for ray-triangle intersection query
@@ -353,6 +435,8 @@ public:
 
 	virtual bool Build() override;
 	virtual bool IntersectTriangles(Ray& ray, Intersection& isect) const override;
+	virtual bool OccludedTriangles(const Ray& ray) const override;
+	virtual void IntersectTrianglesBatch(Ray* rays, Intersection* isects, bool* hits, size_t n) const override;
 	virtual AABB GetAABBTriangles() const override { return aabbTris; }
 	virtual boost::signals2::connection Connect_ReportBuildProgress(const std::function<void(double, bool) >& func) override { return signal_ReportBuildProgress.connect(func); }
 	virtual bool Configure(const ConfigNode& node) override;
@@ -360,51 +444,68 @@ public:
 private:
 
 	/*
-		Build a part of QBVH.
-		[begin, end) is the range of primitive indices.
-		#parent indicates the index of the parent node (specify -1 for building root node)
-		and #child indicates the index of the child node relative to the node specified by #parent.
+		Split the triangles in [buildNode->begin, buildNode->end) recursively.
+		Subtrees with large number of triangles are processed in parallel.
+		The result is independent of the number of threads.
 	*/
-	void Build(const QBVHBuildData& data, unsigned int begin, unsigned int end, int parent, int child, int depth);
-	void PostBuild(const QBVHBuildData& data, unsigned int nodeIndex);
+	void Split(const BinnedSAHBuildData& data, QBVHBuildNode* buildNode, int depth);
 
 	/*
-		Determine the split axis and the position
-		Returns false if the split is failed because the primitive bound is degenerated
+		Build a part of QBVH from the split tree.
+		#parent indicates the index of the parent node (specify -1 for building root node)
+		and #child indicates the index of the child node relative to the node specified by #parent.
 	*/
-	bool SplitAxisAndPosition(const QBVHBuildData& data, unsigned int begin, unsigned int end, int& axis, Math::Float& splitPosition);
+	void Build(const QBVHBuildNode* buildNode, int parent, int child, int depth);
+	void PostBuild(const BinnedSAHBuildData& data, unsigned int nodeIndex);
 
 	/*
-		Rearrange primitives by partition according to the split axis and position
-		splitTriIndex is the boundary primitive index
+		Intersection query for a packet of at most #QBVHPacketSize rays.
+		Nodes are traversed once for all rays in the packet and
+		the rays not intersected with the node bound are masked out.
 	*/
-	void PartitionPrimitives(const QBVHBuildData& data, unsigned int begin, unsigned int end, int axis, Math::Float splitPosition, unsigned int& splitTriIndex);
+	void IntersectTrianglesPacket(Ray* rays, Intersection* isects, bool* hits, size_t n) const;
+
+	// The function is called when a leaf node is fixed in the split process
+	void ReportProgress(unsigned int begin, unsigned int end);
 
 	// Create leaf and intermediate nodes
 	void CreateLeafNode(unsigned int begin, unsigned int end, int parent, int child, const AABB& bound);
 	void CreateIntermediateNode(int parent, int child, const AABB& bound, unsigned int& createdNodeIndex);
 
+	/*
+		Load or save the built acceleration structure from/to the cache file.
+		The key of the cache depends on the intersection mode.
+	*/
+	std::string CacheKey() const;
+	bool LoadCache(const std::string& path, unsigned long long hash);
+	bool SaveCache(const std::string& path, unsigned long long hash) const;
+	bool ValidateCache() const;
+
 private:
 
 	boost::signals2::signal<void (double, bool)> signal_ReportBuildProgress;
-	int numProcessedTris;
+	std::atomic<int> numProcessedTris;
+	std::mutex progressMutex;
+	int maxTaskDepth;
 	AABB aabbTris;
 
 	QBVHIntersectionMode mode;				// Triangle intersection mode
 	unsigned int maxElementsInLeaf;			// Maximum # of triangle in a node
+	std::string cacheDir;					// Directory of the acceleration structure cache (empty if the cache is disabled)
+	bool parallelBuild;						// Build the tree in parallel (the result is same as the serial build)
 
-	std::vector<TriangleRef> triRefs;		// List of triangle references
-	std::vector<TriAccel> triAccels;		// List of triaccels
-	std::vector<QuadTriangle*> quadTris;	// List of quad triangles
-	std::vector<unsigned int> triIndices;	// List of triangle indices. The list is rearranged through build process.
-	std::vector<QBVHNode*> nodes;			// List of QBVH nodes
+	// Nodes and quad triangles are stored in contiguous arrays aligned to cache lines and referred by indices.
+	// The nodes are created in depth-first order, i.e., the first child of a node immediately follows the node.
+	std::vector<TriangleRef> triRefs;												// List of triangle references
+	std::vector<TriAccel> triAccels;												// List of triaccels
+	std::vector<QuadTriangle, aligned_allocator<QuadTriangle, 64>> quadTris;		// List of quad triangles
+	std::vector<unsigned int> triIndices;											// List of triangle indices. The list is rearranged through build process.
+	std::vector<QBVHNode, aligned_allocator<QBVHNode, 64>> nodes;					// List of QBVH nodes
 
 };
 
 QBVHScene::~QBVHScene()
 {
-	for (auto* node : nodes)	LM_SAFE_DELETE(node);
-	for (auto* quad : quadTris)	LM_SAFE_DELETE(quad);
 	triRefs.clear();
 	triAccels.clear();
 	quadTris.clear();
@@ -447,15 +548,40 @@ bool QBVHScene::Configure( const ConfigNode& node )
 		maxElementsInLeaf = 16;
 	}
 
+	// Optional cache directory
+	auto cacheNode = node.Child("cache");
+	if (!cacheNode.Empty())
+	{
+		cacheDir = cacheNode.Value();
+	}
+
+	// Optional serial build, e.g., for comparison
+	node.ChildValueOrDefault("parallel_build", true, parallelBuild);
+
 	return true;
 }
 
 bool QBVHScene::Build()
 {
-	QBVHBuildData data;
+	BinnedSAHBuildData data;
 
 	signal_ReportBuildProgress(0, false);
 
+	// Try to load from the cache
+	std::string cachePath;
+	unsigned long long hash = 0;
+	if (!cacheDir.empty())
+	{
+		hash = AccelerationCache::ComputeHash(*primitives);
+		cachePath = AccelerationCache::CachePath(cacheDir, CacheKey(), hash);
+		if (LoadCache(cachePath, hash))
+		{
+			LM_LOG_INFO("Loaded QBVH from cache '" + cachePath + "'");
+			signal_ReportBuildProgress(1, true);
+			return true;
+		}
+	}
+
 	{
 		// TODO : replace triaccel with SSE optimized quad triangle intersection
 		LM_LOG_INFO(boost::str(boost::format("Creating triangle elements (mode : '%s')") % (mode == QBVHIntersectionMode::SSE ? "sse" : "triaccel")));
@@ -504,10 +630,17 @@ bool QBVHScene::Build()
 		LM_LOG_INFO("Building QBVH");
 		LM_LOG_INDENTER();
 
-		//ResetProgress();
+		numProcessedTris = 0;
+		// The recursion starting from the maximum depth spawns no task, i.e., the build is serial
+		maxTaskDepth = Parallel::MaxTaskDepth();
+		const int rootDepth = parallelBuild ? 0 : maxTaskDepth;
 
 		auto start = std::chrono::high_resolution_clock::now();
-		Build(data, 0, static_cast<int>(triRefs.size()), -1, 0, 0);
+		std::unique_ptr<QBVHBuildNode> root(new QBVHBuildNode);
+		root->begin = 0;
+		root->end = static_cast<unsigned int>(triRefs.size());
+		Split(data, root.get(), rootDepth);
+		Build(root.get(), -1, 0, 0);
 		PostBuild(data, 0);
 		auto end = std::chrono::high_resolution_clock::now();
 
@@ -515,40 +648,246 @@ bool QBVHScene::Build()
 		LM_LOG_INFO("Completed in " + std::to_string(elapsed) + " seconds");
 	}
 
+	// Save to the cache
+	// Failure to save the cache is not critical
+	if (!cachePath.empty())
+	{
+		if (SaveCache(cachePath, hash))
+		{
+			LM_LOG_INFO("Saved QBVH to cache '" + cachePath + "'");
+		}
+		else
+		{
+			LM_LOG_WARN("Failed to save QBVH to cache '" + cachePath + "'");
+		}
+	}
+
 	signal_ReportBuildProgress(1, true);
 
 	return true;
 }
 
-void QBVHScene::Build( const QBVHBuildData& data, unsigned int begin, unsigned int end, int parent, int child, int depth )
+std::string QBVHScene::CacheKey() const
 {
-	// Bound of the primitives [begin, end)
-	AABB bound;
-	for (unsigned int i = begin; i < end; i++)
+	// All parameters affecting the structure of the tree
+	return boost::str(boost::format("qbvh-%s-leaf%d-bins%d")
+		% (mode == QBVHIntersectionMode::SSE ? "sse" : "triaccel")
+		% maxElementsInLeaf
+		% static_cast<int>(BinnedSAH::NumBins));
+}
+
+bool QBVHScene::LoadCache( const std::string& path, unsigned long long hash )
+{
+	AccelerationCache cache;
+	if (!cache.OpenForRead(path, CacheKey(), hash))
 	{
-		bound = bound.Union(data.triBounds[triIndices[i]]);
+		return false;
 	}
-	
+
+	if (!cache.ReadValue(aabbTris) ||
+		!cache.Read(triRefs) ||
+		!cache.Read(triAccels) ||
+		!cache.Read(quadTris) ||
+		!cache.Read(nodes) ||
+		!ValidateCache())
+	{
+		LM_LOG_WARN("Broken cache file '" + path + "'");
+		aabbTris = AABB();
+		triRefs.clear();
+		triAccels.clear();
+		quadTris.clear();
+		nodes.clear();
+		cache.Close();
+		return false;
+	}
+
+	return cache.Close();
+}
+
+bool QBVHScene::SaveCache( const std::string& path, unsigned long long hash ) const
+{
+	AccelerationCache cache;
+	if (!cache.OpenForWrite(path, CacheKey(), hash))
+	{
+		return false;
+	}
+
+	if (!cache.WriteValue(aabbTris) ||
+		!cache.Write(triRefs) ||
+		!cache.Write(triAccels) ||
+		!cache.Write(quadTris) ||
+		!cache.Write(nodes))
+	{
+		cache.Close();
+		return false;
+	}
+
+	return cache.Close();
+}
+
+bool QBVHScene::ValidateCache() const
+{
+	// Triangles must refer to the faces of the primitives
+	for (const auto& triRef : triRefs)
+	{
+		if (!AccelerationCache::ValidTriangle(*primitives, triRef.primitiveIndex, triRef.faceIndex))
+		{
+			return false;
+		}
+	}
+
+	for (const auto& triAccel : triAccels)
+	{
+		if (!AccelerationCache::ValidTriangle(*primitives, static_cast<int>(triAccel.primIndex), static_cast<int>(triAccel.shapeIndex)))
+		{
+			return false;
+		}
+	}
+
+	for (const auto& quad : quadTris)
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			if (quad.triRefIndex[k] >= triRefs.size())
+			{
+				return false;
+			}
+		}
+	}
+
+	// Leaves must refer to the triangle elements used in the intersection mode
+	const size_t numElements = mode == QBVHIntersectionMode::SSE ? quadTris.size() : triAccels.size();
+
+	// Nodes must form a tree in depth-first order.
+	// Children always follow the parent and are referred exactly once,
+	// which ensures the traversal terminates.
+	const size_t numNodes = nodes.size();
+	std::vector<int> numReferences(numNodes, 0);
+	for (size_t i = 0; i < numNodes; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			int childData = nodes[i].children[j];
+			if (childData == QBVHNode::EmptyLeafNode)
+			{
+				continue;
+			}
+
+			if (childData < 0)
+			{
+				unsigned int size, offset;
+				QBVHNode::ExtractLeafData(childData, size, offset);
+				if (static_cast<size_t>(offset) + size > numElements)
+				{
+					return false;
+				}
+			}
+			else
+			{
+				size_t child = static_cast<size_t>(childData);
+				if (child <= i || child >= numNodes)
+				{
+					return false;
+				}
+
+				numReferences[child]++;
+			}
+		}
+	}
+
+	if (numNodes == 0 || numReferences[0] != 0)
+	{
+		return false;
+	}
+
+	for (size_t i = 1; i < numNodes; i++)
+	{
+		if (numReferences[i] != 1)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void QBVHScene::Split( const BinnedSAHBuildData& data, QBVHBuildNode* buildNode, int depth )
+{
+	const unsigned int begin = buildNode->begin;
+	const unsigned int end = buildNode->end;
+
+	// Bound of the primitives [begin, end)
+	AABB& bound = buildNode->bound;
+	Parallel::Reduce(begin, end, BinnedSAH::ParallelMinChunkSize, bound,
+		[&](size_t chunkBegin, size_t chunkEnd, AABB& result)
+		{
+			for (size_t i = chunkBegin; i < chunkEnd; i++)
+			{
+				result = result.Union(data.triBounds[triIndices[i]]);
+			}
+		},
+		[](AABB& result, const AABB& chunkResult)
+		{
+			result = result.Union(chunkResult);
+		}, depth);
+
 	// Leaf node
 	if (end - begin <= maxElementsInLeaf)
 	{
-		CreateLeafNode(begin, end, parent, child, bound);
+		ReportProgress(begin, end);
 		return;
 	}
 
 	// Determine the split axis and position
 	int axis;
 	Math::Float splitPosition;
-	if (!SplitAxisAndPosition(data, begin, end, axis, splitPosition))
+	if (!BinnedSAH::SplitAxisAndPosition(data, triIndices, begin, end, axis, splitPosition, depth))
 	{
 		// The primitive bound is degenerated -> create a leaf node
-		CreateLeafNode(begin, end, parent, child, bound);
+		ReportProgress(begin, end);
 		return;
 	}
 
 	// Partition primitives in [begin, end) according to split axis and position
 	unsigned int splitTriIndex;
-	PartitionPrimitives(data, begin, end, axis, splitPosition, splitTriIndex);
+	BinnedSAH::PartitionPrimitives(data, triIndices, begin, end, axis, splitPosition, splitTriIndex);
+
+	buildNode->left.reset(new QBVHBuildNode);
+	buildNode->left->begin = begin;
+	buildNode->left->end = splitTriIndex;
+	buildNode->right.reset(new QBVHBuildNode);
+	buildNode->right->begin = splitTriIndex;
+	buildNode->right->end = end;
+
+	// Process recursively
+	// The two children refer to the disjoint ranges of #triIndices,
+	// so the left child can be processed in another thread.
+	if (depth < maxTaskDepth && splitTriIndex - begin >= QBVHParallelBuildMinTris && end - splitTriIndex >= QBVHParallelBuildMinTris)
+	{
+		auto* left = buildNode->left.get();
+		auto future = std::async(std::launch::async, [this, &data, left, depth]() { Split(data, left, depth + 1); });
+		Split(data, buildNode->right.get(), depth + 1);
+		future.get();
+	}
+	else
+	{
+		Split(data, buildNode->left.get(), depth + 1);
+		Split(data, buildNode->right.get(), depth + 1);
+	}
+}
+
+void QBVHScene::Build( const QBVHBuildNode* buildNode, int parent, int child, int depth )
+{
+	const unsigned int begin = buildNode->begin;
+	const unsigned int end = buildNode->end;
+	const auto& bound = buildNode->bound;
+
+	// Leaf node
+	if (!buildNode->left)
+	{
+		CreateLeafNode(begin, end, parent, child, bound);
+		return;
+	}
 
 	// Index of the current and child nodes
 	// The value is changed according to the depth of the recursion
@@ -586,16 +925,26 @@ void QBVHScene::Build( const QBVHBuildData& data, unsigned int begin, unsigned i
 	}
 
 	// Process recursively
-	Build(data, begin, splitTriIndex, current, left, depth + 1);
-	Build(data, splitTriIndex, end, current, right, depth + 1);
+	Build(buildNode->left.get(), current, left, depth + 1);
+	Build(buildNode->right.get(), current, right, depth + 1);
+}
+
+void QBVHScene::ReportProgress( unsigned int begin, unsigned int end )
+{
+	int processed = numProcessedTris += static_cast<int>(end - begin);
+	if (!triRefs.empty())
+	{
+		std::unique_lock<std::mutex> lock(progressMutex);
+		signal_ReportBuildProgress(static_cast<double>(processed) / triRefs.size(), false);
+	}
 }
 
-void QBVHScene::PostBuild( const QBVHBuildData& data, unsigned int nodeIndex )
+void QBVHScene::PostBuild( const BinnedSAHBuildData& data, unsigned int nodeIndex )
 {
 	for (int i = 0; i < 4; i++)
 	{
-		auto* node = nodes[nodeIndex];
-		int childData = node->children[i];
+		auto& node = nodes[nodeIndex];
+		int childData = node.children[i];
 		if (childData < 0)
 		{
 			// Empty node
@@ -617,7 +966,7 @@ void QBVHScene::PostBuild( const QBVHBuildData& data, unsigned int nodeIndex )
 				{
 					int endK = 0;
 					Math::Vec3 tempPositions[12];
-					auto* quad = new QuadTriangle();
+					QuadTriangle quad;
 
 					for (int k = 0; k < 4; k++)
 					{
@@ -627,7 +976,7 @@ void QBVHScene::PostBuild( const QBVHBuildData& data, unsigned int nodeIndex )
 						{
 							endK = k;
 							unsigned int triRefIndex = triIndices[triIndex];
-							quad->triRefIndex[k] = triRefIndex;
+							quad.triRefIndex[k] = triRefIndex;
 							const auto& triRef = triRefs[triRefIndex];
 							const auto* primitive = primitives->PrimitiveByIndex(triRef.primitiveIndex);
 							const auto* mesh = primitive->mesh;
@@ -650,13 +999,14 @@ void QBVHScene::PostBuild( const QBVHBuildData& data, unsigned int nodeIndex )
 						tempPositions[3*k  ] = tempPositions[3*endK  ];
 						tempPositions[3*k+1] = tempPositions[3*endK+1];
 						tempPositions[3*k+2] = tempPositions[3*endK+2];
+						quad.triRefIndex[k] = quad.triRefIndex[endK];
 					}
 
-					quad->Load(tempPositions);
+					quad.Load(tempPositions);
 					quadTris.push_back(quad);
 				}
 
-				node->InitializeLeaf(i, size, quadOffset);
+				node.InitializeLeaf(i, size, quadOffset);
 			}
 			else if (mode == QBVHIntersectionMode::Triaccel)
 			{
@@ -683,7 +1033,7 @@ void QBVHScene::PostBuild( const QBVHBuildData& data, unsigned int nodeIndex )
 					triAccel.Load(p1, p2, p3);
 				}
 
-				node->InitializeLeaf(i, size, triAccelOffset);
+				node.InitializeLeaf(i, size, triAccelOffset);
 			}
 		}
 		else
@@ -694,101 +1044,6 @@ void QBVHScene::PostBuild( const QBVHBuildData& data, unsigned int nodeIndex )
 	}
 }
 
-bool QBVHScene::SplitAxisAndPosition( const QBVHBuildData& data, unsigned int begin, unsigned int end, int& axis, Math::Float& splitPosition )
-{
-	// Choose the axis to split
-	AABB centroidBound;
-	for (unsigned int i = begin; i < end; i++)
-	{
-		centroidBound = centroidBound.Union(data.triBoundCentroids[triIndices[i]]);
-	}
-	axis = centroidBound.LongestAxis();
-
-	// Check if the bound is degenerated
-	if (centroidBound.min[axis] == centroidBound.max[axis])
-	{
-		// Degenerated
-		return false;
-	}
-
-	// Determine split position by SAH heuristics
-	// SAH cost is computed with split bins for efficiency
-
-	// Number of bins
-	const int numBins = 12;
-
-	// Some precomputed values
-	const float k0 = centroidBound.min[axis];
-	const float k1 = static_cast<float>(numBins) / (centroidBound.max[axis] - k0);
-
-	// Compute bounds and count # of triangles for each bin
-	AABB binTriBound[numBins];
-	int binTris[numBins] = {0};
-	for (unsigned int i = begin; i < end; i++)
-	{
-		const unsigned int index = triIndices[i];
-		const int binId = std::max(0, std::min(numBins - 1, static_cast<int>(k1 * (data.triBoundCentroids[index][axis] - k0))));
-		binTris[binId]++;
-		binTriBound[binId] = binTriBound[binId].Union(data.triBounds[index]);
-	}
-
-	// Compute costs for each candidate for partition
-	float costs[numBins - 1];
-	for (int i = 0; i < numBins - 1; i++)
-	{
-		AABB b1, b2;
-		int count1 = 0, count2 = 0;
-
-		// [0, i]
-		for (int j = 0; j <= i; j++)
-		{
-			b1 = b1.Union(binTriBound[j]);
-			count1 += binTris[j];
-		}
-
-		// (i, numBins - 1]
-		for (int j = i + 1; j < numBins; j++)
-		{
-			b2 = b2.Union(binTriBound[j]);
-			count2 += binTris[j];
-		}
-
-		// Compute cost
-		costs[i] = static_cast<float>(count1) * b1.SurfaceArea() + static_cast<float>(count2) * b2.SurfaceArea();
-	}
-
-	// Find minimum partition
-	int minCostIdx = 0;
-	double minCost = costs[0];
-	for (int i = 1; i < numBins - 1; i++)
-	{
-		if (minCost > costs[i])
-		{
-			minCost = costs[i];
-			minCostIdx = i;
-		}
-	}
-
-	splitPosition = centroidBound.min[axis] + static_cast<float>(minCostIdx + 1) * (centroidBound.max[axis] - centroidBound.min[axis]) / numBins;
-	return true;
-}
-
-void QBVHScene::PartitionPrimitives( const QBVHBuildData& data, unsigned int begin, unsigned int end, int axis, Math::Float splitPosition, unsigned int& splitTriIndex )
-{
-	splitTriIndex = begin;
-	for (unsigned int i = begin; i < end; i++)
-	{
-		const unsigned int triIndex = triIndices[i];
-		if (data.triBoundCentroids[triIndex][axis] <= splitPosition)
-		{
-			// Swap indices
-			triIndices[i] = triIndices[splitTriIndex];
-			triIndices[splitTriIndex] = triIndex;
-			splitTriIndex++;
-		}
-	}
-}
-
 void QBVHScene::CreateLeafNode( unsigned int begin, unsigned int end, int parent, int child, const AABB& bound )
 {
 	// If the #parent is -1 the root is a leaf node
@@ -796,13 +1051,13 @@ void QBVHScene::CreateLeafNode( unsigned int begin, unsigned int end, int parent
 	if (parent < 0)
 	{
 		// Create node
-		nodes.push_back(new QBVHNode());
+		nodes.emplace_back();
 		parent = 0;
 	}
 
 	// Set the value to the node
 	auto& node = nodes[parent];
-	node->SetBound(child, bound);
+	node.SetBound(child, bound);
 
 	// Initialize a leaf for #child
 	// For now, # of quads section of the leaf data is replaced to # of triangles.
@@ -810,12 +1065,12 @@ void QBVHScene::CreateLeafNode( unsigned int begin, unsigned int end, int parent
 	if (mode == QBVHIntersectionMode::SSE)
 	{
 		// Store # of quad triangles as size entry
-		node->InitializeLeaf(child, (end - begin + 3) / 4, begin);
+		node.InitializeLeaf(child, (end - begin + 3) / 4, begin);
 	}
 	else if (mode == QBVHIntersectionMode::Triaccel)
 	{
 		// Store # of triangles as size entry
-		node->InitializeLeaf(child, end - begin, begin);
+		node.InitializeLeaf(child, end - begin, begin);
 	}
 }
 
@@ -823,14 +1078,13 @@ void QBVHScene::CreateIntermediateNode( int parent, int child, const AABB& bound
 {
 	// Create a new node
 	createdNodeIndex = static_cast<unsigned int>(nodes.size());
-	auto* node = new QBVHNode();
-	nodes.push_back(node);
+	nodes.emplace_back();
 	
 	// Set child data to the parent
 	if (parent >= 0)
 	{
-		nodes[parent]->InitializeIntermediateNode(child, createdNodeIndex);
-		nodes[parent]->SetBound(child, bound);
+		nodes[parent].InitializeIntermediateNode(child, createdNodeIndex);
+		nodes[parent].SetBound(child, bound);
 	}
 }
 
@@ -903,7 +1157,7 @@ bool QBVHScene::IntersectTriangles( Ray& ray, Intersection& isect ) const
 				{
 					Math::Vec2 b;
 					unsigned int quadOffset;
-					if (quadTris[i]->Intersect(ray4, ray, b, quadOffset))
+					if (quadTris[i].Intersect(ray4, ray, b, quadOffset))
 					{
 						intersectedTriIndex = i;
 						intersectedQuadOffset = quadOffset;
@@ -929,12 +1183,12 @@ bool QBVHScene::IntersectTriangles( Ray& ray, Intersection& isect ) const
 		{
 			// Intermediate node
 			// Check intersection to 4 bounds simultaneously
-			auto* node = nodes[data];
-			int mask = node->Intersect(ray4, invRayDirMinT, invRayDirMaxT, rayDirSign);
-			if (mask & 0x1) stack[++stackIndex] = node->children[0];
-			if (mask & 0x2) stack[++stackIndex] = node->children[1];
-			if (mask & 0x4) stack[++stackIndex] = node->children[2];
-			if (mask & 0x8) stack[++stackIndex] = node->children[3];
+			const auto& node = nodes[data];
+			int mask = node.Intersect(ray4, invRayDirMinT, invRayDirMaxT, rayDirSign);
+			if (mask & 0x1) stack[++stackIndex] = node.children[0];
+			if (mask & 0x2) stack[++stackIndex] = node.children[1];
+			if (mask & 0x4) stack[++stackIndex] = node.children[2];
+			if (mask & 0x8) stack[++stackIndex] = node.children[3];
 		}
 	}
 
@@ -943,8 +1197,8 @@ bool QBVHScene::IntersectTriangles( Ray& ray, Intersection& isect ) const
 		// Store some information to the intersection structure
 		if (mode == QBVHIntersectionMode::SSE)
 		{
-			auto* quad = quadTris[intersectedTriIndex];
-			auto& triRef = triRefs[quad->triRefIndex[intersectedQuadOffset]];
+			const auto& quad = quadTris[intersectedTriIndex];
+			auto& triRef = triRefs[quad.triRefIndex[intersectedQuadOffset]];
 			StoreIntersectionFromBarycentricCoords(triRef.primitiveIndex, triRef.faceIndex, ray, intersectedTriB, isect);
 		}
 		else if (mode == QBVHIntersectionMode::Triaccel)
@@ -959,6 +1213,225 @@ bool QBVHScene::IntersectTriangles( Ray& ray, Intersection& isect ) const
 	return false;
 }
 
+bool QBVHScene::OccludedTriangles( const Ray& ray ) const
+{
+	// Some required data for occlusion query
+	// Same as #IntersectTriangles but #maxT is never updated
+	const Ray4 ray4(ray);
+
+	__m128 invRayDirMinT[3], invRayDirMaxT[3];
+	invRayDirMinT[0] = _mm_set1_ps(Math::IsZero(ray.d.x) ? Math::Constants::Eps() : Math::Float(1) / ray.d.x);
+	invRayDirMinT[1] = _mm_set1_ps(Math::IsZero(ray.d.y) ? Math::Constants::Eps() : Math::Float(1) / ray.d.y);
+	invRayDirMinT[2] = _mm_set1_ps(Math::IsZero(ray.d.z) ? Math::Constants::Eps() : Math::Float(1) / ray.d.z);
+	invRayDirMaxT[0] = _mm_set1_ps(Math::IsZero(ray.d.x) ? Math::Constants::Inf() : Math::Float(1) / ray.d.x);
+	invRayDirMaxT[1] = _mm_set1_ps(Math::IsZero(ray.d.y) ? Math::Constants::Inf() : Math::Float(1) / ray.d.y);
+	invRayDirMaxT[2] = _mm_set1_ps(Math::IsZero(ray.d.z) ? Math::Constants::Inf() : Math::Float(1) / ray.d.z);
+
+	int rayDirSign[3];
+	rayDirSign[0] = ray.d.x < 0.0f;
+	rayDirSign[1] = ray.d.y < 0.0f;
+	rayDirSign[2] = ray.d.z < 0.0f;
+
+	// Stack for traversal
+	const int StackSize = 64;
+	int stack[StackSize];
+	int stackIndex = 0;
+	stack[0] = 0;
+
+	// Depth first traversal of QBVH
+	// Terminates as soon as any intersection is found
+	while (stackIndex >= 0)
+	{
+		int data = stack[stackIndex--];
+		if (data < 0)
+		{
+			// Leaf node
+			if (data == QBVHNode::EmptyLeafNode)
+			{
+				continue;
+			}
+
+			unsigned int size, offset;
+			QBVHNode::ExtractLeafData(data, size, offset);
+			for (unsigned int i = offset; i < offset + size; i++)
+			{
+				if (mode == QBVHIntersectionMode::SSE)
+				{
+					if (quadTris[i].Occluded(ray4))
+					{
+						return true;
+					}
+				}
+				else if (mode == QBVHIntersectionMode::Triaccel)
+				{
+					Math::Float t;
+					Math::Vec2 b;
+					if (triAccels[i].Intersect(ray, ray.minT, ray.maxT, b[0], b[1], t))
+					{
+						return true;
+					}
+				}
+			}
+		}
+		else
+		{
+			// Intermediate node
+			const auto& node = nodes[data];
+			int mask = node.Intersect(ray4, invRayDirMinT, invRayDirMaxT, rayDirSign);
+			if (mask & 0x1) stack[++stackIndex] = node.children[0];
+			if (mask & 0x2) stack[++stackIndex] = node.children[1];
+			if (mask & 0x4) stack[++stackIndex] = node.children[2];
+			if (mask & 0x8) stack[++stackIndex] = node.children[3];
+		}
+	}
+
+	return false;
+}
+
+void QBVHScene::IntersectTrianglesBatch( Ray* rays, Intersection* isects, bool* hits, size_t n ) const
+{
+	for (size_t begin = 0; begin < n; begin += QBVHPacketSize)
+	{
+		IntersectTrianglesPacket(rays + begin, isects + begin, hits + begin, Math::Min(n - begin, QBVHPacketSize));
+	}
+}
+
+void QBVHScene::IntersectTrianglesPacket( Ray* rays, Intersection* isects, bool* hits, size_t n ) const
+{
+	// Per-ray data
+	QBVHPacketRay packetRays[QBVHPacketSize];
+	for (size_t r = 0; r < n; r++)
+	{
+		packetRays[r].Load(rays[r]);
+	}
+
+	// Stack for traversal
+	// Each entry holds a node and the mask of the active rays for the node
+	const int StackSize = 64;
+	int stack[StackSize];
+	unsigned long long stackMask[StackSize];
+	int stackIndex = 0;
+
+	// Initial state : all rays are active for the root node
+	stack[0] = 0;
+	stackMask[0] = n == QBVHPacketSize ? ~0ULL : (1ULL << n) - 1;
+
+	// Depth first traversal of QBVH
+	while (stackIndex >= 0)
+	{
+		const int data = stack[stackIndex];
+		const unsigned long long activeMask = stackMask[stackIndex];
+		stackIndex--;
+
+		if (data < 0)
+		{
+			// Leaf node
+			if (data == QBVHNode::EmptyLeafNode)
+			{
+				continue;
+			}
+
+			// Intersection with triangles for each active ray
+			unsigned int size, offset;
+			QBVHNode::ExtractLeafData(data, size, offset);
+			for (size_t r = 0; r < n; r++)
+			{
+				if ((activeMask & (1ULL << r)) == 0)
+				{
+					continue;
+				}
+
+				auto& ray = rays[r];
+				auto& packetRay = packetRays[r];
+				for (unsigned int i = offset; i < offset + size; i++)
+				{
+					if (mode == QBVHIntersectionMode::SSE)
+					{
+						Math::Vec2 b;
+						unsigned int quadOffset;
+						if (quadTris[i].Intersect(packetRay.ray4, ray, b, quadOffset))
+						{
+							packetRay.intersectedTriIndex = i;
+							packetRay.intersectedQuadOffset = quadOffset;
+							packetRay.intersectedTriB = b;
+							packetRay.intersected = true;
+						}
+					}
+					else if (mode == QBVHIntersectionMode::Triaccel)
+					{
+						Math::Float t;
+						Math::Vec2 b;
+						if (triAccels[i].Intersect(ray, ray.minT, ray.maxT, b[0], b[1], t))
+						{
+							ray.maxT = t;
+							packetRay.ray4.maxT = _mm_set1_ps(t);
+							packetRay.intersectedTriIndex = i;
+							packetRay.intersectedTriB = b;
+							packetRay.intersected = true;
+						}
+					}
+				}
+			}
+		}
+		else
+		{
+			// Intermediate node
+			// The node is fetched once and shared among the active rays
+			const auto& node = nodes[data];
+			unsigned long long childMask[4] = { 0, 0, 0, 0 };
+			for (size_t r = 0; r < n; r++)
+			{
+				const unsigned long long bit = 1ULL << r;
+				if ((activeMask & bit) == 0)
+				{
+					continue;
+				}
+
+				const auto& packetRay = packetRays[r];
+				int mask = node.Intersect(packetRay.ray4, packetRay.invRayDirMinT, packetRay.invRayDirMaxT, packetRay.rayDirSign);
+				if (mask & 0x1) childMask[0] |= bit;
+				if (mask & 0x2) childMask[1] |= bit;
+				if (mask & 0x4) childMask[2] |= bit;
+				if (mask & 0x8) childMask[3] |= bit;
+			}
+
+			// Push children intersected with at least one ray
+			for (int i = 0; i < 4; i++)
+			{
+				if (childMask[i] != 0)
+				{
+					stackIndex++;
+					stack[stackIndex] = node.children[i];
+					stackMask[stackIndex] = childMask[i];
+				}
+			}
+		}
+	}
+
+	// Store some information to the intersection structures
+	for (size_t r = 0; r < n; r++)
+	{
+		const auto& packetRay = packetRays[r];
+		hits[r] = packetRay.intersected;
+		if (!packetRay.intersected)
+		{
+			continue;
+		}
+
+		if (mode == QBVHIntersectionMode::SSE)
+		{
+			const auto& quad = quadTris[packetRay.intersectedTriIndex];
+			auto& triRef = triRefs[quad.triRefIndex[packetRay.intersectedQuadOffset]];
+			StoreIntersectionFromBarycentricCoords(triRef.primitiveIndex, triRef.faceIndex, rays[r], packetRay.intersectedTriB, isects[r]);
+		}
+		else if (mode == QBVHIntersectionMode::Triaccel)
+		{
+			auto& triAccel = triAccels[packetRay.intersectedTriIndex];
+			StoreIntersectionFromBarycentricCoords(triAccel.primIndex, triAccel.shapeIndex, rays[r], packetRay.intersectedTriB, isects[r]);
+		}
+	}
+}
+
 LM_COMPONENT_REGISTER_IMPL(QBVHScene, Scene);
 
 #endif
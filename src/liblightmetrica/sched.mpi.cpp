@@ -26,9 +26,9 @@
 #include <lightmetrica/camera.h>
 #include <lightmetrica/bitmapfilm.h>
 #include <lightmetrica/bitmap.h>
+#include <lightmetrica/threadpool.h>
 #include <thread>
 #include <atomic>
-#include <omp.h>
 #include <mpi.h>
 
 #if !LM_MPI
@@ -48,7 +48,8 @@ enum MPIPTTagType
 
 /*!
 	MPI render process scheduler.
-	Render process scheduler for hybrid MPI + OpenMP parallelization.
+	Render process scheduler for hybrid MPI + multi-threaded parallelization.
+	Threads in a process are scheduled by the work-stealing thread pool.
 	We note that this scheduler requires SamplingBasedRenderProcess.
 	\sa SamplingBasedRenderProcess.
 */
@@ -63,6 +64,7 @@ public:
 	virtual bool Configure(const ConfigNode& node, const Assets& assets) override;
 	virtual void SetTerminationMode(TerminationMode mode, double time) override { terminationMode = mode; terminationTime = time; }
 	virtual bool Render(Renderer& renderer, const Scene& scene) const override;
+	virtual int NumThreads() const override { return numThreads; }
 	virtual boost::signals2::connection Connect_ReportProgress(const std::function<void(double, bool)>& func) override { return signal_ReportProgress.connect(func); }
 	virtual long long NumSamples() const override { return numSamples; }
 
@@ -77,7 +79,8 @@ private:
 	long long numSamples;									// Number of samples
 	int numThreads;											// Number of threads
 	long long samplesPerTask;								// Number of samples per MPI task
-	long long samplesPerBlock;								// Samples to be processed per block
+	long long samplesPerBlock;								// Maximum number of samples to be processed per block
+	std::unique_ptr<ThreadPool> threadPool;					// Thread pool
 
 };
 
@@ -98,8 +101,8 @@ bool MPIRenderProcessScheduler::Configure(const ConfigNode& node, const Assets&
 		return false;
 	}
 
-	// Set number of threads
-	omp_set_num_threads(numThreads);
+	// Create thread pool
+	threadPool.reset(new ThreadPool(numThreads));
 
 	return true;
 }
@@ -120,6 +123,10 @@ bool MPIRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) c
 	MPI_Status status;
 	long long processedSamples = 0;
 
+	// True if some render task has failed
+	// Slaves report the failure by sending negative number of processed samples
+	int failed = 0;
+
 	if (rank == 0)
 	{
 		// # Master process
@@ -129,6 +136,9 @@ bool MPIRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) c
 		// Number of samples queried
 		long long queriedSamples = 0;
 
+		// Number of tasks assigned but not finished
+		int runningTasks = 0;
+
 		// --------------------------------------------------------------------------------
 
 		// ## Assign initial tasks to slave processes
@@ -138,6 +148,7 @@ bool MPIRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) c
 			long long samples = terminationMode == TerminationMode::Time ? samplesPerTask : Math::Min(samplesPerTask, numSamples - queriedSamples);
 			MPI_Send(&samples, 1, MPI_LONG_LONG, i, TagType_AssignTask, MPI_COMM_WORLD);
 			queriedSamples += samples;
+			runningTasks++;
 		}
 
 		// --------------------------------------------------------------------------------
@@ -149,6 +160,14 @@ bool MPIRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) c
 			// Wait for result
 			long long processedSamplesBySlave;
 			MPI_Recv(&processedSamplesBySlave, 1, MPI_LONG_LONG, MPI_ANY_SOURCE, TagType_TaskFinished, MPI_COMM_WORLD, &status);
+			runningTasks--;
+			if (processedSamplesBySlave < 0)
+			{
+				// Stop assigning tasks if some task has failed
+				LM_LOG_ERROR("Render task has failed in process #" + std::to_string(status.MPI_SOURCE));
+				failed = 1;
+				break;
+			}
 			processedSamples += processedSamplesBySlave;
 
 			// --------------------------------------------------------------------------------
@@ -166,13 +185,6 @@ bool MPIRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) c
 
 				if (elapsed > terminationTime)
 				{
-					// Wait for remaining tasks
-					while (processedSamples < queriedSamples)
-					{
-						MPI_Recv(&processedSamplesBySlave, 1, MPI_LONG_LONG, MPI_ANY_SOURCE, TagType_TaskFinished, MPI_COMM_WORLD, &status);
-						processedSamples += processedSamplesBySlave;
-					}
-
 					break;
 				}
 				else
@@ -190,11 +202,29 @@ bool MPIRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) c
 				long long samples = terminationMode == TerminationMode::Time ? samplesPerTask : Math::Min(samplesPerTask, numSamples - queriedSamples);
 				MPI_Send(&samples, 1, MPI_LONG_LONG, status.MPI_SOURCE, TagType_AssignTask, MPI_COMM_WORLD);
 				queriedSamples += samples;
+				runningTasks++;
 			}
 		}
 
 		// --------------------------------------------------------------------------------
 
+		// ## Wait for remaining tasks
+		while (runningTasks > 0)
+		{
+			long long processedSamplesBySlave;
+			MPI_Recv(&processedSamplesBySlave, 1, MPI_LONG_LONG, MPI_ANY_SOURCE, TagType_TaskFinished, MPI_COMM_WORLD, &status);
+			runningTasks--;
+			if (processedSamplesBySlave < 0)
+			{
+				LM_LOG_ERROR("Render task has failed in process #" + std::to_string(status.MPI_SOURCE));
+				failed = 1;
+				continue;
+			}
+			processedSamples += processedSamplesBySlave;
+		}
+
+		// --------------------------------------------------------------------------------
+
 		// ## Exit slaves
 		for (int i = 1; i < numProcs; i++)
 		{
@@ -255,30 +285,15 @@ bool MPIRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) c
 			// ### Rendering
 			std::atomic<long long> processedSamples(0);
 
-			// Number of blocks to be separated
-			long long blocks = (assignedSamples + samplesPerBlock) / samplesPerBlock;
-
-			#pragma omp parallel for
-			for (long long block = 0; block < blocks; block++)
+			bool succeeded = threadPool->ParallelFor(assignedSamples, samplesPerBlock, [&](int threadId, long long sampleBegin, long long sampleEnd)
 			{
-				// Thread ID & process
-				int threadId = omp_get_thread_num();
-				auto& process = processes[threadId];
-
-				// Sample range
-				long long sampleBegin = samplesPerBlock * block;
-				long long sampleEnd = Math::Min(sampleBegin + samplesPerBlock, assignedSamples);
-
+				processes[threadId]->ProcessMultipleSamples(scene, sampleEnd - sampleBegin);
 				processedSamples += sampleEnd - sampleBegin;
-
-				for (long long sample = sampleBegin; sample < sampleEnd; sample++)
-				{
-					process->ProcessSingleSample(scene);
-				}
-			}
+			});
 
 			// ### Send a result
-			long long result = processedSamples;
+			// Negative value notifies the failure to the master
+			long long result = succeeded ? processedSamples.load() : -1;
 			MPI_Send(&result, 1, MPI_LONG_LONG, 0, TagType_TaskFinished, MPI_COMM_WORLD);
 		}
 
@@ -300,13 +315,24 @@ bool MPIRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) c
 	if (rank == 0)
 	{
 		MPI_Reduce(MPI_IN_PLACE, data, size, MPI_FLOAT, MPI_SUM, 0, MPI_COMM_WORLD);
-		masterFilm->Rescale(Math::Float(masterFilm->Width() * masterFilm->Height()) / Math::Float(processedSamples));
+		if (!failed)
+		{
+			masterFilm->Rescale(Math::Float(masterFilm->Width() * masterFilm->Height()) / Math::Float(processedSamples));
+		}
 	}
 	else
 	{
 		MPI_Reduce(data, data, size, MPI_FLOAT, MPI_SUM, 0, MPI_COMM_WORLD);
 	}
 
+	// Share the failure among all processes
+	MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	if (failed)
+	{
+		LM_LOG_ERROR("Render operation has failed");
+		return false;
+	}
+
 	return true;
 }
 
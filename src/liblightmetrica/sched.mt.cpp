@@ -25,16 +25,26 @@
 #include <lightmetrica/scene.h>
 #include <lightmetrica/camera.h>
 #include <lightmetrica/bitmapfilm.h>
+#include <lightmetrica/threadpool.h>
 #include <thread>
 #include <atomic>
-#include <omp.h>
+#include <mutex>
+#include <condition_variable>
 
 LM_NAMESPACE_BEGIN
 
+namespace
+{
+	// Interval of the progress reports in milliseconds
+	const long long ProgressReportInterval = 100;
+}
+
 /*!
 	Multithreaded render process scheduler.
 	Creates and schedules render processes among threads.
-	Multi-threading is supported by OpenMP.
+	Multi-threading is supported by the work-stealing thread pool.
+	Progress reports and the check of the termination time are done
+	in a separate reporter thread in order not to interfere the render threads.
 	We note that this scheduler requires SamplingBasedRenderProcess.
 	\sa SamplingBasedRenderProcess.
 */
@@ -49,6 +59,7 @@ public:
 	virtual bool Configure(const ConfigNode& node, const Assets& assets) override;
 	virtual void SetTerminationMode(TerminationMode mode, double time) override { terminationMode = mode; terminationTime = time; }
 	virtual bool Render(Renderer& renderer, const Scene& scene) const override;
+	virtual int NumThreads() const override { return numThreads; }
 	virtual boost::signals2::connection Connect_ReportProgress(const std::function<void(double, bool)>& func) override { return signal_ReportProgress.connect(func); }
 	virtual long long NumSamples() const override { return numSamples; }
 
@@ -62,8 +73,9 @@ private:
 
 	long long numSamples;					//!< Number of samples
 	int numThreads;							//!< Number of threads
-	long long samplesPerBlock;				//!< Samples to be processed per block
+	long long samplesPerBlock;				//!< Maximum number of samples to be processed per block
 	Math::Float progressImageInterval;		//!< Seconds between progress images' output (if -1, disabled)
+	std::unique_ptr<ThreadPool> threadPool;	//!< Thread pool
 
 };
 
@@ -84,8 +96,8 @@ bool MTRenderProcessScheduler::Configure(const ConfigNode& node, const Assets& a
 	}
 	node.ChildValueOrDefault("progress_image_interval", Math::Float(-1), progressImageInterval);
 
-	// Set number of threads
-	omp_set_num_threads(numThreads);
+	// Create thread pool
+	threadPool.reset(new ThreadPool(numThreads));
 
 	return true;
 }
@@ -93,12 +105,8 @@ bool MTRenderProcessScheduler::Configure(const ConfigNode& node, const Assets& a
 bool MTRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) const
 {
 	auto* masterFilm = scene.MainCamera()->GetFilm();
-	std::atomic<long long> processedBlocks(0);
 	std::atomic<long long> processedSamples(0);
 
-	// Number of blocks to be separated
-	long long blocks = (numSamples + samplesPerBlock) / samplesPerBlock;
-
 	signal_ReportProgress(0, false);
 
 	// --------------------------------------------------------------------------------
@@ -128,73 +136,81 @@ bool MTRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) co
 
 	// # Render loop
 
-	bool cancel = false;
-	bool done = false;
+	std::atomic<bool> done(false);
 	auto startTime = std::chrono::high_resolution_clock::now();
 	auto prevStartTime = startTime;
 	int intermediateImageOutputCount = 0;
 
-	while (true)
+	// Reporter thread
+	// The render threads only update the atomic counter of the processed samples.
+	// The reporter thread periodically reads the counter and reports the progress.
+	// In the time termination mode, the thread also wakes up at the termination time and cancels the render threads.
+	std::mutex reporterMutex;
+	std::condition_variable reporterCond;
+	bool renderFinished = false;
+	std::thread reporterThread([&]()
 	{
-		#pragma omp parallel for
-		for (long long block = 0; block < blocks; block++)
+		const auto terminationTimePoint = terminationMode == TerminationMode::Time
+			? startTime + std::chrono::milliseconds(static_cast<long long>(terminationTime * 1000.0))
+			: startTime;
+		std::unique_lock<std::mutex> lock(reporterMutex);
+		while (!renderFinished)
 		{
-			#pragma omp flush (done)
-			if (done)
+			auto nextTimePoint = std::chrono::high_resolution_clock::now() + std::chrono::milliseconds(ProgressReportInterval);
+			if (terminationMode == TerminationMode::Time && !done)
 			{
-				continue;
+				nextTimePoint = std::min(nextTimePoint, terminationTimePoint);
 			}
 
-			// --------------------------------------------------------------------------------
-
-			try
-			{
-				// Thread ID & process
-				int threadId = omp_get_thread_num();
-				auto& process = processes[threadId];
-
-				// Sample range
-				long long sampleBegin = samplesPerBlock * block;
-				long long sampleEnd = Math::Min(sampleBegin + samplesPerBlock, numSamples);
-
-				processedSamples += sampleEnd - sampleBegin;
-
-				for (long long sample = sampleBegin; sample < sampleEnd; sample++)
-				{
-					process->ProcessSingleSample(scene);
-				}
-			}
-			catch (const std::exception& e)
+			reporterCond.wait_until(lock, nextTimePoint);
+			if (renderFinished)
 			{
-				LM_LOG_ERROR(boost::str(boost::format("EXCEPTION (thread #%d) | %s") % omp_get_thread_num() % e.what()));
-				cancel = done = true;
-				#pragma omp flush (done)
+				break;
 			}
 
-			// --------------------------------------------------------------------------------
-
-			// Progress report
-			processedBlocks++;
 			if (terminationMode == TerminationMode::Samples)
 			{
-				auto progress = static_cast<double>(processedBlocks) / blocks;
-				signal_ReportProgress(progress, false);
+				signal_ReportProgress(static_cast<double>(processedSamples.load(std::memory_order_relaxed)) / numSamples, false);
 			}
-			else if (terminationMode == TerminationMode::Time)
+			else if (terminationMode == TerminationMode::Time && !done)
 			{
 				auto currentTime = std::chrono::high_resolution_clock::now();
-				double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime).count()) / 1000.0;
-				if (elapsed > terminationTime)
+				if (currentTime >= terminationTimePoint)
 				{
 					done = true;
-					#pragma omp flush (done)
+					threadPool->Cancel();
 				}
 				else
 				{
+					double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime).count()) / 1000.0;
 					signal_ReportProgress(elapsed / terminationTime, false);
 				}
 			}
 		}
+	});
+
+	bool succeeded = true;
+	while (true)
+	{
+		// Blocks are dynamically distributed among threads
+		// In the time termination mode, the remaining blocks are canceled when the time is over
+		succeeded = threadPool->ParallelFor(numSamples, samplesPerBlock, [&](int threadId, long long sampleBegin, long long sampleEnd)
+		{
+			// The flag is checked here in case the cancellation is requested before the operation starts
+			if (done.load(std::memory_order_relaxed))
+			{
+				threadPool->Cancel();
+				return;
+			}
+
+			processes[threadId]->ProcessMultipleSamples(scene, sampleEnd - sampleBegin);
+			processedSamples.fetch_add(sampleEnd - sampleBegin, std::memory_order_relaxed);
+		});
+
+		if (!succeeded)
+		{
+			break;
+		}
 
 		if (progressImageInterval > Math::Float(0))
 		{
@@ -236,9 +252,17 @@ bool MTRenderProcessScheduler::Render(Renderer& renderer, const Scene& scene) co
 		}
 	}
 
+	// Stop the reporter thread
+	{
+		std::unique_lock<std::mutex> lock(reporterMutex);
+		renderFinished = true;
+	}
+	reporterCond.notify_one();
+	reporterThread.join();
+
 	signal_ReportProgress(1, true);
 
-	if (cancel)
+	if (!succeeded)
 	{
 		LM_LOG_ERROR("Render operation has been canceled");
 		return false;
@@ -25,16 +25,16 @@
 #include <lightmetrica/scene.h>
 #include <lightmetrica/camera.h>
 #include <lightmetrica/film.h>
+#include <lightmetrica/threadpool.h>
 #include <thread>
 #include <atomic>
-#include <omp.h>
 
 LM_NAMESPACE_BEGIN
 
 /*!
 	Deterministic multithreaded render process scheduler.
 	Creates and schedules render processes among threads.
-	Multi-threading is supported by OpenMP.
+	Multi-threading is supported by the work-stealing thread pool.
 	We note that this scheduler requires DeterministicPixelBasedRenderProcess.
 	\sa DeterministicPixelBasedRenderProcess.
 */
@@ -49,6 +49,7 @@ public:
 	virtual bool Configure(const ConfigNode& node, const Assets& assets) override;
 	virtual void SetTerminationMode(TerminationMode mode, double time) override {}
 	virtual bool Render(Renderer& renderer, const Scene& scene) const override;
+	virtual int NumThreads() const override { return numThreads; }
 	virtual boost::signals2::connection Connect_ReportProgress(const std::function<void(double, bool)>& func) override { return signal_ReportProgress.connect(func); }
 
 private:
@@ -58,6 +59,7 @@ private:
 private:
 
 	int numThreads;
+	std::unique_ptr<ThreadPool> threadPool;
 
 };
 
@@ -70,8 +72,8 @@ bool DeterministicMTRenderProcessScheduler::Configure(const ConfigNode& node, co
 		numThreads = Math::Max(1, static_cast<int>(std::thread::hardware_concurrency()) + numThreads);
 	}
 
-	// Set number of threads
-	omp_set_num_threads(numThreads);
+	// Create thread pool
+	threadPool.reset(new ThreadPool(numThreads));
 
 	return true;
 }
@@ -108,18 +110,32 @@ bool DeterministicMTRenderProcessScheduler::Render(Renderer& renderer, const Sce
 
 	signal_ReportProgress(0, false);
 
-	#pragma omp parallel for
-	for (int y = 0; y < film->Height(); y++)
+	// The result is independent of the assignment of the lines to the threads
+	bool succeeded = threadPool->ParallelFor(film->Height(), 1, [&](int threadId, long long begin, long long end)
 	{
-		auto& process = processes[omp_get_thread_num()];
-		for (int x = 0; x < film->Width(); x++)
+		for (int y = static_cast<int>(begin); y < static_cast<int>(end); y++)
 		{
-			process->ProcessSinglePixel(scene, Math::Vec2i(x, y));
+			// Pixels in a line are processed together
+			// in order for the process to utilize the coherence of the primary rays
+			auto& process = processes[threadId];
+			std::vector<Math::Vec2i> pixels;
+			pixels.reserve(film->Width());
+			for (int x = 0; x < film->Width(); x++)
+			{
+				pixels.emplace_back(x, y);
+			}
+			process->ProcessMultiplePixels(scene, &pixels[0], film->Width());
 		}
-	}
+	});
 
 	signal_ReportProgress(1, true);
 
+	if (!succeeded)
+	{
+		LM_LOG_ERROR("Render operation has been canceled");
+		return false;
+	}
+
 	// --------------------------------------------------------------------------------
 
 	return true;
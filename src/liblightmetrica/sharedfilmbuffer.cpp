@@ -0,0 +1,339 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/sharedfilmbuffer.h>
+#include <lightmetrica/parallel.h>
+#include <lightmetrica/confignode.h>
+#include <lightmetrica/logger.h>
+#include <lightmetrica/assert.h>
+
+LM_NAMESPACE_BEGIN
+
+namespace
+{
+	// Number of values in a tile
+	const int TileDataSize = SharedFilmBuffer::TileSize * SharedFilmBuffer::TileSize * 3;
+
+	// Minimum number of values processed in a thread
+	const size_t ParallelMinChunkSize = 1 << 16;
+}
+
+SharedFilmBuffer::SharedFilmBuffer( int width, int height )
+	: width(width)
+	, height(height)
+	, numTilesX((width + TileSize - 1) / TileSize)
+	, numTilesY((height + TileSize - 1) / TileSize)
+	, data(width * height * 3, Math::Float(0))
+	, tileMutexes(new std::mutex[numTilesX * numTilesY])
+	, stripeLocks(NumStripes)
+{
+
+}
+
+void SharedFilmBuffer::AccumulateTile( int tileIndex, const Math::Float* tileData, unsigned int rowMask )
+{
+	const int tileX = tileIndex % numTilesX;
+	const int tileY = tileIndex / numTilesX;
+	const int beginX = tileX * TileSize;
+	const int beginY = tileY * TileSize;
+	const int endX = std::min(beginX + TileSize, width);
+	const int endY = std::min(beginY + TileSize, height);
+
+	std::unique_lock<std::mutex> lock(tileMutexes[tileIndex]);
+	for (int y = beginY; y < endY; y++)
+	{
+		if ((rowMask & (1u << (y - beginY))) == 0)
+		{
+			continue;
+		}
+
+		const auto* src = tileData + 3 * TileSize * (y - beginY);
+		auto* dst = &data[3 * (y * width + beginX)];
+		for (int i = 0; i < 3 * (endX - beginX); i++)
+		{
+			dst[i] += src[i];
+		}
+	}
+}
+
+void SharedFilmBuffer::AccumulateContribution( const Math::Vec2i& pixel, const Math::Vec3& contrb )
+{
+	size_t idx = pixel.y * width + pixel.x;
+	auto& stripeLock = stripeLocks[idx % NumStripes];
+	stripeLock.Lock();
+	data[3 * idx    ] += contrb[0];
+	data[3 * idx + 1] += contrb[1];
+	data[3 * idx + 2] += contrb[2];
+	stripeLock.Unlock();
+}
+
+void SharedFilmBuffer::RecordContribution( const Math::Vec2i& pixel, const Math::Vec3& contrb )
+{
+	std::unique_lock<std::mutex> lock(tileMutexes[TileIndex(pixel)]);
+	size_t idx = pixel.y * width + pixel.x;
+	auto& stripeLock = stripeLocks[idx % NumStripes];
+	stripeLock.Lock();
+	data[3 * idx    ] = contrb[0];
+	data[3 * idx + 1] = contrb[1];
+	data[3 * idx + 2] = contrb[2];
+	stripeLock.Unlock();
+}
+
+void SharedFilmBuffer::AccumulateTo( std::vector<Math::Float>& data ) const
+{
+	Parallel::For(0, this->data.size(), ParallelMinChunkSize, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			data[i] += this->data[i];
+		}
+	});
+}
+
+// --------------------------------------------------------------------------------
+
+FilmTileCache::FilmTileCache( const std::shared_ptr<SharedFilmBuffer>& buffer )
+	: buffer(buffer)
+	, slotTileIndices(NumSlots, -1)
+	, slotRowMasks(NumSlots, 0)
+	, slotData(NumSlots * TileDataSize, Math::Float(0))
+{
+
+}
+
+FilmTileCache::~FilmTileCache()
+{
+	Flush();
+}
+
+void FilmTileCache::AccumulateContribution( const Math::Vec2i& pixel, const Math::Vec3& contrb )
+{
+	// Find the slot
+	// The cached tile is evicted if the slot is used by another tile
+	const int tileIndex = buffer->TileIndex(pixel);
+	const int slot = tileIndex % NumSlots;
+	if (slotTileIndices[slot] != tileIndex)
+	{
+		FlushSlot(slot);
+		slotTileIndices[slot] = tileIndex;
+	}
+
+	// Accumulate to the cached tile
+	const int localX = pixel.x % SharedFilmBuffer::TileSize;
+	const int localY = pixel.y % SharedFilmBuffer::TileSize;
+	auto* p = &slotData[slot * TileDataSize + 3 * (localY * SharedFilmBuffer::TileSize + localX)];
+	p[0] += contrb[0];
+	p[1] += contrb[1];
+	p[2] += contrb[2];
+	slotRowMasks[slot] |= 1u << localY;
+}
+
+void FilmTileCache::Flush()
+{
+	for (int slot = 0; slot < NumSlots; slot++)
+	{
+		FlushSlot(slot);
+	}
+}
+
+void FilmTileCache::FlushSlot( int slot )
+{
+	if (slotTileIndices[slot] < 0)
+	{
+		return;
+	}
+
+	// Only the rows with contributions are flushed and cleared,
+	// which reduces the cost of the eviction for incoherent accesses
+	auto* tileData = &slotData[slot * TileDataSize];
+	const auto rowMask = slotRowMasks[slot];
+	if (rowMask != 0)
+	{
+		buffer->AccumulateTile(slotTileIndices[slot], tileData, rowMask);
+		for (int y = 0; y < SharedFilmBuffer::TileSize; y++)
+		{
+			if ((rowMask & (1u << y)) != 0)
+			{
+				auto* row = tileData + 3 * SharedFilmBuffer::TileSize * y;
+				std::fill(row, row + 3 * SharedFilmBuffer::TileSize, Math::Float(0));
+			}
+		}
+	}
+
+	slotTileIndices[slot] = -1;
+	slotRowMasks[slot] = 0;
+}
+
+// --------------------------------------------------------------------------------
+
+SharedFilmAccumulation::SharedFilmAccumulation()
+	: mode(FilmAccumulationMode::Clone)
+	, sharedPending(false)
+	, sharedClone(false)
+{
+
+}
+
+SharedFilmAccumulation::~SharedFilmAccumulation()
+{
+
+}
+
+bool SharedFilmAccumulation::Load( const ConfigNode& node )
+{
+	// Find 'accumulation_mode' element (optional)
+	auto accumulationModeNode = node.Child("accumulation_mode");
+	if (accumulationModeNode.Empty() || accumulationModeNode.Value() == "clone")
+	{
+		mode = FilmAccumulationMode::Clone;
+	}
+	else if (accumulationModeNode.Value() == "tiled")
+	{
+		mode = FilmAccumulationMode::Tiled;
+	}
+	else if (accumulationModeNode.Value() == "atomic")
+	{
+		mode = FilmAccumulationMode::Atomic;
+	}
+	else
+	{
+		LM_LOG_ERROR("Invalid accumulation mode '" + accumulationModeNode.Value() + "'");
+		return false;
+	}
+
+	return true;
+}
+
+bool SharedFilmAccumulation::RecordContribution( const Math::Vec2i& pixel, const Math::Vec3& contrb )
+{
+	if (!sharedClone)
+	{
+		return false;
+	}
+
+	if (tileCache)
+	{
+		tileCache->Flush();
+	}
+	sharedBuffer->RecordContribution(pixel, contrb);
+	return true;
+}
+
+bool SharedFilmAccumulation::AccumulateContribution( const Math::Vec2i& pixel, const Math::Vec3& contrb )
+{
+	if (!sharedClone)
+	{
+		return false;
+	}
+
+	if (tileCache)
+	{
+		tileCache->AccumulateContribution(pixel, contrb);
+	}
+	else
+	{
+		sharedBuffer->AccumulateContribution(pixel, contrb);
+	}
+	return true;
+}
+
+void SharedFilmAccumulation::AccumulateFilm( const SharedFilmAccumulation& other, std::vector<Math::Float>& data, std::vector<Math::Float>& otherData ) const
+{
+	if (other.sharedClone)
+	{
+		// Clone in the tiled or atomic mode
+		// The contributions are accumulated to the shared buffer,
+		// which is accumulated to the bitmap when the bitmap is accessed.
+		if (sharedClone || other.sharedBuffer != sharedBuffer)
+		{
+			LM_LOG_WARN("Film does not share the buffer with the clone");
+			return;
+		}
+
+		if (other.tileCache)
+		{
+			other.tileCache->Flush();
+		}
+		sharedPending = true;
+		return;
+	}
+
+	// Accumulate data
+	// The data is split into chunks accumulated in parallel
+	Resolve(data);
+	other.Resolve(otherData);
+	LM_ASSERT(data.size() == otherData.size());
+	Parallel::For(0, data.size(), ParallelMinChunkSize, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			data[i] += otherData[i];
+		}
+	});
+}
+
+void SharedFilmAccumulation::Resolve( std::vector<Math::Float>& data ) const
+{
+	if (sharedPending)
+	{
+		sharedBuffer->AccumulateTo(data);
+		sharedPending = false;
+	}
+}
+
+bool SharedFilmAccumulation::ConfigureClone( SharedFilmAccumulation& clone, int width, int height, std::vector<Math::Float>& data ) const
+{
+	clone.mode = mode;
+	if (mode != FilmAccumulationMode::Tiled && mode != FilmAccumulationMode::Atomic)
+	{
+		Resolve(data);
+		return false;
+	}
+
+	// Clone of a clone shares the same buffer.
+	// Otherwise create a new shared buffer if there is no clone using the current one.
+	if (!sharedClone)
+	{
+		Resolve(data);
+		if (!sharedBuffer || sharedBuffer.use_count() == 1)
+		{
+			sharedBuffer = std::make_shared<SharedFilmBuffer>(width, height);
+		}
+	}
+
+	clone.sharedBuffer = sharedBuffer;
+	clone.sharedClone = true;
+	if (mode == FilmAccumulationMode::Tiled)
+	{
+		clone.tileCache.reset(new FilmTileCache(sharedBuffer));
+	}
+
+	return true;
+}
+
+void SharedFilmAccumulation::Reset()
+{
+	tileCache.reset();
+	sharedBuffer.reset();
+	sharedPending = false;
+	sharedClone = false;
+}
+
+LM_NAMESPACE_END
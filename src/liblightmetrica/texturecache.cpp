@@ -0,0 +1,609 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/texturecache.h>
+#include <lightmetrica/logger.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <list>
+
+LM_NAMESPACE_BEGIN
+
+namespace
+{
+
+	// Default memory budget of the shared texture cache
+	const size_t DefaultMemoryBudget = size_t(1) << 30;
+
+	// Magic number and version of the tile file
+	// Increment the version when the layout of the file is changed
+	const char TileFileMagic[8] = { 'L', 'M', 'T', 'I', 'L', 'E', 'D', '\0' };
+	const unsigned int TileFileVersion = 2;
+
+	// The level table and the tiles are aligned to the boundary
+	const size_t TileFileAlignment = 64;
+
+	// Upper bound of the tile size accepted in the tile file
+	const int TileFileMaxTileSize = 1 << 12;
+
+	struct TileFileHeader
+	{
+		char magic[8];
+		unsigned int version;
+		int width;
+		int height;
+		int tileSize;
+		int numLevels;
+		unsigned long long numTiles;
+	};
+
+	// Entry of the level table following the header
+	struct TileFileLevel
+	{
+		int width;
+		int height;
+		int tilesX;
+		int tilesY;
+		unsigned long long tileOffset;
+	};
+
+	LM_FORCE_INLINE unsigned long long AlignedSize(unsigned long long size)
+	{
+		return (size + TileFileAlignment - 1) / TileFileAlignment * TileFileAlignment;
+	}
+
+	// Mixes the bits of the key for the indices of the shards and the lookup caches
+	LM_FORCE_INLINE unsigned long long MixKey(unsigned long long key)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		return key;
+	}
+
+	// Entry of the per-thread lookup cache
+	struct ThreadLookupCacheEntry
+	{
+		unsigned long long cacheID;
+		unsigned long long key;
+		std::shared_ptr<const TextureCache::Tile> tile;
+	};
+
+	ThreadLookupCacheEntry* ThreadLookupCache()
+	{
+		static thread_local ThreadLookupCacheEntry cache[TextureCache::ThreadLookupCacheSize];
+		return cache;
+	}
+
+	// IDs of the cache instances in order to distinguish the entries of the lookup caches
+	std::atomic<unsigned long long> NextCacheID(1);
+
+	const TextureCache::Tile EmptyTile;
+
+}
+
+// --------------------------------------------------------------------------------
+
+class TextureCache::Impl
+{
+public:
+
+	Impl(size_t memoryBudget, int numShards);
+
+public:
+
+	std::shared_ptr<const Tile> FindOrLoad(unsigned long long key, const LoadTileFunc& loadFunc);
+
+public:
+
+	struct Entry
+	{
+		unsigned long long key;
+		std::shared_ptr<const Tile> tile;
+	};
+
+	struct Shard
+	{
+		Shard() : memoryUsage(0) {}
+		std::mutex mutex;
+		std::list<Entry> lru;		// Most recently used entry is at the front
+		std::unordered_map<unsigned long long, std::list<Entry>::iterator> entries;
+		size_t memoryUsage;
+	};
+
+	const unsigned long long cacheID;
+	std::atomic<size_t> memoryBudget;
+	std::vector<Shard> shards;
+	std::atomic<long long> numLoadedTiles;
+	std::atomic<unsigned int> nextTextureID;
+
+};
+
+TextureCache::Impl::Impl( size_t memoryBudget, int numShards )
+	: cacheID(NextCacheID++)
+	, memoryBudget(memoryBudget)
+	, shards(static_cast<size_t>(Math::Max(1, numShards)))
+	, numLoadedTiles(0)
+	, nextTextureID(0)
+{
+
+}
+
+std::shared_ptr<const TextureCache::Tile> TextureCache::Impl::FindOrLoad( unsigned long long key, const LoadTileFunc& loadFunc )
+{
+	auto& shard = shards[(MixKey(key) >> 16) % shards.size()];
+
+	{
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		auto it = shard.entries.find(key);
+		if (it != shard.entries.end())
+		{
+			shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+			return it->second->tile;
+		}
+	}
+
+	// Load the tile outside of the lock
+	auto tile = std::make_shared<Tile>();
+	if (!loadFunc(*tile))
+	{
+		return nullptr;
+	}
+	numLoadedTiles++;
+
+	std::unique_lock<std::mutex> lock(shard.mutex);
+
+	// The same tile might be loaded by another thread
+	auto it = shard.entries.find(key);
+	if (it != shard.entries.end())
+	{
+		shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+		return it->second->tile;
+	}
+
+	Entry entry;
+	entry.key = key;
+	entry.tile = tile;
+	shard.lru.push_front(entry);
+	shard.entries[key] = shard.lru.begin();
+	shard.memoryUsage += tile->size() * sizeof(float);
+
+	// Evict the least recently used tiles exceeding the share of the budget except for the new one
+	const size_t budget = memoryBudget / shards.size();
+	while (shard.memoryUsage > budget && shard.lru.size() > 1)
+	{
+		const auto& evicted = shard.lru.back();
+		shard.memoryUsage -= evicted.tile->size() * sizeof(float);
+		shard.entries.erase(evicted.key);
+		shard.lru.pop_back();
+	}
+
+	return tile;
+}
+
+// --------------------------------------------------------------------------------
+
+TextureCache::TextureCache( size_t memoryBudget, int numShards )
+	: p(new Impl(memoryBudget, numShards))
+{
+
+}
+
+TextureCache::~TextureCache()
+{
+	LM_SAFE_DELETE(p);
+}
+
+TextureCache& TextureCache::Shared()
+{
+	static TextureCache cache(DefaultMemoryBudget);
+	return cache;
+}
+
+void TextureCache::SetMemoryBudget( size_t memoryBudget )
+{
+	p->memoryBudget = memoryBudget;
+}
+
+size_t TextureCache::MemoryBudget() const
+{
+	return p->memoryBudget;
+}
+
+size_t TextureCache::MemoryUsage() const
+{
+	size_t usage = 0;
+	for (auto& shard : p->shards)
+	{
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		usage += shard.memoryUsage;
+	}
+	return usage;
+}
+
+long long TextureCache::NumLoadedTiles() const
+{
+	return p->numLoadedTiles;
+}
+
+unsigned int TextureCache::NewTextureID()
+{
+	return p->nextTextureID++;
+}
+
+const TextureCache::Tile& TextureCache::GetTile( unsigned long long key, const LoadTileFunc& loadFunc )
+{
+	// Find the tile in the lookup cache of the thread without locks
+	auto& entry = ThreadLookupCache()[MixKey(key) % ThreadLookupCacheSize];
+	if (entry.tile && entry.cacheID == p->cacheID && entry.key == key)
+	{
+		return *entry.tile;
+	}
+
+	auto tile = p->FindOrLoad(key, loadFunc);
+	if (!tile)
+	{
+		return EmptyTile;
+	}
+
+	// The lookup cache keeps the tile alive until the entry is replaced
+	entry.cacheID = p->cacheID;
+	entry.key = key;
+	entry.tile = tile;
+	return *entry.tile;
+}
+
+void TextureCache::Clear()
+{
+	for (auto& shard : p->shards)
+	{
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		shard.lru.clear();
+		shard.entries.clear();
+		shard.memoryUsage = 0;
+	}
+}
+
+// --------------------------------------------------------------------------------
+
+namespace
+{
+
+	struct MipmapLevel
+	{
+		int width;
+		int height;
+		int tilesX;
+		int tilesY;
+		size_t tileOffset;		// Index of the first tile of the level
+	};
+
+	std::vector<MipmapLevel> ComputeMipmapLevels(int width, int height, int tileSize)
+	{
+		std::vector<MipmapLevel> levels;
+		size_t tileOffset = 0;
+		while (true)
+		{
+			MipmapLevel level;
+			level.width = width;
+			level.height = height;
+			level.tilesX = (width + tileSize - 1) / tileSize;
+			level.tilesY = (height + tileSize - 1) / tileSize;
+			level.tileOffset = tileOffset;
+			levels.push_back(level);
+			tileOffset += static_cast<size_t>(level.tilesX) * level.tilesY;
+
+			if (width == 1 && height == 1)
+			{
+				break;
+			}
+			width = Math::Max(1, (width + 1) / 2);
+			height = Math::Max(1, (height + 1) / 2);
+		}
+		return levels;
+	}
+
+}
+
+class TiledMipmapImage::Impl
+{
+public:
+
+	Impl() : cache(nullptr), textureID(0), tileSize(0), tilesOffset(0) {}
+
+public:
+
+	TextureCache* cache;
+	unsigned int textureID;
+	boost::interprocess::file_mapping mapping;
+	boost::interprocess::mapped_region region;
+	int tileSize;
+	size_t tilesOffset;					// Offset of the tiles in bytes
+	std::vector<MipmapLevel> levels;
+
+};
+
+TiledMipmapImage::TiledMipmapImage()
+	: p(new Impl)
+{
+
+}
+
+TiledMipmapImage::~TiledMipmapImage()
+{
+	LM_SAFE_DELETE(p);
+}
+
+bool TiledMipmapImage::Build( const std::vector<float>& data, int width, int height, int tileSize, const std::string& path )
+{
+	if (width <= 0 || height <= 0 || tileSize <= 0 || tileSize > TileFileMaxTileSize || data.size() != static_cast<size_t>(width) * height * 3)
+	{
+		LM_LOG_ERROR("Invalid image for the tile file");
+		return false;
+	}
+
+	const auto levels = ComputeMipmapLevels(width, height, tileSize);
+
+	TileFileHeader header;
+	std::memset(&header, 0, sizeof(TileFileHeader));
+	std::memcpy(header.magic, TileFileMagic, sizeof(TileFileMagic));
+	header.version = TileFileVersion;
+	header.width = width;
+	header.height = height;
+	header.tileSize = tileSize;
+	header.numLevels = static_cast<int>(levels.size());
+	header.numTiles = static_cast<unsigned long long>(levels.back().tileOffset) + 1;
+
+	std::vector<TileFileLevel> levelTable(levels.size());
+	std::memset(&levelTable[0], 0, sizeof(TileFileLevel) * levelTable.size());
+	for (size_t l = 0; l < levels.size(); l++)
+	{
+		levelTable[l].width = levels[l].width;
+		levelTable[l].height = levels[l].height;
+		levelTable[l].tilesX = levels[l].tilesX;
+		levelTable[l].tilesY = levels[l].tilesY;
+		levelTable[l].tileOffset = static_cast<unsigned long long>(levels[l].tileOffset);
+	}
+
+	// Write to a uniquely named temporary file and replace the file after all data is written,
+	// so that concurrent builds of the same file never write to the same temporary file
+	boost::system::error_code ec;
+	const std::string tempPath = boost::filesystem::unique_path(path + ".%%%%-%%%%-%%%%-%%%%.tmp", ec).string();
+	if (ec)
+	{
+		LM_LOG_ERROR("Failed to create temporary file name for '" + path + "'");
+		return false;
+	}
+	{
+		std::ofstream out(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			LM_LOG_ERROR("Failed to open file '" + tempPath + "'");
+			return false;
+		}
+
+		static const char zeros[TileFileAlignment] = {};
+		out.write(reinterpret_cast<const char*>(&header), sizeof(TileFileHeader));
+		out.write(zeros, static_cast<std::streamsize>(AlignedSize(sizeof(TileFileHeader)) - sizeof(TileFileHeader)));
+		out.write(reinterpret_cast<const char*>(&levelTable[0]), static_cast<std::streamsize>(sizeof(TileFileLevel) * levelTable.size()));
+		out.write(zeros, static_cast<std::streamsize>(AlignedSize(sizeof(TileFileLevel) * levelTable.size()) - sizeof(TileFileLevel) * levelTable.size()));
+
+		std::vector<float> current(data);
+		std::vector<float> next;
+		std::vector<float> tile(static_cast<size_t>(tileSize) * tileSize * 3);
+		for (size_t l = 0; l < levels.size(); l++)
+		{
+			const auto& level = levels[l];
+
+			// Tiles of the level. Texels outside of the image are filled with zero
+			for (int ty = 0; ty < level.tilesY; ty++)
+			{
+				for (int tx = 0; tx < level.tilesX; tx++)
+				{
+					std::fill(tile.begin(), tile.end(), 0.0f);
+					for (int y = 0; y < tileSize && ty * tileSize + y < level.height; y++)
+					{
+						const int begin = ty * tileSize + y;
+						const int numTexels = Math::Min(tileSize, level.width - tx * tileSize);
+						std::copy(current.begin() + 3 * (static_cast<size_t>(begin) * level.width + tx * tileSize), current.begin() + 3 * (static_cast<size_t>(begin) * level.width + tx * tileSize + numTexels), tile.begin() + 3 * y * tileSize);
+					}
+					out.write(reinterpret_cast<const char*>(&tile[0]), sizeof(float) * tile.size());
+				}
+			}
+
+			// Next level with 2x2 box filter
+			if (l + 1 < levels.size())
+			{
+				const auto& nextLevel = levels[l + 1];
+				next.assign(static_cast<size_t>(nextLevel.width) * nextLevel.height * 3, 0.0f);
+				for (int y = 0; y < nextLevel.height; y++)
+				{
+					for (int x = 0; x < nextLevel.width; x++)
+					{
+						const int x0 = Math::Min(2 * x, level.width - 1);
+						const int x1 = Math::Min(2 * x + 1, level.width - 1);
+						const int y0 = Math::Min(2 * y, level.height - 1);
+						const int y1 = Math::Min(2 * y + 1, level.height - 1);
+						for (int c = 0; c < 3; c++)
+						{
+							next[3 * (y * nextLevel.width + x) + c] = 0.25f * (
+								current[3 * (y0 * level.width + x0) + c] + current[3 * (y0 * level.width + x1) + c] +
+								current[3 * (y1 * level.width + x0) + c] + current[3 * (y1 * level.width + x1) + c]);
+						}
+					}
+				}
+				current.swap(next);
+			}
+		}
+
+		out.close();
+		if (!out)
+		{
+			LM_LOG_ERROR("Failed to write file '" + tempPath + "'");
+			boost::filesystem::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	boost::filesystem::rename(tempPath, path, ec);
+	if (ec)
+	{
+		LM_LOG_ERROR("Failed to rename file '" + tempPath + "' to '" + path + "'");
+		boost::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	return true;
+}
+
+bool TiledMipmapImage::Open( const std::string& path, TextureCache& cache )
+{
+	Close();
+
+	try
+	{
+		p->mapping = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+		p->region = boost::interprocess::mapped_region(p->mapping, boost::interprocess::read_only);
+	}
+	catch (const boost::interprocess::interprocess_exception& e)
+	{
+		LM_LOG_ERROR("Failed to map tile file '" + path + "' : " + e.what());
+		Close();
+		return false;
+	}
+
+	// Validate header
+	TileFileHeader header;
+	if (p->region.get_size() < sizeof(TileFileHeader))
+	{
+		LM_LOG_ERROR("Invalid tile file '" + path + "'");
+		Close();
+		return false;
+	}
+	std::memcpy(&header, p->region.get_address(), sizeof(TileFileHeader));
+	if (std::memcmp(header.magic, TileFileMagic, sizeof(TileFileMagic)) != 0 || header.version != TileFileVersion ||
+		header.width <= 0 || header.height <= 0 || header.tileSize <= 0 || header.tileSize > TileFileMaxTileSize)
+	{
+		LM_LOG_ERROR("Invalid or outdated tile file '" + path + "'");
+		Close();
+		return false;
+	}
+
+	// Validate level table
+	// The table must be consistent with the levels computed from the header
+	const auto levels = ComputeMipmapLevels(header.width, header.height, header.tileSize);
+	const auto numTiles = static_cast<unsigned long long>(levels.back().tileOffset) + 1;
+	const auto levelTableOffset = AlignedSize(sizeof(TileFileHeader));
+	const auto levelTableBytes = static_cast<unsigned long long>(sizeof(TileFileLevel)) * levels.size();
+	if (header.numLevels != static_cast<int>(levels.size()) || header.numTiles != numTiles ||
+		p->region.get_size() < levelTableOffset + levelTableBytes)
+	{
+		LM_LOG_ERROR("Invalid level table in tile file '" + path + "'");
+		Close();
+		return false;
+	}
+	for (size_t l = 0; l < levels.size(); l++)
+	{
+		TileFileLevel level;
+		std::memcpy(&level, static_cast<const char*>(p->region.get_address()) + levelTableOffset + sizeof(TileFileLevel) * l, sizeof(TileFileLevel));
+		if (level.width != levels[l].width || level.height != levels[l].height ||
+			level.tilesX != levels[l].tilesX || level.tilesY != levels[l].tilesY ||
+			level.tileOffset != static_cast<unsigned long long>(levels[l].tileOffset))
+		{
+			LM_LOG_ERROR("Invalid level table in tile file '" + path + "'");
+			Close();
+			return false;
+		}
+	}
+
+	// Validate size
+	const auto tilesOffset = AlignedSize(levelTableOffset + levelTableBytes);
+	const auto tileBytes = static_cast<unsigned long long>(header.tileSize) * header.tileSize * 3 * sizeof(float);
+	if (p->region.get_size() != tilesOffset + numTiles * tileBytes)
+	{
+		LM_LOG_ERROR("Invalid size of tile file '" + path + "'");
+		Close();
+		return false;
+	}
+
+	p->cache = &cache;
+	p->textureID = cache.NewTextureID();
+	p->tileSize = header.tileSize;
+	p->tilesOffset = static_cast<size_t>(tilesOffset);
+	p->levels = levels;
+
+	return true;
+}
+
+void TiledMipmapImage::Close()
+{
+	p->region = boost::interprocess::mapped_region();
+	p->mapping = boost::interprocess::file_mapping();
+	p->cache = nullptr;
+	p->levels.clear();
+}
+
+int TiledMipmapImage::NumLevels() const
+{
+	return static_cast<int>(p->levels.size());
+}
+
+int TiledMipmapImage::Width( int level ) const
+{
+	return p->levels[level].width;
+}
+
+int TiledMipmapImage::Height( int level ) const
+{
+	return p->levels[level].height;
+}
+
+Math::Vec3 TiledMipmapImage::Texel( int x, int y, int level ) const
+{
+	const auto& l = p->levels[level];
+	const int tileSize = p->tileSize;
+	const size_t tileIndex = l.tileOffset + static_cast<size_t>(y / tileSize) * l.tilesX + x / tileSize;
+
+	// Key of the tile : texture ID (upper 32 bits) and the index of the tile
+	const auto key = (static_cast<unsigned long long>(p->textureID) << 32) | static_cast<unsigned long long>(tileIndex);
+	const Impl* impl = p;
+	const auto& tile = p->cache->GetTile(key, [impl, tileIndex](TextureCache::Tile& tile)
+	{
+		// Copy the tile from the mapped file
+		const size_t n = static_cast<size_t>(impl->tileSize) * impl->tileSize * 3;
+		const auto* data = static_cast<const char*>(impl->region.get_address()) + impl->tilesOffset + tileIndex * n * sizeof(float);
+		tile.resize(n);
+		std::memcpy(&tile[0], data, n * sizeof(float));
+		return true;
+	});
+
+	if (tile.empty())
+	{
+		return Math::Vec3();
+	}
+
+	const size_t i = 3 * (static_cast<size_t>(y % tileSize) * tileSize + x % tileSize);
+	return Math::Vec3(Math::Float(tile[i]), Math::Float(tile[i + 1]), Math::Float(tile[i + 2]));
+}
+
+LM_NAMESPACE_END
@@ -0,0 +1,316 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include <lightmetrica/threadpool.h>
+#include <lightmetrica/logger.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+
+LM_NAMESPACE_BEGIN
+
+class ThreadPool::Impl
+{
+public:
+
+	Impl(int numThreads);
+	~Impl();
+
+public:
+
+	int NumThreads() const { return numThreads; }
+	bool ParallelFor(long long n, long long grainSize, const BlockFunc& func);
+	void Cancel() { canceled = true; }
+	bool Canceled() const { return canceled; }
+
+private:
+
+	struct Range
+	{
+		long long begin;
+		long long end;
+	};
+
+	// Per-thread deque of ranges
+	// The owner pushes and pops at the back and thieves steal from the front
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Range> ranges;
+	};
+
+private:
+
+	void WorkerThread(int threadId);
+	void ProcessRanges(int threadId);
+	bool Pop(int threadId, Range& range);
+	bool Steal(int threadId, Range& range);
+	void Push(int threadId, const Range& range);
+
+private:
+
+	int numThreads;
+	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+	// Synchronization of the start and the end of the jobs
+	std::mutex jobMutex;
+	std::condition_variable jobStartCond;
+	std::condition_variable jobFinishCond;
+	long long jobIndex;					// Incremented for each job
+	int runningThreads;					// Number of worker threads processing the current job
+	bool exit;
+
+	// Current job
+	const BlockFunc* func;
+	long long grainSize;
+	std::atomic<long long> remaining;	// Number of work units not yet processed
+	std::atomic<bool> canceled;
+	std::atomic<bool> failed;
+
+};
+
+ThreadPool::Impl::Impl( int numThreads )
+	: numThreads(std::max(1, numThreads))
+	, jobIndex(0)
+	, runningThreads(0)
+	, exit(false)
+	, func(nullptr)
+	, grainSize(1)
+	, remaining(0)
+	, canceled(false)
+	, failed(false)
+{
+	for (int i = 0; i < this->numThreads; i++)
+	{
+		queues.emplace_back(new WorkerQueue);
+	}
+
+	// The calling thread works as the thread #0
+	for (int i = 1; i < this->numThreads; i++)
+	{
+		threads.emplace_back(&Impl::WorkerThread, this, i);
+	}
+}
+
+ThreadPool::Impl::~Impl()
+{
+	{
+		std::unique_lock<std::mutex> lock(jobMutex);
+		exit = true;
+	}
+	jobStartCond.notify_all();
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+bool ThreadPool::Impl::ParallelFor( long long n, long long grainSize, const BlockFunc& func )
+{
+	if (n <= 0)
+	{
+		return true;
+	}
+
+	this->func = &func;
+	this->grainSize = std::max(1LL, grainSize);
+	remaining = n;
+	canceled = false;
+	failed = false;
+
+	// Distribute the range evenly among threads
+	for (int i = 0; i < numThreads; i++)
+	{
+		auto& queue = *queues[i];
+		std::unique_lock<std::mutex> lock(queue.mutex);
+		queue.ranges.clear();
+		long long begin = n * i / numThreads;
+		long long end = n * (i + 1) / numThreads;
+		if (begin < end)
+		{
+			queue.ranges.push_back(Range{ begin, end });
+		}
+	}
+
+	// Start the job
+	{
+		std::unique_lock<std::mutex> lock(jobMutex);
+		runningThreads = numThreads - 1;
+		jobIndex++;
+	}
+	jobStartCond.notify_all();
+
+	// Process in the calling thread
+	ProcessRanges(0);
+
+	// Wait for the worker threads
+	{
+		std::unique_lock<std::mutex> lock(jobMutex);
+		jobFinishCond.wait(lock, [this](){ return runningThreads == 0; });
+	}
+
+	this->func = nullptr;
+	return !failed;
+}
+
+void ThreadPool::Impl::WorkerThread( int threadId )
+{
+	long long processedJobIndex = 0;
+
+	while (true)
+	{
+		// Wait for a job
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobStartCond.wait(lock, [this, processedJobIndex](){ return exit || jobIndex != processedJobIndex; });
+			if (exit)
+			{
+				break;
+			}
+			processedJobIndex = jobIndex;
+		}
+
+		ProcessRanges(threadId);
+
+		// Notify the end of the job
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			runningThreads--;
+		}
+		jobFinishCond.notify_all();
+	}
+}
+
+void ThreadPool::Impl::ProcessRanges( int threadId )
+{
+	while (!canceled && remaining > 0)
+	{
+		Range range;
+		if (!Pop(threadId, range) && !Steal(threadId, range))
+		{
+			// Some ranges are still being processed by the other threads
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Split the range until the size is no more than the grain size
+		// The upper halves are left for this thread or for the thieves
+		while (range.end - range.begin > grainSize)
+		{
+			long long mid = range.begin + (range.end - range.begin) / 2;
+			Push(threadId, Range{ mid, range.end });
+			range.end = mid;
+		}
+
+		if (!canceled)
+		{
+			try
+			{
+				(*func)(threadId, range.begin, range.end);
+			}
+			catch (const std::exception& e)
+			{
+				LM_LOG_ERROR(boost::str(boost::format("EXCEPTION (thread #%d) | %s") % threadId % e.what()));
+				failed = true;
+				canceled = true;
+			}
+		}
+
+		remaining -= range.end - range.begin;
+	}
+}
+
+bool ThreadPool::Impl::Pop( int threadId, Range& range )
+{
+	auto& queue = *queues[threadId];
+	std::unique_lock<std::mutex> lock(queue.mutex);
+	if (queue.ranges.empty())
+	{
+		return false;
+	}
+
+	range = queue.ranges.back();
+	queue.ranges.pop_back();
+	return true;
+}
+
+bool ThreadPool::Impl::Steal( int threadId, Range& range )
+{
+	for (int i = 1; i < numThreads; i++)
+	{
+		auto& queue = *queues[(threadId + i) % numThreads];
+		std::unique_lock<std::mutex> lock(queue.mutex);
+		if (!queue.ranges.empty())
+		{
+			range = queue.ranges.front();
+			queue.ranges.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::Impl::Push( int threadId, const Range& range )
+{
+	auto& queue = *queues[threadId];
+	std::unique_lock<std::mutex> lock(queue.mutex);
+	queue.ranges.push_back(range);
+}
+
+// --------------------------------------------------------------------------------
+
+ThreadPool::ThreadPool( int numThreads )
+	: p(new Impl(numThreads))
+{
+
+}
+
+ThreadPool::~ThreadPool()
+{
+	LM_SAFE_DELETE(p);
+}
+
+int ThreadPool::NumThreads() const
+{
+	return p->NumThreads();
+}
+
+bool ThreadPool::ParallelFor( long long n, long long grainSize, const BlockFunc& func )
+{
+	return p->ParallelFor(n, grainSize, func);
+}
+
+void ThreadPool::Cancel()
+{
+	p->Cancel();
+}
+
+bool ThreadPool::Canceled() const
+{
+	return p->Canceled();
+}
+
+LM_NAMESPACE_END
@@ -0,0 +1,140 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "base.perf.h"
+#include <lightmetrica.test/stub.config.h>
+#include <lightmetrica.test/stub.assets.h>
+#include <lightmetrica/bitmapfilm.h>
+#include <lightmetrica/bitmap.h>
+#include <thread>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class FilmAccumulationPerfTest : public TestBase
+{
+public:
+
+	FilmAccumulationPerfTest()
+		: numThreads(static_cast<int>(std::thread::hardware_concurrency()))
+		, width(1920)
+		, height(1080)
+		, numSplatsPerThread(1 << 22)
+	{
+		numThreads = Math::Max(1, numThreads);
+	}
+
+protected:
+
+	double ElapsedSeconds(const std::chrono::high_resolution_clock::time_point& start) const
+	{
+		auto end = std::chrono::high_resolution_clock::now();
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()) / 1000000.0;
+	}
+
+	// Splat to the clones of a film from all threads and merge them into the original film.
+	// The positions are either random like light tracing or coherent like path tracing.
+	// Returns elapsed time in seconds including the cloning and the merging.
+	double Splat(const std::string& mode, bool coherent)
+	{
+		std::unique_ptr<BitmapFilm> film(ComponentFactory::Create<BitmapFilm>("hdr"));
+		EXPECT_TRUE(film->Load(config.LoadFromStringAndGetFirstChild(boost::str(boost::format(
+			"<film type=\"hdr\">"
+			"<width>%d</width>"
+			"<height>%d</height>"
+			"<accumulation_mode>%s</accumulation_mode>"
+			"</film>") % width % height % mode)), assets));
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<std::unique_ptr<Film>> clones;
+		for (int i = 0; i < numThreads; i++)
+		{
+			clones.emplace_back(film->Clone());
+		}
+
+		std::vector<std::thread> threads;
+		for (int i = 0; i < numThreads; i++)
+		{
+			threads.emplace_back([this, &clones, i, coherent]()
+			{
+				auto* clone = clones[i].get();
+				unsigned int v = i + 1;
+				for (long long j = 0; j < numSplatsPerThread; j++)
+				{
+					Math::Vec2 rasterPos;
+					if (coherent)
+					{
+						long long pixel = (j + i * numSplatsPerThread) % (width * height);
+						rasterPos = Math::Vec2(
+							(Math::Float(pixel % width) + Math::Float(0.5)) / Math::Float(width),
+							(Math::Float(pixel / width) + Math::Float(0.5)) / Math::Float(height));
+					}
+					else
+					{
+						v = v * 1664525u + 1013904223u;
+						rasterPos.x = Math::Float(v >> 8) / Math::Float(1 << 24);
+						v = v * 1664525u + 1013904223u;
+						rasterPos.y = Math::Float(v >> 8) / Math::Float(1 << 24);
+					}
+					clone->AccumulateContribution(rasterPos, Math::Vec3(Math::Float(1)));
+				}
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+
+		for (const auto& clone : clones)
+		{
+			film->AccumulateContribution(*clone);
+		}
+		film->Rescale(Math::Float(1));
+
+		return ElapsedSeconds(start);
+	}
+
+protected:
+
+	int numThreads;
+	int width;
+	int height;
+	long long numSplatsPerThread;
+	StubConfig config;
+	StubAssets assets;
+
+};
+
+TEST_F(FilmAccumulationPerfTest, Splat)
+{
+	std::cout << boost::str(boost::format("%dx%d, %d threads, %d splats per thread") % width % height % numThreads % numSplatsPerThread) << std::endl;
+	for (bool coherent : { false, true })
+	{
+		for (const std::string mode : { "clone", "tiled", "atomic" })
+		{
+			const double time = Splat(mode, coherent);
+			std::cout << boost::str(boost::format("%s, %s : %.3f seconds") % (coherent ? "coherent" : "random") % mode % time) << std::endl;
+		}
+	}
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
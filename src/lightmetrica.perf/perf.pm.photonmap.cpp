@@ -0,0 +1,160 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "base.perf.h"
+#include <lightmetrica/pm.photonmap.kdtree.h>
+#include <lightmetrica/pm.photonmap.hashgrid.h>
+#include <random>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class PhotonMapPerfTest : public TestBase
+{
+public:
+
+	PhotonMapPerfTest()
+		: numPhotons(1 << 21)
+		, numQueries(1 << 18)
+		, numNNQueryPhotons(50)
+		, maxNNQueryDist(Math::Float(0.02))
+	{
+		// Photons and query points on the surfaces of a Cornell box-like scene :
+		// five walls of the unit box and a caustic-like concentration on the floor
+		std::mt19937 gen(42);
+		std::uniform_real_distribution<double> dist;
+		const auto SamplePoint = [&]() -> Math::Vec3
+		{
+			const auto u = Math::Float(dist(gen));
+			const auto v = Math::Float(dist(gen));
+			switch (static_cast<int>(dist(gen) * 6))
+			{
+				case 0: return Math::Vec3(u, Math::Float(0), v);
+				case 1: return Math::Vec3(u, Math::Float(1), v);
+				case 2: return Math::Vec3(Math::Float(0), u, v);
+				case 3: return Math::Vec3(Math::Float(1), u, v);
+				case 4: return Math::Vec3(u, v, Math::Float(0));
+				default: return Math::Vec3(Math::Float(0.5) + (u - Math::Float(0.5)) * Math::Float(0.1), Math::Float(0), Math::Float(0.5) + (v - Math::Float(0.5)) * Math::Float(0.1));
+			}
+		};
+
+		photons.resize(numPhotons);
+		for (auto& photon : photons)
+		{
+			photon.p = SamplePoint();
+		}
+
+		queries.resize(numQueries);
+		for (auto& query : queries)
+		{
+			query = SamplePoint();
+		}
+	}
+
+protected:
+
+	double ElapsedSeconds(const std::chrono::high_resolution_clock::time_point& start) const
+	{
+		auto end = std::chrono::high_resolution_clock::now();
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()) / 1000000.0;
+	}
+
+	// Build the photon map and process the queries in the same way as the photon mapping renderer.
+	// Returns the number of collected photons to prevent the queries from being optimized away.
+	template <typename PhotonMapType>
+	long long Run(const std::string& name)
+	{
+		typedef std::pair<const Photon*, Math::Float> CollectedPhotonInfo;
+		const auto comp = [](const CollectedPhotonInfo& p1, const CollectedPhotonInfo& p2){ return p1.second < p2.second; };
+
+		PhotonMapType photonMap;
+		photonMap.SetMaxQueryDist(maxNNQueryDist);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		photonMap.Build(photons);
+		const double buildTime = ElapsedSeconds(start);
+
+		// k-nearest neighbor queries limited by the maximum distance
+		long long numCollected = 0;
+		std::vector<CollectedPhotonInfo> collectedPhotonInfo;
+		start = std::chrono::high_resolution_clock::now();
+		for (const auto& query : queries)
+		{
+			auto maxDist2 = maxNNQueryDist * maxNNQueryDist;
+			collectedPhotonInfo.clear();
+			const size_t n = static_cast<size_t>(numNNQueryPhotons);
+			photonMap.CollectPhotons(query, maxDist2, [&](const Math::Vec3& p, const Photon& photon, Math::Float& maxDist2)
+			{
+				auto dist2 = Math::Length2(photon.p - p);
+				if (collectedPhotonInfo.size() < n)
+				{
+					collectedPhotonInfo.emplace_back(&photon, dist2);
+					if (collectedPhotonInfo.size() == n)
+					{
+						std::make_heap(collectedPhotonInfo.begin(), collectedPhotonInfo.end(), comp);
+						maxDist2 = collectedPhotonInfo.front().second;
+					}
+				}
+				else
+				{
+					std::pop_heap(collectedPhotonInfo.begin(), collectedPhotonInfo.end(), comp);
+					collectedPhotonInfo.back() = std::make_pair(&photon, dist2);
+					std::push_heap(collectedPhotonInfo.begin(), collectedPhotonInfo.end(), comp);
+					maxDist2 = collectedPhotonInfo.front().second;
+				}
+			});
+			numCollected += static_cast<long long>(collectedPhotonInfo.size());
+		}
+		const double knnTime = ElapsedSeconds(start);
+
+		// Fixed-radius queries
+		start = std::chrono::high_resolution_clock::now();
+		for (const auto& query : queries)
+		{
+			auto maxDist2 = maxNNQueryDist * maxNNQueryDist;
+			photonMap.CollectPhotons(query, maxDist2, [&numCollected](const Math::Vec3&, const Photon&, Math::Float&){ numCollected++; });
+		}
+		const double radiusTime = ElapsedSeconds(start);
+
+		std::cout << boost::str(boost::format("%s : build %.3f seconds, knn %.3f seconds, radius %.3f seconds") % name % buildTime % knnTime % radiusTime) << std::endl;
+		return numCollected;
+	}
+
+protected:
+
+	int numPhotons;
+	int numQueries;
+	int numNNQueryPhotons;
+	Math::Float maxNNQueryDist;
+	Photons photons;
+	std::vector<Math::Vec3> queries;
+
+};
+
+TEST_F(PhotonMapPerfTest, Query)
+{
+	std::cout << boost::str(boost::format("%d photons, %d queries, %d nearest photons, max distance %f") % numPhotons % numQueries % numNNQueryPhotons % maxNNQueryDist) << std::endl;
+	const auto kdtree = Run<KdTreePhotonMap>("kdtree");
+	const auto hashgrid = Run<HashGridPhotonMap>("hashgrid");
+	EXPECT_EQ(kdtree, hashgrid);
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
@@ -16,17 +16,193 @@
 	You should have received a copy of the GNU General Public License
 	along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
-
 #include "pch.h"
 #include "base.perf.h"
+#include <lightmetrica.test/stub.bsdf.h>
+#include <lightmetrica.test/stub.trianglemesh.h>
+#include <lightmetrica/primitive.h>
+#include <lightmetrica/primitives.h>
+#include <lightmetrica/scene.h>
+#include <lightmetrica/ray.h>
+#include <lightmetrica/intersection.h>
+#include <lightmetrica/confignode.h>
+#include <random>
 
 LM_NAMESPACE_BEGIN
 LM_TEST_NAMESPACE_BEGIN
 
+// Random small triangles in the unit cube
+class StubTriangleMesh_RandomSmall : public StubTriangleMesh
+{
+public:
+
+	StubTriangleMesh_RandomSmall(int faceCount, Math::Float size)
+	{
+		std::mt19937 gen(42);
+		std::uniform_real_distribution<double> dist;
+
+		for (int i = 0; i < faceCount; i++)
+		{
+			const Math::Vec3 c(Math::Float(dist(gen)), Math::Float(dist(gen)), Math::Float(dist(gen)));
+			Math::Vec3 ps[3];
+			for (int j = 0; j < 3; j++)
+			{
+				ps[j] = c + Math::Vec3(Math::Float(dist(gen) - 0.5), Math::Float(dist(gen) - 0.5), Math::Float(dist(gen) - 0.5)) * size;
+			}
+
+			const auto n = Math::Normalize(Math::Cross(ps[1] - ps[0], ps[2] - ps[0]));
+			for (int j = 0; j < 3; j++)
+			{
+				positions.push_back(ps[j][0]);
+				positions.push_back(ps[j][1]);
+				positions.push_back(ps[j][2]);
+				normals.push_back(n[0]);
+				normals.push_back(n[1]);
+				normals.push_back(n[2]);
+				texcoords.push_back(Math::Float(j == 1));
+				texcoords.push_back(Math::Float(j == 2));
+				faces.push_back(3*i+j);
+			}
+		}
+	}
+
+};
+
+class StubPrimitives_SingleMesh : public Primitives
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("stub");
+
+public:
+
+	StubPrimitives_SingleMesh(TriangleMesh* mesh, BSDF* bsdf)
+	{
+		primitives.emplace_back(new Primitive(Math::Mat4::Identity()));
+		primitives.back()->mesh = mesh;
+		primitives.back()->bsdf = bsdf;
+	}
+
+public:
+
+	virtual bool Load(const ConfigNode& node, const Assets& assets) { return true; }
+	virtual void Reset() {}
+	virtual int NumPrimitives() const { return static_cast<int>(primitives.size()); }
+	virtual const Primitive* PrimitiveByIndex(int index) const { return primitives.at(index).get(); }
+	virtual const Primitive* PrimitiveByID(const std::string& id) const { return nullptr; }
+	virtual const Camera* MainCamera() const { return nullptr; }
+	virtual int NumLights() const { return 0; }
+	virtual const Light* LightByIndex(int index) const { return nullptr; }
+	virtual bool PostConfigure(const Scene& scene) { return true; }
+	virtual bool IntersectEmitterShapes(Ray& ray, Intersection& isect) const { return false; }
+	virtual bool OccludedEmitterShapes(const Ray& ray) const { return false; }
+	virtual AABB GetAABBEmitterShapes() const { return AABB(); }
+
+private:
+
+	std::vector<std::unique_ptr<Primitive>> primitives;
+
+};
+
+/*
+	Measures the cost of Scene::Intersect with and without the precomputed triangle data.
+	The scene consists of small random triangles in the unit cube, so that the traversal is cheap
+	and the cost of computing the intersection data for the hit points is visible.
+	The rays start at random points in the unit cube and have uniformly distributed directions.
+*/
 class SceneIntersectionPerfTest : public TestBase
 {
+public:
+
+	SceneIntersectionPerfTest()
+		: numFaces(1 << 16)
+		, numRays(1 << 21)
+		, triangleSize(Math::Float(0.02))
+		, mesh(new StubTriangleMesh_RandomSmall(numFaces, triangleSize))
+		, bsdf(new StubBSDF)
+	{
+		std::mt19937 gen(42);
+		std::uniform_real_distribution<double> dist;
+		rays.resize(numRays);
+		for (auto& ray : rays)
+		{
+			const auto z = Math::Float(1 - 2 * dist(gen));
+			const auto r = Math::Sqrt(Math::Max(Math::Float(0), Math::Float(1) - z * z));
+			const auto phi = Math::Float(2 * Math::Constants::Pi() * dist(gen));
+			ray.o = Math::Vec3(Math::Float(dist(gen)), Math::Float(dist(gen)), Math::Float(dist(gen)));
+			ray.d = Math::Vec3(r * Math::Cos(phi), r * Math::Sin(phi), z);
+			ray.minT = Math::Constants::Zero();
+			ray.maxT = Math::Constants::Inf();
+		}
+	}
+
+protected:
+
+	double ElapsedSeconds(const std::chrono::high_resolution_clock::time_point& start) const
+	{
+		auto end = std::chrono::high_resolution_clock::now();
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()) / 1000000.0;
+	}
+
+	// Traces all rays and returns the number of hits.
+	// The checksum of the intersection data is printed to prevent the computation from being optimized away.
+	long long Run(const std::string& type, bool precompute)
+	{
+		std::unique_ptr<Scene> scene(ComponentFactory::Create<Scene>(type));
+		scene->Load(new StubPrimitives_SingleMesh(mesh.get(), bsdf.get()));
+		EXPECT_TRUE(scene->Configure(ConfigNode()));
+		EXPECT_TRUE(scene->Build());
+		if (precompute)
+		{
+			scene->PrecomputeTriangles();
+		}
+
+		long long numHits = 0;
+		Math::Float checksum(0);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (const auto& r : rays)
+		{
+			Ray ray = r;
+			Intersection isect;
+			if (scene->Intersect(ray, isect))
+			{
+				numHits++;
+				checksum += isect.geom.uv[0] + isect.geom.sn[0];
+			}
+		}
+		const double time = ElapsedSeconds(start);
+
+		std::cout << boost::str(boost::format("%s (%s) : %.3f seconds, %.2f Mrays/s, %d hits (%f)") % type % (precompute ? "precomputed" : "not precomputed") % time % (numRays / time / 1000000.0) % numHits % checksum) << std::endl;
+		return numHits;
+	}
+
+protected:
+
+	int numFaces;
+	int numRays;
+	Math::Float triangleSize;
+	std::unique_ptr<TriangleMesh> mesh;
+	std::unique_ptr<StubBSDF> bsdf;
+	std::vector<Ray> rays;
 
 };
 
+TEST_F(SceneIntersectionPerfTest, PrecomputedTriangles)
+{
+	std::vector<std::string> sceneTypes;
+	sceneTypes.push_back("bvh");
+#if LM_SSE2 && LM_SINGLE_PRECISION
+	sceneTypes.push_back("qbvh");
+#endif
+
+	std::cout << boost::str(boost::format("%d random triangles of size %f, %d rays") % numFaces % triangleSize % numRays) << std::endl;
+	for (const auto& type : sceneTypes)
+	{
+		const auto hits = Run(type, false);
+		const auto precomputedHits = Run(type, true);
+		EXPECT_EQ(hits, precomputedHits);
+	}
+}
+
 LM_TEST_NAMESPACE_END
 LM_NAMESPACE_END
@@ -0,0 +1,273 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+#include "base.perf.h"
+#include <lightmetrica.test/stub.config.h>
+#include <lightmetrica.test/stub.assets.h>
+#include <lightmetrica.test/stub.film.h>
+#include <lightmetrica/sched.h>
+#include <lightmetrica/renderer.h>
+#include <lightmetrica/renderproc.h>
+#include <lightmetrica/scene.h>
+#include <lightmetrica/primitives.h>
+#include <lightmetrica/camera.h>
+#include <lightmetrica/aabb.h>
+#include <thread>
+#include <atomic>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+// Render process with a fixed amount of work per sample
+class StubRenderProcess : public SamplingBasedRenderProcess
+{
+public:
+
+	StubRenderProcess(int workPerSample) : workPerSample(workPerSample), result(0) {}
+
+public:
+
+	virtual void ProcessSingleSample(const Scene& scene)
+	{
+		unsigned int v = result;
+		for (int i = 0; i < workPerSample; i++)
+		{
+			v = v * 1664525u + 1013904223u;
+		}
+		result = v;
+	}
+
+	virtual const Film* GetFilm() const { return &film; }
+
+private:
+
+	int workPerSample;
+	volatile unsigned int result;
+	StubFilm film;
+
+};
+
+class StubRenderer : public Renderer
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("stub");
+
+public:
+
+	StubRenderer(int workPerSample) : workPerSample(workPerSample) {}
+
+public:
+
+	virtual std::string Type() const { return ImplTypeName(); }
+	virtual bool Configure(const ConfigNode& node, const Assets& assets, const Scene& scene, const RenderProcessScheduler& sched) { return true; }
+	virtual bool Preprocess(const Scene& scene, const RenderProcessScheduler& sched) { return true; }
+	virtual bool Postprocess(const Scene& scene, const RenderProcessScheduler& sched) const { return true; }
+	virtual RenderProcess* CreateRenderProcess(const Scene& scene, int threadID, int numThreads) { return new StubRenderProcess(workPerSample); }
+	virtual boost::signals2::connection Connect_ReportProgress(const std::function<void (double, bool)>& func) { return signal_ReportProgress.connect(func); }
+
+private:
+
+	int workPerSample;
+	boost::signals2::signal<void (double, bool)> signal_ReportProgress;
+
+};
+
+class StubCamera : public Camera
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("stub");
+
+public:
+
+	virtual bool Load(const ConfigNode& node, const Assets& assets) { return true; }
+	virtual bool SampleDirection(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result) const { return false; }
+	virtual Math::Vec3 SampleAndEstimateDirection(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleResult& result) const { return Math::Vec3(); }
+	virtual bool SampleAndEstimateDirectionBidir(const GeneralizedBSDFSampleQuery& query, const SurfaceGeometry& geom, GeneralizedBSDFSampleBidirResult& result) const { return false; }
+	virtual Math::Vec3 EvaluateDirection(const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom) const { return Math::Vec3(); }
+	virtual Math::PDFEval EvaluateDirectionPDF(const GeneralizedBSDFEvaluateQuery& query, const SurfaceGeometry& geom) const { return Math::PDFEval(); }
+	virtual int BSDFTypes() const { return 0; }
+	virtual void SamplePosition(const Math::Vec2& sample, SurfaceGeometry& geom, Math::PDFEval& pdf) const {}
+	virtual Math::Vec3 EvaluatePosition(const SurfaceGeometry& geom) const { return Math::Vec3(); }
+	virtual Math::PDFEval EvaluatePositionPDF(const SurfaceGeometry& geom) const { return Math::PDFEval(); }
+	virtual void RegisterPrimitives(const std::vector<Primitive*>& primitives) {}
+	virtual void PostConfigure(const Scene& scene) {}
+	virtual EmitterShape* CreateEmitterShape() const { return nullptr; }
+	virtual AABB GetAABB() const { return AABB(); }
+	virtual bool RayToRasterPosition(const Math::Vec3& p, const Math::Vec3& d, Math::Vec2& rasterPos) const { return false; }
+	virtual Film* GetFilm() const { return &film; }
+
+private:
+
+	mutable StubFilm film;
+
+};
+
+class StubPrimitives : public Primitives
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("stub");
+
+public:
+
+	virtual bool Load(const ConfigNode& node, const Assets& assets) { return true; }
+	virtual bool PostConfigure(const Scene& scene) { return true; }
+	virtual bool IntersectEmitterShapes(Ray& ray, Intersection& isect) const { return false; }
+	virtual bool OccludedEmitterShapes(const Ray& ray) const { return false; }
+	virtual AABB GetAABBEmitterShapes() const { return AABB(); }
+	virtual void Reset() {}
+	virtual int NumPrimitives() const { return 0; }
+	virtual const Primitive* PrimitiveByIndex(int index) const { return nullptr; }
+	virtual const Primitive* PrimitiveByID(const std::string& id) const { return nullptr; }
+	virtual const Camera* MainCamera() const { return &camera; }
+	virtual int NumLights() const { return 0; }
+	virtual const Light* LightByIndex(int index) const { return nullptr; }
+
+private:
+
+	StubCamera camera;
+
+};
+
+class StubScene : public Scene
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("stub");
+
+public:
+
+	virtual bool Configure(const ConfigNode& node) { return true; }
+	virtual bool Build() { return true; }
+	virtual bool IntersectTriangles(Ray& ray, Intersection& isect) const { return false; }
+	virtual bool OccludedTriangles(const Ray& ray) const { return false; }
+	virtual AABB GetAABBTriangles() const { return AABB(); }
+	virtual boost::signals2::connection Connect_ReportBuildProgress(const std::function<void (double, bool)>& func) { return signal_ReportBuildProgress.connect(func); }
+
+private:
+
+	boost::signals2::signal<void (double, bool)> signal_ReportBuildProgress;
+
+};
+
+/*
+	Measures the overhead of the render process scheduler.
+	The time to process the samples with the scheduler is compared with
+	the ideal time where the samples are evenly and statically distributed among the threads.
+*/
+class RenderProcessSchedulerPerfTest : public TestBase
+{
+public:
+
+	RenderProcessSchedulerPerfTest()
+		: numThreads(static_cast<int>(std::thread::hardware_concurrency()))
+		, workPerSample(1000)
+		, numSamples(1LL << 20)
+	{
+		numThreads = Math::Max(1, numThreads);
+		scene.Load(new StubPrimitives);
+	}
+
+protected:
+
+	double ElapsedSeconds(const std::chrono::high_resolution_clock::time_point& start) const
+	{
+		auto end = std::chrono::high_resolution_clock::now();
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()) / 1000000.0;
+	}
+
+	// Render with the statically distributed samples
+	double RenderIdeal() const
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> threads;
+		for (int i = 0; i < numThreads; i++)
+		{
+			threads.emplace_back([this, i]()
+			{
+				StubRenderProcess process(workPerSample);
+				long long begin = numSamples * i / numThreads;
+				long long end = numSamples * (i + 1) / numThreads;
+				process.ProcessMultipleSamples(scene, end - begin);
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		return ElapsedSeconds(start);
+	}
+
+	// Render with the scheduler
+	double RenderWithScheduler(long long samplesPerBlock, TerminationMode mode, double time)
+	{
+		std::unique_ptr<RenderProcessScheduler> sched(ComponentFactory::Create<RenderProcessScheduler>("mt"));
+		EXPECT_TRUE(config.LoadFromString(boost::str(boost::format(
+			"<scheduler>"
+			"<num_samples>%d</num_samples>"
+			"<num_threads>%d</num_threads>"
+			"<samples_per_block>%d</samples_per_block>"
+			"</scheduler>") % numSamples % numThreads % samplesPerBlock), ""));
+		EXPECT_TRUE(sched->Configure(config.Root().Child("scheduler"), assets));
+		sched->SetTerminationMode(mode, time);
+
+		StubRenderer renderer(workPerSample);
+		auto start = std::chrono::high_resolution_clock::now();
+		EXPECT_TRUE(sched->Render(renderer, scene));
+		return ElapsedSeconds(start);
+	}
+
+protected:
+
+	int numThreads;
+	int workPerSample;
+	long long numSamples;
+	StubConfig config;
+	StubAssets assets;
+	StubScene scene;
+
+};
+
+TEST_F(RenderProcessSchedulerPerfTest, Overhead)
+{
+	const double idealTime = RenderIdeal();
+	std::cout << boost::str(boost::format("Ideal : %.3f seconds (%d threads)") % idealTime % numThreads) << std::endl;
+
+	for (long long samplesPerBlock : { 10LL, 100LL, 1000LL })
+	{
+		const double time = RenderWithScheduler(samplesPerBlock, TerminationMode::Samples, 0);
+		std::cout << boost::str(boost::format("samples_per_block = %d : %.3f seconds (overhead %.2f%%)") % samplesPerBlock % time % ((time / idealTime - 1) * 100)) << std::endl;
+	}
+}
+
+TEST_F(RenderProcessSchedulerPerfTest, TimeTermination)
+{
+	const double terminationTime = 1;
+	for (long long samplesPerBlock : { 10LL, 1000LL })
+	{
+		const double time = RenderWithScheduler(samplesPerBlock, TerminationMode::Time, terminationTime);
+		std::cout << boost::str(boost::format("samples_per_block = %d : %.3f seconds (overshoot %.3f seconds)") % samplesPerBlock % time % (time - terminationTime)) << std::endl;
+	}
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
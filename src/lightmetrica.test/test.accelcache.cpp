@@ -0,0 +1,143 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica/accelcache.h>
+#include <lightmetrica/math.types.h>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class AccelerationCacheTest : public TestBase
+{
+public:
+
+	AccelerationCacheTest()
+	{
+		dir = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	}
+
+	~AccelerationCacheTest()
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(dir, ec);
+	}
+
+protected:
+
+	std::string dir;
+
+};
+
+TEST_F(AccelerationCacheTest, WriteAndRead)
+{
+	const unsigned long long hash = 0x0123456789abcdefULL;
+	const auto path = AccelerationCache::CachePath(dir, "test", hash);
+
+	std::vector<int> values;
+	for (int i = 0; i < 100; i++)
+	{
+		values.push_back(i * i);
+	}
+
+	{
+		AccelerationCache cache;
+		ASSERT_TRUE(cache.OpenForWrite(path, "test", hash));
+		EXPECT_TRUE(cache.WriteValue(Math::Float(42)));
+		EXPECT_TRUE(cache.Write(values));
+		EXPECT_TRUE(cache.Write(std::vector<int>()));
+		EXPECT_TRUE(cache.Close());
+	}
+
+	{
+		AccelerationCache cache;
+		ASSERT_TRUE(cache.OpenForRead(path, "test", hash));
+
+		Math::Float value;
+		std::vector<int> readValues, emptyValues;
+		EXPECT_TRUE(cache.ReadValue(value));
+		EXPECT_TRUE(cache.Read(readValues));
+		EXPECT_TRUE(cache.Read(emptyValues));
+		EXPECT_EQ(Math::Float(42), value);
+		EXPECT_EQ(values, readValues);
+		EXPECT_TRUE(emptyValues.empty());
+
+		// No more section
+		EXPECT_FALSE(cache.Read(readValues));
+		EXPECT_TRUE(cache.Close());
+	}
+}
+
+TEST_F(AccelerationCacheTest, Invalid)
+{
+	const unsigned long long hash = 1;
+	const auto path = AccelerationCache::CachePath(dir, "test", hash);
+
+	{
+		AccelerationCache cache;
+		ASSERT_TRUE(cache.OpenForWrite(path, "test", hash));
+		EXPECT_TRUE(cache.WriteValue(1));
+		EXPECT_TRUE(cache.Close());
+	}
+
+	// Mismatched hash or key
+	AccelerationCache cache;
+	EXPECT_FALSE(cache.OpenForRead(path, "test", 2));
+	EXPECT_FALSE(cache.OpenForRead(path, "test2", hash));
+
+	// Missing file
+	EXPECT_FALSE(cache.OpenForRead(AccelerationCache::CachePath(dir, "test", 2), "test", 2));
+}
+
+TEST_F(AccelerationCacheTest, LongKey)
+{
+	const unsigned long long hash = 1;
+	const std::string key(100, 'a');
+	const auto path = AccelerationCache::CachePath(dir, "test", hash);
+
+	{
+		AccelerationCache cache;
+		ASSERT_TRUE(cache.OpenForWrite(path, key, hash));
+		EXPECT_TRUE(cache.WriteValue(1));
+		EXPECT_TRUE(cache.Close());
+	}
+
+	// The full key is compared
+	AccelerationCache cache;
+	EXPECT_FALSE(cache.OpenForRead(path, key + "b", hash));
+	EXPECT_FALSE(cache.OpenForRead(path, key.substr(0, 50), hash));
+	ASSERT_TRUE(cache.OpenForRead(path, key, hash));
+
+	int value;
+	EXPECT_TRUE(cache.ReadValue(value));
+	EXPECT_EQ(1, value);
+	EXPECT_TRUE(cache.Close());
+
+	// No temporary file remains
+	int numFiles = 0;
+	for (boost::filesystem::directory_iterator it(dir), end; it != end; ++it)
+	{
+		numFiles++;
+	}
+	EXPECT_EQ(1, numFiles);
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
@@ -83,6 +83,42 @@ namespace
 		</assets>	
 	);
 
+	const std::string AssetNode_Parallel_Success = LM_TEST_MULTILINE_LITERAL(
+		<assets>
+			<num_threads>4</num_threads>
+			<stub_assets_a>
+				<stub_asset_a id="a1" type="a" />
+				<stub_asset_a id="a2" type="a" />
+				<stub_asset_a id="a3" type="a" />
+				<stub_asset_a id="a4" type="a" />
+			</stub_assets_a>
+			<stub_assets_b>
+				<stub_asset_b id="b1" type="b"><stub_asset_a ref="a1" /></stub_asset_b>
+				<stub_asset_b id="b2" type="b"><stub_asset_a ref="a2" /></stub_asset_b>
+				<stub_asset_b id="b3" type="b"><stub_asset_a ref="a3" /></stub_asset_b>
+				<stub_asset_b id="b4" type="b"><stub_asset_a ref="a4" /></stub_asset_b>
+			</stub_assets_b>
+			<stub_assets>
+				<stub_asset id="s1" type="success" />
+				<stub_asset id="s2" type="success" />
+				<stub_asset id="s3" type="success" />
+				<stub_asset id="s4" type="success" />
+			</stub_assets>
+		</assets>
+	);
+
+	const std::string AssetNode_Parallel_Failed = LM_TEST_MULTILINE_LITERAL(
+		<assets>
+			<num_threads>4</num_threads>
+			<stub_assets>
+				<stub_asset id="s1" type="success" />
+				<stub_asset id="s2" type="success" />
+				<stub_asset id="s3" type="fail_on_create" />
+				<stub_asset id="s4" type="success" />
+			</stub_assets>
+		</assets>
+	);
+
 	const std::string AssetNode_Dependency_Failed = LM_TEST_MULTILINE_LITERAL(
 		<assets>
 			<stub_assets_e>
@@ -179,6 +215,35 @@ TEST_F(AssetsTest, Load_Dependency_Failed)
 	EXPECT_FALSE(assets->Load(config.LoadFromStringAndGetFirstChild(AssetNode_Dependency_Failed)));
 }
 
+TEST_F(AssetsTest, Load_Parallel)
+{
+	EXPECT_TRUE(assets->RegisterInterface<StubAsset>());
+	EXPECT_TRUE(assets->RegisterInterface<StubAsset_A>());
+	EXPECT_TRUE(assets->RegisterInterface<StubAsset_B>());
+
+	// Progress is reported in the increasing order and finished once
+	std::vector<std::pair<double, bool>> progress;
+	auto conn = assets->Connect_ReportProgress([&progress](double p, bool done){ progress.emplace_back(p, done); });
+	EXPECT_TRUE(assets->Load(config.LoadFromStringAndGetFirstChild(AssetNode_Parallel_Success)));
+	ASSERT_EQ(size_t(13), progress.size());
+	for (size_t i = 0; i < progress.size(); i++)
+	{
+		EXPECT_EQ(static_cast<double>(i) / 12, progress[i].first);
+		EXPECT_EQ(i == 12, progress[i].second);
+	}
+
+	for (const auto& id : { "a1", "a4", "b1", "b4", "s1", "s4" })
+	{
+		EXPECT_NE(nullptr, assets->GetAssetByName(id));
+	}
+}
+
+TEST_F(AssetsTest, Load_Parallel_Failed)
+{
+	EXPECT_TRUE(assets->RegisterInterface<StubAsset>());
+	EXPECT_FALSE(assets->Load(config.LoadFromStringAndGetFirstChild(AssetNode_Parallel_Failed)));
+}
+
 TEST_F(AssetsTest, GetAssetByName_Failed)
 {
 	EXPECT_TRUE(assets->RegisterInterface<StubAsset>());
@@ -0,0 +1,179 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica.test/base.math.h>
+#include <lightmetrica.test/stub.assets.h>
+#include <lightmetrica.test/stub.config.h>
+#include <lightmetrica/trianglemesh.h>
+#include <lightmetrica/binarymesh.h>
+#include <fstream>
+
+namespace
+{
+
+	const std::string RawMeshNode = LM_TEST_MULTILINE_LITERAL(
+		<triangle_mesh id="quad" type="raw">
+			<positions>
+				0 1 0
+				0 1 1
+				1 1 0
+				1 1 1
+			</positions>
+			<normals>
+				0 -1 0
+				0 -1 0
+				0 -1 0
+				0 -1 0
+			</normals>
+			<texcoords>
+				0 0
+				0 1
+				1 0
+				1 1
+			</texcoords>
+			<faces>
+				0 1 2
+				0 1 3
+			</faces>
+		</triangle_mesh>
+	);
+
+	const std::string BinaryMeshNode_Template = LM_TEST_MULTILINE_LITERAL(
+		<triangle_mesh id="quad" type="binary">
+			<path>%s</path>
+		</triangle_mesh>
+	);
+
+}
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class BinaryMeshTest : public TestBase
+{
+public:
+
+	BinaryMeshTest()
+		: path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.lmmesh")).string())
+	{
+
+	}
+
+	~BinaryMeshTest()
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove(path, ec);
+	}
+
+	std::unique_ptr<TriangleMesh> LoadBinaryMesh()
+	{
+		std::unique_ptr<TriangleMesh> mesh(ComponentFactory::Create<TriangleMesh>("binary"));
+		StubConfig config;
+		if (!mesh->Load(config.LoadFromStringAndGetFirstChild(boost::str(boost::format(BinaryMeshNode_Template) % path)), assets))
+		{
+			return nullptr;
+		}
+		return mesh;
+	}
+
+protected:
+
+	std::string path;
+	StubAssets assets;
+
+};
+
+TEST_F(BinaryMeshTest, SaveAndLoad)
+{
+	std::unique_ptr<TriangleMesh> rawMesh(ComponentFactory::Create<TriangleMesh>("raw"));
+	StubConfig config;
+	ASSERT_TRUE(rawMesh->Load(config.LoadFromStringAndGetFirstChild(RawMeshNode), assets));
+	ASSERT_TRUE(BinaryMeshUtils::Save(*rawMesh, path));
+
+	auto mesh = LoadBinaryMesh();
+	ASSERT_NE(nullptr, mesh);
+	ASSERT_EQ(rawMesh->NumVertices(), mesh->NumVertices());
+	ASSERT_EQ(rawMesh->NumFaces(), mesh->NumFaces());
+	for (int i = 0; i < mesh->NumVertices(); i++)
+	{
+		EXPECT_TRUE(ExpectNear(rawMesh->Positions()[i], mesh->Positions()[i]));
+		EXPECT_TRUE(ExpectNear(rawMesh->Normals()[i], mesh->Normals()[i]));
+	}
+	for (int i = 0; i < mesh->NumVertices() / 3 * 2; i++)
+	{
+		EXPECT_TRUE(ExpectNear(rawMesh->TexCoords()[i], mesh->TexCoords()[i]));
+	}
+	for (int i = 0; i < mesh->NumFaces(); i++)
+	{
+		EXPECT_EQ(rawMesh->Faces()[i], mesh->Faces()[i]);
+	}
+
+	// Arrays are aligned
+	EXPECT_EQ(uintptr_t(0), reinterpret_cast<uintptr_t>(mesh->Positions()) % 16);
+	EXPECT_EQ(uintptr_t(0), reinterpret_cast<uintptr_t>(mesh->Faces()) % 16);
+}
+
+TEST_F(BinaryMeshTest, Load_Failed)
+{
+	// Missing file
+	EXPECT_EQ(nullptr, LoadBinaryMesh());
+
+	// Invalid file
+	{
+		std::ofstream out(path, std::ios::out | std::ios::binary);
+		out << "invalid binary mesh file";
+	}
+	EXPECT_EQ(nullptr, LoadBinaryMesh());
+}
+
+TEST_F(BinaryMeshTest, Load_Truncated)
+{
+	std::unique_ptr<TriangleMesh> rawMesh(ComponentFactory::Create<TriangleMesh>("raw"));
+	StubConfig config;
+	ASSERT_TRUE(rawMesh->Load(config.LoadFromStringAndGetFirstChild(RawMeshNode), assets));
+	ASSERT_TRUE(BinaryMeshUtils::Save(*rawMesh, path));
+
+	// Remove the array of faces
+	const auto size = boost::filesystem::file_size(path);
+	boost::filesystem::resize_file(path, size - 64);
+	EXPECT_EQ(nullptr, LoadBinaryMesh());
+}
+
+TEST_F(BinaryMeshTest, Load_InvalidFaceIndex)
+{
+	std::unique_ptr<TriangleMesh> rawMesh(ComponentFactory::Create<TriangleMesh>("raw"));
+	StubConfig config;
+	ASSERT_TRUE(rawMesh->Load(config.LoadFromStringAndGetFirstChild(RawMeshNode), assets));
+	ASSERT_TRUE(BinaryMeshUtils::Save(*rawMesh, path));
+
+	// Overwrite the first vertex index, which is the beginning of the last 64-byte aligned array
+	{
+		const auto size = boost::filesystem::file_size(path);
+		std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+		f.seekp(size - 64);
+		const unsigned int index = 4;
+		f.write(reinterpret_cast<const char*>(&index), sizeof(unsigned int));
+	}
+	EXPECT_EQ(nullptr, LoadBinaryMesh());
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
@@ -179,6 +179,7 @@ TEST_F(BPTPowerHeuristicsMISWeightTest, Consistency)
 	// BPT weights
 	std::unique_ptr<BPTMISWeight> misWeightFunc_Power(ComponentFactory::Create<BPTMISWeight>("power"));
 	std::unique_ptr<BPTMISWeight> misWeightFunc_PowerNaive(ComponentFactory::Create<BPTMISWeight>("powernaive"));
+	std::unique_ptr<BPTMISWeight> misWeightFunc_PowerRecursive(ComponentFactory::Create<BPTMISWeight>("powerrecursive"));
 
 	const int Samples = 1<<12;
 	for (int sample = 0; sample < Samples; sample++)
@@ -221,10 +222,13 @@ TEST_F(BPTPowerHeuristicsMISWeightTest, Consistency)
 				// Calculate weights using different implementation
 				auto weight_Power		= misWeightFunc_Power->Evaluate(fullpath);
 				auto weight_PowerNaive	= misWeightFunc_PowerNaive->Evaluate(fullpath);
+				auto weight_PowerRecursive = misWeightFunc_PowerRecursive->Evaluate(fullpath);
 
 				// Compare weights
 				auto result = ExpectNear(weight_Power, weight_PowerNaive);
 				EXPECT_TRUE(result);
+				auto resultRecursive = ExpectNear(weight_Power, weight_PowerRecursive);
+				EXPECT_TRUE(resultRecursive);
 				if (!result)
 				{
 					LM_LOG_DEBUG("s     = " + std::to_string(s));
@@ -244,5 +248,22 @@ TEST_F(BPTPowerHeuristicsMISWeightTest, Consistency)
 	}
 }
 
+TEST_F(BPTPowerHeuristicsMISWeightTest, PowerRecursive_Configure)
+{
+	std::unique_ptr<Assets> assets(ComponentFactory::Create<Assets>());
+	std::unique_ptr<BPTMISWeight> misWeightFunc_PowerRecursive(ComponentFactory::Create<BPTMISWeight>("powerrecursive"));
+	EXPECT_TRUE(misWeightFunc_PowerRecursive->RequiresRecursiveQuantities());
+
+	// Only beta = 2 is supported
+	StubConfig config;
+	EXPECT_TRUE(misWeightFunc_PowerRecursive->Configure(config.LoadFromStringAndGetFirstChild("<mis_weight type=\"powerrecursive\" />"), *assets));
+	EXPECT_TRUE(misWeightFunc_PowerRecursive->Configure(config.LoadFromStringAndGetFirstChild("<mis_weight type=\"powerrecursive\"><beta_coeff>2</beta_coeff></mis_weight>"), *assets));
+	EXPECT_FALSE(misWeightFunc_PowerRecursive->Configure(config.LoadFromStringAndGetFirstChild("<mis_weight type=\"powerrecursive\"><beta_coeff>3</beta_coeff></mis_weight>"), *assets));
+
+	// Other weights do not require the quantities
+	std::unique_ptr<BPTMISWeight> misWeightFunc_Power(ComponentFactory::Create<BPTMISWeight>("power"));
+	EXPECT_FALSE(misWeightFunc_Power->RequiresRecursiveQuantities());
+}
+
 LM_TEST_NAMESPACE_END
 LM_NAMESPACE_END
\ No newline at end of file
@@ -25,6 +25,7 @@
 #include <lightmetrica/bitmapfilm.h>
 #include <lightmetrica/bitmap.h>
 #include <FreeImage.h>
+#include <thread>
 
 namespace
 {
@@ -45,6 +46,22 @@ namespace
 		</film>
 	);
 
+	const std::string FilmNode_Tiled = LM_TEST_MULTILINE_LITERAL(
+		<film id="test" type="hdr">
+			<width>40</width>
+			<height>30</height>
+			<accumulation_mode>tiled</accumulation_mode>
+		</film>
+	);
+
+	const std::string FilmNode_Atomic = LM_TEST_MULTILINE_LITERAL(
+		<film id="test" type="hdr">
+			<width>40</width>
+			<height>30</height>
+			<accumulation_mode>atomic</accumulation_mode>
+		</film>
+	);
+
 	const std::string FilmNode_Fail_MissingElement = LM_TEST_MULTILINE_LITERAL(
 		<film id="test" type="hdr">
 			<height>30</height>
@@ -181,6 +198,93 @@ TEST_F(HDRBitmapFilmTest, AccumulateContribution_2)
 	}
 }
 
+TEST_F(HDRBitmapFilmTest, AccumulateContribution_Tiled)
+{
+	// Accumulate to the clones in the tiled mode
+	EXPECT_TRUE(film->Load(config.LoadFromStringAndGetFirstChild(FilmNode_Tiled), assets));
+	const int NumClones = 4;
+	std::vector<std::unique_ptr<Film>> clones;
+	for (int i = 0; i < NumClones; i++)
+	{
+		clones.emplace_back(film->Clone());
+		for (int y = 0; y < film->Height(); y++)
+		{
+			for (int x = 0; x < film->Width(); x++)
+			{
+				Math::Vec2 rasterPos(
+					(Math::Float(x) + Math::Float(0.5)) / Math::Float(film->Width()),
+					(Math::Float(y) + Math::Float(0.5)) / Math::Float(film->Height()));
+				clones[i]->AccumulateContribution(rasterPos, Math::Vec3(Math::Float(x), Math::Float(y), Math::Float(1)));
+			}
+		}
+	}
+
+	// Accumulate the clones to #film
+	for (const auto& clone : clones)
+	{
+		film->AccumulateContribution(*clone);
+	}
+
+	// Check data
+	const auto& data = film->Bitmap().InternalData();
+	for (int y = 0; y < film->Height(); y++)
+	{
+		for (int x = 0; x < film->Width(); x++)
+		{
+			size_t i = y * film->Width() + x;
+			EXPECT_TRUE(ExpectNear(Math::Float(NumClones * x), data[3*i  ]));
+			EXPECT_TRUE(ExpectNear(Math::Float(NumClones * y), data[3*i+1]));
+			EXPECT_TRUE(ExpectNear(Math::Float(NumClones), data[3*i+2]));
+		}
+	}
+}
+
+TEST_F(HDRBitmapFilmTest, AccumulateContribution_Atomic)
+{
+	// Accumulate to the clones in the atomic mode from multiple threads
+	EXPECT_TRUE(film->Load(config.LoadFromStringAndGetFirstChild(FilmNode_Atomic), assets));
+	const int NumClones = 4;
+	const int Count = 10;
+	std::vector<std::unique_ptr<Film>> clones;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < NumClones; i++)
+	{
+		clones.emplace_back(film->Clone());
+	}
+	for (int i = 0; i < NumClones; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			for (int j = 0; j < Count; j++)
+			{
+				clones[i]->AccumulateContribution(Math::Vec2(), Math::Vec3(Math::Float(1)));
+				clones[i]->AccumulateContribution(Math::Vec2(Math::Float(1)), Math::Vec3(Math::Float(2)));
+			}
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	// Accumulate the clones to #film
+	for (const auto& clone : clones)
+	{
+		film->AccumulateContribution(*clone);
+	}
+
+	// Check data
+	const auto& data = film->Bitmap().InternalData();
+	EXPECT_TRUE(ExpectNear(Math::Float(NumClones * Count), data[0]));
+	EXPECT_TRUE(ExpectNear(Math::Float(NumClones * Count), data[1]));
+	EXPECT_TRUE(ExpectNear(Math::Float(NumClones * Count), data[2]));
+
+	size_t i = data.size() - 3;
+	EXPECT_TRUE(ExpectNear(Math::Float(NumClones * Count * 2), data[i  ]));
+	EXPECT_TRUE(ExpectNear(Math::Float(NumClones * Count * 2), data[i+1]));
+	EXPECT_TRUE(ExpectNear(Math::Float(NumClones * Count * 2), data[i+2]));
+}
+
 TEST_F(HDRBitmapFilmTest, Save)
 {
 	// Create a film
@@ -0,0 +1,245 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica.test/base.math.h>
+#include <lightmetrica.test/stub.config.h>
+#include <lightmetrica/assets.h>
+#include <lightmetrica/texture.h>
+#include <lightmetrica/bsdf.h>
+#include <lightmetrica/trianglemesh.h>
+#include <lightmetrica/film.h>
+#include <lightmetrica/camera.h>
+#include <lightmetrica/light.h>
+#include <lightmetrica/confignode.h>
+#include <lightmetrica/scene.h>
+#include <lightmetrica/primitives.h>
+#include <lightmetrica/surfacegeometry.h>
+#include <lightmetrica/math.stats.h>
+
+namespace
+{
+
+	// Environment light with a constant texture and a quad which determines the bounding sphere
+	const std::string SceneFile = LM_TEST_MULTILINE_LITERAL(
+		<assets>
+			<textures>
+				<texture id="sky" type="constant">
+					<color>1 1 1</color>
+				</texture>
+			</textures>
+			<triangle_meshes>
+				<triangle_mesh id="quad" type="raw">
+					<positions>
+						-1 0 -1
+						-1 0 1
+						1 0 1
+						1 0 -1
+					</positions>
+					<normals>
+						0 1 0
+						0 1 0
+						0 1 0
+						0 1 0
+					</normals>
+					<faces>
+						0 2 1
+						0 3 2
+					</faces>
+				</triangle_mesh>
+			</triangle_meshes>
+			<bsdfs>
+				<bsdf id="diffuse_white" type="diffuse">
+					<diffuse_reflectance>
+						<color>1 1 1</color>
+					</diffuse_reflectance>
+				</bsdf>
+			</bsdfs>
+			<films>
+				<film id="film_1" type="hdr">
+					<width>10</width>
+					<height>10</height>
+					<imagetype>radiancehdr</imagetype>
+				</film>
+			</films>
+			<cameras>
+				<camera id="camera_1" type="perspective">
+					<film ref="film_1" />
+					<fovy>45</fovy>
+				</camera>
+			</cameras>
+			<lights>
+				<light id="env" type="env.bitmap">
+					<texture ref="sky" />
+					<rotate>30</rotate>
+				</light>
+			</lights>
+		</assets>
+		<scene type="naive">
+			<root>
+				<node>
+					<transform>
+						<lookat>
+							<position>0 1 1</position>
+							<center>0 0 0</center>
+							<up>0 1 0</up>
+						</lookat>
+					</transform>
+					<camera ref="camera_1" />
+				</node>
+				<node>
+					<triangle_mesh ref="quad" />
+					<bsdf ref="diffuse_white" />
+				</node>
+			</root>
+			<environment_light ref="env" />
+		</scene>
+	);
+
+}
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class EnvmapEnvironmentLightTest : public TestBase
+{
+public:
+
+	EnvmapEnvironmentLightTest()
+	{
+		EXPECT_TRUE(config.LoadFromString(SceneFile, ""));
+
+		assets.reset(ComponentFactory::Create<Assets>());
+		assets->RegisterInterface<Texture>();
+		assets->RegisterInterface<BSDF>();
+		assets->RegisterInterface<TriangleMesh>();
+		assets->RegisterInterface<Film>();
+		assets->RegisterInterface<Camera>();
+		assets->RegisterInterface<Light>();
+		EXPECT_TRUE(assets->Load(config.Root().Child("assets")));
+
+		std::unique_ptr<Primitives> primitives(ComponentFactory::Create<Primitives>());
+		EXPECT_TRUE(primitives->Load(config.Root().Child("scene"), *assets));
+		scene.reset(ComponentFactory::Create<Scene>(config.Root().Child("scene").AttributeValue("type")));
+		scene->Load(primitives.release());
+		EXPECT_TRUE(scene->Configure(config.Root().Child("scene")));
+		EXPECT_TRUE(scene->Build());
+		EXPECT_TRUE(scene->PostConfigure());
+
+		light = dynamic_cast<const Light*>(assets->GetAssetByName("env"));
+		EXPECT_NE(nullptr, light);
+	}
+
+protected:
+
+	StubConfig config;
+	std::unique_ptr<Assets> assets;
+	std::unique_ptr<Scene> scene;
+	const Light* light;
+
+};
+
+TEST_F(EnvmapEnvironmentLightTest, SamplePosition)
+{
+	// Sampled PDF must match the evaluated one
+	const int Count = 1<<6;
+	for (int i = 0; i < Count; i++)
+	{
+		for (int j = 0; j < Count; j++)
+		{
+			const Math::Vec2 u((Math::Float(i) + Math::Float(0.5)) / Math::Float(Count), (Math::Float(j) + Math::Float(0.5)) / Math::Float(Count));
+			SurfaceGeometry geom;
+			Math::PDFEval pdf;
+			light->SamplePosition(u, geom, pdf);
+			EXPECT_EQ(Math::ProbabilityMeasure::Area, pdf.measure);
+			EXPECT_LT(Math::Float(0), pdf.v);
+			EXPECT_TRUE(ExpectNear(light->EvaluatePositionPDF(geom).v, pdf.v, Math::Float(1e-3)));
+		}
+	}
+}
+
+TEST_F(EnvmapEnvironmentLightTest, PositionPDFIsNormalized)
+{
+	// Integrate the PDF over the bounding sphere with uniformly distributed positions
+	const auto bound = light->GetAABB();
+	const auto center = (bound.max + bound.min) / Math::Float(2);
+	const auto radius = (bound.max.x - bound.min.x) / Math::Float(2);
+	const auto area = Math::Float(4) * Math::Constants::Pi() * radius * radius;
+
+	const int Count = 1<<8;
+	Math::Float sum(0);
+	for (int i = 0; i < Count; i++)
+	{
+		for (int j = 0; j < Count; j++)
+		{
+			const Math::Vec2 u((Math::Float(i) + Math::Float(0.5)) / Math::Float(Count), (Math::Float(j) + Math::Float(0.5)) / Math::Float(Count));
+			const auto d = Math::UniformSampleSphere(u);
+			SurfaceGeometry geom;
+			geom.degenerated = false;
+			geom.p = center + d * radius;
+			geom.gn = geom.sn = -d;
+			geom.ComputeTangentSpace();
+			sum += light->EvaluatePositionPDF(geom).v;
+		}
+	}
+
+	EXPECT_TRUE(ExpectNear(Math::Float(1), sum * area / Math::Float(Count * Count), Math::Float(1e-2)));
+}
+
+TEST_F(EnvmapEnvironmentLightTest, SampleAndEstimateDirection)
+{
+	// Estimate of the integral of the directional component over the projected solid angle,
+	// which is equal to the luminance of the constant texture
+	SurfaceGeometry geom;
+	Math::PDFEval positionPdf;
+	light->SamplePosition(Math::Vec2(0.3, 0.6), geom, positionPdf);
+
+	GeneralizedBSDFSampleQuery bsdfSQ;
+	bsdfSQ.type = GeneralizedBSDFType::LightDirection;
+	bsdfSQ.transportDir = TransportDirection::LE;
+
+	const int Count = 1<<8;
+	Math::Float sum(0);
+	for (int i = 0; i < Count; i++)
+	{
+		for (int j = 0; j < Count; j++)
+		{
+			bsdfSQ.sample = Math::Vec2((Math::Float(i) + Math::Float(0.5)) / Math::Float(Count), (Math::Float(j) + Math::Float(0.5)) / Math::Float(Count));
+			GeneralizedBSDFSampleResult bsdfSR;
+			const auto weight = light->SampleAndEstimateDirection(bsdfSQ, geom, bsdfSR);
+			if (Math::IsZero(weight))
+			{
+				continue;
+			}
+
+			GeneralizedBSDFEvaluateQuery bsdfEQ;
+			bsdfEQ.type = GeneralizedBSDFType::LightDirection;
+			bsdfEQ.transportDir = TransportDirection::LE;
+			bsdfEQ.wo = bsdfSR.wo;
+			EXPECT_TRUE(ExpectNear(light->EvaluateDirectionPDF(bsdfEQ, geom).v, bsdfSR.pdf.v, Math::Float(1e-3)));
+			sum += Math::Luminance(weight);
+		}
+	}
+
+	EXPECT_TRUE(ExpectNear(Math::Float(1), sum / Math::Float(Count * Count), Math::Float(2e-2)));
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
@@ -0,0 +1,231 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica.test/base.math.h>
+#include <lightmetrica.test/stub.config.h>
+#include <lightmetrica/assets.h>
+#include <lightmetrica/texture.h>
+#include <lightmetrica/bsdf.h>
+#include <lightmetrica/trianglemesh.h>
+#include <lightmetrica/film.h>
+#include <lightmetrica/camera.h>
+#include <lightmetrica/light.h>
+#include <lightmetrica/confignode.h>
+#include <lightmetrica/scene.h>
+#include <lightmetrica/primitives.h>
+
+namespace
+{
+
+	// Four area lights placed along x axis
+	const std::string SceneFile = LM_TEST_MULTILINE_LITERAL(
+		<assets>
+			<triangle_meshes>
+				<triangle_mesh id="quad" type="raw">
+					<positions>
+						-0.1 0 -0.1
+						-0.1 0 0.1
+						0.1 0 0.1
+						0.1 0 -0.1
+					</positions>
+					<normals>
+						0 -1 0
+						0 -1 0
+						0 -1 0
+						0 -1 0
+					</normals>
+					<faces>
+						0 2 1
+						0 3 2
+					</faces>
+				</triangle_mesh>
+			</triangle_meshes>
+			<bsdfs>
+				<bsdf id="diffuse_black" type="diffuse">
+					<diffuse_reflectance>
+						<color>0 0 0</color>
+					</diffuse_reflectance>
+				</bsdf>
+			</bsdfs>
+			<films>
+				<film id="film_1" type="hdr">
+					<width>10</width>
+					<height>10</height>
+					<imagetype>radiancehdr</imagetype>
+				</film>
+			</films>
+			<cameras>
+				<camera id="camera_1" type="perspective">
+					<film ref="film_1" />
+					<fovy>45</fovy>
+				</camera>
+			</cameras>
+			<lights>
+				<light id="light_1" type="area">
+					<luminance>1 1 1</luminance>
+				</light>
+				<light id="light_2" type="area">
+					<luminance>1 1 1</luminance>
+				</light>
+				<light id="light_3" type="area">
+					<luminance>2 2 2</luminance>
+				</light>
+				<light id="light_4" type="area">
+					<luminance>4 4 4</luminance>
+				</light>
+			</lights>
+		</assets>
+		<scene type="naive">
+			<root>
+				<node>
+					<transform>
+						<lookat>
+							<position>0 0 1</position>
+							<center>0 0 0</center>
+							<up>0 1 0</up>
+						</lookat>
+					</transform>
+					<camera ref="camera_1" />
+				</node>
+				<node>
+					<transform>
+						<translate>0 1 0</translate>
+					</transform>
+					<triangle_mesh ref="quad" />
+					<light ref="light_1" />
+					<bsdf ref="diffuse_black" />
+				</node>
+				<node>
+					<transform>
+						<translate>1 1 0</translate>
+					</transform>
+					<triangle_mesh ref="quad" />
+					<light ref="light_2" />
+					<bsdf ref="diffuse_black" />
+				</node>
+				<node>
+					<transform>
+						<translate>4 1 0</translate>
+					</transform>
+					<triangle_mesh ref="quad" />
+					<light ref="light_3" />
+					<bsdf ref="diffuse_black" />
+				</node>
+				<node>
+					<transform>
+						<translate>10 1 0</translate>
+					</transform>
+					<triangle_mesh ref="quad" />
+					<light ref="light_4" />
+					<bsdf ref="diffuse_black" />
+				</node>
+			</root>
+		</scene>
+	);
+
+}
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class LightTreeTest : public TestBase
+{
+public:
+
+	LightTreeTest()
+	{
+		EXPECT_TRUE(config.LoadFromString(SceneFile, ""));
+
+		assets.reset(ComponentFactory::Create<Assets>());
+		assets->RegisterInterface<Texture>();
+		assets->RegisterInterface<BSDF>();
+		assets->RegisterInterface<TriangleMesh>();
+		assets->RegisterInterface<Film>();
+		assets->RegisterInterface<Camera>();
+		assets->RegisterInterface<Light>();
+		EXPECT_TRUE(assets->Load(config.Root().Child("assets")));
+
+		std::unique_ptr<Primitives> primitives(ComponentFactory::Create<Primitives>());
+		EXPECT_TRUE(primitives->Load(config.Root().Child("scene"), *assets));
+		scene.reset(ComponentFactory::Create<Scene>(config.Root().Child("scene").AttributeValue("type")));
+		scene->Load(primitives.release());
+		EXPECT_TRUE(scene->Configure(config.Root().Child("scene")));
+		EXPECT_TRUE(scene->Build());
+		EXPECT_TRUE(scene->PostConfigure());
+	}
+
+protected:
+
+	StubConfig config;
+	std::unique_ptr<Assets> assets;
+	std::unique_ptr<Scene> scene;
+
+};
+
+TEST_F(LightTreeTest, PDFSumsToOne)
+{
+	const Math::Vec3 points[] = { Math::Vec3(0), Math::Vec3(1, 0, 0), Math::Vec3(5, 2, 1), Math::Vec3(-10, 0, 3) };
+	for (const auto& p : points)
+	{
+		Math::Float sum(0);
+		for (const auto* light : { "light_1", "light_2", "light_3", "light_4" })
+		{
+			sum += scene->LightSelectionPdf(p, dynamic_cast<const Light*>(assets->GetAssetByName(light))).v;
+		}
+		EXPECT_TRUE(ExpectNear(Math::Float(1), sum));
+	}
+}
+
+TEST_F(LightTreeTest, Sample)
+{
+	// Frequencies of the selected lights must match the PDFs
+	const Math::Vec3 p(0.5, 0, 0);
+	const int Count = 1<<14;
+	std::map<const Light*, int> counts;
+	for (int i = 0; i < Count; i++)
+	{
+		Math::Vec2 lightSampleP((Math::Float(i) + Math::Float(0.5)) / Math::Float(Count), Math::Float(0.5));
+		Math::PDFEval selectionPdf;
+		const auto* light = scene->SampleLightSelection(p, lightSampleP, selectionPdf);
+		ASSERT_NE(nullptr, light);
+		EXPECT_TRUE(ExpectNear(scene->LightSelectionPdf(p, light).v, selectionPdf.v));
+		EXPECT_LE(Math::Float(0), lightSampleP.x);
+		EXPECT_GE(Math::Float(1), lightSampleP.x);
+		counts[light]++;
+	}
+
+	for (const auto& count : counts)
+	{
+		EXPECT_TRUE(ExpectNear(scene->LightSelectionPdf(p, count.first).v, Math::Float(count.second) / Math::Float(Count), Math::Float(1e-2)));
+	}
+}
+
+TEST_F(LightTreeTest, NearLightsArePreferred)
+{
+	// The lights near the shading point are selected more frequently than the power-based selection
+	const auto* light1 = dynamic_cast<const Light*>(assets->GetAssetByName("light_1"));
+	const auto* light4 = dynamic_cast<const Light*>(assets->GetAssetByName("light_4"));
+	EXPECT_LT(scene->LightSelectionPdf(light1).v, scene->LightSelectionPdf(Math::Vec3(0), light1).v);
+	EXPECT_LT(scene->LightSelectionPdf(light4).v, scene->LightSelectionPdf(Math::Vec3(10, 0, 0), light4).v);
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
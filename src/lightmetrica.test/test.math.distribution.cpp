@@ -59,5 +59,147 @@ TEST_F(DiscreteDistribution1DTest, Sample)
 	EXPECT_EQ(3U, dist.Sample(Math::Float(0.76)));
 }
 
+// --------------------------------------------------------------------------------
+
+class DiscreteAliasDistribution1DTest : public TestBase {};
+
+TEST_F(DiscreteAliasDistribution1DTest, Normalize)
+{
+	Math::DiscreteAliasDistribution1D dist;
+	dist.Add(Math::Float(1));
+	dist.Add(Math::Float(3));
+	dist.Normalize();
+	EXPECT_TRUE(ExpectNear(Math::Float(0.25), dist.EvaluatePDF(0)));
+	EXPECT_TRUE(ExpectNear(Math::Float(0.75), dist.EvaluatePDF(1)));
+	EXPECT_TRUE(ExpectNear(Math::Float(0), dist.EvaluatePDF(2)));
+}
+
+TEST_F(DiscreteAliasDistribution1DTest, Sample)
+{
+	// Probability of the sampled indices by sweeping the sample
+	const Math::Float weights[] = { Math::Float(1), Math::Float(0), Math::Float(5), Math::Float(2) };
+	Math::DiscreteAliasDistribution1D dist;
+	for (const auto& w : weights)
+	{
+		dist.Add(w);
+	}
+	dist.Normalize();
+
+	const int Count = 1<<12;
+	int counts[4] = { 0 };
+	for (int i = 0; i < Count; i++)
+	{
+		auto index = dist.Sample((Math::Float(i) + Math::Float(0.5)) / Math::Float(Count));
+		ASSERT_LT(index, 4U);
+		counts[index]++;
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		EXPECT_TRUE(ExpectNear(weights[i] / Math::Float(8), Math::Float(counts[i]) / Math::Float(Count), Math::Float(1e-2)));
+	}
+}
+
+TEST_F(DiscreteAliasDistribution1DTest, SampleReuse)
+{
+	// Reused samples must be uniformly distributed in [0, 1) for each index
+	Math::DiscreteAliasDistribution1D dist;
+	dist.Add(Math::Float(1));
+	dist.Add(Math::Float(3));
+	dist.Normalize();
+
+	const int Count = 1<<12;
+	Math::Float sum[2] = { Math::Float(0), Math::Float(0) };
+	int counts[2] = { 0, 0 };
+	for (int i = 0; i < Count; i++)
+	{
+		auto u = (Math::Float(i) + Math::Float(0.5)) / Math::Float(Count);
+		auto index = dist.SampleReuse(u);
+		ASSERT_LT(index, 2U);
+		EXPECT_LE(Math::Float(0), u);
+		EXPECT_GE(Math::Float(1), u);
+		sum[index] += u;
+		counts[index]++;
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		EXPECT_TRUE(ExpectNear(Math::Float(0.5), sum[i] / Math::Float(counts[i]), Math::Float(1e-2)));
+	}
+}
+
+TEST_F(DiscreteAliasDistribution1DTest, ZeroSum)
+{
+	// Treated as uniform distribution
+	Math::DiscreteAliasDistribution1D dist;
+	dist.Add(Math::Float(0));
+	dist.Add(Math::Float(0));
+	dist.Normalize();
+	EXPECT_TRUE(ExpectNear(Math::Float(0.5), dist.EvaluatePDF(0)));
+	EXPECT_EQ(0U, dist.Sample(Math::Float(0.1)));
+	EXPECT_EQ(1U, dist.Sample(Math::Float(0.9)));
+}
+
+// --------------------------------------------------------------------------------
+
+class PiecewiseConstantDistribution2DTest : public TestBase {};
+
+TEST_F(PiecewiseConstantDistribution2DTest, EvaluatePDF)
+{
+	// 2x2 cells : PDF w.r.t. area measure is (value / sum) * (number of cells)
+	const std::vector<Math::Float> values = { Math::Float(1), Math::Float(3), Math::Float(0), Math::Float(4) };
+	Math::PiecewiseConstantDistribution2D dist;
+	dist.Build(values, 2, 2);
+	EXPECT_TRUE(ExpectNear(Math::Float(0.5), dist.EvaluatePDF(Math::Vec2(0.25, 0.25))));
+	EXPECT_TRUE(ExpectNear(Math::Float(1.5), dist.EvaluatePDF(Math::Vec2(0.75, 0.25))));
+	EXPECT_TRUE(ExpectNear(Math::Float(0), dist.EvaluatePDF(Math::Vec2(0.25, 0.75))));
+	EXPECT_TRUE(ExpectNear(Math::Float(2), dist.EvaluatePDF(Math::Vec2(0.75, 0.75))));
+}
+
+TEST_F(PiecewiseConstantDistribution2DTest, Sample)
+{
+	// Frequencies of the sampled cells by sweeping the samples
+	const int Width = 3;
+	const int Height = 2;
+	const std::vector<Math::Float> values = { Math::Float(1), Math::Float(0), Math::Float(2), Math::Float(3), Math::Float(1), Math::Float(1) };
+	Math::PiecewiseConstantDistribution2D dist;
+	dist.Build(values, Width, Height);
+
+	const int Count = 1<<7;
+	int counts[Width * Height] = { 0 };
+	for (int i = 0; i < Count; i++)
+	{
+		for (int j = 0; j < Count; j++)
+		{
+			const Math::Vec2 u((Math::Float(i) + Math::Float(0.5)) / Math::Float(Count), (Math::Float(j) + Math::Float(0.5)) / Math::Float(Count));
+			Math::Float pdf;
+			const auto p = dist.Sample(u, pdf);
+			ASSERT_LE(Math::Float(0), p.x);
+			ASSERT_GE(Math::Float(1), p.x);
+			ASSERT_LE(Math::Float(0), p.y);
+			ASSERT_GE(Math::Float(1), p.y);
+			EXPECT_TRUE(ExpectNear(dist.EvaluatePDF(p), pdf));
+			const int x = Math::Clamp(static_cast<int>(p.x * Math::Float(Width)), 0, Width - 1);
+			const int y = Math::Clamp(static_cast<int>(p.y * Math::Float(Height)), 0, Height - 1);
+			counts[y * Width + x]++;
+		}
+	}
+
+	for (int i = 0; i < Width * Height; i++)
+	{
+		EXPECT_TRUE(ExpectNear(values[i] / Math::Float(8), Math::Float(counts[i]) / Math::Float(Count * Count), Math::Float(1e-2)));
+	}
+}
+
+TEST_F(PiecewiseConstantDistribution2DTest, ZeroSum)
+{
+	// Treated as uniform distribution
+	const std::vector<Math::Float> values(4, Math::Float(0));
+	Math::PiecewiseConstantDistribution2D dist;
+	dist.Build(values, 2, 2);
+	EXPECT_FALSE(dist.Empty());
+	EXPECT_TRUE(ExpectNear(Math::Float(1), dist.EvaluatePDF(Math::Vec2(0.25, 0.75))));
+}
+
 LM_TEST_NAMESPACE_END
 LM_NAMESPACE_END
\ No newline at end of file
@@ -0,0 +1,164 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica.test/base.math.h>
+#include <lightmetrica.test/stub.config.h>
+#include <lightmetrica.test/testscenes.h>
+#include <lightmetrica/assets.h>
+#include <lightmetrica/texture.h>
+#include <lightmetrica/bsdf.h>
+#include <lightmetrica/trianglemesh.h>
+#include <lightmetrica/film.h>
+#include <lightmetrica/camera.h>
+#include <lightmetrica/light.h>
+#include <lightmetrica/confignode.h>
+#include <lightmetrica/scene.h>
+#include <lightmetrica/primitives.h>
+#include <lightmetrica/renderer.h>
+#include <lightmetrica/sched.h>
+#include <lightmetrica/pm.photonmap.h>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+/*
+	Stub photon map.
+	Records the photons passed to the last #Build.
+*/
+class StubPhotonMap : public PhotonMap
+{
+public:
+
+	LM_COMPONENT_IMPL_DEF("stub");
+
+public:
+
+	virtual void Build(const Photons& photons) { builtPhotons = photons; }
+	virtual void CollectPhotons(const Math::Vec3& p, Math::Float& maxDist2, const PhotonCollectFunc& collectFunc) const {}
+	virtual void GetPhotons(std::vector<const Photon*>& photons) const {}
+
+public:
+
+	static Photons builtPhotons;
+
+};
+
+Photons StubPhotonMap::builtPhotons;
+
+LM_COMPONENT_REGISTER_IMPL(StubPhotonMap, PhotonMap);
+
+// --------------------------------------------------------------------------------
+
+class PhotonMappingRendererTest : public TestBase
+{
+public:
+
+	PhotonMappingRendererTest()
+	{
+		EXPECT_TRUE(sceneConfig.LoadFromString(TestScenes::Simple03(), ""));
+
+		assets.reset(ComponentFactory::Create<Assets>());
+		EXPECT_TRUE(assets->RegisterInterface<Texture>());
+		EXPECT_TRUE(assets->RegisterInterface<BSDF>());
+		EXPECT_TRUE(assets->RegisterInterface<TriangleMesh>());
+		EXPECT_TRUE(assets->RegisterInterface<Film>());
+		EXPECT_TRUE(assets->RegisterInterface<Camera>());
+		EXPECT_TRUE(assets->RegisterInterface<Light>());
+		EXPECT_TRUE(assets->Load(sceneConfig.Root().Child("assets")));
+
+		std::unique_ptr<Primitives> primitives(ComponentFactory::Create<Primitives>());
+		EXPECT_TRUE(primitives->Load(sceneConfig.Root().Child("scene"), *assets));
+		scene.reset(ComponentFactory::Create<Scene>(sceneConfig.Root().Child("scene").AttributeValue("type")));
+		scene->Load(primitives.release());
+		EXPECT_TRUE(scene->Configure(sceneConfig.Root().Child("scene")));
+		EXPECT_TRUE(scene->Build());
+	}
+
+protected:
+
+	// Traces photons with the given number of threads and returns the photons stored in the photon map
+	Photons TracePhotons(int numThreads, long long maxPhotons)
+	{
+		StubConfig schedConfig;
+		std::unique_ptr<RenderProcessScheduler> sched(ComponentFactory::Create<RenderProcessScheduler>("mt"));
+		EXPECT_TRUE(sched->Configure(schedConfig.LoadFromStringAndGetFirstChild(
+			"<scheduler type=\"mt\"><num_threads>" + std::to_string(numThreads) + "</num_threads></scheduler>"), *assets));
+
+		StubConfig rendererConfig;
+		std::unique_ptr<Renderer> renderer(ComponentFactory::Create<Renderer>("pm"));
+		EXPECT_TRUE(renderer->Configure(rendererConfig.LoadFromStringAndGetFirstChild(
+			"<renderer type=\"pm\">"
+				"<num_photon_trace_samples>10000</num_photon_trace_samples>"
+				"<max_photons>" + std::to_string(maxPhotons) + "</max_photons>"
+				"<photon_map_impl>stub</photon_map_impl>"
+				"<sampler type=\"random\"><rng>sfmt</rng><rng_seed>1</rng_seed></sampler>"
+			"</renderer>"), *assets, *scene, *sched));
+
+		StubPhotonMap::builtPhotons.clear();
+		EXPECT_TRUE(renderer->Preprocess(*scene, *sched));
+		return StubPhotonMap::builtPhotons;
+	}
+
+	void ExpectSamePhotons(const Photons& expected, const Photons& actual)
+	{
+		ASSERT_EQ(expected.size(), actual.size());
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			EXPECT_TRUE(ExpectVec3Near(expected[i].p, actual[i].p, Math::Float(0)));
+			EXPECT_TRUE(ExpectVec3Near(expected[i].throughput, actual[i].throughput, Math::Float(0)));
+			EXPECT_TRUE(ExpectVec3Near(expected[i].wi, actual[i].wi, Math::Float(0)));
+		}
+	}
+
+protected:
+
+	StubConfig sceneConfig;
+	std::unique_ptr<Assets> assets;
+	std::unique_ptr<Scene> scene;
+
+};
+
+TEST_F(PhotonMappingRendererTest, TracePhotons_IndependentOfNumThreads)
+{
+	// All light paths are traced
+	const long long UnlimitedPhotons = 1LL<<30;
+	const auto expected = TracePhotons(1, UnlimitedPhotons);
+	EXPECT_FALSE(expected.empty());
+	for (int numThreads : { 2, 4, 7 })
+	{
+		ExpectSamePhotons(expected, TracePhotons(numThreads, UnlimitedPhotons));
+	}
+}
+
+TEST_F(PhotonMappingRendererTest, TracePhotons_IndependentOfNumThreads_MaxPhotons)
+{
+	// Tracing stops in the middle of the light paths
+	const long long MaxPhotons = 1000;
+	const auto expected = TracePhotons(1, MaxPhotons);
+	EXPECT_EQ(static_cast<size_t>(MaxPhotons), expected.size());
+	for (int numThreads : { 2, 4, 7 })
+	{
+		ExpectSamePhotons(expected, TracePhotons(numThreads, MaxPhotons));
+	}
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
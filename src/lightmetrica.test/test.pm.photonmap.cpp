@@ -21,6 +21,8 @@
 #include <lightmetrica.test/base.h>
 #include <lightmetrica.test/base.math.h>
 #include <lightmetrica/pm.photonmap.h>
+#include <lightmetrica/pm.photonmap.kdtree.h>
+#include <lightmetrica/pm.photonmap.hashgrid.h>
 #include <random>
 
 LM_NAMESPACE_BEGIN
@@ -33,6 +35,7 @@ TEST_F(PhotonMapTest, Consistency)
 	std::vector<std::string> photonMapTypes;
 	photonMapTypes.emplace_back("naive");
 	photonMapTypes.emplace_back("kdtree");
+	photonMapTypes.emplace_back("hashgrid");
 
 	// Create photon map with random photons
 	std::vector<std::unique_ptr<PhotonMap>> photonMaps;
@@ -174,5 +177,114 @@ TEST_F(PhotonMapTest, Consistency)
 	}
 }
 
+TEST_F(PhotonMapTest, KdTreeCollectInRadius)
+{
+	// Photons with duplicated positions and enough number of photons for parallel build
+	Photons photons;
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> dist;
+	const int Samples = 1<<14;
+	for (int i = 0; i < Samples; i++)
+	{
+		Photon photon;
+		photon.p = i % 3 == 0 && i > 0
+			? photons[i - 1].p
+			: Math::Vec3(Math::Float(dist(gen)), Math::Float(dist(gen)), Math::Float(dist(gen)));
+		photons.push_back(photon);
+	}
+
+	std::unique_ptr<PhotonMap> naive(ComponentFactory::Create<PhotonMap>("naive"));
+	naive->Build(photons);
+	KdTreePhotonMap kdtree;
+	kdtree.Build(photons);
+
+	// Number of photons in the fixed radius must match
+	// for both type-erased and templated collect functions
+	const int Queries = 1<<6;
+	for (int query = 0; query < Queries; query++)
+	{
+		Math::Vec3 p(Math::Float(dist(gen)), Math::Float(dist(gen)), Math::Float(dist(gen)));
+		const Math::Float MaxDist2(0.01);
+
+		int expected = 0;
+		auto maxDist2 = MaxDist2;
+		naive->CollectPhotons(p, maxDist2, [&expected](const Math::Vec3&, const Photon&, Math::Float&){ expected++; });
+
+		int count = 0;
+		maxDist2 = MaxDist2;
+		kdtree.CollectPhotons(p, maxDist2, PhotonMap::PhotonCollectFunc([&count](const Math::Vec3&, const Photon&, Math::Float&){ count++; }));
+		EXPECT_EQ(expected, count);
+
+		int countTemplated = 0;
+		maxDist2 = MaxDist2;
+		kdtree.CollectPhotons(p, maxDist2, [&countTemplated](const Math::Vec3& q, const Photon& photon, Math::Float& maxDist2)
+		{
+			EXPECT_LT(Math::Length2(photon.p - q), maxDist2);
+			countTemplated++;
+		});
+		EXPECT_EQ(expected, countTemplated);
+	}
+}
+
+TEST_F(PhotonMapTest, KdTreeEmpty)
+{
+	KdTreePhotonMap kdtree;
+	kdtree.Build(Photons());
+	Math::Float maxDist2(1);
+	int count = 0;
+	kdtree.CollectPhotons(Math::Vec3(), maxDist2, [&count](const Math::Vec3&, const Photon&, Math::Float&){ count++; });
+	EXPECT_EQ(0, count);
+}
+
+TEST_F(PhotonMapTest, HashGridCollectInRadius)
+{
+	// Photons distributed on a plane and a few outliers
+	Photons photons;
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> dist;
+	const int Samples = 1<<14;
+	for (int i = 0; i < Samples; i++)
+	{
+		Photon photon;
+		photon.p = i % 100 == 0
+			? Math::Vec3(Math::Float(dist(gen)), Math::Float(dist(gen)), Math::Float(dist(gen))) * Math::Float(10)
+			: Math::Vec3(Math::Float(dist(gen)), Math::Float(0.5), Math::Float(dist(gen)));
+		photons.push_back(photon);
+	}
+
+	const Math::Float MaxDist(0.05);
+	std::unique_ptr<PhotonMap> naive(ComponentFactory::Create<PhotonMap>("naive"));
+	naive->Build(photons);
+	HashGridPhotonMap hashgrid;
+	hashgrid.SetMaxQueryDist(MaxDist);
+	hashgrid.Build(photons);
+	EXPECT_TRUE(ExpectNear(MaxDist, hashgrid.CellSize()));
+
+	// Number of photons in the radius must match with the naive implementation
+	// including the radius larger than the cell size
+	const int Queries = 1<<6;
+	for (int query = 0; query < Queries; query++)
+	{
+		Math::Vec3 p(Math::Float(dist(gen)), Math::Float(0.5), Math::Float(dist(gen)));
+		for (const auto& scale : { Math::Float(0.5), Math::Float(1), Math::Float(3) })
+		{
+			const auto maxDist2 = MaxDist * MaxDist * scale * scale;
+
+			int expected = 0;
+			auto maxDist2_naive = maxDist2;
+			naive->CollectPhotons(p, maxDist2_naive, [&expected](const Math::Vec3&, const Photon&, Math::Float&){ expected++; });
+
+			int count = 0;
+			auto maxDist2_hashgrid = maxDist2;
+			hashgrid.CollectPhotons(p, maxDist2_hashgrid, [&count](const Math::Vec3& q, const Photon& photon, Math::Float& maxDist2)
+			{
+				EXPECT_LT(Math::Length2(photon.p - q), maxDist2);
+				count++;
+			});
+			EXPECT_EQ(expected, count);
+		}
+	}
+}
+
 LM_TEST_NAMESPACE_END
 LM_NAMESPACE_END
\ No newline at end of file
@@ -0,0 +1,138 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica/pool.h>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class MemoryArenaTest : public TestBase {};
+
+namespace
+{
+	struct LM_ALIGN(64) AlignedData
+	{
+		char data[100];
+	};
+
+	struct CountedData
+	{
+		CountedData() { count++; }
+		~CountedData() { count--; }
+		static int count;
+	};
+
+	int CountedData::count = 0;
+}
+
+// Allocated memory is aligned and does not overlap
+TEST_F(MemoryArenaTest, Allocate)
+{
+	MemoryArena arena(1024);
+	std::vector<std::pair<char*, size_t>> allocs;
+	for (size_t i = 0; i < 1000; i++)
+	{
+		size_t size = 1 + (i * 37) % 200;
+		size_t align = size_t(1) << (i % 7);
+		auto* p = static_cast<char*>(arena.Allocate(size, align));
+		EXPECT_TRUE(is_aligned(p, align));
+		std::fill(p, p + size, static_cast<char>(i));
+		allocs.emplace_back(p, size);
+	}
+
+	for (size_t i = 0; i < allocs.size(); i++)
+	{
+		for (size_t j = 0; j < allocs[i].second; j++)
+		{
+			EXPECT_EQ(static_cast<char>(i), allocs[i].first[j]);
+		}
+	}
+}
+
+// Memory is reused after the reset
+TEST_F(MemoryArenaTest, Reset)
+{
+	MemoryArena arena(1024);
+	for (int i = 0; i < 100; i++)
+	{
+		arena.Allocate(100);
+	}
+	const size_t totalBlockSize = arena.TotalBlockSize();
+
+	for (int j = 0; j < 10; j++)
+	{
+		arena.Reset();
+		for (int i = 0; i < 100; i++)
+		{
+			arena.Allocate(100);
+		}
+		EXPECT_EQ(totalBlockSize, arena.TotalBlockSize());
+	}
+}
+
+// Request larger than the block size
+TEST_F(MemoryArenaTest, LargeAllocation)
+{
+	MemoryArena arena(1024);
+	arena.Allocate(100);
+	auto* p = static_cast<char*>(arena.Allocate(4096));
+	std::fill(p, p + 4096, 1);
+	auto* q = static_cast<char*>(arena.Allocate(100));
+	EXPECT_TRUE(q + 100 <= p || p + 4096 <= q);
+
+	// The large block is reused after the reset
+	const size_t totalBlockSize = arena.TotalBlockSize();
+	arena.Reset();
+	arena.Allocate(100);
+	arena.Allocate(4096);
+	EXPECT_EQ(totalBlockSize, arena.TotalBlockSize());
+}
+
+TEST_F(MemoryArenaTest, Construct)
+{
+	MemoryArena arena;
+	for (int i = 0; i < 100; i++)
+	{
+		auto* data = arena.Construct<AlignedData>();
+		EXPECT_TRUE(is_aligned(data, 64));
+	}
+}
+
+// Destructors are called on release of the object pool
+TEST_F(MemoryArenaTest, ObjectPool)
+{
+	{
+		ObjectPool<CountedData> pool;
+		for (int i = 0; i < 10; i++)
+		{
+			pool.Construct();
+		}
+		EXPECT_EQ(10, CountedData::count);
+		pool.Release();
+		EXPECT_EQ(0, CountedData::count);
+		pool.Construct();
+		EXPECT_EQ(1, CountedData::count);
+	}
+	EXPECT_EQ(0, CountedData::count);
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
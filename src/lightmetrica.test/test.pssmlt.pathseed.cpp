@@ -0,0 +1,123 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica.test/stub.config.h>
+#include <lightmetrica.test/testscenes.h>
+#include <lightmetrica/assets.h>
+#include <lightmetrica/texture.h>
+#include <lightmetrica/bsdf.h>
+#include <lightmetrica/trianglemesh.h>
+#include <lightmetrica/film.h>
+#include <lightmetrica/camera.h>
+#include <lightmetrica/light.h>
+#include <lightmetrica/confignode.h>
+#include <lightmetrica/scene.h>
+#include <lightmetrica/primitives.h>
+#include <lightmetrica/random.h>
+#include <lightmetrica/sampler.h>
+#include <lightmetrica/pssmlt.pathseed.h>
+#include <lightmetrica/pssmlt.pathsampler.h>
+#include <lightmetrica/pssmlt.splat.h>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class PSSMLTSeedStreamsTest : public TestBase
+{
+public:
+
+	PSSMLTSeedStreamsTest()
+	{
+		EXPECT_TRUE(config.LoadFromString(TestScenes::Simple03(), ""));
+
+		assets.reset(ComponentFactory::Create<Assets>());
+		EXPECT_TRUE(assets->RegisterInterface<Texture>());
+		EXPECT_TRUE(assets->RegisterInterface<BSDF>());
+		EXPECT_TRUE(assets->RegisterInterface<TriangleMesh>());
+		EXPECT_TRUE(assets->RegisterInterface<Film>());
+		EXPECT_TRUE(assets->RegisterInterface<Camera>());
+		EXPECT_TRUE(assets->RegisterInterface<Light>());
+		EXPECT_TRUE(assets->Load(config.Root().Child("assets")));
+
+		std::unique_ptr<Primitives> primitives(ComponentFactory::Create<Primitives>());
+		EXPECT_TRUE(primitives->Load(config.Root().Child("scene"), *assets));
+		scene.reset(ComponentFactory::Create<Scene>(config.Root().Child("scene").AttributeValue("type")));
+		scene->Load(primitives.release());
+		EXPECT_TRUE(scene->Configure(config.Root().Child("scene")));
+		EXPECT_TRUE(scene->Build());
+
+		rng.reset(ComponentFactory::Create<Random>("sfmt"));
+		pathSampler.reset(ComponentFactory::Create<PSSMLTPathSampler>("pt"));
+		EXPECT_TRUE(pathSampler->Configure(ConfigNode(), *assets));
+	}
+
+protected:
+
+	bool SampleCandidates(long long numSeedSamples, int numThreads, std::vector<PSSMLTPathSeed>& candidates, Math::Float& sumI)
+	{
+		return PSSMLTSeedStreams::SampleCandidates(
+			numSeedSamples, 42, numThreads, *rng, *pathSampler,
+			[this](PSSMLTPathSampler& pathSampler, Sampler& sampler, PSSMLTSplats& splats)
+			{
+				pathSampler.SampleAndEvaluate(*scene, sampler, splats, 3, -1);
+			},
+			[](double progress) {},
+			candidates, sumI);
+	}
+
+protected:
+
+	StubConfig config;
+	std::unique_ptr<Assets> assets;
+	std::unique_ptr<Scene> scene;
+	std::unique_ptr<Random> rng;
+	std::unique_ptr<PSSMLTPathSampler> pathSampler;
+
+};
+
+TEST_F(PSSMLTSeedStreamsTest, SampleCandidates_IndependentOfNumThreads)
+{
+	// The number of samples is not a multiple of the number of samples in a stream
+	const long long NumSeedSamples = 5 * PSSMLTSeedStreams::NumSamplesPerStream + 100;
+
+	std::vector<PSSMLTPathSeed> expected;
+	Math::Float expectedSumI;
+	ASSERT_TRUE(SampleCandidates(NumSeedSamples, 1, expected, expectedSumI));
+	EXPECT_FALSE(expected.empty());
+
+	for (int numThreads : { 2, 4, 7 })
+	{
+		std::vector<PSSMLTPathSeed> candidates;
+		Math::Float sumI;
+		ASSERT_TRUE(SampleCandidates(NumSeedSamples, numThreads, candidates, sumI));
+		EXPECT_EQ(expectedSumI, sumI);
+		ASSERT_EQ(expected.size(), candidates.size());
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			EXPECT_EQ(expected[i].stream, candidates[i].stream);
+			EXPECT_EQ(expected[i].index, candidates[i].index);
+			EXPECT_EQ(expected[i].I, candidates[i].I);
+		}
+	}
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
@@ -56,6 +56,34 @@ TEST_F(RewindableSamplerTest, GenerateAndRestore)
 	}
 }
 
+TEST_F(RewindableSamplerTest, GenerateAndRestore_Seekable)
+{
+	// Rewinding with a random number generator supporting seeking
+	std::unique_ptr<RewindableSampler> sampler(ComponentFactory::Create<RewindableSampler>());
+	sampler->Configure(ComponentFactory::Create<Random>("philox"));
+	sampler->SetSeed(1);
+
+	// Generate some samples
+	const int Count = 1<<9;
+	std::vector<Math::Float> samples;
+	for (int i = 0; i < Count; i++)
+	{
+		samples.push_back(sampler->Next());
+	}
+
+	// Restore state and re-generate samples
+	for (int index = 0; index < Count-1; index++)
+	{
+		sampler->Rewind(index);
+		EXPECT_EQ(index, sampler->SampleIndex());
+		for (int i = index; i < Count; i++)
+		{
+			// Check generated values
+			EXPECT_TRUE(ExpectNear(sampler->Next(), samples[i]));
+		}
+	}
+}
+
 // --------------------------------------------------------------------------------
 
 class PSSMLTPrimarySampleTest : public TestBase
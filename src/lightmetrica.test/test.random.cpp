@@ -0,0 +1,115 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica.test/base.math.h>
+#include <lightmetrica/random.h>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class PhiloxRandomTest : public TestBase
+{
+public:
+
+	PhiloxRandomTest()
+		: rng(ComponentFactory::Create<Random>("philox"))
+	{
+
+	}
+
+protected:
+
+	std::unique_ptr<Random> rng;
+
+};
+
+TEST_F(PhiloxRandomTest, KnownAnswer)
+{
+	// Known answer of Philox4x32-10 with zero counter and zero key
+	ASSERT_NE(nullptr, rng);
+	rng->SetSeed(0);
+	EXPECT_EQ(0x6627e8d5U, rng->NextUInt());
+	EXPECT_EQ(0xe169c58dU, rng->NextUInt());
+	EXPECT_EQ(0xbc57ac4cU, rng->NextUInt());
+	EXPECT_EQ(0x9b00dbd8U, rng->NextUInt());
+}
+
+TEST_F(PhiloxRandomTest, Seek)
+{
+	// Generate some numbers
+	rng->SetSeed(1);
+	const int Count = 1<<9;
+	std::vector<unsigned int> values;
+	for (int i = 0; i < Count; i++)
+	{
+		values.push_back(rng->NextUInt());
+	}
+
+	// Seek and re-generate numbers
+	for (int index = 0; index < Count-1; index += 7)
+	{
+		rng->SetSeed(1);
+		EXPECT_TRUE(rng->Seek(index));
+		for (int i = index; i < Count; i++)
+		{
+			EXPECT_EQ(values[i], rng->NextUInt());
+		}
+	}
+}
+
+TEST_F(PhiloxRandomTest, NextBlock)
+{
+	// Generate numbers one by one
+	rng->SetSeed(1);
+	const int Count = 1<<9;
+	std::vector<Math::Float> expected;
+	for (int i = 0; i < Count; i++)
+	{
+		expected.push_back(rng->Next());
+	}
+
+	// Generate numbers with various block sizes
+	// starting from various positions in a block
+	for (int offset = 0; offset < 4; offset++)
+	{
+		for (int n : { 1, 3, 16, 37, 100 })
+		{
+			rng->SetSeed(1);
+			for (int i = 0; i < offset; i++)
+			{
+				rng->Next();
+			}
+
+			std::vector<Math::Float> values(n);
+			rng->NextBlock(&values[0], n);
+			for (int i = 0; i < n; i++)
+			{
+				EXPECT_EQ(expected[offset + i], values[i]);
+			}
+
+			// The sequence continues after the block
+			EXPECT_EQ(expected[offset + n], rng->Next());
+		}
+	}
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
@@ -22,6 +22,7 @@
 #include <lightmetrica.test/base.math.h>
 #include <lightmetrica.test/stub.bsdf.h>
 #include <lightmetrica.test/stub.trianglemesh.h>
+#include <lightmetrica.test/stub.config.h>
 #include <lightmetrica/primitive.h>
 #include <lightmetrica/primitives.h>
 #include <lightmetrica/scene.h>
@@ -29,6 +30,7 @@
 #include <lightmetrica/intersection.h>
 #include <lightmetrica/math.functions.h>
 #include <lightmetrica/confignode.h>
+#include <lightmetrica/accelcache.h>
 
 LM_NAMESPACE_BEGIN
 LM_TEST_NAMESPACE_BEGIN
@@ -60,6 +62,7 @@ public:
 	virtual const Light* LightByIndex( int index ) const { return nullptr; }
 	virtual bool PostConfigure( const Scene& scene ) { return true; }
 	virtual bool IntersectEmitterShapes( Ray& ray, Intersection& isect ) const { return false; }
+	virtual bool OccludedEmitterShapes( const Ray& ray ) const { return false; }
 	virtual AABB GetAABBEmitterShapes() const { return AABB(); }
 
 private:
@@ -82,6 +85,9 @@ public:
 		// List of scene types to be tested
 		sceneTypes.push_back("naive");
 		sceneTypes.push_back("bvh");
+#if LM_AVX && LM_SINGLE_PRECISION
+		sceneTypes.push_back("obvh");
+#endif
 #if LM_SSE2 && LM_SINGLE_PRECISION
 		sceneTypes.push_back("qbvh");
 #if LM_PLATFORM_WINDOWS
@@ -92,7 +98,7 @@ public:
 
 protected:
 
-	std::shared_ptr<Scene> CreateAndSetupScene(const std::string& type, TriangleMesh* mesh)
+	std::shared_ptr<Scene> CreateAndSetupScene(const std::string& type, TriangleMesh* mesh, const ConfigNode& node = ConfigNode())
 	{
 		// Create scene
 		std::shared_ptr<Scene> scene(ComponentFactory::Create<Scene>(type));
@@ -101,12 +107,47 @@ protected:
 		scene->Load(new StubPrimitives(mesh, bsdf.get()));
 
 		// Load & build
-		EXPECT_TRUE(scene->Configure(ConfigNode()));
+		EXPECT_TRUE(scene->Configure(node));
 		EXPECT_TRUE(scene->Build());
 
 		return scene;
 	}
 
+	// Read all sections of the acceleration structure cache in the directory
+	// The key and the hash are encoded in the file name (see AccelerationCache::CachePath)
+	std::vector<std::vector<char>> ReadCacheSections(const std::string& dir)
+	{
+		std::vector<std::vector<char>> sections;
+		std::vector<boost::filesystem::path> paths;
+		for (boost::filesystem::directory_iterator it(dir), end; it != end; ++it)
+		{
+			paths.push_back(it->path());
+		}
+		if (paths.size() != 1)
+		{
+			ADD_FAILURE() << "Cache file is not found in " << dir;
+			return sections;
+		}
+
+		const auto stem = paths[0].stem().string();
+		const auto pos = stem.rfind('_');
+		AccelerationCache cache;
+		if (pos == std::string::npos || !cache.OpenForRead(paths[0].string(), stem.substr(0, pos), std::stoull(stem.substr(pos + 1), nullptr, 16)))
+		{
+			ADD_FAILURE() << "Failed to open cache file " << paths[0].string();
+			return sections;
+		}
+
+		std::vector<char> section;
+		while (cache.Read(section))
+		{
+			sections.push_back(section);
+		}
+
+		cache.Close();
+		return sections;
+	}
+
 protected:
 
 	std::vector<std::string> sceneTypes;
@@ -186,6 +227,142 @@ TEST_F(SceneIntersectionTest, Intersect_Simple2)
 	}
 }
 
+TEST_F(SceneIntersectionTest, Occluded_Simple)
+{
+	for (const auto& type : sceneTypes)
+	{
+		// Triangle mesh and scene
+		std::unique_ptr<TriangleMesh> mesh(new StubTriangleMesh_Simple());
+		auto scene = CreateAndSetupScene(type, mesh.get());
+
+		// Trace rays in the region of [0, 1]^2
+		Ray ray;
+		const int Steps = 10;
+		const Math::Float Delta = Math::Float(1) / Math::Float(Steps);
+		for (int i = 1; i < Steps; i++)
+		{
+			const Math::Float y = Delta * Math::Float(i);
+			for (int j = 1; j < Steps; j++)
+			{
+				const Math::Float x = Delta * Math::Float(j);
+
+				// Occluded if the segment crosses the triangles
+				ray.o = Math::Vec3(x, y, 1);
+				ray.d = Math::Vec3(0, 0, -1);
+				ray.minT = Math::Constants::Zero();
+				ray.maxT = Math::Float(2);
+				EXPECT_TRUE(scene->Occluded(ray));
+
+				// Not occluded if the segment ends before the triangles
+				ray.maxT = Math::Float(0.5);
+				EXPECT_FALSE(scene->Occluded(ray));
+
+				// Not occluded if the ray goes away from the triangles
+				ray.d = Math::Vec3(0, 0, 1);
+				ray.maxT = Math::Constants::Inf();
+				EXPECT_FALSE(scene->Occluded(ray));
+			}
+		}
+	}
+}
+
+// Check if the batched query returns the same result as the single query
+TEST_F(SceneIntersectionTest, IntersectBatch_Consistency)
+{
+	std::unique_ptr<TriangleMesh> mesh(new StubTriangleMesh_Random());
+	for (const auto& type : sceneTypes)
+	{
+		auto scene = CreateAndSetupScene(type, mesh.get());
+
+		// Rays in the region of [0, 1]^2, half of them goes away from the triangles
+		const int Steps = 10;
+		const Math::Float Delta = Math::Float(1) / Math::Float(Steps);
+		std::vector<Ray, aligned_allocator<Ray, std::alignment_of<Ray>::value>> rays;
+		for (int i = 1; i < Steps; i++)
+		{
+			const Math::Float y = Delta * Math::Float(i);
+			for (int j = 1; j < Steps; j++)
+			{
+				const Math::Float x = Delta * Math::Float(j);
+				Ray ray;
+				ray.o = Math::Vec3(x, y, 1);
+				ray.d = Math::Vec3(0, 0, (i + j) % 2 == 0 ? -1 : 1);
+				ray.minT = Math::Constants::Zero();
+				ray.maxT = Math::Constants::Inf();
+				rays.push_back(ray);
+			}
+		}
+
+		// Batched query
+		// Note that the query modifies the rays (maxT), so we keep the original ones
+		const size_t n = rays.size();
+		auto batchRays = rays;
+		std::vector<Intersection, aligned_allocator<Intersection, std::alignment_of<Intersection>::value>> isects(n);
+		std::unique_ptr<bool[]> hits(new bool[n]);
+		size_t numHits = scene->IntersectBatch(&batchRays[0], &isects[0], hits.get(), n);
+
+		// Compare with the single query
+		size_t expectedNumHits = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			Intersection isect;
+			bool hit = scene->Intersect(rays[i], isect);
+			EXPECT_EQ(hit, hits[i]);
+			if (hit && hits[i])
+			{
+				expectedNumHits++;
+				EXPECT_TRUE(ExpectVec3Near(isect.geom.p, isects[i].geom.p));
+				EXPECT_TRUE(ExpectVec3Near(isect.geom.gn, isects[i].geom.gn));
+				EXPECT_TRUE(ExpectVec2Near(isect.geom.uv, isects[i].geom.uv));
+			}
+		}
+		EXPECT_EQ(expectedNumHits, numHits);
+	}
+}
+
+// Check if the precomputed triangles give the same intersection data
+TEST_F(SceneIntersectionTest, Intersect_PrecomputedTriangles)
+{
+	std::unique_ptr<TriangleMesh> mesh(new StubTriangleMesh_Random());
+	for (const auto& type : sceneTypes)
+	{
+		auto scene = CreateAndSetupScene(type, mesh.get());
+		auto precomputedScene = CreateAndSetupScene(type, mesh.get());
+		precomputedScene->PrecomputeTriangles();
+
+		const int Steps = 10;
+		const Math::Float Delta = Math::Float(1) / Math::Float(Steps);
+		for (int i = 1; i < Steps; i++)
+		{
+			const Math::Float y = Delta * Math::Float(i);
+			for (int j = 1; j < Steps; j++)
+			{
+				const Math::Float x = Delta * Math::Float(j);
+
+				Ray ray;
+				ray.o = Math::Vec3(x, y, 1);
+				ray.d = Math::Vec3(0, 0, -1);
+				ray.minT = Math::Constants::Zero();
+				ray.maxT = Math::Constants::Inf();
+				Ray precomputedRay = ray;
+
+				Intersection isect, precomputedIsect;
+				bool hit = scene->Intersect(ray, isect);
+				bool precomputedHit = precomputedScene->Intersect(precomputedRay, precomputedIsect);
+				EXPECT_EQ(hit, precomputedHit);
+				if (hit && precomputedHit)
+				{
+					EXPECT_TRUE(ExpectVec3Near(isect.geom.p, precomputedIsect.geom.p));
+					EXPECT_TRUE(ExpectVec3Near(isect.geom.gn, precomputedIsect.geom.gn));
+					EXPECT_TRUE(ExpectVec3Near(isect.geom.sn, precomputedIsect.geom.sn));
+					EXPECT_TRUE(ExpectVec3Near(isect.geom.ss, precomputedIsect.geom.ss));
+					EXPECT_TRUE(ExpectVec2Near(isect.geom.uv, precomputedIsect.geom.uv));
+				}
+			}
+		}
+	}
+}
+
 // Check if all implementation returns the same result
 TEST_F(SceneIntersectionTest, Consistency)
 {
@@ -265,5 +442,166 @@ TEST_F(SceneIntersectionTest, Consistency)
 	}
 }
 
+// Check if the scenes built in parallel (with large number of triangles) returns the same result as the naive scene
+TEST_F(SceneIntersectionTest, Consistency_ParallelBuild)
+{
+	std::unique_ptr<TriangleMesh> mesh(new StubTriangleMesh_Random(1 << 16));
+	auto naiveScene = CreateAndSetupScene("naive", mesh.get());
+
+	for (const auto& type : sceneTypes)
+	{
+		auto scene = CreateAndSetupScene(type, mesh.get());
+
+		const int Steps = 10;
+		const Math::Float Delta = Math::Float(1) / Math::Float(Steps);
+		for (int i = 1; i < Steps; i++)
+		{
+			const Math::Float y = Delta * Math::Float(i);
+			for (int j = 1; j < Steps; j++)
+			{
+				const Math::Float x = Delta * Math::Float(j);
+
+				Ray ray;
+				ray.o = Math::Vec3(x, y, 1);
+				ray.d = Math::Vec3(0, 0, -1);
+				ray.minT = Math::Constants::Zero();
+				ray.maxT = Math::Constants::Inf();
+				Ray naiveRay = ray;
+
+				Intersection isect, naiveIsect;
+				bool hit = scene->Intersect(ray, isect);
+				bool naiveHit = naiveScene->Intersect(naiveRay, naiveIsect);
+				EXPECT_EQ(naiveHit, hit);
+				if (hit && naiveHit)
+				{
+					EXPECT_TRUE(ExpectVec3Near(naiveIsect.geom.p, isect.geom.p));
+				}
+			}
+		}
+	}
+
+	// The parallel build must create the same tree as the serial build.
+	// The trees are compared through the caches, which contain the nodes
+	// and the triangles in the order of the leaves.
+	for (const auto& type : sceneTypes)
+	{
+		if (type != "bvh" && type != "qbvh")
+		{
+			continue;
+		}
+
+		const auto dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+		const auto serialDir = (dir / "serial").string();
+		const auto parallelDir = (dir / "parallel").string();
+		StubConfig serialConfig, parallelConfig;
+		CreateAndSetupScene(type, mesh.get(), serialConfig.LoadFromStringAndGetFirstChild("<scene><cache>" + serialDir + "</cache><parallel_build>false</parallel_build></scene>"));
+		CreateAndSetupScene(type, mesh.get(), parallelConfig.LoadFromStringAndGetFirstChild("<scene><cache>" + parallelDir + "</cache><parallel_build>true</parallel_build></scene>"));
+
+		// The first section is the bound of the triangles and the last section is the nodes.
+		// The nodes (and the bounds) are compared by the size, i.e., the number of nodes
+		// because the structures might contain uninitialized paddings.
+		const auto serialSections = ReadCacheSections(serialDir);
+		const auto parallelSections = ReadCacheSections(parallelDir);
+		ASSERT_EQ(serialSections.size(), parallelSections.size());
+		ASSERT_LE(size_t(2), serialSections.size());
+		for (size_t i = 0; i < serialSections.size(); i++)
+		{
+			if (i == 0 || i == serialSections.size() - 1)
+			{
+				EXPECT_EQ(serialSections[i].size(), parallelSections[i].size());
+			}
+			else
+			{
+				EXPECT_TRUE(serialSections[i] == parallelSections[i]);
+			}
+		}
+
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(dir, ec);
+	}
+}
+
+TEST_F(SceneIntersectionTest, Cache_Corrupted)
+{
+	const auto dir = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+	StubConfig config;
+	const auto node = config.LoadFromStringAndGetFirstChild("<scene><cache>" + dir + "</cache></scene>");
+
+	std::unique_ptr<TriangleMesh> mesh(new StubTriangleMesh_Random(1 << 10));
+	auto naiveScene = CreateAndSetupScene("naive", mesh.get());
+
+	for (const auto& type : sceneTypes)
+	{
+		if (type != "bvh" && type != "qbvh")
+		{
+			continue;
+		}
+
+		// Build and save the cache
+		{
+			std::shared_ptr<Scene> scene(ComponentFactory::Create<Scene>(type));
+			scene->Load(new StubPrimitives(mesh.get(), bsdf.get()));
+			ASSERT_TRUE(scene->Configure(node));
+			ASSERT_TRUE(scene->Build());
+		}
+
+		// Overwrite the tail of the cache file, which contains the nodes,
+		// so that the node and leaf indices point outside of the arrays
+		std::vector<std::string> cachePaths;
+		for (boost::filesystem::directory_iterator it(dir), end; it != end; ++it)
+		{
+			cachePaths.push_back(it->path().string());
+		}
+		ASSERT_EQ(size_t(1), cachePaths.size());
+		{
+			const auto size = boost::filesystem::file_size(cachePaths[0]);
+			const size_t CorruptedSize = 256;
+			ASSERT_LT(CorruptedSize, size);
+			std::fstream f(cachePaths[0], std::ios::in | std::ios::out | std::ios::binary);
+			f.seekp(size - CorruptedSize);
+			const std::string data(CorruptedSize, '\x7f');
+			f.write(data.c_str(), data.size());
+		}
+
+		// The corrupted cache must be rejected and the tree is rebuilt
+		std::shared_ptr<Scene> scene(ComponentFactory::Create<Scene>(type));
+		scene->Load(new StubPrimitives(mesh.get(), bsdf.get()));
+		ASSERT_TRUE(scene->Configure(node));
+		ASSERT_TRUE(scene->Build());
+
+		const int Steps = 10;
+		const Math::Float Delta = Math::Float(1) / Math::Float(Steps);
+		for (int i = 1; i < Steps; i++)
+		{
+			const Math::Float y = Delta * Math::Float(i);
+			for (int j = 1; j < Steps; j++)
+			{
+				const Math::Float x = Delta * Math::Float(j);
+
+				Ray ray;
+				ray.o = Math::Vec3(x, y, 1);
+				ray.d = Math::Vec3(0, 0, -1);
+				ray.minT = Math::Constants::Zero();
+				ray.maxT = Math::Constants::Inf();
+				Ray naiveRay = ray;
+
+				Intersection isect, naiveIsect;
+				bool hit = scene->Intersect(ray, isect);
+				bool naiveHit = naiveScene->Intersect(naiveRay, naiveIsect);
+				EXPECT_EQ(naiveHit, hit);
+				if (hit && naiveHit)
+				{
+					EXPECT_TRUE(ExpectVec3Near(naiveIsect.geom.p, isect.geom.p));
+				}
+			}
+		}
+
+		boost::filesystem::remove_all(dir);
+	}
+
+	boost::system::error_code ec;
+	boost::filesystem::remove_all(dir, ec);
+}
+
 LM_TEST_NAMESPACE_END
 LM_NAMESPACE_END
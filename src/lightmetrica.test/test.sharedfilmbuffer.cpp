@@ -0,0 +1,141 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica/sharedfilmbuffer.h>
+#include <thread>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class SharedFilmBufferTest : public TestBase {};
+
+// Contributions accumulated via the tile caches are flushed to the shared buffer
+TEST_F(SharedFilmBufferTest, TileCache)
+{
+	// The size is not a multiple of the tile size
+	const int Width = 100;
+	const int Height = 37;
+	auto buffer = std::make_shared<SharedFilmBuffer>(Width, Height);
+
+	{
+		// Touches more tiles than the number of slots, so some tiles are evicted
+		FilmTileCache cache(buffer);
+		for (int i = 0; i < 3; i++)
+		{
+			for (int y = 0; y < Height; y++)
+			{
+				for (int x = 0; x < Width; x++)
+				{
+					cache.AccumulateContribution(Math::Vec2i(x, y), Math::Vec3(Math::Float(1), Math::Float(x), Math::Float(y)));
+				}
+			}
+		}
+	}
+
+	std::vector<Math::Float> data(Width * Height * 3, Math::Float(1));
+	buffer->AccumulateTo(data);
+	for (int y = 0; y < Height; y++)
+	{
+		for (int x = 0; x < Width; x++)
+		{
+			int idx = y * Width + x;
+			EXPECT_EQ(Math::Float(4), data[3 * idx]);
+			EXPECT_EQ(Math::Float(1 + 3 * x), data[3 * idx + 1]);
+			EXPECT_EQ(Math::Float(1 + 3 * y), data[3 * idx + 2]);
+		}
+	}
+}
+
+// Multiple threads flush the tiles to the same buffer
+TEST_F(SharedFilmBufferTest, MultipleThreads)
+{
+	const int Width = 64;
+	const int Height = 64;
+	const int NumThreads = 4;
+	auto buffer = std::make_shared<SharedFilmBuffer>(Width, Height);
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < NumThreads; i++)
+	{
+		threads.emplace_back([&buffer]()
+		{
+			FilmTileCache cache(buffer);
+			for (int j = 0; j < 100; j++)
+			{
+				for (int y = 0; y < Height; y++)
+				{
+					for (int x = 0; x < Width; x++)
+					{
+						cache.AccumulateContribution(Math::Vec2i(x, y), Math::Vec3(Math::Float(1)));
+					}
+				}
+				cache.Flush();
+			}
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::vector<Math::Float> data(Width * Height * 3, Math::Float(0));
+	buffer->AccumulateTo(data);
+	for (const auto& v : data)
+	{
+		EXPECT_EQ(Math::Float(100 * NumThreads), v);
+	}
+}
+
+// Multiple threads accumulate to the pixels of the same buffer
+TEST_F(SharedFilmBufferTest, AccumulateContribution)
+{
+	const int Width = 8;
+	const int Height = 8;
+	const int NumThreads = 4;
+	const int Count = Width * Height * 100;
+	SharedFilmBuffer buffer(Width, Height);
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < NumThreads; i++)
+	{
+		threads.emplace_back([&]()
+		{
+			for (int j = 0; j < Count; j++)
+			{
+				buffer.AccumulateContribution(Math::Vec2i(j % Width, (j / Width) % Height), Math::Vec3(Math::Float(1)));
+			}
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::vector<Math::Float> data(Width * Height * 3, Math::Float(0));
+	buffer.AccumulateTo(data);
+	for (const auto& v : data)
+	{
+		EXPECT_EQ(Math::Float(100 * NumThreads), v);
+	}
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
@@ -0,0 +1,304 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica.test/base.math.h>
+#include <lightmetrica/texturecache.h>
+#include <thread>
+#include <fstream>
+#include <atomic>
+
+namespace
+{
+
+	const size_t TileElements = 256;
+	const size_t TileBytes = TileElements * sizeof(float);
+
+}
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class TextureCacheTest : public TestBase
+{
+public:
+
+	static TextureCache::LoadTileFunc LoadTileFunc(float value, std::atomic<int>& count)
+	{
+		return [value, &count](TextureCache::Tile& tile)
+		{
+			count++;
+			tile.assign(TileElements, value);
+			return true;
+		};
+	}
+
+};
+
+TEST_F(TextureCacheTest, GetTile)
+{
+	TextureCache cache(16 * TileBytes);
+	std::atomic<int> count(0);
+
+	// Loaded only on the first request
+	for (int i = 0; i < 3; i++)
+	{
+		const auto& tile = cache.GetTile(1, LoadTileFunc(1.0f, count));
+		ASSERT_EQ(TileElements, tile.size());
+		EXPECT_EQ(1.0f, tile[0]);
+	}
+	EXPECT_EQ(1, count);
+	EXPECT_EQ(1, cache.NumLoadedTiles());
+	EXPECT_EQ(TileBytes, cache.MemoryUsage());
+
+	// Different key
+	EXPECT_EQ(2.0f, cache.GetTile(2, LoadTileFunc(2.0f, count))[0]);
+	EXPECT_EQ(2, count);
+}
+
+TEST_F(TextureCacheTest, GetTile_Failed)
+{
+	TextureCache cache(16 * TileBytes);
+	const auto& tile = cache.GetTile(1, [](TextureCache::Tile&){ return false; });
+	EXPECT_TRUE(tile.empty());
+	EXPECT_EQ(size_t(0), cache.MemoryUsage());
+}
+
+TEST_F(TextureCacheTest, Eviction)
+{
+	// Single shard holding 4 tiles
+	TextureCache cache(4 * TileBytes, 1);
+	std::atomic<int> count(0);
+
+	for (int i = 0; i < 8; i++)
+	{
+		cache.GetTile(i, LoadTileFunc(float(i), count));
+		EXPECT_LE(cache.MemoryUsage(), cache.MemoryBudget());
+	}
+	EXPECT_EQ(8, count);
+	EXPECT_EQ(4 * TileBytes, cache.MemoryUsage());
+
+	// Check in another thread in order to bypass the per-thread lookup cache
+	count = 0;
+	std::thread([&]()
+	{
+		// Recently used tiles are kept
+		EXPECT_EQ(7.0f, cache.GetTile(7, LoadTileFunc(7.0f, count))[0]);
+		EXPECT_EQ(0, count);
+
+		// Evicted tiles are loaded again
+		EXPECT_EQ(0.0f, cache.GetTile(0, LoadTileFunc(0.0f, count))[0]);
+		EXPECT_EQ(1, count);
+	}).join();
+}
+
+TEST_F(TextureCacheTest, SetMemoryBudget)
+{
+	TextureCache cache(8 * TileBytes, 1);
+	std::atomic<int> count(0);
+	for (int i = 0; i < 8; i++)
+	{
+		cache.GetTile(i, LoadTileFunc(float(i), count));
+	}
+	EXPECT_EQ(8 * TileBytes, cache.MemoryUsage());
+
+	// Tiles are evicted on the next request
+	cache.SetMemoryBudget(2 * TileBytes);
+	cache.GetTile(8, LoadTileFunc(8.0f, count));
+	EXPECT_EQ(2 * TileBytes, cache.MemoryUsage());
+
+	cache.Clear();
+	EXPECT_EQ(size_t(0), cache.MemoryUsage());
+}
+
+TEST_F(TextureCacheTest, GetTile_MultiThreaded)
+{
+	TextureCache cache(64 * TileBytes, 4);
+	std::atomic<int> count(0);
+	std::atomic<bool> failed(false);
+
+	const int NumThreads = 8;
+	const int NumKeys = 256;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < NumThreads; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			for (int i = 0; i < 10000; i++)
+			{
+				const int key = (i * 7 + t * 13) % NumKeys;
+				const auto& tile = cache.GetTile(key, LoadTileFunc(float(key), count));
+				if (tile.size() != TileElements || tile[0] != float(key) || tile[TileElements - 1] != float(key))
+				{
+					failed = true;
+				}
+			}
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	EXPECT_FALSE(failed);
+	EXPECT_EQ(count, cache.NumLoadedTiles());
+	EXPECT_LE(cache.MemoryUsage(), cache.MemoryBudget());
+}
+
+// --------------------------------------------------------------------------------
+
+class TiledMipmapImageTest : public TestBase
+{
+public:
+
+	TiledMipmapImageTest()
+		: path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%.lmtiled")).string())
+		, cache(1 << 20)
+	{
+
+	}
+
+	~TiledMipmapImageTest()
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove(path, ec);
+	}
+
+protected:
+
+	std::string path;
+	TextureCache cache;
+
+};
+
+TEST_F(TiledMipmapImageTest, BuildAndOpen)
+{
+	// 5x3 image with the texel values (x + 10y, 0, 1)
+	const int width = 5;
+	const int height = 3;
+	std::vector<float> data;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			data.push_back(float(x + 10 * y));
+			data.push_back(0.0f);
+			data.push_back(1.0f);
+		}
+	}
+
+	ASSERT_TRUE(TiledMipmapImage::Build(data, width, height, 2, path));
+
+	TiledMipmapImage image;
+	ASSERT_TRUE(image.Open(path, cache));
+
+	// Levels : 5x3, 3x2, 2x1, 1x1
+	ASSERT_EQ(4, image.NumLevels());
+	EXPECT_EQ(5, image.Width(0));
+	EXPECT_EQ(3, image.Height(0));
+	EXPECT_EQ(3, image.Width(1));
+	EXPECT_EQ(2, image.Height(1));
+	EXPECT_EQ(2, image.Width(2));
+	EXPECT_EQ(1, image.Height(2));
+	EXPECT_EQ(1, image.Width(3));
+	EXPECT_EQ(1, image.Height(3));
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			EXPECT_TRUE(ExpectVec3Near(Math::Vec3(Math::Float(x + 10 * y), Math::Float(0), Math::Float(1)), image.Texel(x, y, 0)));
+		}
+	}
+
+	// 2x2 box filter
+	EXPECT_TRUE(ExpectVec3Near(Math::Vec3(Math::Float(5.5), Math::Float(0), Math::Float(1)), image.Texel(0, 0, 1)));
+	EXPECT_TRUE(ExpectVec3Near(Math::Vec3(Math::Float(9), Math::Float(0), Math::Float(1)), image.Texel(2, 0, 1)));
+	EXPECT_TRUE(ExpectVec3Near(Math::Vec3(Math::Float(24), Math::Float(0), Math::Float(1)), image.Texel(2, 1, 1)));
+}
+
+TEST_F(TiledMipmapImageTest, Open_Failed)
+{
+	TiledMipmapImage image;
+
+	// Missing file
+	EXPECT_FALSE(image.Open(path, cache));
+
+	// Invalid file
+	{
+		std::ofstream out(path, std::ios::out | std::ios::binary);
+		out << "invalid tile file";
+	}
+	EXPECT_FALSE(image.Open(path, cache));
+	EXPECT_EQ(0, image.NumLevels());
+}
+
+TEST_F(TiledMipmapImageTest, Build_NoTemporaryFiles)
+{
+	const std::vector<float> data(4 * 4 * 3, 1.0f);
+	ASSERT_TRUE(TiledMipmapImage::Build(data, 4, 4, 2, path));
+	ASSERT_TRUE(TiledMipmapImage::Build(data, 4, 4, 2, path));
+
+	// Temporary files are named after the path and must be renamed or removed
+	const auto filename = boost::filesystem::path(path).filename().string();
+	for (boost::filesystem::directory_iterator it(boost::filesystem::path(path).parent_path()), end; it != end; ++it)
+	{
+		const auto name = it->path().filename().string();
+		EXPECT_FALSE(name.size() > filename.size() && name.compare(0, filename.size() + 1, filename + ".") == 0);
+	}
+}
+
+TEST_F(TiledMipmapImageTest, Open_InconsistentLevelTable)
+{
+	const std::vector<float> data(4 * 4 * 3, 1.0f);
+	ASSERT_TRUE(TiledMipmapImage::Build(data, 4, 4, 2, path));
+
+	// Overwrite the number of tiles in x-direction of the first level.
+	// The level table follows the header aligned to 64 bytes.
+	{
+		std::fstream out(path, std::ios::in | std::ios::out | std::ios::binary);
+		const int tilesX = 100;
+		out.seekp(64 + 2 * sizeof(int));
+		out.write(reinterpret_cast<const char*>(&tilesX), sizeof(int));
+	}
+
+	TiledMipmapImage image;
+	EXPECT_FALSE(image.Open(path, cache));
+	EXPECT_EQ(0, image.NumLevels());
+}
+
+TEST_F(TiledMipmapImageTest, Open_InvalidSize)
+{
+	const std::vector<float> data(4 * 4 * 3, 1.0f);
+	ASSERT_TRUE(TiledMipmapImage::Build(data, 4, 4, 2, path));
+
+	// Trailing bytes
+	{
+		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::app);
+		out << "trailing bytes";
+	}
+
+	TiledMipmapImage image;
+	EXPECT_FALSE(image.Open(path, cache));
+	EXPECT_EQ(0, image.NumLevels());
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
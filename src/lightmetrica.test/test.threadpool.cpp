@@ -0,0 +1,106 @@
+/*
+	Lightmetrica : A research-oriented renderer
+
+	Copyright (c) 2014 Hisanari Otsu
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.test.h"
+#include <lightmetrica.test/base.h>
+#include <lightmetrica/threadpool.h>
+#include <atomic>
+
+LM_NAMESPACE_BEGIN
+LM_TEST_NAMESPACE_BEGIN
+
+class ThreadPoolTest : public TestBase {};
+
+// Check if all work units are processed exactly once
+TEST_F(ThreadPoolTest, ParallelFor)
+{
+	ThreadPool pool(4);
+	EXPECT_EQ(4, pool.NumThreads());
+
+	// The same pool is reused for multiple operations
+	for (long long n : { 0LL, 1LL, 3LL, 1000LL, 12345LL })
+	{
+		std::vector<std::atomic<int>> counts(static_cast<size_t>(n));
+		for (auto& count : counts)
+		{
+			count = 0;
+		}
+
+		std::atomic<bool> invalidThreadId(false);
+		std::atomic<bool> invalidBlock(false);
+		EXPECT_TRUE(pool.ParallelFor(n, 7, [&](int threadId, long long begin, long long end)
+		{
+			if (threadId < 0 || threadId >= 4)
+			{
+				invalidThreadId = true;
+			}
+			if (begin >= end || end - begin > 7)
+			{
+				invalidBlock = true;
+			}
+			for (long long i = begin; i < end; i++)
+			{
+				counts[static_cast<size_t>(i)]++;
+			}
+		}));
+
+		EXPECT_FALSE(invalidThreadId);
+		EXPECT_FALSE(invalidBlock);
+		EXPECT_FALSE(pool.Canceled());
+		for (const auto& count : counts)
+		{
+			EXPECT_EQ(1, count);
+		}
+	}
+}
+
+TEST_F(ThreadPoolTest, Cancel)
+{
+	ThreadPool pool(4);
+	std::atomic<long long> processed(0);
+	EXPECT_TRUE(pool.ParallelFor(100000, 1, [&](int threadId, long long begin, long long end)
+	{
+		if (processed.fetch_add(end - begin) >= 100)
+		{
+			pool.Cancel();
+		}
+	}));
+
+	// At most one block per thread is processed after the cancellation
+	EXPECT_TRUE(pool.Canceled());
+	EXPECT_GE(104, processed);
+}
+
+TEST_F(ThreadPoolTest, Exception)
+{
+	ThreadPool pool(2);
+	EXPECT_FALSE(pool.ParallelFor(100, 1, [&](int threadId, long long begin, long long end)
+	{
+		if (begin == 50)
+		{
+			throw std::runtime_error("test");
+		}
+	}));
+
+	// The pool can be used after the failure
+	EXPECT_TRUE(pool.ParallelFor(100, 1, [&](int threadId, long long begin, long long end) {}));
+}
+
+LM_TEST_NAMESPACE_END
+LM_NAMESPACE_END
@@ -32,7 +32,9 @@
 #include <lightmetrica/light.h>
 #include <lightmetrica/bsdf.h>
 #include <lightmetrica/texture.h>
+#include <lightmetrica/texturecache.h>
 #include <lightmetrica/trianglemesh.h>
+#include <lightmetrica/binarymesh.h>
 #include <lightmetrica/math.h>
 #include <lightmetrica/fp.h>
 #include <iostream>
@@ -47,6 +49,7 @@
 #include <ctime>
 #include <boost/program_options.hpp>
 #include <boost/format.hpp>
+#include <boost/filesystem.hpp>
 #if LM_PLATFORM_WINDOWS
 #include <windows.h>
 #elif LM_PLATFORM_LINUX
@@ -82,6 +85,7 @@ private:
 
 	bool LoadConfiguration(Config& config);
 	bool LoadAssets(const Config& config, Assets& assets);
+	bool ConvertMeshes(const Config& config, const Assets& assets);
 	bool LoadAndBuildScene(const Config& config, const Assets& assets, Scene& scene);
 	bool ConfigureAndDispatchRenderer(const Config& config, const Assets& assets, const Scene& scene, Renderer& renderer, RenderProcessScheduler& sched);
 
@@ -115,6 +119,8 @@ private:
 	std::string basePath;
 	double terminationTime;
 	bool mpiMode;
+	std::string convertMeshesDir;
+	long long textureCacheSize;		// In megabytes
 	#pragma endregion
 
 	#pragma region Logging & progress control thread related variables
@@ -172,7 +178,9 @@ bool LightmetricaApplication::ParseArguments( int argc, char** argv )
 		("interactive,i", po::bool_switch(&interactiveMode), "Interactive mode")
 		("base-path,b", po::value<std::string>(&basePath)->default_value(""), "Base path for asset loading")
 		("termination-time,t", po::value<double>(&terminationTime)->default_value(0), "Termination time for rendering")
-		("mpi", po::bool_switch(&mpiMode), "MPI mode");
+		("mpi", po::bool_switch(&mpiMode), "MPI mode")
+		("convert-meshes", po::value<std::string>(&convertMeshesDir)->default_value(""), "Convert triangle meshes to binary meshes in the given directory and exit")
+		("texture-cache-size", po::value<long long>(&textureCacheSize)->default_value(1024), "Memory budget of the texture cache in megabytes");
 
 	// positional arguments
 	po::positional_options_description p;
@@ -216,6 +224,13 @@ bool LightmetricaApplication::ParseArguments( int argc, char** argv )
 		return false;
 	}
 
+	if (textureCacheSize <= 0)
+	{
+		std::cerr << "Invalid argument : 'texture-cache-size'" << std::endl;
+		PrintHelpMessage(opt);
+		return false;
+	}
+
 #ifndef LM_MPI
 	if (mpiMode)
 	{
@@ -264,6 +279,10 @@ bool LightmetricaApplication::Run()
 	}
 	#pragma endregion
 
+	#pragma region Configure texture cache
+	TextureCache::Shared().SetMemoryBudget(static_cast<size_t>(textureCacheSize) << 20);
+	#pragma endregion
+
 	#pragma region Load configuration
 	std::unique_ptr<Config> config(ComponentFactory::Create<Config>());
 	if (!LoadConfiguration(*config))
@@ -280,6 +299,19 @@ bool LightmetricaApplication::Run()
 	}
 	#pragma endregion
 
+	#pragma region Convert meshes
+	if (!convertMeshesDir.empty())
+	{
+		if (!ConvertMeshes(*config, *assets))
+		{
+			return false;
+		}
+
+		PrintFinishMessage();
+		return true;
+	}
+	#pragma endregion
+
 	#pragma region Create and setup scene
 	auto sceneType = config->Root().Child("scene").AttributeValue("type");
 	std::unique_ptr<Scene> scene(ComponentFactory::Create<Scene>(sceneType));
@@ -410,6 +442,45 @@ bool LightmetricaApplication::LoadAssets( const Config& config, Assets& assets )
 	return true;
 }
 
+bool LightmetricaApplication::ConvertMeshes( const Config& config, const Assets& assets )
+{
+	namespace fs = boost::filesystem;
+
+	LM_LOG_INFO("Entering : Mesh conversion");
+	LM_LOG_INDENTER();
+
+	boost::system::error_code ec;
+	fs::create_directories(convertMeshesDir, ec);
+	if (ec)
+	{
+		LM_LOG_ERROR("Failed to create directory '" + convertMeshesDir + "'");
+		return false;
+	}
+
+	// Convert all triangle meshes to the binary meshes named after the IDs.
+	// The converted meshes can be used with <triangle_mesh id="..." type="binary"><path>...</path></triangle_mesh>
+	auto meshesNode = config.Root().Child("assets").Child("triangle_meshes");
+	for (auto meshNode = meshesNode.FirstChild(); !meshNode.Empty(); meshNode = meshNode.NextChild())
+	{
+		const auto id = meshNode.AttributeValue("id");
+		const auto* mesh = dynamic_cast<const TriangleMesh*>(assets.GetAssetByName(id));
+		if (mesh == nullptr)
+		{
+			LM_LOG_ERROR("Missing triangle mesh '" + id + "'");
+			return false;
+		}
+
+		const auto path = (fs::path(convertMeshesDir) / (id + ".lmmesh")).string();
+		LM_LOG_INFO("Converting triangle mesh '" + id + "' to '" + path + "'");
+		if (!BinaryMeshUtils::Save(*mesh, path))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 bool LightmetricaApplication::LoadAndBuildScene( const Config& config, const Assets& assets, Scene& scene )
 {
 	#pragma region Load primitives
@@ -466,6 +537,15 @@ bool LightmetricaApplication::LoadAndBuildScene( const Config& config, const Ass
 		{
 			progressBar.End();
 		}
+
+		// Precompute world-space triangles if requested
+		bool precomputeTriangles;
+		config.Root().Child("scene").ChildValueOrDefault("precompute_triangles", false, precomputeTriangles);
+		if (precomputeTriangles)
+		{
+			LM_LOG_INFO("Precomputing world-space triangles");
+			scene.PrecomputeTriangles();
+		}
 	}
 	#pragma endregion
 